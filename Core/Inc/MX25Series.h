@@ -88,6 +88,14 @@ typedef enum {
     MX25Series_status_error_invalid_chip_def =
         (0b100000 | MX25Series_status_error),
     MX25Series_status_error_ctx_nullptr = (0b1000000 | MX25Series_status_error),
+    MX25Series_status_error_program_failed =
+        (0b10000000 | MX25Series_status_error),
+    MX25Series_status_error_erase_failed =
+        (0b100000000 | MX25Series_status_error),
+    MX25Series_status_error_write_disabled =
+        (0b1000000000 | MX25Series_status_error),
+    MX25Series_status_error_mode_switch =
+        (0b10000000000 | MX25Series_status_error),
 
 } MX25Series_status_enum_t;
 
@@ -237,6 +245,21 @@ Power mode or High Performance mode. Please check Ordering Information for the \
 L/H Switch default support. */
 #define MX25Series_CR_LH (1ul << 1ul)
 
+// Register 'MX25Series.SCUR'.
+#define MX25Series_SCUR_PSB    (1ul << 2ul) /**< Program suspended */
+#define MX25Series_SCUR_ESB    (1ul << 3ul) /**< Erase suspended */
+#define MX25Series_SCUR_P_FAIL (1ul << 5ul) /**< Last program failed */
+#define MX25Series_SCUR_E_FAIL (1ul << 6ul) /**< Last erase failed */
+
+// WIP polling interval after the typical time: a fraction of it, at least
+// MX25Series_POLL_MIN_US.
+#ifndef MX25Series_POLL_DIVIDER
+#define MX25Series_POLL_DIVIDER 8
+#endif
+#ifndef MX25Series_POLL_MIN_US
+#define MX25Series_POLL_MIN_US 20
+#endif
+
 #ifndef MX25Series_tUNKNOWN_TIMING
 #define MX25Series_tUNKNOWN_TIMING 5000000
 #endif
@@ -279,12 +302,33 @@ L/H Switch default support. */
     20000 /**! 20 milli-seconds. High Performance Write Status Register Cycle \
              Time */
 
+// Typical values in micro-seconds, the wait starts polling once they elapsed.
+#define MX25R6435F_tPP_TYP \
+    850 /**! 0.85 milli-seconds, Page Program Typical Time */
+#define MX25R6435F_tSE_TYP \
+    40000 /**! 40 milli-seconds, Sector Erase Typical Time */
+#define MX25R6435F_tBE32K_TYP \
+    160000 /**! 160 milli-seconds, 32KB Block Erase Typical Time */
+#define MX25R6435F_tBE64K_TYP \
+    320000 /**! 320 milli-seconds, 64KB Block Erase Typical Time */
+#define MX25R6435F_tCE_TYP \
+    50000000 /**! 50 seconds, Chip Erase Typical Time */
+#define MX25R6435F_tW_TYP \
+    3000 /**! 3 milli-seconds, Write Status Register Typical Cycle Time */
+
+// Suspend timings in micro-seconds, the same in both power modes.
+#define MX25R6435F_tSUS \
+    20 /**! 20 micro-seconds, Program/Erase Suspend Latency */
+#define MX25R6435F_tERS \
+    400 /**! 400 micro-seconds, Erase Resume to next Suspend */
+
 typedef struct {
     uint8_t manufacturer_id;
     uint8_t memory_type;
     uint8_t memory_density;
     uint32_t memory_size;
     uint32_t page_size;
+    bool high_performance; /**! L/H bit of the configuration register */
     struct {
         uint32_t tBP;      /**! Byte-Program Max Time */
         uint32_t tPP;      /**! Page Program Max Time */
@@ -293,8 +337,18 @@ typedef struct {
         uint32_t tBE64K;   /**! 64KB Block Erase Max Time */
         uint32_t tCE;      /**! Chip Erase Max Time */
         uint32_t tWSR;     /**! Status Register Write Max Time */
+        uint32_t tSUS;     /**! Program/Erase Suspend Latency Max Time */
+        uint32_t tERS;     /**! Erase Resume to next Suspend Min Time */
         uint32_t tUNKNOWN; /**! Unknown Operation Max Time */
     } timing;
+    struct {
+        uint32_t tPP;      /**! Page Program Typical Time */
+        uint32_t tSE;      /**! Sector Erase Typical Time */
+        uint32_t tBE32K;   /**! 32KB Block Erase Typical Time */
+        uint32_t tBE64K;   /**! 64KB Block Erase Typical Time */
+        uint32_t tCE;      /**! Chip Erase Typical Time */
+        uint32_t tWSR;     /**! Status Register Write Typical Time */
+    } typical;
     char name[20];
 } MX25Series_Chip_Info_t;
 
@@ -375,7 +429,8 @@ MX25Series_status_enum_t MX25Series_read_status_register(
 /**
  * MX25Series_read_configuration_register
  * @param dev the device structure for the MX25Series chip.
- * @param configuration_register see datasheet page 31 for register fields.
+ * @param configuration_register see datasheet page 31 for register fields,
+ * configuration register 1 in the upper byte as in the MX25Series_CR_* masks.
  * @return a MX25Series_status_enum_t indication success or error codes.
  */
 MX25Series_status_enum_t MX25Series_read_configuration_register(
@@ -386,7 +441,7 @@ MX25Series_status_enum_t MX25Series_read_configuration_register(
  * @param dev the device structure for the MX25Series chip.
  * @param status_register the value to write to the status register
  * @param configuration_register the value to write to the configuration
- * register
+ * register, configuration register 1 in the upper byte.
  * @return a MX25Series_status_enum_t indication success or error codes.
  */
 MX25Series_status_enum_t MX25Series_configure_chip(
@@ -419,19 +474,114 @@ MX25Series_status_enum_t MX25Series_read_stored_data(MX25Series_t *dev,
                                                      uint8_t *buffer);
 
 /**
- * MX25Series_write_stored_data stores the specified data at the specified
- * address.
+ * MX25Series_read_sfdp reads the Serial Flash Discoverable Parameters (RDSFDP).
  * @param dev the device structure for the MX25Series chip.
- * @param memory_address
- * @param length
- * @param buffer
+ * @param sfdp_address the 24-bit address in the SFDP space.
+ * @param length the number of bytes to read.
+ * @param buffer the buffer in which to store the read data.
  * @return a MX25Series_status_enum_t indication success or error codes.
  */
-MX25Series_status_enum_t MX25Series_write_stored_data(MX25Series_t *dev,
-                                                      uint32_t memory_address,
-                                                      size_t length,
-                                                      uint8_t *buffer);
+MX25Series_status_enum_t MX25Series_read_sfdp(MX25Series_t *dev,
+                                              uint32_t sfdp_address,
+                                              size_t length, uint8_t *buffer);
+/**
+ * MX25Series_program_start write enables and starts the program of one page,
+ * without waiting for it. The caller waits with MX25Series_wait_ready() and
+ * checks the program fail flag, see MX25Series_program().
+ * @param dev the device structure for the MX25Series chip.
+ * @param memory_address the 24-bit memory address to program from.
+ * @param length the number of bytes to program, inside one page.
+ * @param buffer the data to program.
+ * @return a MX25Series_status_enum_t indication success or error codes,
+ *         MX25Series_status_error if the data crosses a page boundary.
+ */
+MX25Series_status_enum_t MX25Series_program_start(MX25Series_t *dev,
+                                                  uint32_t memory_address,
+                                                  size_t length,
+                                                  uint8_t *buffer);
 
+/**
+ * MX25Series_program programs any number of bytes: the data is split at page
+ * boundaries, every page is write enabled, programmed and waited for with
+ * MX25Series_wait_ready(), then checked against the program fail flag.
+ * @param dev the device structure for the MX25Series chip.
+ * @param memory_address the 24-bit memory address to program from.
+ * @param length the number of bytes to program.
+ * @param buffer the data to program.
+ * @return a MX25Series_status_enum_t indication success or error codes.
+ */
+MX25Series_status_enum_t MX25Series_program(MX25Series_t *dev,
+                                            uint32_t memory_address,
+                                            size_t length, uint8_t *buffer);
+/**
+ * MX25Series_erase_and_wait write enables, erases and waits for the erase
+ * with MX25Series_wait_ready(), then checks the erase fail flag.
+ * @param dev the device structure for the MX25Series chip.
+ * @param erase_type the scope of the erasure.
+ * @param memory_address Any address within the block to erase.
+ * @return a MX25Series_status_enum_t indication success or error codes.
+ */
+MX25Series_status_enum_t MX25Series_erase_and_wait(
+    MX25Series_t *dev, MX25Series_Erase_enum_t erase_type,
+    uint32_t memory_address);
+/**
+ * MX25Series_write_enable_checked issues WREN and reads the WEL bit back, it
+ * stays 0 while WP# protects the status register or the chip is busy.
+ * @param dev the device structure for the MX25Series chip.
+ * @return a MX25Series_status_enum_t indication success or error codes.
+ */
+MX25Series_status_enum_t MX25Series_write_enable_checked(MX25Series_t *dev);
+/**
+ * MX25Series_wait_ready waits for the end of a program/erase/write status
+ * cycle. It sleeps the typical time first without any bus traffic, then polls
+ * WIP every typical_us / MX25Series_POLL_DIVIDER micro-seconds until max_us.
+ * @param dev the device structure for the MX25Series chip.
+ * @param typical_us time during which the operation is not expected to end.
+ * @param max_us timeout, counted from the call.
+ * @return MX25Series_status_ok or MX25Series_status_error_timeout.
+ */
+MX25Series_status_enum_t MX25Series_wait_ready(MX25Series_t *dev,
+                                               uint32_t typical_us,
+                                               uint32_t max_us);
+/**
+ * MX25Series_get_erasure_typical_time returns the typical time in
+ * micro-seconds of the provided erase_type.
+ * @param dev the device structure for the MX25Series chip.
+ * @param erase_type the MX25Series_Erase_enum_t type.
+ * @return the typical number of micro-seconds of the specified erasure.
+ */
+uint32_t MX25Series_get_erasure_typical_time(
+    MX25Series_t *dev, MX25Series_Erase_enum_t erase_type);
+/**
+ * MX25Series_set_power_mode switches the chip between Ultra Low Power and
+ * High Performance with the L/H bit, then makes chip_def the active chip
+ * definition so the timings match the mode. The status register and the
+ * other configuration bits are written back unchanged. The chip must be idle.
+ * @param dev the device structure for the MX25Series chip.
+ * @param chip_def the chip definition of the mode to switch to.
+ * @return a MX25Series_status_enum_t indication success or error codes.
+ */
+MX25Series_status_enum_t MX25Series_set_power_mode(
+    MX25Series_t *dev, MX25Series_Chip_Info_t *chip_def);
+/**
+ * MX25Series_suspend issues PGM/ERS Suspend and waits up to the tSUS timing
+ * of the chip definition for WIP to clear, so that the array can be read. An operation about to
+ * complete may end instead, its fail flags are then kept in the security
+ * register.
+ * @param dev the device structure for the MX25Series chip.
+ * @param suspended set if a program or erase is suspended and must be resumed.
+ * @return a MX25Series_status_enum_t indication success or error codes.
+ */
+MX25Series_status_enum_t MX25Series_suspend(MX25Series_t *dev,
+                                            bool *suspended);
+/**
+ * MX25Series_resume issues PGM/ERS Resume. A resumed erase is then left
+ * running for the tERS timing of the chip definition, a suspend any sooner
+ * would keep it from progressing.
+ * @param dev the device structure for the MX25Series chip.
+ * @return a MX25Series_status_enum_t indication success or error codes.
+ */
+MX25Series_status_enum_t MX25Series_resume(MX25Series_t *dev);
 /**
  * MX25Series_erase erases the specified flash area, specified by erase_type ond
  * memory_address
@@ -540,6 +690,12 @@ void MX25Series___enable_write_protect_pin(MX25Series_t *dev, bool value);
  * @return
  */
 bool MX25Series___test_linker(MX25Series_t *dev);
+/**
+ * MX25Series___delay_micro_second busy waits for at least us micro-seconds.
+ * @param dev the device structure for the MX25Series chip.
+ * @param us the number of micro-seconds to wait.
+ */
+void MX25Series___delay_micro_second(MX25Series_t *dev, unsigned int us);
 
 #if defined(__cplusplus)
 }
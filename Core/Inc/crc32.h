@@ -1,4 +1,36 @@
+#ifndef CRC32_H_
+#define CRC32_H_
+
 #include <stddef.h>
 #include <stdint.h>
 
+/* CRC32 kernels, selected at compile time with CRC32_KERNEL */
+#define CRC32_KERNEL_NIBBLE   (0) // 16 entries table (64B flash), 2 lookups per byte
+#define CRC32_KERNEL_BYTE     (1) // 256 entries table (1KB flash), 1 lookup per byte
+#define CRC32_KERNEL_SLICE4   (2) // 4x256 entries table (4KB flash), 4 bytes per step
+#define CRC32_KERNEL_SLICE8   (3) // 8x256 entries table (8KB flash), 8 bytes per step
+
+#ifndef CRC32_KERNEL
+#define CRC32_KERNEL          CRC32_KERNEL_SLICE4
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 uint32_t crc32(const void *buf, uint32_t size);
+
+/* Incremental interface, crc32_final(crc32_update(crc32_init(), buf, size)) == crc32(buf, size) */
+uint32_t crc32_init(void);
+uint32_t crc32_update(uint32_t crc, const void *buf, uint32_t size);
+uint32_t crc32_final(uint32_t crc);
+
+/* Selected kernel information */
+const char *crc32_kernel_name(void);
+uint32_t crc32_kernel_table_size(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC32_H_ */
@@ -27,6 +27,7 @@
 /******************************************************************************
 * Includes
 *******************************************************************************/
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -40,8 +41,12 @@
 #define DFU_DUMP_IMAGE_DATA                 (0) // 1: Dump image data
 
 #if (DFU_STORAGE_SPI_STM32 != 0)
-#define DFU_STORAGE_SPI_MX25                (0)
+/* Storage backends probed at dfu_init(), the first one recognizing the JEDEC ID of the flash is used */
+#define DFU_STORAGE_SPI_MX25                (1)
 #define DFU_STORAGE_SPI_N25Q                (1)
+#ifndef DFU_STORAGE_RAM
+#define DFU_STORAGE_RAM                     (0) // 1: RAM backend for tests, see dfu_storage_ram_attach()
+#endif
 #endif /*(DFU_STORAGE_SPI_STM32 != 0) */
 
 
@@ -52,23 +57,95 @@
 #define IMAGE_FIRMWARE_REVISION_VERSION     (1)
 
 #define FLASH_N25_MAX_WRITE_SIZE            (256)
+#define FLASH_N25_FAST_READ_DUMMY_CYCLES    (8) // FAST_READ dummy cycles, whole bytes only
 #define FLASH_N25_FW_START_ADDR            	(0)
 
+#define DFU_DIR_ADDR                        (FLASH_N25_FW_START_ADDR) // Image directory, indexes every committed image
+#define DFU_DIR_SIZE                        (4096) // One subsector, 128 entries before the directory is compacted
+#define DFU_DIR_MAX_IMAGES                  (8) // Images the directory can index at the same time
+#define DFU_JOURNAL_ADDR                    (DFU_DIR_ADDR + DFU_DIR_SIZE) // Progress journal of the update in flight
+#define DFU_JOURNAL_SIZE                    (4096) // One smallest erase unit, record then erase and program bitmaps
+#define DFU_JOURNAL_MAGIC                   (0x314C4E4AUL) // "JNL1"
+
+#define DFU_SLOT_COUNT                      (2) // Image slots, the valid slot with the highest sequence number is active
+#define DFU_SLOT_BASE_ADDR                  (FLASH_N25_FW_START_ADDR + 0x10000) // After the directory sector
+#define DFU_SLOT_SIZE                       (0x7F0000) // Slot size if the flash size is unknown, see dfu_slot_size()
+#define DFU_SLOT_HEADER_SIZE                (FLASH_N25_MAX_WRITE_SIZE) // Header page at the end of a slot, data at its start
+#define DFU_BLOCK_TABLE_SIZE                (4096 - DFU_SLOT_HEADER_SIZE) // Block CRC table right below the slot header, same subsector
+#define DFU_BLOCK_TABLE_MAGIC               (0x314B4C42UL) // "BLK1"
+
 
 /******************************************************************************
 * Configuration Constants
 *******************************************************************************/
+#define DFU_STREAM_CHUNK_SIZE               (512) // Window used to stream image data through RAM (CRC, validation)
+#define DFU_DIFF_UPDATE                     (1) // 1: Only erase/program the units that differ from the new image
+#define DFU_DIFF_UNIT_SIZE                  (4096) // Compare/erase unit of the differential update, multiple of the smallest erase size
+#define DFU_ERASE_COST_TYPICAL              (1) // 1: Erase planner uses typical erase times, 0: maximum erase times
+#define DFU_ERASE_KEEP_BUF_SIZE             (4096) // Smallest erase size, bytes outside an erased range are kept here
+#define DFU_ERASE_BLANK_CHECK               (1) // 1: Read the erase units first, the blank ones are not erased
+#define DFU_PREERASE                        (1) // 1: dfu_preerase_begin/poll() erase the next update area in idle time
+#define DFU_PREERASE_SLEEP                  (1) // 1: dfu_preerase_poll() sleeps until the next tick while the flash is busy
+#define DFU_N25Q_FAST_READ                  (1) // 0: READ only, 1: FAST_READ above the READ clock limit, 2: FAST_READ always
+#define DFU_WRITE_VERIFY                    (3) // Default dfu_verify_t of storage writes: 0 FSR, 1 sampled, 2 CRC, 3 full
+#define DFU_VERIFY_SAMPLE_PAGES             (16) // DFU_VERIFY_SAMPLED reads back one page out of this many
+#define DFU_UPDATE_BUDGET_MS                (2) // Default time slice of dfu_update_poll(), 0: one step per call
+#define DFU_UPDATE_BUF_PAGES                (4) // Pages of image data dfu_update_feed() can queue ahead of programming
+#define DFU_COMPRESSED_IMAGE                (1) // 1: Accept compressed (lz_stream) image payloads, 4KB of RAM for the decoder
+#define DFU_BLOCK_CRC                       (1) // 1: Store a CRC per block of the image, validation stops at the first bad block
+#define DFU_BLOCK_CRC_MIN_SIZE              (4096) // Smallest block (power of 2), doubled until the table fits DFU_BLOCK_TABLE_SIZE
+#define DFU_JOURNAL                         (1) // 1: Updates record their progress, an update cut by a reset resumes there
+
+#if (DFU_PREERASE != 0) && (DFU_ERASE_BLANK_CHECK == 0)
+#error "DFU_PREERASE needs DFU_ERASE_BLANK_CHECK"
+#endif
+#if (DFU_JOURNAL != 0) && (DFU_ERASE_BLANK_CHECK == 0)
+#error "DFU_JOURNAL needs DFU_ERASE_BLANK_CHECK"
+#endif
+#if (DFU_JOURNAL != 0) && (DFU_JOURNAL_ADDR + DFU_JOURNAL_SIZE > DFU_SLOT_BASE_ADDR)
+#error "DFU_JOURNAL_ADDR overlaps the image slots"
+#endif
+#if (DFU_BLOCK_CRC != 0) && (DFU_BLOCK_CRC_MIN_SIZE <= (DFU_UPDATE_BUF_PAGES + 1) * FLASH_N25_MAX_WRITE_SIZE)
+#error "DFU_BLOCK_CRC_MIN_SIZE must be larger than the data dfu_update_feed() queues ahead of programming"
+#endif
+
+#ifndef DFU_LOG_ENABLE
+#define DFU_LOG_ENABLE                      (1) // 0: Compile out LOG_ERR/LOG_WRN/LOG_INF
+#endif
+#ifndef DFU_PROFILE_PHASES
+#define DFU_PROFILE_PHASES                  (0) // 1: Call dfu_phase_hook() on entry/exit of each update phase
+#endif
 
 
 /******************************************************************************
 * Macros
 *******************************************************************************/
 #if !(DFU_STORAGE_SPI_ZEPHYR == 1)
-#define LOG_ERR(...) printf("[ERR] "__VA_ARGS__); printf("\r\n");
-#define LOG_WRN(...) printf("[WRN] "__VA_ARGS__); printf("\r\n");
-#define LOG_INF(...) printf("[INF] "__VA_ARGS__); printf("\r\n");
+#if (DFU_LOG_ENABLE != 0)
+#ifdef DFU_LOG_STREAM
+// Host builds log to DFU_LOG_STREAM (stderr), their stdout carries the tool output
+#define DFU_LOG_PRINTF(...) fprintf(DFU_LOG_STREAM, __VA_ARGS__)
+#else
+#define DFU_LOG_PRINTF(...) printf(__VA_ARGS__)
+#endif
+#define LOG_ERR(...) DFU_LOG_PRINTF("[ERR] "__VA_ARGS__); DFU_LOG_PRINTF("\r\n");
+#define LOG_WRN(...) DFU_LOG_PRINTF("[WRN] "__VA_ARGS__); DFU_LOG_PRINTF("\r\n");
+#define LOG_INF(...) DFU_LOG_PRINTF("[INF] "__VA_ARGS__); DFU_LOG_PRINTF("\r\n");
+#else
+#define LOG_ERR(...)
+#define LOG_WRN(...)
+#define LOG_INF(...)
+#endif /* End of (DFU_LOG_ENABLE != 0) */
 #endif /* End of (DFU_STORAGE_SPI_ZEPHYR == 1) */
 
+#if (DFU_PROFILE_PHASES != 0)
+#define DFU_PHASE_ENTER(phase)  dfu_phase_hook(phase, true)
+#define DFU_PHASE_EXIT(phase)   dfu_phase_hook(phase, false)
+#else
+#define DFU_PHASE_ENTER(phase)
+#define DFU_PHASE_EXIT(phase)
+#endif /* End of (DFU_PROFILE_PHASES != 0) */
+
 /******************************************************************************
 * Typedefs
 *******************************************************************************/
@@ -84,10 +161,127 @@ typedef struct __attribute__((packed)){
     uint8_t image_data_version_minor;
     uint8_t image_data_version_revision;
     uint32_t image_data_crc;    
-    uint32_t reserved;
+    uint32_t image_sequence;    // Incremented by every slot update, selects the active slot
 
 }image_header_t;
 
+/* Block CRC table, stored right below the slot header: this header, then the crc32() of each block of the image,
+   (1 << block_size_log2) bytes per block, the last one may be shorter. Programmed before the image header. */
+typedef struct __attribute__((packed))
+{
+    uint32_t table_magic;       // DFU_BLOCK_TABLE_MAGIC
+    uint32_t img_data_size;     // Size and CRC of the image the table belongs to
+    uint32_t image_data_crc;
+    uint16_t block_count;
+    uint8_t block_size_log2;
+    uint8_t reserved;
+    uint32_t table_crc;         // crc32() of the block CRCs
+} dfu_block_table_t;
+
+/* Block CRCs given with a new image (image pack), the stored blocks are checked against them */
+typedef struct
+{
+    const uint8_t *p_crcs;      // crc32() of each block, little endian, NULL for none
+    uint8_t block_size_log2;
+} dfu_block_crcs_t;
+
+/* Update phases reported to dfu_phase_hook(), phases may nest (e.g. verify inside program) */
+typedef enum
+{
+    DFU_PHASE_ERASE = 0,        // Erase of the image area
+    DFU_PHASE_DIFF,             // Compare of the stored image against the new one (differential update)
+    DFU_PHASE_PROGRAM,          // Page programming of image data and header
+    DFU_PHASE_VERIFY,           // Readback compare after programming
+    DFU_PHASE_COMMIT_CRC,       // CRC of the new image (source and storage) before the header is committed
+    DFU_PHASE_VALIDATE,         // CRC check of the stored image (boot validation)
+    DFU_PHASE_COUNT,
+} dfu_phase_t;
+
+/* Verification of the pages written to storage, the program error flags are checked at every level */
+typedef enum
+{
+    DFU_VERIFY_FSR = 0,         // Flag status register only
+    DFU_VERIFY_SAMPLED,         // Readback compare of one page out of DFU_VERIFY_SAMPLE_PAGES
+    DFU_VERIFY_CRC,             // CRC of the written data against one continuous readback at the end
+    DFU_VERIFY_FULL,            // Readback compare of every page
+} dfu_verify_t;
+
+/* States of a non-blocking update (dfu_update_begin/feed/poll) */
+typedef enum
+{
+    DFU_UPDATE_IDLE = 0,        // No update started
+    DFU_UPDATE_ERASE,           // Erasing the image area, data can already be fed
+    DFU_UPDATE_PROGRAM,         // Programming the fed pages
+    DFU_UPDATE_VERIFY,          // CRC of the stored data against the CRC of the fed data
+    DFU_UPDATE_COMMIT,          // Programming the image header
+    DFU_UPDATE_DONE,            // Image committed
+    DFU_UPDATE_ERROR,           // Update failed, dfu_update_begin() starts over
+} dfu_update_state_t;
+
+/* Context of a non-blocking update, only one update can run at a time */
+typedef struct
+{
+    dfu_update_state_t state;
+    image_header_t header;      // Written at hdr_addr once the data is verified
+    uint32_t hdr_addr;
+    uint32_t dest_addr;
+    uint32_t total_len;
+    uint32_t budget_ms;         // Time slice of dfu_update_poll()
+    uint32_t erase_addr;        // Next address to erase
+    uint32_t erase_end;
+    uint32_t erased;            // Bytes of the data and header areas erased
+    bool erase_data_pending;    // Header area erased first, the data area follows
+    uint32_t keep_start;        // Range of a partially erased unit, the rest of the unit is programmed back
+    uint32_t keep_len;
+    uint32_t erase_run_end;     // End of the units to erase found by the blank check
+    uint32_t feed_skip;         // Bytes dfu_update_feed() drops before the data (pack header)
+    uint32_t resume_len;        // Bytes programmed before a reset, dfu_update_feed() only decodes them
+    uint32_t received;          // Bytes accepted by dfu_update_feed()
+    uint32_t started;           // Bytes whose page program was started
+    uint32_t programmed;        // Bytes whose page program completed
+    uint32_t verified;
+    uint32_t header_written;
+    uint32_t crc;               // Running CRC of the fed data, after decompression
+    bool compressed;            // Fed data is a compressed payload, decoded into the page queue
+    uint32_t payload_crc;       // CRC of the decompressed image given by the payload header
+    uint32_t verify_crc;        // Running CRC of the stored data
+    uint32_t table_addr;        // Block CRC table, 0 if the image gets none
+    uint8_t block_size_log2;
+    dfu_block_crcs_t src_blocks; // Block CRCs given with the image
+    uint32_t block_crc;         // Running CRC of the stored block being checked
+    uint32_t fed_block_crc;     // Running CRC of the block being fed
+    uint32_t fed_block_done[2]; // CRC of the last blocks fed completely, by parity of the block index
+    uint32_t table_crc;         // Running CRC of the block CRCs stored so far
+    uint8_t pages[DFU_UPDATE_BUF_PAGES][FLASH_N25_MAX_WRITE_SIZE]; // Fed data, one flash page per entry
+    uint8_t page_tail;          // Oldest queued page
+    uint8_t page_queued;        // Complete pages waiting to be programmed
+    uint32_t page_fill;         // Bytes in the page being filled
+    bool busy;                  // Erase or page program in flight
+    uint32_t busy_addr;
+    uint32_t busy_len;          // Page length, 0 for an erase
+    uint8_t busy_erase_id;      // Erase type of an erase
+    const uint8_t *busy_data;   // Page data, for the readback compare
+    bool busy_readback;
+    uint32_t busy_tick;         // HAL_GetTick() at the start of the operation
+    uint32_t busy_timeout_ms;
+} dfu_update_t;
+
+/* Context of the idle-time pre-erase (dfu_preerase_begin/poll) */
+typedef struct
+{
+    uint32_t addr;              // Next unit to blank check or erase
+    uint32_t end;
+    uint32_t run_end;           // End of the units to erase found by the blank check
+    uint32_t update_count;      // Updates started before the pre-erase, the next one ends it
+    uint32_t erased;            // Bytes erased
+    uint32_t blank;             // Bytes found already blank
+    bool busy;                  // Erase in flight
+    uint32_t busy_addr;
+    uint32_t busy_size;
+    uint32_t busy_tick;         // HAL_GetTick() at the start of the erase
+    uint32_t busy_timeout_ms;
+} dfu_preerase_t;
+
 /******************************************************************************
 * Variables
 *******************************************************************************/
@@ -101,15 +295,47 @@ typedef struct __attribute__((packed)){
 extern "C"{
 #endif
 
+struct device;
+
 int dfu_init(const struct device *storage_dev);
 int dfu_image_is_valid(uint32_t addr);
 int dfu_image_validate_header(uint32_t img_start_addr);
 int dfu_image_validate_data_content(uint32_t img_start_addr);
+int dfu_image_validate_range(uint32_t img_start_addr, uint32_t offset, uint32_t len);
 int dfu_image_clear(uint32_t img_start_addr);
 int dfu_image_commit(image_header_t* img_header_data, uint32_t hdr_addr);
 int dfu_image_read_header(uint32_t img_start_addr, image_header_t* img_header_data);
 int dfu_image_update(image_header_t* img_meta_data, uint8_t* p_data, uint32_t data_len, uint32_t dest_img_addr);
-int dfu_fw_image_update(uint8_t* fw_data, uint32_t fw_len, uint32_t addr);
+int dfu_fw_image_update(uint8_t* fw_data, uint32_t fw_len);
+uint32_t dfu_slot_size(void);
+uint32_t dfu_slot_addr(uint8_t slot);
+int dfu_slot_active(image_header_t *p_header);
+int dfu_slot_update(image_header_t *img_meta_data, uint8_t *p_data, uint32_t data_len);
+int dfu_slot_rollback(void);
+int dfu_dir_list(image_header_t *p_headers, uint32_t max_count);
+int dfu_dir_find(uint8_t image_type, image_header_t *p_header);
+int dfu_dir_add(const image_header_t *p_header);
+int dfu_dir_remove(uint32_t img_data_start_addr);
+void dfu_set_write_verify(dfu_verify_t level);
+dfu_verify_t dfu_get_write_verify(void);
+int dfu_update_begin(dfu_update_t *ctx, const image_header_t *img_meta_data, uint32_t dest_img_addr, uint32_t data_len,
+                     uint32_t hdr_addr);
+int dfu_update_begin_payload(dfu_update_t *ctx, const image_header_t *img_meta_data, uint32_t dest_img_addr,
+                             const uint8_t *p_payload, uint32_t payload_len, uint32_t hdr_addr);
+int dfu_update_feed(dfu_update_t *ctx, const uint8_t *p_data, uint32_t len);
+dfu_update_state_t dfu_update_poll(dfu_update_t *ctx);
+int dfu_update_read(dfu_update_t *ctx, uint32_t addr, uint8_t *p_data, uint32_t len);
+void dfu_update_set_budget(dfu_update_t *ctx, uint32_t budget_ms);
+uint8_t dfu_update_progress(const dfu_update_t *ctx);
+int dfu_fw_image_update_begin(dfu_update_t *ctx, const uint8_t *fw_data, uint32_t fw_len);
+int dfu_preerase_begin(dfu_preerase_t *ctx, uint32_t addr, uint32_t len);
+int dfu_preerase_poll(dfu_preerase_t *ctx);
+int dfu_fw_image_preerase_begin(dfu_preerase_t *ctx);
+
+#if (DFU_PROFILE_PHASES != 0)
+/* Implemented by the profiler (e.g. Host/sim/dfu_profile.c) */
+void dfu_phase_hook(dfu_phase_t phase, bool enter);
+#endif
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,148 @@
+/****************************************************************************
+* Title                 :   DFU storage backends header file
+* Filename              :   dfu_storage.h
+* Origin Date           :   2026/10/17
+* Version               :   v0.0.0
+* Notes                 :   None
+*****************************************************************************/
+
+/** \file dfu_storage.h
+ *  \brief Runtime selected storage backends of the DFU module
+ *
+ *  Every backend drives one flash family through its own driver and reports
+ *  the chip geometry (size, page size, erase types and timings). Backends are
+ *  probed in order at dfu_init(), the first one that recognizes the JEDEC ID
+ *  of the flash on the bus is used, so one build runs on any supported part.
+ *  Parts with SFDP tables describe their own page size, erase types and
+ *  timings, the backend datasheet values are only used without them.
+ *  Program and erase operations only start the operation, completion is
+ *  checked with status() or wait() so the DFU module can pipeline pages and
+ *  run erases in the background. Backends that can suspend a program/erase
+ *  let the array be read while one runs, after the suspend latency.
+ */
+#ifndef DFU_STORAGE_H_
+#define DFU_STORAGE_H_
+
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "erase_plan.h"
+#include "MX25Series.h"
+#include "sfdp.h"
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#define DFU_STORAGE_MAX_ERASE_TYPES     (4)
+
+/* Return values of dfu_storage_ops_t.status() and wait() */
+#define DFU_STORAGE_BUSY                (1) // Program/erase in progress
+#define DFU_STORAGE_READY               (0) // Last operation completed successfully
+#define DFU_STORAGE_ERROR               (-1) // Last operation failed, the error flags are cleared
+#define DFU_STORAGE_TIMEOUT             (-2)
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+typedef struct
+{
+    uint32_t size;          // Erase size in bytes, power of 2, 0 if not supported
+    uint8_t id;             // Backend erase type, passed back to erase_start()
+    uint32_t typ_ms;        // Typical duration, used for planning with DFU_ERASE_COST_TYPICAL
+    uint32_t max_ms;        // Maximum duration, used as timeout
+} dfu_storage_erase_t;
+
+typedef struct
+{
+    const char *name;
+    uint8_t jedec_id[3];        // Manufacturer, memory type, capacity
+    uint32_t size;              // Addressable size in bytes
+    uint32_t page_size;         // Program page size, at most FLASH_N25_MAX_WRITE_SIZE
+    uint8_t erase_value;
+    uint32_t program_max_ms;    // Page program timeout
+    dfu_storage_erase_t erase[DFU_STORAGE_MAX_ERASE_TYPES]; // Block erase types by increasing size
+    uint8_t erase_count;
+    dfu_storage_erase_t chip_erase; // size 0 if the whole chip cannot be erased at once
+    bool sfdp;                  // Page size, erase types and timings read from the SFDP tables
+    /* Filled by dfu_storage_select() */
+    erase_plan_type_t plan_types[DFU_STORAGE_MAX_ERASE_TYPES];
+    erase_plan_geometry_t plan; // Erase planner view of the erase types
+} dfu_storage_geometry_t;
+
+typedef struct
+{
+    const char *name;
+    /* Read the JEDEC ID, 0 and geometry filled in if this backend drives the flash, negative value otherwise */
+    int (*probe)(dfu_storage_geometry_t *geo);
+    /* Read the 3 JEDEC ID bytes again, NULL if the flash is not on a bus */
+    int (*read_id)(uint8_t *id);
+    /* Read the SFDP address space, NULL if the flash has no SFDP tables */
+    int (*read_sfdp)(uint32_t addr, uint8_t *data, uint32_t len);
+    int (*read)(uint32_t addr, uint8_t *data, uint32_t len);
+    /* Continuous read: one command at read_begin(), the following bytes are streamed by read_next() until
+     * read_end(). NULL if not supported, read() is used instead */
+    int (*read_begin)(uint32_t addr);
+    int (*read_next)(uint8_t *data, uint32_t len);
+    void (*read_end)(void);
+    /* Copy data inside one page into the next program buffer, returns the copy, valid until the second next call.
+     * Staging is allowed while the previous page is still programming */
+    const uint8_t *(*program_stage)(uint32_t addr, const uint8_t *data, uint32_t len);
+    /* Start programming the last staged page, the flash must be ready */
+    int (*program_start)(void);
+    /* Start one erase of the given dfu_storage_erase_t.id, chip erase included */
+    int (*erase_start)(uint8_t id, uint32_t addr);
+    /* DFU_STORAGE_BUSY, DFU_STORAGE_READY or DFU_STORAGE_ERROR for the operation in flight, without waiting */
+    int (*status)(void);
+    /* Wait for the operation in flight, NULL to poll status() */
+    int (*wait)(uint32_t timeout_ms);
+    /* Suspend the operation in flight: 1 once suspended, 0 if it completed first, its status is then kept for
+     * status(), negative value on failure. NULL if the flash cannot suspend */
+    int (*suspend)(void);
+    /* Resume the suspended operation */
+    int (*resume)(void);
+    /* Enter (true) or leave (false) the mode used while an update runs, the flash is idle. NULL if the flash has a
+     * single mode */
+    int (*update_mode)(bool update);
+} dfu_storage_ops_t;
+
+/******************************************************************************
+* Variables
+*******************************************************************************/
+extern const dfu_storage_ops_t dfu_storage_n25q;
+extern const dfu_storage_ops_t dfu_storage_mx25;
+extern const dfu_storage_ops_t dfu_storage_ram;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+int dfu_storage_probe(void);
+int dfu_storage_select(const dfu_storage_ops_t *ops);
+const dfu_storage_ops_t *dfu_storage_backend(void);
+const dfu_storage_geometry_t *dfu_storage_geometry(void);
+int dfu_storage_wait(uint32_t timeout_ms);
+int dfu_storage_suspend(void);
+int dfu_storage_resume(void);
+int dfu_storage_read_id(uint8_t *id);
+int dfu_storage_read_sfdp(uint32_t addr, uint8_t *data, uint32_t len);
+uint32_t dfu_storage_erase_max_ms(uint8_t id);
+int dfu_storage_update_mode(bool update);
+int dfu_storage_sfdp_geometry(const sfdp_info_t *sfdp, uint8_t chip_erase_id, uint32_t max_page_size,
+                              dfu_storage_geometry_t *geo);
+
+void dfu_storage_mx25_attach(MX25Series_t *dev, MX25Series_Chip_Info_t *update_chip_def);
+void dfu_storage_ram_attach(uint8_t *mem, uint32_t size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // DFU_STORAGE_H_
+
+/*** End of File **************************************************************/
@@ -0,0 +1,70 @@
+/****************************************************************************
+* Title                 :   Erase planner header file
+* Filename              :   erase_plan.h
+* Origin Date           :   2026/10/17
+* Version               :   v0.0.0
+* Notes                 :   None
+*****************************************************************************/
+
+/** \file erase_plan.h
+ *  \brief Cover a flash range with the cheapest mix of erase sizes
+ *
+ *  The planner only knows the erase sizes of the device and their expected
+ *  durations. Given a range aligned to the smallest erase size it returns the
+ *  erase operations one by one, choosing for every aligned block between one
+ *  large erase and several smaller ones by cost, and a chip erase when the
+ *  range is the whole device and that is cheaper. Unaligned head and tail are
+ *  left to the caller, which must preserve the bytes outside the range.
+ */
+#ifndef ERASE_PLAN_H_
+#define ERASE_PLAN_H_
+
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+typedef struct
+{
+    uint32_t size;      // Erase size in bytes, power of 2
+    uint32_t time_ms;   // Expected erase duration
+    uint8_t id;         // Backend erase type (command, driver enum)
+} erase_plan_type_t;
+
+typedef struct
+{
+    const erase_plan_type_t *types; // Block erase types, sorted by increasing size
+    uint8_t type_count;
+    uint32_t chip_size;             // Device size in bytes
+    uint32_t chip_erase_ms;         // Chip erase duration, 0 if not supported
+    uint8_t chip_erase_id;
+} erase_plan_geometry_t;
+
+typedef struct
+{
+    uint32_t addr;
+    uint32_t size;
+    uint32_t time_ms;
+    uint8_t id;
+} erase_plan_op_t;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+int erase_plan_next(const erase_plan_geometry_t *geo, uint32_t addr, uint32_t end, erase_plan_op_t *op);
+uint32_t erase_plan_cost_ms(const erase_plan_geometry_t *geo, uint32_t addr, uint32_t end);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ERASE_PLAN_H_
+
+/*** End of File **************************************************************/
@@ -0,0 +1,79 @@
+/****************************************************************************
+* Title                 :   Packed image header file
+* Filename              :   image_pack.h
+* Origin Date           :   2026/10/17
+* Version               :   v0.0.0
+* Notes                 :   None
+*****************************************************************************/
+
+/** \file image_pack.h
+ *  \brief Images packed on the host, with their header built at pack time
+ *
+ *  A pack is a image_pack_header_t, a table of image_count entries, then the
+ *  payload of each image and its optional block CRC table, 4 bytes aligned.
+ *  Each entry carries the image_header_t of its image (magic, type, version,
+ *  size and CRC of the image as stored), the payload is the image itself or
+ *  a compressed payload (lz_stream.h). The block CRC table holds the crc32()
+ *  of every (1 << block_size_log2) bytes block of the image as stored, the
+ *  last block may be shorter.
+ *
+ *  Packs are produced on the host by Host/tools/image_pack.
+ */
+#ifndef IMAGE_PACK_H_
+#define IMAGE_PACK_H_
+
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+
+#include "dfu.h"
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#define IMAGE_PACK_MAGIC                (0x314B5049UL) // "IPK1"
+#define IMAGE_PACK_MAX_IMAGES           (DFU_DIR_MAX_IMAGES)
+#define IMAGE_PACK_ALIGN                (4)
+#define IMAGE_PACK_FLAG_COMPRESSED      (0x01) // Payload is a lz_stream payload, the image itself otherwise
+#define IMAGE_PACK_FLAG_BLOCK_CRC       (0x02) // A block CRC table follows the payload
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;             // IMAGE_PACK_MAGIC
+    uint8_t image_count;
+    uint8_t reserved[3];
+    uint32_t total_len;         // Whole pack, this header included
+    uint32_t entries_crc;       // crc32() of the entry table
+} image_pack_header_t;
+
+typedef struct __attribute__((packed))
+{
+    image_header_t header;      // Address and sequence are left to the target
+    uint32_t payload_offset;    // From the start of the pack
+    uint32_t payload_len;
+    uint32_t block_crc_offset;  // From the start of the pack, 0 without block CRC table
+    uint8_t block_size_log2;
+    uint8_t flags;
+    uint16_t reserved;
+} image_pack_entry_t;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+const image_pack_entry_t *image_pack_find(const void *p_data, uint32_t len, uint8_t image_type);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // IMAGE_PACK_H_
+
+/*** End of File **************************************************************/
@@ -0,0 +1,86 @@
+/****************************************************************************
+* Title                 :   Streaming LZ decoder header file
+* Filename              :   lz_stream.h
+* Origin Date           :   2026/10/17
+* Version               :   v0.0.0
+* Notes                 :   None
+*****************************************************************************/
+
+/** \file lz_stream.h
+ *  \brief Decode compressed image payloads in fixed-size windows
+ *
+ *  A payload is a lz_stream_header_t followed by LZ4 block style sequences:
+ *  a token (literal length in the high nibble, match length - 4 in the low
+ *  nibble, 15 meaning extra 255-terminated length bytes follow), the literals,
+ *  then a 2 bytes little endian match offset. The last sequence has no match.
+ *  Offsets never exceed the window given in the header, so the decoder only
+ *  keeps a (1 << window_bits) bytes history ring and can be resumed at any
+ *  input or output boundary: the input can arrive in chunks of any size and
+ *  the output is pulled in chunks of any size, e.g. one flash page at a time.
+ *
+ *  Payloads are produced on the host by Host/tools/lz_pack.
+ */
+#ifndef LZ_STREAM_H_
+#define LZ_STREAM_H_
+
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#define LZ_STREAM_MAGIC             (0x31535A4CUL) // "LZS1"
+#define LZ_STREAM_FLAG_COMPRESSED   (0x01) // Sequences follow the header, stored (raw) data otherwise
+#define LZ_STREAM_MIN_MATCH         (4)
+#define LZ_STREAM_MAX_WINDOW_BITS   (12) // Decoder history size, 4KB of RAM
+#define LZ_STREAM_MIN_WINDOW_BITS   (8)
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;         // LZ_STREAM_MAGIC
+    uint32_t raw_size;      // Decompressed size
+    uint32_t raw_crc;       // crc32() of the decompressed data
+    uint8_t window_bits;    // Largest match offset is (1 << window_bits)
+    uint8_t flags;
+    uint16_t reserved;
+} lz_stream_header_t;
+
+typedef struct
+{
+    lz_stream_header_t header;
+    uint8_t header_len;     // Header bytes received so far
+    uint8_t state;
+    bool error;
+    uint32_t out_pos;       // Decompressed bytes produced so far
+    uint32_t literal_len;
+    uint32_t match_len;
+    uint32_t match_offset;
+    uint8_t window[1 << LZ_STREAM_MAX_WINDOW_BITS];
+} lz_stream_t;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+const lz_stream_header_t *lz_stream_payload_header(const void *p_data, uint32_t len);
+void lz_stream_init(lz_stream_t *s);
+int lz_stream_decode(lz_stream_t *s, const uint8_t *in, uint32_t in_len, uint32_t *p_consumed,
+                     uint8_t *out, uint32_t out_len);
+bool lz_stream_done(const lz_stream_t *s);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // LZ_STREAM_H_
+
+/*** End of File **************************************************************/
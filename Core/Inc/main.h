@@ -42,6 +42,8 @@ extern "C" {
 /* Exported constants --------------------------------------------------------*/
 /* USER CODE BEGIN EC */
 #define FLASH_N25_DBG_MSG_EN (0)
+#define FLASH_N25_SPI_USE_DMA (1)
+#define FLASH_N25_SPI_DMA_MIN_SIZE (16) // Shorter transfers stay on the polled HAL calls
 /* USER CODE END EC */
 
 /* Exported macro ------------------------------------------------------------*/
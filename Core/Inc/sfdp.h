@@ -0,0 +1,105 @@
+/****************************************************************************
+* Title                 :   SFDP parser header file
+* Filename              :   sfdp.h
+* Origin Date           :   2026/10/17
+* Version               :   v0.0.0
+* Notes                 :   None
+*****************************************************************************/
+
+/** \file sfdp.h
+ *  \brief Serial Flash Discoverable Parameters (JESD216) parser
+ *
+ *  Reads the SFDP header, the Basic Flash Parameter Table and the optional
+ *  sector map through a read callback, so it does not depend on the flash
+ *  driver. The result describes the array size, addressing, page size, the
+ *  erase types with their typical and maximum durations and the fast read
+ *  instructions. Erase types the sector map does not allow everywhere on the
+ *  array are dropped, the remaining ones are legal at any aligned address.
+ */
+#ifndef SFDP_H_
+#define SFDP_H_
+
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#define SFDP_READ_CMD               (0x5A) // 3 address bytes and 8 dummy cycles, whatever the address mode
+#define SFDP_ERASE_TYPES            (4)
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+typedef enum
+{
+    SFDP_ADDR_3 = 0,        // 3-byte addresses only
+    SFDP_ADDR_3_OR_4,       // 3-byte by default, 4-byte mode can be entered
+    SFDP_ADDR_4,            // 4-byte addresses only
+} sfdp_addr_mode_t;
+
+typedef enum
+{
+    SFDP_FAST_READ_1_1_2 = 0,
+    SFDP_FAST_READ_1_2_2,
+    SFDP_FAST_READ_1_1_4,
+    SFDP_FAST_READ_1_4_4,
+    SFDP_FAST_READ_COUNT,
+} sfdp_fast_read_mode_t;
+
+typedef struct
+{
+    uint8_t opcode;         // 0 if not supported
+    uint8_t dummy_cycles;   // Wait states after the address
+    uint8_t mode_cycles;    // Mode bits clocks after the address
+} sfdp_fast_read_t;
+
+typedef struct
+{
+    uint32_t size;          // Erase size in bytes, power of 2
+    uint8_t opcode;
+    uint32_t typ_ms;        // 0 if the table gives no timing
+    uint32_t max_ms;
+} sfdp_erase_t;
+
+typedef struct
+{
+    uint8_t major;              // BFPT revision
+    uint8_t minor;
+    uint64_t size;              // Array size in bytes
+    sfdp_addr_mode_t addr_mode;
+    bool enter_4b_wren;         // 4-byte mode is entered with WREN then 0xB7
+    bool enter_4b;              // 4-byte mode is entered with 0xB7
+    uint32_t page_size;
+    uint32_t program_typ_us;    // 0 if the table gives no timing
+    uint32_t program_max_us;
+    sfdp_erase_t erase[SFDP_ERASE_TYPES]; // Erase types by increasing size
+    uint8_t erase_count;
+    uint32_t chip_erase_typ_ms; // 0 if the table gives no timing
+    uint32_t chip_erase_max_ms;
+    sfdp_fast_read_t fast_read[SFDP_FAST_READ_COUNT];
+    bool sector_map;            // Erase types were filtered by a sector map
+} sfdp_info_t;
+
+/* Read len bytes of the SFDP address space, 0 on success */
+typedef int (*sfdp_read_t)(uint32_t addr, uint8_t *data, uint32_t len);
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+int sfdp_parse(sfdp_read_t read, sfdp_info_t *info);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SFDP_H_
+
+/*** End of File **************************************************************/
@@ -29,7 +29,7 @@ extern "C" {
 #include "main.h"
 
 /* USER CODE BEGIN Includes */
-
+#include <stdbool.h>
 /* USER CODE END Includes */
 
 extern SPI_HandleTypeDef hspi1;
@@ -37,14 +37,20 @@ extern SPI_HandleTypeDef hspi1;
 extern SPI_HandleTypeDef hspi2;
 
 /* USER CODE BEGIN Private defines */
-
+/* Completion of a SPI_DMA_Transmit()/SPI_DMA_Receive(), called from the DMA interrupt */
+typedef void (*spi_dma_callback_t)(SPI_HandleTypeDef *hspi, HAL_StatusTypeDef status, void *arg);
 /* USER CODE END Private defines */
 
 void MX_SPI1_Init(void);
 void MX_SPI2_Init(void);
 
 /* USER CODE BEGIN Prototypes */
-
+HAL_StatusTypeDef SPI_DMA_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size,
+                                   spi_dma_callback_t callback, void *arg);
+HAL_StatusTypeDef SPI_DMA_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size,
+                                  spi_dma_callback_t callback, void *arg);
+bool SPI_DMA_IsBusy(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef SPI_DMA_Wait(SPI_HandleTypeDef *hspi, uint32_t Timeout);
 /* USER CODE END Prototypes */
 
 #ifdef __cplusplus
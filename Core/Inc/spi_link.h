@@ -0,0 +1,79 @@
+/****************************************************************************
+* Title                 :   SPI link training header file
+* Filename              :   spi_link.h
+* Origin Date           :   2026/10/17
+* Version               :   v0.0.0
+* Notes                 :   None
+*****************************************************************************/
+
+/** \file spi_link.h
+ *  \brief Pick the fastest SPI clock a flash link carries reliably
+ *
+ *  The reference JEDEC ID and the CRC of a reference region are read at the
+ *  configured (slowest) prescaler, then the prescaler is stepped down one
+ *  division at a time. Every step reads the ID and the region
+ *  SPI_LINK_PASSES times and must match the reference. The first failing step
+ *  ends the training, the setting kept is SPI_LINK_MARGIN_STEPS slower than
+ *  the fastest one that passed. The flash is accessed through callbacks, so
+ *  any flash driver on any bus can be trained.
+ */
+#ifndef SPI_LINK_H_
+#define SPI_LINK_H_
+
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+
+#include "main.h"
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#ifndef SPI_LINK_PASSES
+#define SPI_LINK_PASSES             (4)    // Reads of the ID and the reference region per prescaler
+#endif
+#ifndef SPI_LINK_MARGIN_STEPS
+#define SPI_LINK_MARGIN_STEPS       (1)    // Prescaler steps kept below the fastest passing one
+#endif
+#define SPI_LINK_REF_LEN            (1024) // Default reference region length
+#define SPI_LINK_SFDP_REF_LEN       (128)  // SFDP header, parameter headers and Basic Flash Parameter Table
+#define SPI_LINK_ID_LEN             (3)
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+typedef struct
+{
+    int (*read_id)(uint8_t *id);    // SPI_LINK_ID_LEN bytes of JEDEC ID, 0 on success
+    int (*read)(uint32_t addr, uint8_t *data, uint32_t len); // 0 on success
+    uint32_t ref_addr;              // Reference region, read only
+    uint32_t ref_len;
+} spi_link_probe_t;
+
+typedef struct
+{
+    uint32_t prescaler;             // SPI_BAUDRATEPRESCALER_x locked in
+    uint32_t clock_hz;
+    uint32_t fastest_hz;            // Fastest clock that passed, before the margin
+    uint32_t failed_hz;             // Slowest clock that failed, 0 if none did
+} spi_link_result_t;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+int spi_link_train(SPI_HandleTypeDef *hspi, const spi_link_probe_t *probe, spi_link_result_t *result);
+int spi_link_fallback(SPI_HandleTypeDef *hspi);
+uint32_t spi_link_clock_hz(const SPI_HandleTypeDef *hspi);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SPI_LINK_H_
+
+/*** End of File **************************************************************/
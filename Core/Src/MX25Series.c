@@ -29,6 +29,7 @@ MX25Series_Chip_Info_t MX25R6435F_Chip_Def_Low_Power = {.manufacturer_id = MX25R
                                                         .memory_density = MX25R6435F_MEMORY_DENSITY,
                                                         .memory_size = MX25R6435F_MEMORY_SIZE,
                                                         .page_size = MX25R6435F_PAGE_SIZE,
+                                                        .high_performance = false,
                                                         .timing = {.tBP = MX25R6435F_tBP_LP,
                                                                    .tPP = MX25R6435F_tPP_LP,
                                                                    .tSE = MX25R6435F_tSE_LP,
@@ -36,7 +37,15 @@ MX25Series_Chip_Info_t MX25R6435F_Chip_Def_Low_Power = {.manufacturer_id = MX25R
                                                                    .tBE64K = MX25R6435F_tBE64K_LP,
                                                                    .tCE = MX25R6435F_tCE_LP,
                                                                    .tWSR = MX25R6435F_tW_LP,
+                                                                   .tSUS = MX25R6435F_tSUS,
+                                                                   .tERS = MX25R6435F_tERS,
                                                                    .tUNKNOWN = MX25Series_tUNKNOWN_TIMING},
+                                                        .typical = {.tPP = MX25R6435F_tPP_TYP,
+                                                                    .tSE = MX25R6435F_tSE_TYP,
+                                                                    .tBE32K = MX25R6435F_tBE32K_TYP,
+                                                                    .tBE64K = MX25R6435F_tBE64K_TYP,
+                                                                    .tCE = MX25R6435F_tCE_TYP,
+                                                                    .tWSR = MX25R6435F_tW_TYP},
                                                         .name = "MX25R6435F"};
 
 MX25Series_Chip_Info_t MX25R6435F_Chip_Def_High_Performance = {.manufacturer_id = MX25R6435F_MANUFACTURER_ID,
@@ -44,6 +53,7 @@ MX25Series_Chip_Info_t MX25R6435F_Chip_Def_High_Performance = {.manufacturer_id
                                                                .memory_density = MX25R6435F_MEMORY_DENSITY,
                                                                .memory_size = MX25R6435F_MEMORY_SIZE,
                                                                .page_size = MX25R6435F_PAGE_SIZE,
+                                                               .high_performance = true,
                                                                .timing = {.tBP = MX25R6435F_tBP_HP,
                                                                           .tPP = MX25R6435F_tPP_HP,
                                                                           .tSE = MX25R6435F_tSE_HP,
@@ -51,7 +61,15 @@ MX25Series_Chip_Info_t MX25R6435F_Chip_Def_High_Performance = {.manufacturer_id
                                                                           .tBE64K = MX25R6435F_tBE64K_HP,
                                                                           .tCE = MX25R6435F_tCE_HP,
                                                                           .tWSR = MX25R6435F_tW_HP,
+                                                                          .tSUS = MX25R6435F_tSUS,
+                                                                          .tERS = MX25R6435F_tERS,
                                                                           .tUNKNOWN = MX25Series_tUNKNOWN_TIMING},
+                                                               .typical = {.tPP = MX25R6435F_tPP_TYP,
+                                                                           .tSE = MX25R6435F_tSE_TYP,
+                                                                           .tBE32K = MX25R6435F_tBE32K_TYP,
+                                                                           .tBE64K = MX25R6435F_tBE64K_TYP,
+                                                                           .tCE = MX25R6435F_tCE_TYP,
+                                                                           .tWSR = MX25R6435F_tW_TYP},
                                                                .name = "MX25R6435F"};
 
 MX25Series_status_enum_t MX25Series_init(MX25Series_t *dev, MX25Series_Chip_Info_t *chip_def, uint8_t cs_pin,
@@ -113,8 +131,8 @@ MX25Series_status_enum_t MX25Series_read_electronic_signature(MX25Series_t *dev,
 
     MX25Series___enable_cs_pin(dev, true);
     result = MX25Series___issue_command(dev, MX25Series_Command_RES);
-    result |= MX25Series___read(dev, sizeof(result), &value);
-    *electronic_id = result;
+    result |= MX25Series___read(dev, sizeof(value), &value);
+    *electronic_id = value;
     MX25Series___enable_cs_pin(dev, false);
     return result;
 }
@@ -148,11 +166,13 @@ MX25Series_status_enum_t MX25Series_read_status_register(MX25Series_t *dev, uint
 MX25Series_status_enum_t MX25Series_read_configuration_register(MX25Series_t *dev, uint16_t *configuration_register)
 {
     MX25Series_status_enum_t result = MX25Series_status_init;
+    uint8_t value[2] = {0};
 
     MX25Series___enable_cs_pin(dev, true);
     result = MX25Series___issue_command(dev, MX25Series_Command_RDCR);
-    result |= MX25Series___read(dev, sizeof(*configuration_register), (uint8_t *) configuration_register);
+    result |= MX25Series___read(dev, sizeof(value), value);
     MX25Series___enable_cs_pin(dev, false);
+    *configuration_register = (uint16_t) ((value[0] << 8) | value[1]);
     return result;
 }
 
@@ -160,11 +180,11 @@ MX25Series_status_enum_t MX25Series_configure_chip(MX25Series_t *dev, uint8_t st
                                                    uint16_t configuration_register)
 {
     MX25Series_status_enum_t result = MX25Series_status_init;
+    uint8_t value[3] = {status_register, (uint8_t) (configuration_register >> 8), (uint8_t) configuration_register};
 
     MX25Series___enable_cs_pin(dev, true);
     result = MX25Series___issue_command(dev, MX25Series_Command_WRSR);
-    result |= MX25Series___write(dev, 1, &status_register);
-    result |= MX25Series___write(dev, 2, (uint8_t *) &configuration_register);
+    result |= MX25Series___write(dev, sizeof(value), value);
     MX25Series___enable_cs_pin(dev, false);
     return result;
 }
@@ -212,8 +232,32 @@ MX25Series_status_enum_t MX25Series_read_stored_data(MX25Series_t *dev, bool use
     return result;
 }
 
-MX25Series_status_enum_t MX25Series_write_stored_data(MX25Series_t *dev, uint32_t memory_address, size_t length,
-                                                      uint8_t *buffer)
+MX25Series_status_enum_t MX25Series_read_sfdp(MX25Series_t *dev, uint32_t sfdp_address, size_t length,
+                                              uint8_t *buffer)
+{
+    MX25Series_status_enum_t result = MX25Series_status_init;
+    uint8_t address[4] = {0};
+
+    address[0] = (sfdp_address & 0xFF0000) >> 16;
+    address[1] = (sfdp_address & 0xFF00) >> 8;
+    address[2] = (sfdp_address & 0xFF);
+    // Followed by 8 dummy cycles
+    address[3] = dev->transfer_dummy_byte;
+
+    MX25Series___enable_cs_pin(dev, true);
+    result = MX25Series___issue_command(dev, MX25Series_Command_RDSFDP);
+    result |= MX25Series___write(dev, sizeof(address), address);
+    result |= MX25Series___read(dev, length, buffer);
+    MX25Series___enable_cs_pin(dev, false);
+
+    return result;
+}
+
+/*
+ * Page Program command alone: the chip must be write enabled and the data must not cross a page boundary
+ */
+static MX25Series_status_enum_t MX25Series___page_program(MX25Series_t *dev, uint32_t memory_address, size_t length,
+                                                          uint8_t *buffer)
 {
     MX25Series_status_enum_t result = MX25Series_status_init;
     uint8_t address[3] = {0};
@@ -277,6 +321,141 @@ MX25Series_status_enum_t MX25Series_erase(MX25Series_t *dev, MX25Series_Erase_en
     return result;
 }
 
+MX25Series_status_enum_t MX25Series_write_enable_checked(MX25Series_t *dev)
+{
+    uint8_t status_register = 0;
+    MX25Series_status_enum_t result = MX25Series_set_write_enable(dev, true);
+    result |= MX25Series_read_status_register(dev, &status_register);
+    if (!MX25Series_HAS_ERROR(result) && (status_register & MX25Series_SR_WEL) == 0)
+    {
+        return MX25Series_status_error_write_disabled;
+    }
+    return result;
+}
+
+MX25Series_status_enum_t MX25Series_wait_ready(MX25Series_t *dev, uint32_t typical_us, uint32_t max_us)
+{
+    uint8_t status_register = MX25Series_SR_WIP;
+    uint32_t poll_us = typical_us / MX25Series_POLL_DIVIDER;
+    uint32_t elapsed_us;
+
+    if (poll_us < MX25Series_POLL_MIN_US)
+    {
+        poll_us = MX25Series_POLL_MIN_US;
+    }
+    // No bus traffic while the operation is not expected to end
+    elapsed_us = (typical_us < max_us) ? typical_us : max_us;
+    MX25Series___delay_micro_second(dev, elapsed_us);
+
+    // The bus time of the polls is not counted, the timeout is never shorter than max_us
+    for (;;)
+    {
+        if (MX25Series_HAS_ERROR(MX25Series_read_status_register(dev, &status_register)))
+        {
+            return MX25Series_status_error;
+        }
+        if ((status_register & MX25Series_SR_WIP) == 0)
+        {
+            return MX25Series_status_ok;
+        }
+        if (elapsed_us >= max_us)
+        {
+            return MX25Series_status_error_timeout;
+        }
+        MX25Series___delay_micro_second(dev, poll_us);
+        elapsed_us += poll_us;
+    }
+}
+
+MX25Series_status_enum_t MX25Series_program_start(MX25Series_t *dev, uint32_t memory_address, size_t length,
+                                                  uint8_t *buffer)
+{
+    uint32_t page_size = dev->chip_def->page_size;
+    // A page program wraps inside its page
+    if (length == 0 || (memory_address % page_size) + length > page_size)
+    {
+        return MX25Series_status_error;
+    }
+    MX25Series_status_enum_t result = MX25Series_write_enable_checked(dev);
+    if (MX25Series_HAS_ERROR(result))
+    {
+        return result;
+    }
+    return MX25Series___page_program(dev, memory_address, length, buffer);
+}
+
+MX25Series_status_enum_t MX25Series_program(MX25Series_t *dev, uint32_t memory_address, size_t length,
+                                            uint8_t *buffer)
+{
+    MX25Series_status_enum_t result = MX25Series_status_ok;
+    uint32_t page_size = dev->chip_def->page_size;
+
+    while (length > 0)
+    {
+        // Split at every page boundary
+        size_t chunk = page_size - (memory_address % page_size);
+        if (chunk > length)
+        {
+            chunk = length;
+        }
+
+        result = MX25Series_program_start(dev, memory_address, chunk, buffer);
+        if (MX25Series_HAS_ERROR(result))
+        {
+            return result;
+        }
+        // The program time grows with the number of bytes
+        result |= MX25Series_wait_ready(dev, (uint32_t) (dev->chip_def->typical.tPP * chunk / page_size),
+                                        dev->chip_def->timing.tPP);
+        if (MX25Series_HAS_ERROR(result))
+        {
+            return result;
+        }
+
+        uint8_t security_register = 0;
+        result = MX25Series_read_security_register(dev, &security_register);
+        if (!MX25Series_HAS_ERROR(result) && (security_register & MX25Series_SCUR_P_FAIL) != 0)
+        {
+            return MX25Series_status_error_program_failed;
+        }
+
+        memory_address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return result;
+}
+
+MX25Series_status_enum_t MX25Series_erase_and_wait(MX25Series_t *dev, MX25Series_Erase_enum_t erase_type,
+                                                   uint32_t memory_address)
+{
+    MX25Series_status_enum_t result = MX25Series_write_enable_checked(dev);
+    if (MX25Series_HAS_ERROR(result))
+    {
+        return result;
+    }
+    result = MX25Series_erase(dev, erase_type, memory_address);
+    if (result == MX25Series_status_init)
+    {
+        // Unknown erase type, nothing was sent
+        return MX25Series_status_error;
+    }
+    result |= MX25Series_wait_ready(dev, MX25Series_get_erasure_typical_time(dev, erase_type),
+                                    MX25Series_get_erasure_max_time(dev, erase_type));
+    if (MX25Series_HAS_ERROR(result))
+    {
+        return result;
+    }
+
+    uint8_t security_register = 0;
+    result = MX25Series_read_security_register(dev, &security_register);
+    if (!MX25Series_HAS_ERROR(result) && (security_register & MX25Series_SCUR_E_FAIL) != 0)
+    {
+        return MX25Series_status_error_erase_failed;
+    }
+    return result;
+}
+
 const char *MX25Series_get_erasure_size_string(MX25Series_Erase_enum_t size)
 {
     switch (size)
@@ -328,6 +507,102 @@ uint32_t MX25Series_get_erasure_max_time(MX25Series_t *dev, MX25Series_Erase_enu
     return dev->chip_def->timing.tUNKNOWN;
 }
 
+uint32_t MX25Series_get_erasure_typical_time(MX25Series_t *dev, MX25Series_Erase_enum_t erase_type)
+{
+    switch (erase_type)
+    {
+    case MX25Series_Erase_Block_4K:
+        return dev->chip_def->typical.tSE;
+    case MX25Series_Erase_Block_32K:
+        return dev->chip_def->typical.tBE32K;
+    case MX25Series_Erase_Block_64K:
+        return dev->chip_def->typical.tBE64K;
+    case MX25Series_Erase_Chip:
+        return dev->chip_def->typical.tCE;
+    case MX25Series_Erase_Undefined:
+    default:
+        return 0;
+    }
+}
+
+MX25Series_status_enum_t MX25Series_set_power_mode(MX25Series_t *dev, MX25Series_Chip_Info_t *chip_def)
+{
+    MX25Series_status_enum_t result = MX25Series_status_init;
+    uint8_t status_register = 0;
+    uint16_t configuration_register = 0;
+    uint32_t max_us;
+
+    if (dev->chip_def == NULL || chip_def == NULL)
+    {
+        return MX25Series_status_error_invalid_chip_def;
+    }
+    result = MX25Series_read_status_register(dev, &status_register);
+    result |= MX25Series_read_configuration_register(dev, &configuration_register);
+    if (MX25Series_HAS_ERROR(result))
+    {
+        return result;
+    }
+    if (((configuration_register & MX25Series_CR_LH) != 0) != chip_def->high_performance)
+    {
+        configuration_register ^= MX25Series_CR_LH;
+        result = MX25Series_write_enable_checked(dev);
+        if (MX25Series_HAS_ERROR(result))
+        {
+            return result;
+        }
+        result = MX25Series_configure_chip(dev, status_register & ~(MX25Series_SR_WIP | MX25Series_SR_WEL),
+                                           configuration_register);
+        // The write cycle runs in the outgoing mode
+        max_us = (dev->chip_def->timing.tWSR > chip_def->timing.tWSR) ? dev->chip_def->timing.tWSR
+                                                                        : chip_def->timing.tWSR;
+        result |= MX25Series_wait_ready(dev, dev->chip_def->typical.tWSR, max_us);
+        result |= MX25Series_read_configuration_register(dev, &configuration_register);
+        if (MX25Series_HAS_ERROR(result))
+        {
+            return result;
+        }
+        if (((configuration_register & MX25Series_CR_LH) != 0) != chip_def->high_performance)
+        {
+            return MX25Series_status_error_mode_switch;
+        }
+    }
+    dev->chip_def = chip_def;
+    return MX25Series_status_ok;
+}
+
+MX25Series_status_enum_t MX25Series_suspend(MX25Series_t *dev, bool *suspended)
+{
+    MX25Series_status_enum_t result = MX25Series_status_init;
+    uint8_t security_register = 0;
+
+    *suspended = false;
+    MX25Series___enable_cs_pin(dev, true);
+    result = MX25Series___issue_command(dev, MX25Series_Command_PGM_ERS_Suspend);
+    MX25Series___enable_cs_pin(dev, false);
+    result |= MX25Series_wait_ready(dev, 0, dev->chip_def->timing.tSUS);
+    result |= MX25Series_read_security_register(dev, &security_register);
+    if (!MX25Series_HAS_ERROR(result))
+    {
+        *suspended = (security_register & (MX25Series_SCUR_PSB | MX25Series_SCUR_ESB)) != 0;
+    }
+    return result;
+}
+
+MX25Series_status_enum_t MX25Series_resume(MX25Series_t *dev)
+{
+    uint8_t security_register = 0;
+    MX25Series_status_enum_t result = MX25Series_read_security_register(dev, &security_register);
+
+    MX25Series___enable_cs_pin(dev, true);
+    result |= MX25Series___issue_command(dev, MX25Series_Command_PGM_ERS_Resume);
+    MX25Series___enable_cs_pin(dev, false);
+    if (!MX25Series_HAS_ERROR(result) && (security_register & MX25Series_SCUR_ESB) != 0)
+    {
+        MX25Series___delay_micro_second(dev, dev->chip_def->timing.tERS);
+    }
+    return result;
+}
+
 MX25Series_status_enum_t MX25Series_read_security_register(MX25Series_t *dev, uint8_t *security_register)
 {
     MX25Series_status_enum_t result = MX25Series_status_init;
@@ -443,7 +718,27 @@ bool MX25Series___test_linker(MX25Series_t *dev)
     return true;
 }
 
+/*
+ * Whole milliseconds on the HAL tick, the rest on the SysTick down counter, which HAL_InitTick() reloads every
+ * millisecond.
+ */
 void MX25Series___delay_micro_second(MX25Series_t *dev, unsigned int us)
 {
     assert(dev != NULL);
+    if (us >= 1000)
+    {
+        HAL_Delay(us / 1000);
+        us %= 1000;
+    }
+
+    uint32_t reload = SysTick->LOAD + 1;
+    uint32_t remaining = (uint32_t) (((uint64_t) us * reload) / 1000);
+    uint32_t last = SysTick->VAL;
+    while (remaining > 0)
+    {
+        uint32_t now = SysTick->VAL;
+        uint32_t elapsed = (last >= now) ? (last - now) : (last + reload - now);
+        remaining = (elapsed >= remaining) ? 0 : (remaining - elapsed);
+        last = now;
+    }
 }
@@ -1,30 +1,108 @@
 #include "crc32.h"
 
-#include <stdio.h>
 #include <stdint.h>
-#include <stdlib.h>
+#include <string.h>
 
-/* Simple public domain implementation of the standard CRC32 checksum.
- * Outputs the checksum for each file given as a command line argument.
- * Invalid file names and files that cause errors are silently skipped.
- * The program reads from stdin if it is called with no arguments.
+/* Standard CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320).
  *
- * From http://home.thep.lu.se/~bjorn/crc/ */
+ * The lookup tables are generated on the host by Host/tools/crc32_table_gen.c
+ * and declared const, so they are placed in flash instead of being built in
+ * RAM on first use. The kernel is selected at compile time with CRC32_KERNEL,
+ * only the table rows used by that kernel are compiled in. */
 
-uint32_t crc32_for_byte(uint32_t r) {
-  for(int j = 0; j < 8; ++j)
-    r = (r & 1? 0: (uint32_t)0xEDB88320L) ^ r >> 1;
-  return r ^ (uint32_t)0xFF000000L;
+#if (CRC32_KERNEL == CRC32_KERNEL_NIBBLE)
+#define CRC32_TABLE_ROWS  (1)
+#elif (CRC32_KERNEL == CRC32_KERNEL_BYTE)
+#define CRC32_TABLE_ROWS  (1)
+#elif (CRC32_KERNEL == CRC32_KERNEL_SLICE4)
+#define CRC32_TABLE_ROWS  (4)
+#elif (CRC32_KERNEL == CRC32_KERNEL_SLICE8)
+#define CRC32_TABLE_ROWS  (8)
+#else
+#error "Unknown CRC32_KERNEL"
+#endif
+
+#include "crc32_table.h"
+
+#if (CRC32_KERNEL == CRC32_KERNEL_SLICE4) || (CRC32_KERNEL == CRC32_KERNEL_SLICE8)
+/* p must be 4 bytes aligned, Cortex-M0+ does not support unaligned word loads */
+static inline uint32_t crc32_load_le32(const uint8_t *p) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  uint32_t word;
+  memcpy(&word, __builtin_assume_aligned(p, 4), sizeof(word));
+  return word;
+#else
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+#endif
 }
+#endif
 
-uint32_t crc32(const void *data, uint32_t n_bytes) {
-  uint32_t crc = 0;
-  static uint32_t table[0x100];
-  if(!*table)
-    for(size_t i = 0; i < 0x100; ++i)
-      table[i] = crc32_for_byte(i);
-  for(size_t i = 0; i < n_bytes; ++i)
-    crc = table[(uint8_t)crc ^ ((uint8_t*)data)[i]] ^ crc >> 8;
+static inline uint32_t crc32_update_byte(uint32_t crc, uint8_t byte) {
+#if (CRC32_KERNEL == CRC32_KERNEL_NIBBLE)
+  crc = crc32_table[0][(crc ^ byte) & 0x0F] ^ (crc >> 4);
+  crc = crc32_table[0][(crc ^ (byte >> 4)) & 0x0F] ^ (crc >> 4);
+  return crc;
+#else
+  return crc32_table[0][(crc ^ byte) & 0xFF] ^ (crc >> 8);
+#endif
+}
+
+uint32_t crc32_init(void) {
+  return 0xFFFFFFFFUL;
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, uint32_t n_bytes) {
+  const uint8_t *p = (const uint8_t *)data;
+
+#if (CRC32_KERNEL == CRC32_KERNEL_SLICE4) || (CRC32_KERNEL == CRC32_KERNEL_SLICE8)
+  /* Byte-wise until the data pointer is word aligned */
+  while (n_bytes && ((uintptr_t)p & 3)) {
+    crc = crc32_update_byte(crc, *p++);
+    n_bytes--;
+  }
+#if (CRC32_KERNEL == CRC32_KERNEL_SLICE8)
+  for (; n_bytes >= 8; n_bytes -= 8, p += 8) {
+    uint32_t lo = crc ^ crc32_load_le32(p);
+    uint32_t hi = crc32_load_le32(p + 4);
+    crc = crc32_table[7][lo & 0xFF] ^ crc32_table[6][(lo >> 8) & 0xFF] ^
+          crc32_table[5][(lo >> 16) & 0xFF] ^ crc32_table[4][lo >> 24] ^
+          crc32_table[3][hi & 0xFF] ^ crc32_table[2][(hi >> 8) & 0xFF] ^
+          crc32_table[1][(hi >> 16) & 0xFF] ^ crc32_table[0][hi >> 24];
+  }
+#endif
+  for (; n_bytes >= 4; n_bytes -= 4, p += 4) {
+    crc ^= crc32_load_le32(p);
+    crc = crc32_table[3][crc & 0xFF] ^ crc32_table[2][(crc >> 8) & 0xFF] ^
+          crc32_table[1][(crc >> 16) & 0xFF] ^ crc32_table[0][crc >> 24];
+  }
+#endif
 
+  while (n_bytes--) {
+    crc = crc32_update_byte(crc, *p++);
+  }
   return crc;
 }
+
+uint32_t crc32_final(uint32_t crc) {
+  return crc ^ 0xFFFFFFFFUL;
+}
+
+uint32_t crc32(const void *data, uint32_t n_bytes) {
+  return crc32_final(crc32_update(crc32_init(), data, n_bytes));
+}
+
+const char *crc32_kernel_name(void) {
+#if (CRC32_KERNEL == CRC32_KERNEL_NIBBLE)
+  return "nibble";
+#elif (CRC32_KERNEL == CRC32_KERNEL_BYTE)
+  return "byte";
+#elif (CRC32_KERNEL == CRC32_KERNEL_SLICE4)
+  return "slice4";
+#else
+  return "slice8";
+#endif
+}
+
+uint32_t crc32_kernel_table_size(void) {
+  return sizeof(crc32_table);
+}
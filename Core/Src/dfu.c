@@ -14,6 +14,7 @@
 /******************************************************************************
  * Includes
  *******************************************************************************/
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -21,28 +22,105 @@
 
 #include "dfu.h"
 #include "crc32.h"
-#include "n25q128a.h"
+#include "erase_plan.h"
+#include "image_pack.h"
+#include "lz_stream.h"
 
 /******************************************************************************
  * Module Preprocessor Constants
  *******************************************************************************/
+#define DFU_DIR_ENTRY_MAGIC             (0xD1EC7081)
+#define DFU_DIR_ENTRY_ADD               (0x00000001) // Image stored at header.img_data_start_addr
+#define DFU_DIR_ENTRY_REMOVE            (0x00000000) // Image at header.img_data_start_addr removed
+#define DFU_BLOCK_TABLE_MAX_BLOCKS      ((DFU_BLOCK_TABLE_SIZE - sizeof(dfu_block_table_t)) / sizeof(uint32_t))
+#define DFU_BLOCK_READ_ENTRIES          (16) // Block CRCs read at once by the block check
+#define DFU_JOURNAL_ENTRY_SIZE          (1024) // Record and bitmaps of one update
+#define DFU_JOURNAL_BITMAP_OFFSET       (64) // Bitmaps after the record, from the start of the entry
+#define DFU_JOURNAL_BITMAP_SIZE         ((DFU_JOURNAL_ENTRY_SIZE - DFU_JOURNAL_BITMAP_OFFSET) / 2)
+#define DFU_JOURNAL_MARK_BYTES          (8) // Bitmap bytes programmed at once
 
 /******************************************************************************
  * Module Preprocessor Macros
  *******************************************************************************/
+#define DFU_JOURNAL_ERASED_ADDR(entry)      ((entry) + DFU_JOURNAL_BITMAP_OFFSET) // Bitmap of the erased units
+#define DFU_JOURNAL_PROGRAMMED_ADDR(entry)  ((entry) + DFU_JOURNAL_BITMAP_OFFSET + DFU_JOURNAL_BITMAP_SIZE)
 
 /******************************************************************************
 * Module Typedefs
 
 *******************************************************************************/
+/* Directory record, appended to the directory sector, the latest record of an address wins */
+typedef struct __attribute__((packed))
+{
+    uint32_t entry_magic;       // DFU_DIR_ENTRY_MAGIC, erased value marks the end of the directory
+    image_header_t header;
+    uint32_t entry_op;          // DFU_DIR_ENTRY_ADD or DFU_DIR_ENTRY_REMOVE
+} dfu_dir_entry_t;
+
+/* Journal record, at the start of a journal entry. The bitmaps that follow have one bit per smallest erase unit of
+   the image area, cleared once the unit is erased, then once it is programmed. */
+typedef struct __attribute__((packed))
+{
+    uint32_t journal_magic;     // DFU_JOURNAL_MAGIC, 0 once the update is over
+    image_header_t header;      // Image being written, CRC 0 if it is only known at the end
+    uint32_t hdr_addr;
+    uint32_t unit_size;
+    uint32_t record_crc;        // crc32() of the fields above
+} dfu_journal_record_t;
+
+/* Pulls the next len bytes of the data to program, at most one flash page, NULL on error */
+typedef const uint8_t *(*dfu_source_t)(void *arg, uint32_t len);
+
+#if (DFU_COMPRESSED_IMAGE != 0)
+/* State of dfu_source_payload() */
+typedef struct
+{
+    const uint8_t *in;          // Payload left to decode
+    uint32_t in_len;
+    bool started;               // Decoder set up, on the first pull once the image area is erased
+} dfu_payload_source_t;
+#endif
 
 /******************************************************************************
  * Module Variable Definitions
  *******************************************************************************/
+/* Shared window for streaming image data, keeps RAM usage independent of the image size */
+static uint8_t dfu_stream_buf[DFU_STREAM_CHUNK_SIZE];
+/* Verification level of dfu_storage_write() */
+static dfu_verify_t dfu_write_verify = (dfu_verify_t) DFU_WRITE_VERIFY;
+#if (DFU_STORAGE_SPI_STM32 == 1) || (DFU_COMPRESSED_IMAGE != 0)
+/* RAM of the erase keep buffer and of the decoder, a compressed image is only decoded once its area is erased */
+static union
+{
+#if (DFU_STORAGE_SPI_STM32 == 1)
+    uint8_t erase_keep[DFU_ERASE_KEEP_BUF_SIZE]; // Bytes of a partially erased unit that are outside the range
+#endif
+#if (DFU_COMPRESSED_IMAGE != 0)
+    lz_stream_t lz;             // Decoder of compressed images, shared by the blocking and non-blocking updates
+#endif
+} dfu_work;
+#endif
+#if (DFU_BLOCK_CRC != 0)
+/* Block CRCs not programmed yet, mirrors the flash page of the block table being filled */
+static uint8_t dfu_block_page[FLASH_N25_MAX_WRITE_SIZE];
+#endif
 
 /******************************************************************************
  * Function Prototypes
  *******************************************************************************/
+static const uint8_t *dfu_source_memory(void *arg, uint32_t len);
+static image_header_t dfu_fw_image_header(uint32_t fw_len, uint32_t addr);
+static int dfu_image_commit_blocks(image_header_t *img_header_data, uint32_t hdr_addr, uint32_t table_addr,
+                                   const dfu_block_crcs_t *p_src);
+#if (DFU_STORAGE_SPI_STM32 == 1)
+static int dfu_storage_erase_planned(const erase_plan_geometry_t *geo, int (*erase_block)(uint8_t id, uint32_t addr),
+                                     uint32_t addr, uint32_t len);
+static int dfu_storage_crc32(uint32_t addr, uint32_t len, uint32_t *p_crc);
+#if (DFU_ERASE_BLANK_CHECK != 0)
+static int dfu_storage_compare(uint32_t addr, const uint8_t *p_data, uint32_t len);
+static void dfu_blank_known_drop(uint32_t addr, uint32_t len);
+#endif
+#endif
 
 /******************************************************************************
  * Function Definitions
@@ -195,89 +273,252 @@ int dfu_init(const struct device *storage_dev)
     return 0;
 }
 
-#elif (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_SPI_MX25 == 1)
-#include "MX25Series.h"
-extern MX25Series_t flash_test;
+#elif (DFU_STORAGE_SPI_STM32 == 1)
+
+#include "main.h"
+#include "dfu_storage.h"
+
+/* Probe the storage on first use if dfu_init() was not called */
+#define IS_STORAGE_BACKEND_RDY()                                        \
+    if (dfu_storage_backend() == NULL && dfu_storage_probe() != 0)      \
+    {                                                                   \
+        return -1;                                                      \
+    }
+
+/* Address of the next dfu_storage_read_next() of backends without a continuous read */
+static uint32_t dfu_storage_read_addr;
+
+int flash_get_erase_value()
+{
+    const dfu_storage_geometry_t *geo = dfu_storage_geometry();
+    return (geo != NULL) ? geo->erase_value : 0xFF;
+}
+
 int dfu_storage_read(uint32_t addr, uint8_t *data, uint32_t len)
 {
-    if (MX25Series_read_stored_data(&flash_test, true, addr, len, data) != MX25Series_status_ok)
+    IS_STORAGE_BACKEND_RDY();
+    if (dfu_storage_backend()->read(addr, data, len) != 0)
     {
-        LOG_ERR("Failed to read storage\r\n");
+        LOG_ERR("Failed to read %dB storage at address: 0X%X\r\n", len, addr);
         return -1;
     }
     return 0;
 }
-#elif (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_SPI_N25Q == 1)
 
-#include "n25q128a.h"
-int dfu_storage_read(uint32_t addr, uint8_t *data, uint32_t len)
+/*
+ * @brief continuous read: one read command at addr, dfu_storage_read_next() streams the following bytes until
+ *        dfu_storage_read_end(). No other storage access is allowed in between.
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_storage_read_begin(uint32_t addr)
 {
-    N25Q_ReadDataFromAddress(data, addr, len);
-    return 0;
+    IS_STORAGE_BACKEND_RDY();
+    dfu_storage_read_addr = addr;
+    return (dfu_storage_backend()->read_begin != NULL) ? dfu_storage_backend()->read_begin(addr) : 0;
 }
 
-int dfu_storage_erase(uint32_t addr, uint32_t len)
+static int dfu_storage_read_next(uint8_t *data, uint32_t len)
 {
-    // Calculate number of sectors to erase
-    uint32_t num_sector = ceil((float) len / N25Q128A_SECTOR_SIZE);
-    // Erase sectors
-    for (uint32_t i = 0; i < num_sector; i++)
+    const dfu_storage_ops_t *ops = dfu_storage_backend();
+    if (ops->read_next != NULL)
     {
-        N25Q_SectorErase(addr + i * N25Q128A_SECTOR_SIZE);
+        return ops->read_next(data, len);
     }
-    return 0;
+    int result = ops->read(dfu_storage_read_addr, data, len);
+    dfu_storage_read_addr += len;
+    return result;
 }
 
-int dfu_storage_write(uint32_t addr, uint8_t *data, uint32_t len) {
-    uint32_t remaining_len = len;
-    uint32_t current_addr = addr;
-    int result = 0;
+static void dfu_storage_read_end(void)
+{
+    if (dfu_storage_backend()->read_end != NULL)
+    {
+        dfu_storage_backend()->read_end();
+    }
+}
 
-    while (remaining_len > 0) {
-        uint32_t write_len = (remaining_len > FLASH_N25_MAX_WRITE_SIZE) ? FLASH_N25_MAX_WRITE_SIZE : remaining_len;
-        uint32_t page_start_addr = current_addr & ~(FLASH_N25_MAX_WRITE_SIZE - 1);
+/*
+ * @brief erase one block of the given erase type id and wait for it
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_storage_erase_block(uint8_t id, uint32_t addr)
+{
+    if (dfu_storage_backend()->erase_start(id, addr) != 0)
+    {
+        return -1;
+    }
+    return (dfu_storage_wait(dfu_storage_erase_max_ms(id) + 1) == DFU_STORAGE_READY) ? 0 : -1;
+}
 
-        // Check if the write operation crosses a page boundary
-        if ((current_addr + write_len) > (page_start_addr + FLASH_N25_MAX_WRITE_SIZE))
-        {
-            // Write the data in two parts to avoid crossing the page boundary
-            uint32_t first_part_len = FLASH_N25_MAX_WRITE_SIZE - (current_addr - page_start_addr);
-            uint32_t second_part_len = write_len - first_part_len;
+int dfu_storage_erase(uint32_t addr, uint32_t len)
+{
+    IS_STORAGE_BACKEND_RDY();
+    return dfu_storage_erase_planned(&dfu_storage_geometry()->plan, dfu_storage_erase_block, addr, len);
+}
 
-            // Write the first part
-            N25Q_ProgramFromAddress(data, current_addr, first_part_len);
+/*
+ * @brief wait for the page in flight and check the program error flags
+ * @return int 0 on success, DFU_STORAGE_ERROR or DFU_STORAGE_TIMEOUT otherwise
+ */
+static int dfu_storage_wait_page(uint32_t addr)
+{
+    int status = dfu_storage_wait(dfu_storage_geometry()->program_max_ms + 1);
+    if (status != DFU_STORAGE_READY)
+    {
+        LOG_ERR("Failed to program page at address: 0X%X, status: %d", addr, status);
+    }
+    return status;
+}
 
-            if (result != 0) {
-                return result;
-            }
+/*
+ * @brief end a failed write with a page still in flight: the page is waited for, so that the next command does not
+ *        find the device busy
+ * @return int status of the page if it failed too (DFU_STORAGE_ERROR or DFU_STORAGE_TIMEOUT), -1 otherwise
+ */
+static int dfu_storage_write_abort(uint32_t addr)
+{
+    int status = dfu_storage_wait_page(addr);
+    return (status != DFU_STORAGE_READY) ? status : -1;
+}
 
-            // Write the second part
-            N25Q_ProgramFromAddress(data + first_part_len, page_start_addr + FLASH_N25_MAX_WRITE_SIZE, second_part_len);
+/*
+ * @brief program and verify data pulled page by page from source, pipelined per page: while page N+1 is programming
+ *        page N+2 is staged and the readback of page N is compared. The array cannot be read while it is
+ *        programming, so the readback of page N is done between the end of page N and the start of page N+1.
+ *        Pages are compared against their staged copy, so the source may reuse its buffer for every page.
+ *        The pages read back depend on dfu_write_verify, DFU_VERIFY_CRC reads the whole range once at the end.
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_storage_write_from(uint32_t addr, uint32_t len, dfu_source_t source, void *arg)
+{
+    uint8_t read_data[FLASH_N25_MAX_WRITE_SIZE];
+    uint32_t start_addr = addr;
+    uint32_t total_len = len;
+    uint32_t crc = crc32_init();
+    uint32_t prev_addr = 0;
+    uint32_t prev_len = 0;
+    const uint8_t *prev_data = NULL;
+    bool prev_readback = false;
 
-            if (result != 0) {
-                return result;
+    IS_STORAGE_BACKEND_RDY();
+#if (DFU_ERASE_BLANK_CHECK != 0)
+    dfu_blank_known_drop(addr, len);
+#endif
+    const dfu_storage_ops_t *ops = dfu_storage_backend();
+    uint32_t page_size = dfu_storage_geometry()->page_size;
+    while (len > 0 || prev_len > 0)
+    {
+        // Stage the next page while the previous one is programming
+        uint32_t page_len = 0;
+        bool readback = false;
+        const uint8_t *data = NULL;
+        if (len > 0)
+        {
+            page_len = page_size - (addr & (page_size - 1));
+            page_len = (page_len > len) ? len : page_len;
+            data = source(arg, page_len);
+        }
+        if (data == NULL && page_len > 0)
+        {
+            return (prev_len > 0) ? dfu_storage_write_abort(prev_addr) : -1;
+        }
+        if (page_len > 0)
+        {
+            data = ops->program_stage(addr, data, page_len);
+            readback = (dfu_write_verify == DFU_VERIFY_FULL) ||
+                       (dfu_write_verify == DFU_VERIFY_SAMPLED && ((addr / page_size) % DFU_VERIFY_SAMPLE_PAGES) == 0);
+            if (dfu_write_verify == DFU_VERIFY_CRC)
+            {
+                DFU_PHASE_ENTER(DFU_PHASE_VERIFY);
+                crc = crc32_update(crc, data, page_len);
+                DFU_PHASE_EXIT(DFU_PHASE_VERIFY);
             }
         }
-        else
+
+        // End of the previous page and its readback
+        if (prev_len > 0)
         {
-            // Write the data in a single operation
-            N25Q_ProgramFromAddress(data, current_addr, write_len);
+            if (dfu_storage_wait_page(prev_addr) != 0)
+            {
+                return -1;
+            }
+            if (prev_readback)
+            {
+                DFU_PHASE_ENTER(DFU_PHASE_VERIFY);
+                int read_result = ops->read(prev_addr, read_data, prev_len);
+                DFU_PHASE_EXIT(DFU_PHASE_VERIFY);
+                if (read_result != 0)
+                {
+                    return -1;
+                }
+            }
+        }
+
+        if (page_len > 0 && ops->program_start() != 0)
+        {
+            LOG_ERR("Failed to start programming at address: 0X%X", addr);
+            return -1;
+        }
 
-            if (result != 0) {
-                return result;
+        // Compare the previous page while the next one is programming
+        if (prev_len > 0 && prev_readback)
+        {
+            DFU_PHASE_ENTER(DFU_PHASE_VERIFY);
+            int verify_result = memcmp(prev_data, read_data, prev_len);
+            DFU_PHASE_EXIT(DFU_PHASE_VERIFY);
+            if (verify_result != 0)
+            {
+                LOG_ERR("Failed to write %dB storage at address: 0X%X", prev_len, prev_addr);
+                return (page_len > 0) ? dfu_storage_write_abort(addr) : -1;
             }
         }
-        // Readback and verify
-        uint8_t read_data[FLASH_N25_MAX_WRITE_SIZE];
-        N25Q_ReadDataFromAddress(read_data, current_addr, write_len);
-        if (memcmp(data, read_data, write_len) != 0)
+
+        prev_addr = addr;
+        prev_len = page_len;
+        prev_data = data;
+        prev_readback = readback;
+        addr += page_len;
+        len -= page_len;
+    }
+
+    if (dfu_write_verify == DFU_VERIFY_CRC && total_len > 0)
+    {
+        uint32_t crc_storage = 0;
+        DFU_PHASE_ENTER(DFU_PHASE_VERIFY);
+        int result = dfu_storage_crc32(start_addr, total_len, &crc_storage);
+        DFU_PHASE_EXIT(DFU_PHASE_VERIFY);
+        if (result != 0 || crc_storage != crc32_final(crc))
         {
-            LOG_ERR("Failed to write %dB storage at address: 0X%X", write_len, current_addr);
+            LOG_ERR("Failed to write %dB storage at address: 0X%X, CRC mismatch", total_len, start_addr);
             return -1;
         }
-        remaining_len -= write_len;
-        current_addr += write_len;
-        data += write_len;
+    }
+    return 0;
+}
+
+/*
+ * @brief program and verify data, see dfu_storage_write_from()
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_storage_write(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    const uint8_t *p_src = data;
+    return dfu_storage_write_from(addr, len, dfu_source_memory, &p_src);
+}
+
+/*
+ * @brief init the DFU module, selects the storage backend matching the JEDEC ID of the flash. The MX25 device must be
+ *        attached with dfu_storage_mx25_attach() beforehand to be probed.
+ * @param storage_dev: unused, the backends use their own drivers
+ * @return 0 on success, negative value otherwise
+ */
+int dfu_init(const struct device *storage_dev)
+{
+    (void) storage_dev;
+    if (dfu_storage_probe() != 0)
+    {
+        LOG_ERR("Failed to init DFU flash storage\r\n");
+        return -1;
     }
     return 0;
 }
@@ -288,279 +529,3124 @@ int dfu_storage_write(uint32_t addr, uint8_t *data, uint32_t len) {
 /******************************************************************************
  * DFU Functions
  *******************************************************************************/
+#if !(DFU_STORAGE_SPI_STM32 == 1)
+/* Backends without a continuous read: one read per chunk */
+static uint32_t dfu_storage_read_addr;
+
+static int dfu_storage_read_begin(uint32_t addr)
+{
+    dfu_storage_read_addr = addr;
+    return 0;
+}
+
+static int dfu_storage_read_next(uint8_t *data, uint32_t len)
+{
+    int result = dfu_storage_read(dfu_storage_read_addr, data, len);
+    dfu_storage_read_addr += len;
+    return result;
+}
+
+static void dfu_storage_read_end(void)
+{
+}
+
+/* Backends without a page pipeline: the source is written page by page */
+static int dfu_storage_write_from(uint32_t addr, uint32_t len, dfu_source_t source, void *arg)
+{
+    while (len > 0)
+    {
+        uint32_t page_len = FLASH_N25_MAX_WRITE_SIZE - (addr & (FLASH_N25_MAX_WRITE_SIZE - 1));
+        page_len = (page_len > len) ? len : page_len;
+        const uint8_t *data = source(arg, page_len);
+        if (data == NULL || dfu_storage_write(addr, (uint8_t *) data, page_len) != 0)
+        {
+            return -1;
+        }
+        addr += page_len;
+        len -= page_len;
+    }
+    return 0;
+}
+#endif
 
 /*
- * @brief read image header at the given address
- * @param img_start_addr: start address of the image header
- * @param[out] img_header_data: pointer to store read image header
- * @return int 0 on success, negative value otherwise
+ * @brief dfu_source_t of data in memory, arg points to the data pointer
  */
-int dfu_image_read_header(uint32_t img_start_addr, image_header_t *img_header_data)
+static const uint8_t *dfu_source_memory(void *arg, uint32_t len)
 {
-    assert(img_header_data != NULL);
-    // Read image header
-    if (0 != dfu_storage_read(img_start_addr, (uint8_t *) img_header_data, sizeof(image_header_t)))
+    const uint8_t **p_data = (const uint8_t **) arg;
+    const uint8_t *data = *p_data;
+    *p_data += len;
+    return data;
+}
+
+#if (DFU_COMPRESSED_IMAGE != 0)
+/*
+ * @brief dfu_source_t of a compressed payload, decodes the next page into dfu_stream_buf
+ */
+static const uint8_t *dfu_source_payload(void *arg, uint32_t len)
+{
+    dfu_payload_source_t *src = (dfu_payload_source_t *) arg;
+    uint32_t consumed = 0;
+    if (!src->started)
     {
-        LOG_ERR("Failed to read image header\r\n");
-        return -1;
+        lz_stream_init(&dfu_work.lz);
+        src->started = true;
     }
-    return 0;
+    int decoded = lz_stream_decode(&dfu_work.lz, src->in, src->in_len, &consumed, dfu_stream_buf, len);
+    src->in += consumed;
+    src->in_len -= consumed;
+    if (decoded != (int) len)
+    {
+        LOG_ERR("Compressed image is corrupted\r\n");
+        return NULL;
+    }
+    return dfu_stream_buf;
 }
+#endif /* End of (DFU_COMPRESSED_IMAGE != 0) */
 
 /*
- * @brief: This function is used to validate the image data by compare CRC value in the header and the calculated CRC
- * value
- * @param img_start_addr
- * @return int 0 if the image data is valid, negative value otherwise
+ * @brief select how the pages written to storage are verified, e.g. DFU_VERIFY_FSR on production lines where the
+ *        image is checked afterwards and DFU_VERIFY_FULL for field updates
  */
-int dfu_image_validate_data_content(uint32_t img_start_addr)
+void dfu_set_write_verify(dfu_verify_t level)
 {
-    // Read image header
-    image_header_t image_header = {0};
-    if (dfu_image_read_header(img_start_addr, &image_header) != 0)
+    dfu_write_verify = level;
+}
+
+dfu_verify_t dfu_get_write_verify(void)
+{
+    return dfu_write_verify;
+}
+
+#if (DFU_STORAGE_SPI_STM32 == 1)
+#if (DFU_ERASE_BLANK_CHECK != 0)
+/* Blank check of the current update: bytes not erased, planned erase time without blank check and time spent */
+static uint32_t dfu_blank_skipped;
+static uint32_t dfu_blank_planned_ms;
+static uint32_t dfu_blank_erase_ms;
+/* Whole units known to be blank without reading them, left by the pre-erase. Programming there shortens the range */
+static uint32_t dfu_blank_known_start;
+static uint32_t dfu_blank_known_end;
+/* Updates started, the blank check is reset by each of them */
+static uint32_t dfu_blank_update_count;
+#endif
+
+/*
+ * @brief read one smallest erase unit into the keep buffer before erasing [start, end) inside it
+ * @param unit_addr: start address of the unit
+ * @return int 1 if the unit must be erased, 0 if the range is already erased, negative value otherwise
+ */
+static int dfu_storage_erase_partial_keep(const erase_plan_geometry_t *geo, uint32_t unit_addr, uint32_t start,
+                                          uint32_t end)
+{
+    uint32_t unit_size = geo->types[0].size;
+    uint8_t erase_value = (uint8_t) flash_get_erase_value();
+    if (unit_size > sizeof(dfu_work.erase_keep))
     {
-        LOG_ERR("Failed to read image header\r\n");
+        LOG_ERR("Erase unit %dB larger than the keep buffer\r\n", unit_size);
         return -1;
     }
-
-    // Calculate CRC of the image inside the storage
-    uint32_t crc = 0;
-    uint8_t read_data_buf[image_header.img_data_size];
-    memset(read_data_buf, 0, image_header.img_data_size);
-    if (dfu_storage_read(image_header.img_data_start_addr, read_data_buf, image_header.img_data_size) != 0)
+    if (dfu_storage_read(unit_addr, dfu_work.erase_keep, unit_size) != 0)
     {
-        LOG_ERR("Failed to read %dB image data at address: 0X%X\r\n", image_header.img_data_size,
-                image_header.img_data_start_addr);
         return -1;
     }
-    crc = crc32(read_data_buf, image_header.img_data_size);
 
-    if (crc != image_header.image_data_crc)
+    // Nothing to do if the range is already erased
+    uint32_t i = start - unit_addr;
+    while (i < end - unit_addr && dfu_work.erase_keep[i] == erase_value)
     {
-        LOG_ERR("Image data CRC is invalid: %x instead of %x\r\n", crc, image_header.image_data_crc);
-        return -1;
+        i++;
     }
-    LOG_INF("Found valid image\r\n");
-    return 0;
+    return (i == end - unit_addr) ? 0 : 1;
 }
 
 /*
- * @brief: Clear the image header to default erase value
- * @param img_start_addr 
- * @return int: 0 if the image header is cleared, negative value otherwise
- 
+ * @brief program back the bytes of the erased unit outside [start, end), from the keep buffer
+ * @return int 0 on success, negative value otherwise
  */
-int dfu_image_clear(uint32_t img_start_addr)
+static int dfu_storage_erase_partial_restore(const erase_plan_geometry_t *geo, uint32_t unit_addr, uint32_t start,
+                                             uint32_t end)
 {
-    uint8_t header_len = sizeof(image_header_t);
-    uint8_t header_buf[header_len];
-    memset(header_buf, flash_get_erase_value(), header_len);
-    // Erase the image header
-    if (0 != dfu_storage_write(img_start_addr, header_buf, header_len))
+    uint32_t unit_size = geo->types[0].size;
+    uint8_t erase_value = (uint8_t) flash_get_erase_value();
+    uint32_t keep_ranges[2][2] = {{unit_addr, start}, {end, unit_addr + unit_size}};
+    for (uint8_t r = 0; r < 2; r++)
     {
-        LOG_ERR("Failed to clear image header at address: 0X%X\r\n", img_start_addr);
-        return -1;
+        uint32_t keep_start = keep_ranges[r][0];
+        uint32_t keep_end = keep_ranges[r][1];
+        // Skip the erased bytes at both ends of the kept area
+        while (keep_start < keep_end && dfu_work.erase_keep[keep_start - unit_addr] == erase_value)
+        {
+            keep_start++;
+        }
+        while (keep_end > keep_start && dfu_work.erase_keep[keep_end - 1 - unit_addr] == erase_value)
+        {
+            keep_end--;
+        }
+        if (keep_end > keep_start &&
+            dfu_storage_write(keep_start, &dfu_work.erase_keep[keep_start - unit_addr], keep_end - keep_start) != 0)
+        {
+            LOG_ERR("Failed to restore %dB at address: 0X%X\r\n", keep_end - keep_start, keep_start);
+            return -1;
+        }
     }
     return 0;
 }
 
-/**
- * @brief: Commit image header, write header to storage at given address after validating image data
- * @param img_header_data: pointer to image header data
- * @param dest_img_addr: destination address to write image header
- * @return int: 0 if the image header is committed, negative value otherwise
+/*
+ * @brief erase [start, end) inside one smallest erase unit, keeping the rest of the unit
+ * @param unit_addr: start address of the unit
+ * @return int 0 on success, negative value otherwise
  */
-int dfu_image_commit(image_header_t *img_header_data, uint32_t hdr_addr)
+static int dfu_storage_erase_partial(const erase_plan_geometry_t *geo, int (*erase_block)(uint8_t id, uint32_t addr),
+                                     uint32_t unit_addr, uint32_t start, uint32_t end)
 {
-    assert(img_header_data != NULL);
-    uint8_t read_data_buf[img_header_data->img_data_size];
-    memset(read_data_buf, 0, sizeof(read_data_buf));
-    // Calculate CRC of the image inside the storage
-    if (dfu_storage_read(img_header_data->img_data_start_addr, read_data_buf, img_header_data->img_data_size) != 0)
+    int result = dfu_storage_erase_partial_keep(geo, unit_addr, start, end);
+    if (result <= 0)
     {
-        LOG_ERR("dfu_image_commit() failed to read %dB image data at address: 0X%X\r\n", img_header_data->img_data_size,
-                img_header_data->img_data_start_addr);
-        return -1;
+        return result;
     }
-    uint32_t crc_storage = crc32(read_data_buf, img_header_data->img_data_size);
-    // Check CRC
-    if (img_header_data->image_data_crc != crc_storage)
+    if (erase_block(geo->types[0].id, unit_addr) != 0)
     {
-        LOG_ERR("dfu_image_commit() Image data CRC is invalid: %x instead of %x\r\n", img_header_data->image_data_crc,
-                crc_storage);
         return -1;
     }
+    // Restore what was programmed before and after the range
+    return dfu_storage_erase_partial_restore(geo, unit_addr, start, end);
+}
+
+#if (DFU_ERASE_BLANK_CHECK != 0)
+static void dfu_blank_check_reset(void)
+{
+    dfu_blank_skipped = 0;
+    dfu_blank_planned_ms = 0;
+    dfu_blank_erase_ms = 0;
+    dfu_blank_update_count++;
+}
 
-    // Write image header
-    if (0 != dfu_storage_write(hdr_addr, (uint8_t *) img_header_data, sizeof(image_header_t)))
+static void dfu_blank_check_report(void)
+{
+    if (dfu_blank_skipped > 0)
     {
-        LOG_ERR(" dfu_image_commit() Failed to write image header at address: 0X%X\r\n", hdr_addr);
-        return -1;
+        LOG_INF("Blank check: %dKB already erased, %d ms of erase saved\r\n", dfu_blank_skipped / 1024,
+                (dfu_blank_planned_ms > dfu_blank_erase_ms) ? dfu_blank_planned_ms - dfu_blank_erase_ms : 0);
     }
-    return 0;
 }
 
-/**
- * @brief: Update image at given address with new image data
- * @param img_meta_data: pointer to new image header data
- * @param p_data: pointer to new image data
- * @param data_len: length of new image data
- * @param dest_img_addr: destination address to write new image
- * @return int: 0 if the image is updated, negative value otherwise
+/*
+ * @brief expected time to erase the units fully inside [addr, end), without blank check
  */
-int dfu_image_update(image_header_t *img_meta_data, uint8_t *p_data, uint32_t data_len, uint32_t dest_img_addr)
+static uint32_t dfu_blank_check_plan_ms(const erase_plan_geometry_t *geo, uint32_t addr, uint32_t end)
 {
-    assert(img_meta_data != NULL);
-
-    // Prepare storage for new image
-    uint32_t img_total_size = data_len + sizeof(image_header_t);
+    uint32_t unit_size = geo->types[0].size;
+    addr = (addr + unit_size - 1) & ~(unit_size - 1);
+    end &= ~(unit_size - 1);
+    return (end > addr) ? erase_plan_cost_ms(geo, addr, end) : 0;
+}
 
-    // Erase the image area
-    if (0 != dfu_storage_erase(dest_img_addr, img_total_size))
+#if (DFU_PREERASE != 0) || (DFU_JOURNAL != 0)
+/*
+ * @brief record the units of [start, end) as blank, merged with the known range when they touch
+ */
+static void dfu_blank_known_add(uint32_t start, uint32_t end)
+{
+    if (dfu_blank_known_end > dfu_blank_known_start && start <= dfu_blank_known_end && end >= dfu_blank_known_start)
     {
-        LOG_ERR("Failed to erase %dB image area at address: 0X%X\r\n", img_total_size, dest_img_addr);
-        return -1;
+        start = (start < dfu_blank_known_start) ? start : dfu_blank_known_start;
+        end = (end > dfu_blank_known_end) ? end : dfu_blank_known_end;
     }
+    dfu_blank_known_start = start;
+    dfu_blank_known_end = end;
+}
+#endif
 
-    // Write image content
-    if (0 != dfu_storage_write(dest_img_addr, p_data, data_len))
+/*
+ * @brief before [addr, addr + len) is programmed, cut the known range at the unit holding addr
+ */
+static void dfu_blank_known_drop(uint32_t addr, uint32_t len)
+{
+    if (len > 0 && addr < dfu_blank_known_end && addr + len > dfu_blank_known_start)
     {
-        LOG_ERR("Failed to write %dB image data at address: 0X%X\r\n", data_len, dest_img_addr);
-        return -1;
+        uint32_t unit_addr = addr & ~(dfu_storage_geometry()->erase[0].size - 1);
+        dfu_blank_known_end = (unit_addr > dfu_blank_known_start) ? unit_addr : dfu_blank_known_start;
     }
+}
 
-    // Update image header based on new image data
-    img_meta_data->img_data_size = data_len;
-    img_meta_data->img_data_start_addr = dest_img_addr;
-    // Calcuate CRC of new image data
-    uint32_t crc_new_data = crc32(p_data, data_len);
-    img_meta_data->image_data_crc = crc_new_data;
-
-    // Commit image
-    if (0 != dfu_image_commit(img_meta_data, dest_img_addr + data_len))
+/*
+ * @brief end of the units from addr known to be blank, at most end. addr if the unit at addr is not known.
+ */
+static uint32_t dfu_blank_known_skip(uint32_t addr, uint32_t end)
+{
+    if (addr < dfu_blank_known_start || addr >= dfu_blank_known_end)
     {
-        LOG_ERR("Failed to commit image\r\n");
-        return -1;
+        return addr;
     }
-    return 0;
+    return (dfu_blank_known_end < end) ? dfu_blank_known_end : end;
 }
 
 /*
- * @brief: Check if the image at the given address is valid by comparing header values
- *         with image default value (default_image_header)
- * @param addr: address of the image header
- * @return int: 0 if the image is valid, negative value otherwise 
+ * @brief end of the run of units to erase that starts with the unit at addr, which is not blank. The run stops at
+ *        the first blank unit, at end or at a boundary of the largest erase size, which no planned erase crosses.
+ *        A unit that is not blank usually shows it in its first bytes, only the blank one ending the run is read
+ *        completely.
+ * @return int 0 on success, negative value otherwise
  */
-int dfu_image_is_valid(uint32_t addr)
+static int dfu_storage_erase_run_end(const erase_plan_geometry_t *geo, uint32_t addr, uint32_t end,
+                                     uint32_t *p_run_end)
 {
-    // Retrieve image header
-    image_header_t read_header = {0};
-    if (dfu_image_read_header(addr, &read_header) != 0)
+    uint32_t unit_size = geo->types[0].size;
+    uint32_t block_size = geo->types[geo->type_count - 1].size;
+    addr += unit_size;
+    while (addr < end && (addr & (block_size - 1)) != 0)
     {
-        LOG_ERR("Failed to read image header\r\n");
-        return -1;
+        int blank = dfu_storage_compare(addr, NULL, unit_size);
+        if (blank < 0)
+        {
+            return -1;
+        }
+        if (blank == 1)
+        {
+            break;
+        }
+        addr += unit_size;
     }
+    *p_run_end = addr;
+    return 0;
+}
+#endif /* End of (DFU_ERASE_BLANK_CHECK != 0) */
 
-    if (read_header.image_magic != IMAGE_MAGIC_NUMBER)
+/*
+ * @brief next step of erasing the units of [addr, end), both aligned on the smallest erase unit. With
+ *        DFU_ERASE_BLANK_CHECK the units known blank are skipped at once, then one unit is checked per call until
+ *        one is not blank: the run of units to erase it starts is found at once and erased by the next calls.
+ * @param[in,out] p_run_end: end of the run being erased, addr or lower to look for the next one
+ * @param[out] p_op: erase to do, or the blank units skipped (addr and size)
+ * @return int 1 if p_op is an erase, 0 if it is skipped, negative value otherwise
+ */
+static int dfu_storage_erase_next(const erase_plan_geometry_t *geo, uint32_t addr, uint32_t end,
+                                  uint32_t *p_run_end, erase_plan_op_t *p_op)
+{
+#if (DFU_ERASE_BLANK_CHECK != 0)
+    if (addr >= *p_run_end)
     {
-        LOG_WRN("Invalid image magic number: 0x%X\r\n", read_header.image_magic);
-        return -1;
+        uint32_t unit_size = geo->types[0].size;
+        uint32_t skip_end = dfu_blank_known_skip(addr, end);
+        int blank = (skip_end > addr) ? 1 : dfu_storage_compare(addr, NULL, unit_size);
+        if (blank == 1)
+        {
+            p_op->addr = addr;
+            p_op->size = (skip_end > addr) ? skip_end - addr : unit_size;
+            p_op->time_ms = 0;
+            dfu_blank_skipped += p_op->size;
+            return 0;
+        }
+        if (blank < 0 || dfu_storage_erase_run_end(geo, addr, end, p_run_end) != 0)
+        {
+            LOG_ERR("Failed to blank check at address: 0X%X\r\n", addr);
+            return -1;
+        }
+    }
+    uint32_t run_end = *p_run_end;
+#else
+    (void) p_run_end;
+    uint32_t run_end = end;
+#endif /* End of (DFU_ERASE_BLANK_CHECK != 0) */
+    if (erase_plan_next(geo, addr, run_end, p_op) != 0)
+    {
+        LOG_ERR("Failed to erase at address: 0X%X\r\n", addr);
+        return -1;
+    }
+#if (DFU_ERASE_BLANK_CHECK != 0)
+    dfu_blank_erase_ms += p_op->time_ms;
+#endif
+    return 1;
+}
+
+/*
+ * @brief erase exactly [addr, addr + len) with the cheapest mix of the device erase sizes. Bytes of the partially
+ *        covered units at both ends are kept. With DFU_ERASE_BLANK_CHECK the blank units are not erased.
+ * @param geo: erase sizes and timings of the device
+ * @param erase_block: backend function erasing one block of the given erase type id
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_storage_erase_planned(const erase_plan_geometry_t *geo, int (*erase_block)(uint8_t id, uint32_t addr),
+                                     uint32_t addr, uint32_t len)
+{
+    uint32_t unit_size = geo->types[0].size;
+    uint32_t end = addr + len;
+
+    // Unaligned head, or a range inside a single unit
+    uint32_t unit_addr = addr & ~(unit_size - 1);
+    if (len > 0 && (addr != unit_addr || end < unit_addr + unit_size))
+    {
+        uint32_t part_end = (end < unit_addr + unit_size) ? end : unit_addr + unit_size;
+        if (dfu_storage_erase_partial(geo, erase_block, unit_addr, addr, part_end) != 0)
+        {
+            return -1;
+        }
+        addr = part_end;
+    }
+    // Unaligned tail
+    if (addr < end && (end & (unit_size - 1)) != 0)
+    {
+        unit_addr = end & ~(unit_size - 1);
+        if (dfu_storage_erase_partial(geo, erase_block, unit_addr, unit_addr, end) != 0)
+        {
+            return -1;
+        }
+        end = unit_addr;
+    }
+
+#if (DFU_ERASE_BLANK_CHECK != 0)
+    dfu_blank_planned_ms += (addr < end) ? erase_plan_cost_ms(geo, addr, end) : 0;
+#endif
+    erase_plan_op_t op;
+    uint32_t run_end = addr;
+    while (addr < end)
+    {
+        int result = dfu_storage_erase_next(geo, addr, end, &run_end, &op);
+        if (result < 0)
+        {
+            return -1;
+        }
+        if (result > 0 && erase_block(op.id, op.addr) != 0)
+        {
+            LOG_ERR("Failed to erase at address: 0X%X\r\n", addr);
+            return -1;
+        }
+        addr += op.size;
+    }
+    return 0;
+}
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) */
+
+
+/*
+ * @brief calculate CRC32 of a storage area by streaming it through a fixed size window, with a single continuous
+ *        read over the whole area
+ * @param addr: start address of the area
+ * @param len: length of the area in bytes
+ * @param[in,out] p_running: running CRC (crc32_update()) the area is also added to, NULL for none
+ * @param[out] p_crc: calculated CRC value
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_storage_crc32_add(uint32_t addr, uint32_t len, uint32_t *p_running, uint32_t *p_crc)
+{
+    assert(p_crc != NULL);
+    uint32_t crc = crc32_init();
+    int retval = dfu_storage_read_begin(addr);
+    while (retval == 0 && len > 0)
+    {
+        uint32_t chunk_len = (len > sizeof(dfu_stream_buf)) ? sizeof(dfu_stream_buf) : len;
+        if (dfu_storage_read_next(dfu_stream_buf, chunk_len) != 0)
+        {
+            LOG_ERR("Failed to read %dB storage at address: 0X%X\r\n", chunk_len, addr);
+            retval = -1;
+            break;
+        }
+        crc = crc32_update(crc, dfu_stream_buf, chunk_len);
+        if (p_running != NULL)
+        {
+            *p_running = crc32_update(*p_running, dfu_stream_buf, chunk_len);
+        }
+        addr += chunk_len;
+        len -= chunk_len;
+    }
+    dfu_storage_read_end();
+    *p_crc = crc32_final(crc);
+    return retval;
+}
+
+static int dfu_storage_crc32(uint32_t addr, uint32_t len, uint32_t *p_crc)
+{
+    return dfu_storage_crc32_add(addr, len, NULL, p_crc);
+}
+
+/*
+ * @brief compare a storage area with the expected content, stops at the first difference
+ * @param addr: start address of the area
+ * @param p_data: expected content, NULL to check that the area is erased
+ * @param len: length of the area in bytes
+ * @return int 1 if the storage matches, 0 if it differs, negative value otherwise
+ */
+static int dfu_storage_compare(uint32_t addr, const uint8_t *p_data, uint32_t len)
+{
+    // Start with short reads, a unit that differs usually does it in its first bytes
+    uint32_t read_len = 32;
+    int retval = 1;
+    if (len == 0 || dfu_storage_read_begin(addr) != 0)
+    {
+        return (len == 0) ? 1 : -1;
+    }
+    while (retval == 1 && len > 0)
+    {
+        uint32_t chunk_len = (len > read_len) ? read_len : len;
+        if (dfu_storage_read_next(dfu_stream_buf, chunk_len) != 0)
+        {
+            LOG_ERR("Failed to read %dB storage at address: 0X%X\r\n", chunk_len, addr);
+            retval = -1;
+            break;
+        }
+        if (p_data != NULL)
+        {
+            retval = (memcmp(dfu_stream_buf, p_data, chunk_len) == 0) ? 1 : 0;
+            p_data += chunk_len;
+        }
+        else
+        {
+            for (uint32_t i = 0; i < chunk_len && retval == 1; i++)
+            {
+                retval = (dfu_stream_buf[i] == (uint8_t) flash_get_erase_value()) ? 1 : 0;
+            }
+        }
+        addr += chunk_len;
+        len -= chunk_len;
+        read_len = (read_len * 2 > sizeof(dfu_stream_buf)) ? sizeof(dfu_stream_buf) : read_len * 2;
+    }
+    dfu_storage_read_end();
+    return retval;
+}
+
+#if (DFU_DIFF_UPDATE != 0)
+/*
+ * @brief erase a run of units and program the new image data that falls inside it
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_storage_rewrite_units(uint32_t run_addr, uint32_t run_end, uint8_t *p_data, uint32_t data_len,
+                                     uint32_t dest_img_addr, uint32_t hdr_len)
+{
+    // Only the image area (data and header) of the units is erased
+    uint32_t area_end = dest_img_addr + data_len + hdr_len;
+    run_addr = (run_addr > dest_img_addr) ? run_addr : dest_img_addr;
+    run_end = (run_end < area_end) ? run_end : area_end;
+
+    DFU_PHASE_ENTER(DFU_PHASE_ERASE);
+    int result = dfu_storage_erase(run_addr, run_end - run_addr);
+    DFU_PHASE_EXIT(DFU_PHASE_ERASE);
+    if (result != 0)
+    {
+        LOG_ERR("Failed to erase %dB at address: 0X%X\r\n", run_end - run_addr, run_addr);
+        return -1;
+    }
+
+    uint32_t start = (run_addr > dest_img_addr) ? run_addr : dest_img_addr;
+    uint32_t end = (run_end < dest_img_addr + data_len) ? run_end : dest_img_addr + data_len;
+    if (end > start)
+    {
+        DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+        result = dfu_storage_write(start, p_data + (start - dest_img_addr), end - start);
+        DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+        if (result != 0)
+        {
+            LOG_ERR("Failed to write %dB image data at address: 0X%X\r\n", end - start, start);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief write new image data to storage, only erasing and programming the DFU_DIFF_UNIT_SIZE units whose content
+ *        differs. The hdr_len bytes after the data (header right after the image) are expected erased for the
+ *        commit. Consecutive differing units are rewritten together so the erase can use the largest erase size.
+ * @param p_data: pointer to new image data
+ * @param data_len: length of new image data
+ * @param dest_img_addr: destination address of the new image
+ * @param hdr_len: length of the header area after the data, 0 if the header is elsewhere
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_storage_write_diff(uint8_t *p_data, uint32_t data_len, uint32_t dest_img_addr, uint32_t hdr_len)
+{
+    uint32_t data_end = dest_img_addr + data_len;
+    uint32_t area_end = data_end + hdr_len;
+    uint32_t unit_count = 0;
+    uint32_t unit_written = 0;
+    uint32_t run_addr = 0;
+    uint32_t run_end = 0;
+
+    for (uint32_t unit_addr = dest_img_addr & ~(DFU_DIFF_UNIT_SIZE - 1); unit_addr < area_end;
+         unit_addr += DFU_DIFF_UNIT_SIZE)
+    {
+        // Part of the image area inside this unit: data in [start, split), header in [split, end)
+        uint32_t start = (unit_addr > dest_img_addr) ? unit_addr : dest_img_addr;
+        uint32_t end = (unit_addr + DFU_DIFF_UNIT_SIZE < area_end) ? unit_addr + DFU_DIFF_UNIT_SIZE : area_end;
+        uint32_t split = (end < data_end) ? end : ((start > data_end) ? start : data_end);
+        unit_count++;
+
+        DFU_PHASE_ENTER(DFU_PHASE_DIFF);
+        int same = dfu_storage_compare(start, p_data + (start - dest_img_addr), split - start);
+        if (same == 1)
+        {
+            same = dfu_storage_compare(split, NULL, end - split);
+        }
+        DFU_PHASE_EXIT(DFU_PHASE_DIFF);
+        if (same < 0)
+        {
+            return -1;
+        }
+
+        if (same == 0)
+        {
+            // Extend the current run of differing units
+            if (run_end != unit_addr)
+            {
+                run_addr = unit_addr;
+            }
+            run_end = unit_addr + DFU_DIFF_UNIT_SIZE;
+            unit_written++;
+        }
+        if (run_end > run_addr && (same == 1 || run_end >= area_end))
+        {
+            if (dfu_storage_rewrite_units(run_addr, run_end, p_data, data_len, dest_img_addr, hdr_len) != 0)
+            {
+                return -1;
+            }
+            run_addr = run_end;
+        }
+    }
+    LOG_INF("Differential update: %d/%d units of %dB rewritten\r\n", unit_written, unit_count, DFU_DIFF_UNIT_SIZE);
+    return 0;
+}
+#endif /* End of (DFU_DIFF_UPDATE != 0) */
+
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_JOURNAL != 0)
+/******************************************************************************
+ * Progress journal
+ *******************************************************************************/
+/* Update being recorded, units are counted from unit_base */
+static struct
+{
+    bool active;
+    bool loaded;                // The record left by a reset was looked at, later updates start over
+    bool closing;               // Record closed once the journal is up to date
+    uint32_t entry_addr;
+    uint32_t unit_base;
+    uint32_t unit_size;
+    uint32_t unit_count;
+    uint32_t area_start;        // Data and header area erased by the update
+    uint32_t area_end;
+    uint32_t data_end;
+    uint32_t programmed_units;  // Units programmed, recorded up to marked_programmed
+    uint32_t marked_programmed;
+    uint32_t erased_first;      // Erased units not recorded yet
+    uint32_t erased_end;
+    uint8_t bits[DFU_JOURNAL_MARK_BYTES]; // Bitmap bytes being programmed
+} dfu_journal;
+
+/*
+ * @brief end of the run of cleared bits of a bitmap that starts at bit first
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_journal_count(uint32_t bitmap_addr, uint32_t first, uint32_t *p_end)
+{
+    uint8_t bits = 0;
+    uint32_t bit = first;
+    for (; bit < dfu_journal.unit_count; bit++)
+    {
+        if (bit == first || (bit % 8) == 0)
+        {
+            if (dfu_storage_read(bitmap_addr + bit / 8, &bits, 1) != 0)
+            {
+                return -1;
+            }
+        }
+        if ((bits & (1U << (bit % 8))) != 0)
+        {
+            break;
+        }
+    }
+    *p_end = bit;
+    return 0;
+}
+
+/*
+ * @brief open the journal of an update, before the image area is touched. The update erases
+ *        [start address, start address + area_len) and programs the image data from its start. Records are appended
+ *        to the journal, which is erased once full or when the next entry is not erased. The last record is resumed
+ *        if a reset left it open during the same update (same header, header address and erase unit): the units it
+ *        shows programmed are kept, the units erased after them are known blank. Only the first update after a reset
+ *        resumes, a failed update starts over.
+ * @param p_header: header of the image, size and start address set, CRC 0 if unknown
+ * @return uint32_t bytes of image data already programmed, the update goes on from there
+ */
+static uint32_t dfu_journal_begin(const image_header_t *p_header, uint32_t hdr_addr, uint32_t area_len)
+{
+    const erase_plan_geometry_t *geo = &dfu_storage_geometry()->plan;
+    uint32_t unit_size = geo->types[0].size;
+    uint32_t dest_addr = p_header->img_data_start_addr;
+    bool resume = !dfu_journal.loaded;
+    memset(&dfu_journal, 0, sizeof(dfu_journal));
+    dfu_journal.loaded = true;
+    dfu_journal.unit_size = unit_size;
+    dfu_journal.unit_base = dest_addr & ~(unit_size - 1);
+    dfu_journal.unit_count = (dest_addr + area_len - dfu_journal.unit_base + unit_size - 1) / unit_size;
+    dfu_journal.area_start = dest_addr;
+    dfu_journal.area_end = dest_addr + area_len;
+    dfu_journal.data_end = dest_addr + p_header->img_data_size;
+    if (unit_size != DFU_JOURNAL_SIZE || dfu_journal.unit_count > DFU_JOURNAL_BITMAP_SIZE * 8)
+    {
+        LOG_WRN("Update of %dB not journaled\r\n", area_len);
+        return 0;
+    }
+
+    dfu_journal_record_t expected = {
+        .journal_magic = DFU_JOURNAL_MAGIC,
+        .header = *p_header,
+        .hdr_addr = hdr_addr,
+        .unit_size = unit_size,
+    };
+    expected.record_crc = crc32(&expected, offsetof(dfu_journal_record_t, record_crc));
+    // First entry never written, the last record is before it
+    dfu_journal_record_t record;
+    uint32_t entry_addr = DFU_JOURNAL_ADDR;
+    for (; entry_addr < DFU_JOURNAL_ADDR + DFU_JOURNAL_SIZE; entry_addr += DFU_JOURNAL_ENTRY_SIZE)
+    {
+        int blank = dfu_storage_compare(entry_addr, NULL, sizeof(record));
+        if (blank < 0)
+        {
+            LOG_WRN("Failed to read the update journal\r\n");
+            return 0;
+        }
+        if (blank == 1)
+        {
+            break;
+        }
+    }
+
+    uint32_t programmed = 0;
+    uint32_t erased = 0;
+    dfu_journal.entry_addr = entry_addr - DFU_JOURNAL_ENTRY_SIZE;
+    if (resume && entry_addr > DFU_JOURNAL_ADDR &&
+        dfu_storage_read(dfu_journal.entry_addr, (uint8_t *) &record, sizeof(record)) == 0 &&
+        memcmp(&record, &expected, sizeof(record)) == 0 &&
+        dfu_journal_count(DFU_JOURNAL_PROGRAMMED_ADDR(dfu_journal.entry_addr), 0, &programmed) == 0 &&
+        dfu_journal_count(DFU_JOURNAL_ERASED_ADDR(dfu_journal.entry_addr), programmed + 1, &erased) == 0)
+    {
+        // The unit being programmed at the reset is erased again, the ones after it are still blank
+        dfu_journal.active = true;
+        dfu_journal.programmed_units = programmed;
+        dfu_journal.marked_programmed = programmed;
+        if (erased > programmed + 1)
+        {
+            dfu_blank_known_add(dfu_journal.unit_base + (programmed + 1) * unit_size,
+                                dfu_journal.unit_base + erased * unit_size);
+        }
+        uint32_t resume_addr = dfu_journal.unit_base + programmed * unit_size;
+        resume_addr = (resume_addr < dest_addr) ? dest_addr : resume_addr;
+        resume_addr = (resume_addr > dfu_journal.data_end) ? dfu_journal.data_end : resume_addr;
+        LOG_INF("Update resumed: %dKB programmed, %dKB more erased\r\n", (resume_addr - dest_addr) / 1024,
+                (erased > programmed + 1) ? (erased - programmed - 1) * unit_size / 1024 : 0);
+        return resume_addr - dest_addr;
+    }
+
+    // New record, in the first free entry or at the start of the erased journal. The bitmaps of the entry must be
+    // erased too: a torn record, or data left in the sector by an image stored there before the journal, would show
+    // units erased or programmed.
+    dfu_journal.entry_addr = entry_addr;
+    int blank = 0;
+    if (entry_addr < DFU_JOURNAL_ADDR + DFU_JOURNAL_SIZE)
+    {
+        blank = dfu_storage_compare(entry_addr, NULL, DFU_JOURNAL_ENTRY_SIZE);
+        if (blank < 0)
+        {
+            LOG_WRN("Failed to read the update journal\r\n");
+            return 0;
+        }
+    }
+    if (blank == 0)
+    {
+        dfu_journal.entry_addr = DFU_JOURNAL_ADDR;
+        if (dfu_storage_erase_block(geo->types[0].id, DFU_JOURNAL_ADDR) != 0)
+        {
+            LOG_WRN("Failed to erase the update journal\r\n");
+            return 0;
+        }
+    }
+    if (dfu_storage_write(dfu_journal.entry_addr, (uint8_t *) &expected, sizeof(expected)) != 0)
+    {
+        LOG_WRN("Failed to open the update journal\r\n");
+        return 0;
+    }
+    dfu_journal.active = true;
+    return 0;
+}
+
+/*
+ * @brief record the erase of the given erase type id at addr, once it is done. Only the units inside the image
+ *        area are recorded, the partially erased ones at its ends are not blank. The bits are programmed by
+ *        dfu_journal_next().
+ */
+static void dfu_journal_erased(uint8_t id, uint32_t addr)
+{
+    const erase_plan_geometry_t *geo = &dfu_storage_geometry()->plan;
+    uint32_t len = 0;
+    for (uint8_t i = 0; i < geo->type_count; i++)
+    {
+        len = (geo->types[i].id == id) ? geo->types[i].size : len;
+    }
+    uint32_t start = (addr > dfu_journal.area_start) ? addr : dfu_journal.area_start;
+    uint32_t end = (addr + len < dfu_journal.area_end) ? addr + len : dfu_journal.area_end;
+    if (!dfu_journal.active || start >= end)
+    {
+        return;
+    }
+    uint32_t first = (start - dfu_journal.unit_base + dfu_journal.unit_size - 1) / dfu_journal.unit_size;
+    uint32_t last = (end - dfu_journal.unit_base) / dfu_journal.unit_size;
+    if (first < last)
+    {
+        dfu_journal.erased_first = first;
+        dfu_journal.erased_end = last;
+    }
+}
+
+/*
+ * @brief record the image data programmed up to addr, in order. A unit is recorded once it is programmed up to its
+ *        end or up to the end of the data. The bits are programmed by dfu_journal_next().
+ */
+static void dfu_journal_programmed(uint32_t addr)
+{
+    if (!dfu_journal.active)
+    {
+        return;
+    }
+    uint32_t units = (addr >= dfu_journal.data_end)
+                         ? (dfu_journal.data_end - dfu_journal.unit_base + dfu_journal.unit_size - 1) /
+                               dfu_journal.unit_size
+                         : (addr - dfu_journal.unit_base) / dfu_journal.unit_size;
+    dfu_journal.programmed_units = (units > dfu_journal.programmed_units) ? units : dfu_journal.programmed_units;
+}
+
+/*
+ * @brief next bitmap bytes to program for the units recorded but not marked yet: the bytes are read and their bits
+ *        cleared, up to DFU_JOURNAL_MARK_BYTES at once. Then the magic number of a closing record.
+ * @param[out] p_addr, pp_data, p_len: bytes to program, the data stays valid until the next call
+ * @return int 1 if bytes must be programmed, 0 if the journal is up to date, negative value otherwise
+ */
+static int dfu_journal_next(uint32_t *p_addr, const uint8_t **pp_data, uint32_t *p_len)
+{
+    uint32_t bitmap_addr = DFU_JOURNAL_PROGRAMMED_ADDR(dfu_journal.entry_addr);
+    uint32_t *p_first = &dfu_journal.marked_programmed;
+    uint32_t end = dfu_journal.programmed_units;
+    if (dfu_journal.erased_first < dfu_journal.erased_end)
+    {
+        bitmap_addr = DFU_JOURNAL_ERASED_ADDR(dfu_journal.entry_addr);
+        p_first = &dfu_journal.erased_first;
+        end = dfu_journal.erased_end;
+    }
+    if (!dfu_journal.active || (*p_first >= end && !dfu_journal.closing))
+    {
+        return 0;
+    }
+    if (*p_first >= end)
+    {
+        dfu_journal.active = false;
+        memset(dfu_journal.bits, 0, sizeof(uint32_t));
+        *p_addr = dfu_journal.entry_addr;
+        *pp_data = dfu_journal.bits;
+        *p_len = sizeof(uint32_t);
+        return 1;
+    }
+    uint32_t byte = *p_first / 8;
+    uint32_t len = (end + 7) / 8 - byte;
+    len = (len > DFU_JOURNAL_MARK_BYTES) ? DFU_JOURNAL_MARK_BYTES : len;
+    if (dfu_storage_read(bitmap_addr + byte, dfu_journal.bits, len) != 0)
+    {
+        return -1;
+    }
+    uint32_t bit = *p_first;
+    for (; bit < end && bit < (byte + len) * 8; bit++)
+    {
+        dfu_journal.bits[bit / 8 - byte] &= (uint8_t) ~(1U << (bit % 8));
+    }
+    *p_first = bit;
+    *p_addr = bitmap_addr + byte;
+    *pp_data = dfu_journal.bits;
+    *p_len = len;
+    return 1;
+}
+
+/*
+ * @brief program the units recorded but not marked yet
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_journal_flush(void)
+{
+    uint32_t addr = 0;
+    const uint8_t *data = NULL;
+    uint32_t len = 0;
+    int result = 0;
+    while ((result = dfu_journal_next(&addr, &data, &len)) > 0)
+    {
+        if (dfu_storage_write(addr, (uint8_t *) data, len) != 0)
+        {
+            return -1;
+        }
+    }
+    return result;
+}
+
+/*
+ * @brief close the journal once the update is committed, its record is no longer resumed. The magic number of the
+ *        record is cleared by dfu_journal_next().
+ */
+static void dfu_journal_close(void)
+{
+    dfu_journal.closing = true;
+}
+
+/*
+ * @brief close the journal and program it
+ */
+static void dfu_journal_end(void)
+{
+    dfu_journal_close();
+    if (dfu_journal_flush() != 0)
+    {
+        LOG_WRN("Failed to close the update journal\r\n");
+    }
+}
+
+#if (DFU_COMPRESSED_IMAGE != 0) || (DFU_DIFF_UPDATE == 0)
+/*
+ * @brief erase one block and record it in the journal, erase_block of dfu_storage_erase_planned()
+ */
+static int dfu_journal_erase_block(uint8_t id, uint32_t addr)
+{
+    if (dfu_storage_erase_block(id, addr) != 0)
+    {
+        return -1;
+    }
+    dfu_journal_erased(id, addr);
+    return dfu_journal_flush();
+}
+
+/*
+ * @brief dfu_storage_write_from() unit by unit, each unit is recorded in the journal once programmed
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_journal_write_from(uint32_t addr, uint32_t len, dfu_source_t source, void *arg)
+{
+    while (len > 0)
+    {
+        uint32_t unit_len = dfu_journal.active ? dfu_journal.unit_size - (addr & (dfu_journal.unit_size - 1)) : len;
+        unit_len = (unit_len > len) ? len : unit_len;
+        if (dfu_storage_write_from(addr, unit_len, source, arg) != 0)
+        {
+            return -1;
+        }
+        dfu_journal_programmed(addr + unit_len);
+        if (dfu_journal_flush() != 0)
+        {
+            return -1;
+        }
+        addr += unit_len;
+        len -= unit_len;
+    }
+    return 0;
+}
+#endif /* End of (DFU_COMPRESSED_IMAGE != 0) || (DFU_DIFF_UPDATE == 0) */
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) && (DFU_JOURNAL != 0) */
+
+#if (DFU_BLOCK_CRC != 0)
+/******************************************************************************
+ * Block CRC table
+ *******************************************************************************/
+/*
+ * @brief address of the block table of an image whose header is at hdr_addr, right below the header
+ * @return uint32_t 0 if there is no room for a table between the data and the header (header right after the data,
+ *         image filling the slot)
+ */
+static uint32_t dfu_block_table_addr(uint32_t data_addr, uint32_t data_len, uint32_t hdr_addr)
+{
+    if (hdr_addr < data_addr || hdr_addr - data_addr < data_len ||
+        hdr_addr - data_addr - data_len < DFU_BLOCK_TABLE_SIZE)
+    {
+        return 0;
+    }
+    return hdr_addr - DFU_BLOCK_TABLE_SIZE;
+}
+
+static uint32_t dfu_block_count(uint32_t data_len, uint8_t block_size_log2)
+{
+    return (data_len >> block_size_log2) + ((data_len & ((1UL << block_size_log2) - 1)) != 0);
+}
+
+/*
+ * @brief block size of the table of a new image: the smallest one from DFU_BLOCK_CRC_MIN_SIZE up whose table fits,
+ *        or the block size of the block CRCs given with the image if it is not smaller
+ * @param[in,out] p_src: block CRCs given with the image, dropped if their blocks are too small. May be NULL.
+ */
+static uint8_t dfu_block_size_log2(uint32_t data_len, dfu_block_crcs_t *p_src)
+{
+    uint8_t block_size_log2 = 0;
+    while ((1UL << block_size_log2) < DFU_BLOCK_CRC_MIN_SIZE)
+    {
+        block_size_log2++;
+    }
+    while (dfu_block_count(data_len, block_size_log2) > DFU_BLOCK_TABLE_MAX_BLOCKS)
+    {
+        block_size_log2++;
+    }
+    if (p_src != NULL && p_src->p_crcs != NULL)
+    {
+        if (p_src->block_size_log2 >= block_size_log2 && p_src->block_size_log2 < 32)
+        {
+            return p_src->block_size_log2;
+        }
+        LOG_WRN("Block CRCs of the image ignored, blocks of %dB at least are needed\r\n",
+                (uint32_t) (1UL << block_size_log2));
+        p_src->p_crcs = NULL;
+    }
+    return block_size_log2;
+}
+
+/*
+ * @brief CRC of one block in a list of little endian CRCs, which may not be aligned
+ */
+static uint32_t dfu_block_crc_get(const uint8_t *p_crcs, uint32_t index)
+{
+    uint32_t crc;
+    memcpy(&crc, &p_crcs[index * sizeof(crc)], sizeof(crc));
+    return crc;
+}
+
+/*
+ * @brief add the CRC of a block to dfu_block_page
+ * @param[out] p_addr: address of the entries to program
+ * @return uint32_t length of the entries to program from dfu_block_page once their page is complete or the block
+ *         is the last one, 0 otherwise
+ */
+static uint32_t dfu_block_page_add(uint32_t table_addr, uint32_t index, uint32_t count, uint32_t crc,
+                                   uint32_t *p_addr)
+{
+    uint32_t first = table_addr + sizeof(dfu_block_table_t);
+    uint32_t addr = first + index * sizeof(crc);
+    uint32_t page_offset = addr % sizeof(dfu_block_page);
+    memcpy(&dfu_block_page[page_offset], &crc, sizeof(crc));
+    if (page_offset + sizeof(crc) < sizeof(dfu_block_page) && index + 1 < count)
+    {
+        return 0;
+    }
+    *p_addr = (addr - page_offset < first) ? first : addr - page_offset;
+    return addr + sizeof(crc) - *p_addr;
+}
+
+/*
+ * @brief read the stored image block by block, check each block against the given block CRCs and program its CRC
+ *        in the block table. Stops at the first block that does not match.
+ * @param p_src: block CRCs given with the image, NULL for none
+ * @param[out] p_table: table header, programmed by the caller once the image CRC is checked
+ * @param[out] p_crc: CRC of the whole image
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_block_table_write(const image_header_t *p_header, uint32_t table_addr, const dfu_block_crcs_t *p_src,
+                                 dfu_block_table_t *p_table, uint32_t *p_crc)
+{
+    dfu_block_crcs_t src = {0};
+    if (p_src != NULL)
+    {
+        src = *p_src;
+    }
+    uint8_t block_size_log2 = dfu_block_size_log2(p_header->img_data_size, &src);
+    uint32_t count = dfu_block_count(p_header->img_data_size, block_size_log2);
+    uint32_t image_crc = crc32_init();
+    uint32_t table_crc = crc32_init();
+    for (uint32_t index = 0; index < count; index++)
+    {
+        uint32_t offset = index << block_size_log2;
+        uint32_t len = p_header->img_data_size - offset;
+        len = (len > (1UL << block_size_log2)) ? (1UL << block_size_log2) : len;
+        uint32_t crc = 0;
+        if (dfu_storage_crc32_add(p_header->img_data_start_addr + offset, len, &image_crc, &crc) != 0)
+        {
+            LOG_ERR("Failed to read %dB image data at address: 0X%X\r\n", len, p_header->img_data_start_addr + offset);
+            return -1;
+        }
+        if (src.p_crcs != NULL && crc != dfu_block_crc_get(src.p_crcs, index))
+        {
+            LOG_ERR("Block %d at address: 0X%X is corrupted: %x instead of %x\r\n", index,
+                    p_header->img_data_start_addr + offset, crc, dfu_block_crc_get(src.p_crcs, index));
+            return -1;
+        }
+        table_crc = crc32_update(table_crc, &crc, sizeof(crc));
+        uint32_t addr = 0;
+        uint32_t page_len = dfu_block_page_add(table_addr, index, count, crc, &addr);
+        if (page_len > 0 && dfu_storage_write(addr, &dfu_block_page[addr % sizeof(dfu_block_page)], page_len) != 0)
+        {
+            LOG_ERR("Failed to write the block table at address: 0X%X\r\n", addr);
+            return -1;
+        }
+    }
+
+    p_table->table_magic = DFU_BLOCK_TABLE_MAGIC;
+    p_table->img_data_size = p_header->img_data_size;
+    p_table->image_data_crc = p_header->image_data_crc;
+    p_table->block_count = (uint16_t) count;
+    p_table->block_size_log2 = block_size_log2;
+    p_table->reserved = 0xFF;
+    p_table->table_crc = crc32_final(table_crc);
+    *p_crc = crc32_final(image_crc);
+    return 0;
+}
+
+/*
+ * @brief read the block table of an image and check that it belongs to it
+ * @param[out] p_table_addr: address of the table
+ * @return int 0 if the image has a valid table, negative value otherwise
+ */
+static int dfu_block_table_read(const image_header_t *p_header, uint32_t hdr_addr, dfu_block_table_t *p_table,
+                                uint32_t *p_table_addr)
+{
+    uint32_t table_addr = dfu_block_table_addr(p_header->img_data_start_addr, p_header->img_data_size, hdr_addr);
+    uint32_t crc = 0;
+    if (table_addr == 0 || dfu_storage_read(table_addr, (uint8_t *) p_table, sizeof(*p_table)) != 0 ||
+        p_table->table_magic != DFU_BLOCK_TABLE_MAGIC || p_table->img_data_size != p_header->img_data_size ||
+        p_table->image_data_crc != p_header->image_data_crc || p_table->block_size_log2 >= 32 ||
+        p_table->block_count > DFU_BLOCK_TABLE_MAX_BLOCKS ||
+        p_table->block_count != dfu_block_count(p_header->img_data_size, p_table->block_size_log2) ||
+        dfu_storage_crc32(table_addr + sizeof(*p_table), p_table->block_count * sizeof(uint32_t), &crc) != 0 ||
+        crc != p_table->table_crc)
+    {
+        return -1;
+    }
+    *p_table_addr = table_addr;
+    return 0;
+}
+
+/*
+ * @brief check the stored blocks [first, end) of an image against its block table, stops at the first bad block
+ * @return int 0 if the blocks match, negative value otherwise
+ */
+static int dfu_block_check(const image_header_t *p_header, uint32_t table_addr, const dfu_block_table_t *p_table,
+                           uint32_t first, uint32_t end)
+{
+    uint32_t crcs[DFU_BLOCK_READ_ENTRIES];
+    for (uint32_t index = first; index < end; index++)
+    {
+        uint32_t entry = (index - first) % DFU_BLOCK_READ_ENTRIES;
+        if (entry == 0)
+        {
+            uint32_t count = (end - index > DFU_BLOCK_READ_ENTRIES) ? DFU_BLOCK_READ_ENTRIES : end - index;
+            if (dfu_storage_read(table_addr + sizeof(*p_table) + index * sizeof(uint32_t), (uint8_t *) crcs,
+                                 count * sizeof(uint32_t)) != 0)
+            {
+                LOG_ERR("Failed to read the block table at address: 0X%X\r\n", table_addr);
+                return -1;
+            }
+        }
+        uint32_t offset = index << p_table->block_size_log2;
+        uint32_t len = p_header->img_data_size - offset;
+        len = (len > (1UL << p_table->block_size_log2)) ? (1UL << p_table->block_size_log2) : len;
+        uint32_t crc = 0;
+        if (dfu_storage_crc32(p_header->img_data_start_addr + offset, len, &crc) != 0)
+        {
+            LOG_ERR("Failed to read %dB image data at address: 0X%X\r\n", len, p_header->img_data_start_addr + offset);
+            return -1;
+        }
+        if (crc != crcs[entry])
+        {
+            LOG_ERR("Block %d at address: 0X%X is corrupted: %x instead of %x\r\n", index,
+                    p_header->img_data_start_addr + offset, crc, crcs[entry]);
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+
+/*
+ * @brief check the stored data of an image against its header: block by block if it has a block table, stopping at
+ *        the first bad block, against the image CRC otherwise
+ * @param hdr_addr: address of the image header
+ * @return int 0 if the data is valid, negative value otherwise
+ */
+static int dfu_image_check_data(const image_header_t *p_header, uint32_t hdr_addr)
+{
+    int result = 0;
+    DFU_PHASE_ENTER(DFU_PHASE_VALIDATE);
+#if (DFU_BLOCK_CRC != 0)
+    dfu_block_table_t table;
+    uint32_t table_addr = 0;
+    if (dfu_block_table_read(p_header, hdr_addr, &table, &table_addr) == 0)
+    {
+        result = dfu_block_check(p_header, table_addr, &table, 0, table.block_count);
+        DFU_PHASE_EXIT(DFU_PHASE_VALIDATE);
+        return result;
+    }
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+    uint32_t crc = 0;
+    result = dfu_storage_crc32(p_header->img_data_start_addr, p_header->img_data_size, &crc);
+    DFU_PHASE_EXIT(DFU_PHASE_VALIDATE);
+    if (result != 0)
+    {
+        LOG_ERR("Failed to read %dB image data at address: 0X%X\r\n", p_header->img_data_size,
+                p_header->img_data_start_addr);
+        return -1;
+    }
+    if (crc != p_header->image_data_crc)
+    {
+        LOG_ERR("Image data CRC is invalid: %x instead of %x\r\n", crc, p_header->image_data_crc);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief read image header at the given address
+ * @param img_start_addr: start address of the image header
+ * @param[out] img_header_data: pointer to store read image header
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_image_read_header(uint32_t img_start_addr, image_header_t *img_header_data)
+{
+    assert(img_header_data != NULL);
+    // Read image header
+    if (0 != dfu_storage_read(img_start_addr, (uint8_t *) img_header_data, sizeof(image_header_t)))
+    {
+        LOG_ERR("Failed to read image header\r\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief: This function is used to validate the image data by compare CRC value in the header and the calculated CRC
+ * value
+ * @param img_start_addr
+ * @return int 0 if the image data is valid, negative value otherwise
+ */
+int dfu_image_validate_data_content(uint32_t img_start_addr)
+{
+    // Read image header
+    image_header_t image_header = {0};
+    if (dfu_image_read_header(img_start_addr, &image_header) != 0)
+    {
+        LOG_ERR("Failed to read image header\r\n");
+        return -1;
+    }
+
+    // Check the image inside the storage
+    if (dfu_image_check_data(&image_header, img_start_addr) != 0)
+    {
+        return -1;
+    }
+    LOG_INF("Found valid image\r\n");
+    return 0;
+}
+
+/*
+ * @brief: Validate only the part [offset, offset + len) of the image data, e.g. the part about to be used. With a
+ *         block table only the blocks holding the range are read, the whole image is checked otherwise.
+ * @param img_start_addr: address of the image header
+ * @return int 0 if the range is valid, negative value otherwise
+ */
+int dfu_image_validate_range(uint32_t img_start_addr, uint32_t offset, uint32_t len)
+{
+    image_header_t image_header = {0};
+    if (dfu_image_read_header(img_start_addr, &image_header) != 0 || image_header.image_magic != IMAGE_MAGIC_NUMBER)
+    {
+        LOG_ERR("Failed to read image header\r\n");
+        return -1;
+    }
+    if (offset > image_header.img_data_size || len > image_header.img_data_size - offset)
+    {
+        LOG_ERR("Range of %dB at %d is outside the %dB image\r\n", len, offset, image_header.img_data_size);
+        return -1;
+    }
+#if (DFU_BLOCK_CRC != 0)
+    dfu_block_table_t table;
+    uint32_t table_addr = 0;
+    if (dfu_block_table_read(&image_header, img_start_addr, &table, &table_addr) == 0)
+    {
+        uint32_t first = offset >> table.block_size_log2;
+        uint32_t end = (len == 0) ? first : ((offset + len - 1) >> table.block_size_log2) + 1;
+        DFU_PHASE_ENTER(DFU_PHASE_VALIDATE);
+        int result = dfu_block_check(&image_header, table_addr, &table, first, end);
+        DFU_PHASE_EXIT(DFU_PHASE_VALIDATE);
+        return result;
+    }
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+    return dfu_image_check_data(&image_header, img_start_addr);
+}
+
+/*
+ * @brief: Clear the image header to default erase value
+ * @param img_start_addr 
+ * @return int: 0 if the image header is cleared, negative value otherwise
+ 
+ */
+int dfu_image_clear(uint32_t img_start_addr)
+{
+    uint8_t header_len = sizeof(image_header_t);
+    uint8_t header_buf[header_len];
+    memset(header_buf, flash_get_erase_value(), header_len);
+    // Erase the image header
+    DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+    int result = dfu_storage_write(img_start_addr, header_buf, header_len);
+    DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+    if (0 != result)
+    {
+        LOG_ERR("Failed to clear image header at address: 0X%X\r\n", img_start_addr);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief: Commit image header, write header to storage at given address after validating image data
+ * @param img_header_data: pointer to image header data
+ * @param dest_img_addr: destination address to write image header
+ * @return int: 0 if the image header is committed, negative value otherwise
+ */
+int dfu_image_commit(image_header_t *img_header_data, uint32_t hdr_addr)
+{
+    return dfu_image_commit_blocks(img_header_data, hdr_addr, 0, NULL);
+}
+
+/**
+ * @brief: dfu_image_commit() with a block table: its CRCs are programmed at table_addr (erased, 0 for no table) from
+ *         the same read of the stored data as the image CRC, checked against the block CRCs given with the image
+ * @param p_src: block CRCs given with the image, NULL for none
+ * @return int: 0 if the image header is committed, negative value otherwise
+ */
+static int dfu_image_commit_blocks(image_header_t *img_header_data, uint32_t hdr_addr, uint32_t table_addr,
+                                   const dfu_block_crcs_t *p_src)
+{
+    assert(img_header_data != NULL);
+    // Calculate CRC of the image inside the storage
+    uint32_t crc_storage = 0;
+    int result = 0;
+    DFU_PHASE_ENTER(DFU_PHASE_COMMIT_CRC);
+#if (DFU_BLOCK_CRC != 0)
+    dfu_block_table_t table;
+    if (table_addr != 0)
+    {
+        result = dfu_block_table_write(img_header_data, table_addr, p_src, &table, &crc_storage);
+    }
+    else
+#else
+    (void) table_addr;
+    (void) p_src;
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+    {
+        result = dfu_storage_crc32(img_header_data->img_data_start_addr, img_header_data->img_data_size, &crc_storage);
+    }
+    DFU_PHASE_EXIT(DFU_PHASE_COMMIT_CRC);
+    if (result != 0)
+    {
+        LOG_ERR("dfu_image_commit() failed to check %dB image data at address: 0X%X\r\n",
+                img_header_data->img_data_size, img_header_data->img_data_start_addr);
+        return -1;
+    }
+    // Check CRC
+    if (img_header_data->image_data_crc != crc_storage)
+    {
+        LOG_ERR("dfu_image_commit() Image data CRC is invalid: %x instead of %x\r\n", img_header_data->image_data_crc,
+                crc_storage);
+        return -1;
+    }
+
+    // Write the block table header then the image header, the table is only used once the image is committed
+    DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+#if (DFU_BLOCK_CRC != 0)
+    if (table_addr != 0)
+    {
+        result = dfu_storage_write(table_addr, (uint8_t *) &table, sizeof(table));
+    }
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+    if (0 == result)
+    {
+        result = dfu_storage_write(hdr_addr, (uint8_t *) img_header_data, sizeof(image_header_t));
+    }
+    DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+    if (0 != result)
+    {
+        LOG_ERR(" dfu_image_commit() Failed to write image header at address: 0X%X\r\n", hdr_addr);
+        return -1;
+    }
+
+    // Index the image, it is complete without it: the slot headers decide, dfu_slot_find() adds a missing record
+    if (dfu_dir_add(img_header_data) != 0)
+    {
+        LOG_WRN("dfu_image_commit() Failed to add the image to the directory\r\n");
+    }
+    return 0;
+}
+
+#if (DFU_COMPRESSED_IMAGE != 0) || (DFU_DIFF_UPDATE == 0)
+/*
+ * @brief: Erase the image area, header area included, and program the image data pulled from source. The first
+ *          resume_len bytes of data, programmed before a reset, are kept: they are pulled from source and dropped.
+ * @return int: 0 on success, negative value otherwise
+ */
+static int dfu_image_program(uint32_t dest_img_addr, uint32_t img_len, uint32_t hdr_len, uint32_t resume_len,
+                             dfu_source_t source, void *arg)
+{
+    uint32_t img_total_size = img_len + hdr_len;
+
+    // Erase the image area
+    DFU_PHASE_ENTER(DFU_PHASE_ERASE);
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_JOURNAL != 0)
+    IS_STORAGE_BACKEND_RDY();
+    int result = dfu_storage_erase_planned(&dfu_storage_geometry()->plan, dfu_journal_erase_block,
+                                           dest_img_addr + resume_len, img_total_size - resume_len);
+#else
+    int result = dfu_storage_erase(dest_img_addr + resume_len, img_total_size - resume_len);
+#endif
+    DFU_PHASE_EXIT(DFU_PHASE_ERASE);
+    if (0 != result)
+    {
+        LOG_ERR("Failed to erase %dB image area at address: 0X%X\r\n", img_total_size, dest_img_addr);
+        return -1;
+    }
+
+    // Write image content
+    DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+    for (uint32_t skipped = 0; skipped < resume_len && 0 == result; skipped += FLASH_N25_MAX_WRITE_SIZE)
+    {
+        uint32_t len = (resume_len - skipped > FLASH_N25_MAX_WRITE_SIZE) ? FLASH_N25_MAX_WRITE_SIZE
+                                                                          : resume_len - skipped;
+        result = (source(arg, len) != NULL) ? 0 : -1;
+    }
+    if (0 == result)
+    {
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_JOURNAL != 0)
+        result = dfu_journal_write_from(dest_img_addr + resume_len, img_len - resume_len, source, arg);
+#else
+        result = dfu_storage_write_from(dest_img_addr + resume_len, img_len - resume_len, source, arg);
+#endif
+    }
+    DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+    return result;
+}
+#endif
+
+/**
+ * @brief: Write new image data and commit its header at hdr_addr, either right after the data or in a separate
+ *         area that is erased first (slot header)
+ * @param p_lz: header of the compressed payload p_data, NULL if p_data is the raw image. A payload is decoded page
+ *              by page straight into the program pipeline, its CRC is the CRC of the decompressed image.
+ * @return int: 0 if the image is updated, negative value otherwise
+ */
+static int dfu_image_store(image_header_t *img_meta_data, uint8_t *p_data, uint32_t data_len, uint32_t dest_img_addr,
+                           uint32_t hdr_addr, const lz_stream_header_t *p_lz, const dfu_block_crcs_t *p_blocks)
+{
+    assert(img_meta_data != NULL);
+    uint32_t img_len = (p_lz != NULL) ? p_lz->raw_size : data_len;
+    // Length of the header area erased together with the data
+    uint32_t hdr_len = (hdr_addr == dest_img_addr + img_len) ? sizeof(image_header_t) : 0;
+#if (DFU_BLOCK_CRC != 0)
+    // Block table right below a separate header, erased with it
+    uint32_t table_addr = dfu_block_table_addr(dest_img_addr, img_len, hdr_addr);
+#else
+    uint32_t table_addr = 0;
+#endif
+    uint32_t hdr_area = (table_addr != 0) ? table_addr : hdr_addr;
+    uint32_t crc_new_data = 0;
+#if (DFU_COMPRESSED_IMAGE != 0) || (DFU_DIFF_UPDATE == 0)
+    uint32_t resume_len = 0;
+#endif
+    int result = 0;
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_ERASE_BLANK_CHECK != 0)
+    dfu_blank_check_reset();
+#endif
+
+#if (DFU_COMPRESSED_IMAGE == 0)
+    if (p_lz != NULL)
+    {
+        LOG_ERR("Compressed images are not supported\r\n");
+        return -1;
+    }
+#endif
+
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_JOURNAL != 0) && ((DFU_COMPRESSED_IMAGE != 0) || (DFU_DIFF_UPDATE == 0))
+    // Progress of a full rewrite is journaled, the differential update compares the stored units instead
+    if (p_lz != NULL || DFU_DIFF_UPDATE == 0)
+    {
+        image_header_t journal_header = *img_meta_data;
+        journal_header.img_data_size = img_len;
+        journal_header.img_data_start_addr = dest_img_addr;
+        journal_header.image_data_crc = (p_lz != NULL) ? p_lz->raw_crc : crc32(p_data, data_len);
+        resume_len = dfu_journal_begin(&journal_header, hdr_addr, img_len + hdr_len);
+    }
+#endif
+
+    if (hdr_len == 0)
+    {
+        // Invalidate the old header before touching the data
+        DFU_PHASE_ENTER(DFU_PHASE_ERASE);
+        result = dfu_storage_erase(hdr_area, hdr_addr + sizeof(image_header_t) - hdr_area);
+        DFU_PHASE_EXIT(DFU_PHASE_ERASE);
+        if (0 != result)
+        {
+            LOG_ERR("Failed to erase image header at address: 0X%X\r\n", hdr_addr);
+            return -1;
+        }
+    }
+
+#if (DFU_COMPRESSED_IMAGE != 0)
+    if (p_lz != NULL)
+    {
+        // Not differential, the stored image would have to be compared with the decoded data. The payload CRC is
+        // checked against the decompressed image in storage by dfu_image_commit().
+        dfu_payload_source_t src = { .in = p_data, .in_len = data_len, .started = false };
+        result = dfu_image_program(dest_img_addr, img_len, hdr_len, resume_len, dfu_source_payload, &src);
+        crc_new_data = p_lz->raw_crc;
+    }
+    else
+#endif /* End of (DFU_COMPRESSED_IMAGE != 0) */
+    {
+#if (DFU_DIFF_UPDATE != 0)
+        // Only rewrite the units that changed, header area included
+        result = dfu_storage_write_diff(p_data, data_len, dest_img_addr, hdr_len);
+#else
+        const uint8_t *p_src = p_data;
+        result = dfu_image_program(dest_img_addr, data_len, hdr_len, resume_len, dfu_source_memory, &p_src);
+#endif /* End of (DFU_DIFF_UPDATE != 0) */
+        if (0 == result)
+        {
+            // Calcuate CRC of new image data
+            DFU_PHASE_ENTER(DFU_PHASE_COMMIT_CRC);
+            crc_new_data = crc32(p_data, data_len);
+            DFU_PHASE_EXIT(DFU_PHASE_COMMIT_CRC);
+        }
+    }
+    if (0 != result)
+    {
+        LOG_ERR("Failed to write %dB image data at address: 0X%X\r\n", img_len, dest_img_addr);
+        return -1;
+    }
+
+    // Update image header based on new image data
+    img_meta_data->img_data_size = img_len;
+    img_meta_data->img_data_start_addr = dest_img_addr;
+    img_meta_data->image_data_crc = crc_new_data;
+
+    // Commit image, a failed commit is not resumed either
+    result = dfu_image_commit_blocks(img_meta_data, hdr_addr, table_addr, p_blocks);
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_JOURNAL != 0)
+    dfu_journal_end();
+#endif
+    if (0 != result)
+    {
+        LOG_ERR("Failed to commit image\r\n");
+        return -1;
+    }
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_ERASE_BLANK_CHECK != 0)
+    dfu_blank_check_report();
+#endif
+    return 0;
+}
+
+/*
+ * @brief: dfu_image_store() with the flash in its update mode
+ */
+static int dfu_image_write(image_header_t *img_meta_data, uint8_t *p_data, uint32_t data_len, uint32_t dest_img_addr,
+                           uint32_t hdr_addr, const lz_stream_header_t *p_lz, const dfu_block_crcs_t *p_blocks)
+{
+#if (DFU_STORAGE_SPI_STM32 == 1)
+    dfu_storage_update_mode(true);
+#endif
+    int result = dfu_image_store(img_meta_data, p_data, data_len, dest_img_addr, hdr_addr, p_lz, p_blocks);
+#if (DFU_STORAGE_SPI_STM32 == 1)
+    dfu_storage_update_mode(false);
+#endif
+    return result;
+}
+
+/**
+ * @brief: Update image at given address with new image data, the header is written right after the data
+ * @param img_meta_data: pointer to new image header data
+ * @param p_data: pointer to new image data
+ * @param data_len: length of new image data
+ * @param dest_img_addr: destination address to write new image
+ * @return int: 0 if the image is updated, negative value otherwise
+ */
+int dfu_image_update(image_header_t *img_meta_data, uint8_t *p_data, uint32_t data_len, uint32_t dest_img_addr)
+{
+    return dfu_image_write(img_meta_data, p_data, data_len, dest_img_addr, dest_img_addr + data_len, NULL, NULL);
+}
+
+/*
+ * @brief: Check that a stored image has the version and type of the expected one
+ * @return int: 0 if it matches, negative value otherwise
+ */
+static int dfu_image_check_version(const image_header_t *p_header, const image_header_t *p_expected)
+{
+    // Check version
+	if (p_expected->image_data_version_major    != p_header->image_data_version_major ||
+		p_expected->image_data_version_minor    != p_header->image_data_version_minor ||
+		p_expected->image_data_version_revision != p_header->image_data_version_revision )
+	{
+		LOG_WRN("Current version: %d.%d.%d is mismatch with %d.%d.%d in storage\r\n",
+		p_expected->image_data_version_major, p_expected->image_data_version_minor,
+			p_expected->image_data_version_revision, p_header->image_data_version_major,
+			p_header->image_data_version_minor, p_header->image_data_version_revision);
+		return -1;
+	}
+
+	// Check image type
+	if (p_expected->image_data_type != p_header->image_data_type)
+	{
+		LOG_WRN("Current image type: %d is mismatch with %d in storage\r\n",
+			p_expected->image_data_type, p_header->image_data_type);
+		return -1;
+	}
+    return 0;
+}
+
+/*
+ * @brief: Check if the image at the given address is valid by comparing header values
+ *         with image default value (default_image_header)
+ * @param addr: address of the image header
+ * @return int: 0 if the image is valid, negative value otherwise 
+ */
+int dfu_image_is_valid(uint32_t addr)
+{
+    // Retrieve image header
+    image_header_t read_header = {0};
+    if (dfu_image_read_header(addr, &read_header) != 0)
+    {
+        LOG_ERR("Failed to read image header\r\n");
+        return -1;
+    }
+
+    if (read_header.image_magic != IMAGE_MAGIC_NUMBER)
+    {
+        LOG_WRN("Invalid image magic number: 0x%X\r\n", read_header.image_magic);
+        return -1;
+    }
+
+    image_header_t built_in_header = dfu_fw_image_header(0, 0);
+    if (dfu_image_check_version(&read_header, &built_in_header) != 0)
+    {
+        return -1;
+    }
+
+    // Check CRC of the image data in the storage
+    if (dfu_image_validate_data_content(addr) != 0)
+    {
+        LOG_WRN("CRC check failed\r\n");
+        return -1;
+    }
+
+    LOG_INF("Valid image found at 0x%X, type: %d, length: %d \r\n", 
+        read_header.img_data_start_addr, read_header.image_data_type, read_header.img_data_size);
+    LOG_INF("Version: %d.%d.%d \r\n",
+		read_header.image_data_version_major, read_header.image_data_version_minor, read_header.image_data_version_revision);
+    LOG_INF("CRC: 0x%X \r\n", read_header.image_data_crc);
+#if (DFU_DUMP_IMAGE_DATA != 0)
+    LOG_INF("Data content: \r\n");
+    dfu_storage_read_begin(read_header.img_data_start_addr);
+    for (uint32_t offset = 0; offset < read_header.img_data_size; offset += sizeof(dfu_stream_buf))
+    {
+        uint32_t chunk_len = read_header.img_data_size - offset;
+        chunk_len = (chunk_len > sizeof(dfu_stream_buf)) ? sizeof(dfu_stream_buf) : chunk_len;
+        if (dfu_storage_read_next(dfu_stream_buf, chunk_len) != 0)
+        {
+            LOG_ERR("Failed to read %dB image data at address: 0X%X\r\n", chunk_len,
+                    read_header.img_data_start_addr + offset);
+            dfu_storage_read_end();
+            return -1;
+        }
+        for (uint32_t i = 0; i < chunk_len; i++)
+        {
+            LOG_INF("%02X ", dfu_stream_buf[i]);
+        }
+    }
+    dfu_storage_read_end();
+    LOG_INF("\r\n");
+#endif /* End of (DFU_DUMP_IMAGE_DATA != 0) */
+    return 0;
+}
+
+/******************************************************************************
+ * Image directory
+ *******************************************************************************/
+/* The directory was checked since the reset, see dfu_dir_append() */
+static bool dfu_dir_checked;
+
+/*
+ * @brief read the directory: one continuous read up to the first erased record
+ * @param[out] p_live: images in the directory, DFU_DIR_MAX_IMAGES entries
+ * @param[out] p_count: number of images
+ * @param[out] p_end: offset of the first free record
+ * @param[out] p_skipped: number of records that are not valid, may be NULL
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_dir_load(image_header_t *p_live, uint32_t *p_count, uint32_t *p_end, uint32_t *p_skipped)
+{
+    dfu_dir_entry_t entry;
+    uint32_t count = 0;
+    uint32_t offset = 0;
+    uint32_t skipped = 0;
+    int retval = dfu_storage_read_begin(DFU_DIR_ADDR);
+    while (retval == 0 && offset + sizeof(entry) <= DFU_DIR_SIZE)
+    {
+        if (dfu_storage_read_next((uint8_t *) &entry, sizeof(entry)) != 0)
+        {
+            LOG_ERR("Failed to read the directory at offset: 0X%X\r\n", offset);
+            retval = -1;
+            break;
+        }
+        if (entry.entry_magic == 0xFFFFFFFF)
+        {
+            break;
+        }
+        offset += sizeof(entry);
+        // Records torn by a power loss are skipped
+        if (entry.entry_magic != DFU_DIR_ENTRY_MAGIC || entry.header.image_magic != IMAGE_MAGIC_NUMBER)
+        {
+            skipped++;
+            continue;
+        }
+
+        uint32_t i = 0;
+        while (i < count && p_live[i].img_data_start_addr != entry.header.img_data_start_addr)
+        {
+            i++;
+        }
+        if (entry.entry_op == DFU_DIR_ENTRY_REMOVE)
+        {
+            if (i < count)
+            {
+                p_live[i] = p_live[--count];
+            }
+        }
+        else if (i < DFU_DIR_MAX_IMAGES)
+        {
+            p_live[i] = entry.header;
+            count = (i == count) ? count + 1 : count;
+        }
+        else
+        {
+            LOG_WRN("Directory holds more than %d images\r\n", DFU_DIR_MAX_IMAGES);
+        }
+    }
+    dfu_storage_read_end();
+    *p_count = count;
+    *p_end = offset;
+    if (p_skipped != NULL)
+    {
+        *p_skipped = skipped;
+    }
+    return retval;
+}
+
+/*
+ * @brief append one record, the directory is compacted to its live images when it is full. The first append after
+ *        a reset also compacts it unless it holds valid records followed by erased flash: a record torn by a power
+ *        loss, or data left in the sector by an image stored there before the directory, would corrupt the record
+ *        appended after it.
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_dir_append(const image_header_t *p_header, uint32_t op)
+{
+    image_header_t live[DFU_DIR_MAX_IMAGES];
+    uint32_t count = 0;
+    uint32_t end = 0;
+    uint32_t skipped = 0;
+    dfu_dir_entry_t entry = {.entry_magic = DFU_DIR_ENTRY_MAGIC, .header = *p_header, .entry_op = op};
+    if (dfu_dir_load(live, &count, &end, &skipped) != 0)
+    {
+        return -1;
+    }
+    bool compact = (end + sizeof(entry) > DFU_DIR_SIZE);
+    if (!dfu_dir_checked && !compact)
+    {
+        int blank = dfu_storage_compare(DFU_DIR_ADDR + end, NULL, DFU_DIR_SIZE - end);
+        if (blank < 0)
+        {
+            return -1;
+        }
+        compact = (skipped > 0 || blank == 0);
+    }
+
+    int result = 0;
+    DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+    if (compact)
+    {
+        LOG_INF("Compacting the directory, %d images\r\n", count);
+        result = dfu_storage_erase(DFU_DIR_ADDR, DFU_DIR_SIZE);
+        for (end = 0; result == 0 && end < count * sizeof(entry); end += sizeof(entry))
+        {
+            dfu_dir_entry_t kept = {.entry_magic = DFU_DIR_ENTRY_MAGIC, .header = live[end / sizeof(entry)],
+                                    .entry_op = DFU_DIR_ENTRY_ADD};
+            result = dfu_storage_write(DFU_DIR_ADDR + end, (uint8_t *) &kept, sizeof(kept));
+        }
+    }
+    if (result == 0)
+    {
+        result = dfu_storage_write(DFU_DIR_ADDR + end, (uint8_t *) &entry, sizeof(entry));
+    }
+    DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+    if (result != 0)
+    {
+        LOG_ERR("Failed to write the directory at offset: 0X%X\r\n", end);
+        return -1;
+    }
+    dfu_dir_checked = true;
+    return 0;
+}
+
+/*
+ * @brief list the images in the directory
+ * @param[out] p_headers: headers of the images, up to max_count
+ * @return int number of images in the directory, negative value otherwise
+ */
+int dfu_dir_list(image_header_t *p_headers, uint32_t max_count)
+{
+    image_header_t live[DFU_DIR_MAX_IMAGES];
+    uint32_t count = 0;
+    uint32_t end = 0;
+    if (dfu_dir_load(live, &count, &end, NULL) != 0)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count && i < max_count; i++)
+    {
+        p_headers[i] = live[i];
+    }
+    return (int) count;
+}
+
+/*
+ * @brief newest image (highest sequence number) of the given type in the directory, the data is not checked
+ * @return int 0 on success, negative value if there is no image of this type
+ */
+int dfu_dir_find(uint8_t image_type, image_header_t *p_header)
+{
+    image_header_t live[DFU_DIR_MAX_IMAGES];
+    uint32_t count = 0;
+    uint32_t end = 0;
+    int found = -1;
+    if (dfu_dir_load(live, &count, &end, NULL) != 0)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (live[i].image_data_type == image_type &&
+            (found < 0 || (int32_t) (live[i].image_sequence - live[found].image_sequence) > 0))
+        {
+            found = i;
+        }
+    }
+    if (found < 0)
+    {
+        return -1;
+    }
+    *p_header = live[found];
+    return 0;
+}
+
+/*
+ * @brief index a committed image, replaces the image previously stored at the same address
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_dir_add(const image_header_t *p_header)
+{
+    assert(p_header != NULL);
+    return dfu_dir_append(p_header, DFU_DIR_ENTRY_ADD);
+}
+
+/*
+ * @brief remove the image stored at the given address from the directory
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_dir_remove(uint32_t img_data_start_addr)
+{
+    image_header_t header = {.image_magic = IMAGE_MAGIC_NUMBER, .img_data_start_addr = img_data_start_addr};
+    return dfu_dir_append(&header, DFU_DIR_ENTRY_REMOVE);
+}
+
+/******************************************************************************
+ * Image slots
+ *******************************************************************************/
+/*
+ * @brief size of a slot: the flash after DFU_SLOT_BASE_ADDR split in DFU_SLOT_COUNT, aligned down to the largest
+ *        erase size, DFU_SLOT_SIZE if the flash size is unknown
+ */
+uint32_t dfu_slot_size(void)
+{
+#if (DFU_STORAGE_SPI_STM32 == 1)
+    if (dfu_storage_backend() == NULL)
+    {
+        dfu_storage_probe();
+    }
+    const dfu_storage_geometry_t *geo = dfu_storage_geometry();
+    if (geo != NULL && geo->size > DFU_SLOT_BASE_ADDR)
+    {
+        uint32_t largest_erase = geo->erase[geo->erase_count - 1].size;
+        return ((geo->size - DFU_SLOT_BASE_ADDR) / DFU_SLOT_COUNT) & ~(largest_erase - 1);
+    }
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) */
+    return DFU_SLOT_SIZE;
+}
+
+/*
+ * @brief address of a slot, the image data starts there (aligned for the largest erases) and the header is in the
+ *        last DFU_SLOT_HEADER_SIZE bytes of the slot
+ */
+uint32_t dfu_slot_addr(uint8_t slot)
+{
+    return DFU_SLOT_BASE_ADDR + (uint32_t) slot * dfu_slot_size();
+}
+
+static uint32_t dfu_slot_header_addr(uint8_t slot)
+{
+    return dfu_slot_addr(slot) + dfu_slot_size() - DFU_SLOT_HEADER_SIZE;
+}
+
+/*
+ * @brief bring the directory record of a slot in line with its header: the header is committed (or invalidated by a
+ *        rollback) first, a reset can leave the record out of date
+ * @param p_header: header of the slot, NULL if it holds no image
+ * @param p_record: directory record of the slot, NULL if there is none
+ */
+static void dfu_slot_dir_sync(uint8_t slot, const image_header_t *p_header, const image_header_t *p_record)
+{
+    int result = 0;
+    if (p_header != NULL && (p_record == NULL || p_record->image_sequence != p_header->image_sequence))
+    {
+        result = dfu_dir_add(p_header);
+    }
+    else if (p_header == NULL && p_record != NULL)
+    {
+        result = dfu_dir_remove(dfu_slot_addr(slot));
+    }
+    if (result != 0)
+    {
+        LOG_WRN("Failed to update the directory record of slot %d\r\n", slot);
+    }
+}
+
+/*
+ * @brief find the valid slot (magic number and data CRC) with the highest sequence number. The slot headers decide,
+ *        the directory records of the slots are fixed up to match them.
+ * @param[out] p_header: header of the slot found
+ * @param exclude: slot to ignore, negative value for none
+ * @return int slot index, negative value if no slot is valid
+ */
+static int dfu_slot_find(image_header_t *p_header, int exclude)
+{
+    image_header_t headers[DFU_SLOT_COUNT];
+    bool candidate[DFU_SLOT_COUNT] = {false};
+    image_header_t stored[DFU_DIR_MAX_IMAGES];
+    int count = dfu_dir_list(stored, DFU_DIR_MAX_IMAGES);
+    for (uint8_t slot = 0; slot < DFU_SLOT_COUNT; slot++)
+    {
+        if (slot == exclude)
+        {
+            continue;
+        }
+        int read = dfu_image_read_header(dfu_slot_header_addr(slot), &headers[slot]);
+        candidate[slot] = (read == 0) && (headers[slot].image_magic == IMAGE_MAGIC_NUMBER);
+        const image_header_t *p_record = NULL;
+        for (int i = 0; i < count && i < DFU_DIR_MAX_IMAGES; i++)
+        {
+            p_record = (stored[i].img_data_start_addr == dfu_slot_addr(slot)) ? &stored[i] : p_record;
+        }
+        // Unreadable header or directory: the record is left as it is
+        if (read == 0 && count >= 0)
+        {
+            dfu_slot_dir_sync(slot, candidate[slot] ? &headers[slot] : NULL, p_record);
+        }
+    }
+
+    // Newest first, the CRC is only checked on the slots that would be selected
+    while (true)
+    {
+        int best = -1;
+        for (uint8_t slot = 0; slot < DFU_SLOT_COUNT; slot++)
+        {
+            if (candidate[slot] &&
+                (best < 0 || (int32_t) (headers[slot].image_sequence - headers[best].image_sequence) > 0))
+            {
+                best = slot;
+            }
+        }
+        if (best < 0)
+        {
+            return -1;
+        }
+        if (dfu_image_check_data(&headers[best], dfu_slot_header_addr(best)) == 0)
+        {
+            *p_header = headers[best];
+            return best;
+        }
+        LOG_WRN("Slot %d, sequence %d is not valid\r\n", best, headers[best].image_sequence);
+        candidate[best] = false;
+    }
+}
+
+/*
+ * @brief active slot: the valid slot with the highest sequence number
+ * @param[out] p_header: header of the active slot
+ * @return int slot index, negative value if no slot is valid
+ */
+int dfu_slot_active(image_header_t *p_header)
+{
+    assert(p_header != NULL);
+    return dfu_slot_find(p_header, -1);
+}
+
+/*
+ * @brief slot written by the next update: the one after the active slot, whose image is the oldest
+ */
+static uint8_t dfu_slot_next(int active)
+{
+    return (active < 0) ? 0 : (uint8_t) ((active + 1) % DFU_SLOT_COUNT);
+}
+
+/*
+ * @brief write an image into the slot after the active one. The active slot is untouched until the new header is
+ *        committed, which makes the new slot active.
+ */
+static int dfu_slot_write(int active, const image_header_t *active_header, image_header_t *img_meta_data,
+                          uint8_t *p_data, uint32_t data_len, const dfu_block_crcs_t *p_blocks)
+{
+    const lz_stream_header_t *p_lz = lz_stream_payload_header(p_data, data_len);
+    uint32_t img_len = (p_lz != NULL) ? p_lz->raw_size : data_len;
+    if (img_len > dfu_slot_size() - DFU_SLOT_HEADER_SIZE)
+    {
+        LOG_ERR("Image of %dB does not fit in a slot\r\n", img_len);
+        return -1;
+    }
+    uint8_t slot = dfu_slot_next(active);
+    img_meta_data->image_sequence = (active < 0) ? 1 : active_header->image_sequence + 1;
+    if (dfu_image_write(img_meta_data, p_data, data_len, dfu_slot_addr(slot), dfu_slot_header_addr(slot), p_lz,
+                        p_blocks) != 0)
+    {
+        LOG_ERR("Failed to update slot %d\r\n", slot);
+        return -1;
+    }
+    LOG_INF("Slot %d active, sequence: %d\r\n", slot, img_meta_data->image_sequence);
+    return slot;
+}
+
+/*
+ * @brief write a new image into the inactive slot and switch to it
+ * @param img_meta_data: pointer to new image header data, size, address, CRC and sequence are filled in
+ * @param p_data: raw image or compressed payload (Host/tools/lz_pack)
+ * @return int index of the new active slot, negative value otherwise
+ */
+int dfu_slot_update(image_header_t *img_meta_data, uint8_t *p_data, uint32_t data_len)
+{
+    assert(img_meta_data != NULL);
+    image_header_t active_header;
+    int active = dfu_slot_find(&active_header, -1);
+    return dfu_slot_write(active, &active_header, img_meta_data, p_data, data_len, NULL);
+}
+
+/*
+ * @brief go back to the previous image: the magic number of the active header is programmed to 0 (no erase
+ *        needed), so the previous valid slot becomes active
+ * @return int index of the new active slot, negative value otherwise
+ */
+int dfu_slot_rollback(void)
+{
+    image_header_t header;
+    int active = dfu_slot_find(&header, -1);
+    int previous = (active < 0) ? -1 : dfu_slot_find(&header, active);
+    if (previous < 0)
+    {
+        LOG_ERR("No image to roll back to\r\n");
+        return -1;
+    }
+
+    uint32_t magic = 0;
+    DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+    int result = dfu_storage_write(dfu_slot_header_addr(active), (uint8_t *) &magic, sizeof(magic));
+    DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+    if (result != 0)
+    {
+        LOG_ERR("Failed to invalidate slot %d\r\n", active);
+        return -1;
+    }
+    // The header decides, dfu_slot_find() removes a record left by a failure or a reset here
+    if (dfu_dir_remove(dfu_slot_addr(active)) != 0)
+    {
+        LOG_WRN("Failed to remove slot %d from the directory\r\n", active);
+    }
+    LOG_INF("Rolled back from slot %d to slot %d, sequence: %d\r\n", active, previous, header.image_sequence);
+    return previous;
+}
+
+/*
+ * @brief check that the active slot holds the firmware image built into this application
+ * @param fw_header: header of the built-in image, see dfu_fw_image_source()
+ * @return int 0 if it does, negative value otherwise
+ */
+static int dfu_fw_image_check(int active, const image_header_t *active_header, const image_header_t *fw_header,
+                              const uint8_t *fw_data, uint32_t fw_len)
+{
+    if (active < 0 || dfu_image_check_version(active_header, fw_header) != 0)
+    {
+        return -1;
+    }
+    // A compressed payload carries the size and CRC of the decompressed image
+    const lz_stream_header_t *p_lz = lz_stream_payload_header(fw_data, fw_len);
+    uint32_t img_len = (p_lz != NULL) ? p_lz->raw_size : fw_len;
+    if (active_header->img_data_size != img_len ||
+        active_header->image_data_crc != ((p_lz != NULL) ? p_lz->raw_crc : crc32(fw_data, fw_len)))
+    {
+        LOG_WRN("Image in slot %d differs from the built-in one\r\n", active);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief header of the firmware image built into this application
+ */
+static image_header_t dfu_fw_image_header(uint32_t fw_len, uint32_t addr)
+{
+    image_header_t header = {
+        .image_magic = IMAGE_MAGIC_NUMBER,
+        .image_data_type = IMAGE_TYPE_RFIC_FIRMWARE,
+        .image_data_version_major = IMAGE_FIRMWARE_MAJOR_VERSION,
+        .image_data_version_minor = IMAGE_FIRMWARE_MINOR_VERSION,
+        .image_data_version_revision = IMAGE_FIRMWARE_REVISION_VERSION,
+        .img_data_size = fw_len,
+        .img_data_start_addr = addr,
+    };
+    return header;
+}
+
+/*
+ * @brief header and data of the firmware image built into this application. A pack (Host/tools/image_pack) gives
+ *        the header built at pack time and the payload of its firmware entry, a raw image or a compressed payload
+ *        gets the built-in version.
+ * @param[in,out] pp_data, p_len: built-in data, then the raw image or compressed payload to write
+ * @param[out] p_blocks: block CRCs of the pack entry, none otherwise
+ */
+static image_header_t dfu_fw_image_source(const uint8_t **pp_data, uint32_t *p_len, dfu_block_crcs_t *p_blocks)
+{
+    const image_pack_entry_t *p_entry = image_pack_find(*pp_data, *p_len, IMAGE_TYPE_RFIC_FIRMWARE);
+    p_blocks->p_crcs = NULL;
+    if (p_entry == NULL)
+    {
+        return dfu_fw_image_header(*p_len, 0);
+    }
+    image_header_t header = p_entry->header;
+    if ((p_entry->flags & IMAGE_PACK_FLAG_BLOCK_CRC) != 0)
+    {
+        p_blocks->p_crcs = *pp_data + p_entry->block_crc_offset;
+        p_blocks->block_size_log2 = p_entry->block_size_log2;
+    }
+    *pp_data += p_entry->payload_offset;
+    *p_len = p_entry->payload_len;
+    return header;
+}
+
+/**
+ * @brief Update the firmware image in the storage if the active slot does not hold it. The new image is written to
+ *        the inactive slot, the active one stays valid until the switch.
+ * @param fw_data: raw image, compressed payload (fw.lz) or pack (image_pack)
+ * @return int 
+ */
+int dfu_fw_image_update(uint8_t* fw_data, uint32_t fw_len)
+{
+	int retval = 0;
+    image_header_t active_header;
+    int active = dfu_slot_active(&active_header);
+    const uint8_t *p_data = fw_data;
+    dfu_block_crcs_t blocks;
+    image_header_t default_image_header = dfu_fw_image_source(&p_data, &fw_len, &blocks);
+    //Check and update new img if needed
+    if (dfu_fw_image_check(active, &active_header, &default_image_header, p_data, fw_len) != 0)
+	{
+        uint8_t img_update_retry = 5;
+		LOG_WRN("Invalid image, perform DFU update");
+		// Try to update image with max img_update_retry attempts
+		for (uint8_t retry = 0; retry <= img_update_retry; retry++)
+		{
+			if (retry == img_update_retry)
+			{
+				LOG_ERR("dfu_fw_image_update() Failed to update image after %d attempts", retry);
+				retval = -1;
+				break;
+			}
+
+			if (dfu_slot_write(active, &active_header, &default_image_header, (uint8_t *) p_data, fw_len, &blocks) < 0)
+			{
+				LOG_ERR("dfu_fw_image_update() Failed to update image, (%d/%d)", retry + 1, img_update_retry);
+			}
+			else
+			{
+				LOG_INF("Image updated successfully");
+				retval = 0;
+				break;
+			}
+		}
+	}
+    return retval;
+}
+
+#if (DFU_STORAGE_SPI_STM32 == 1)
+/******************************************************************************
+ * Non-blocking update
+ *******************************************************************************/
+
+/*
+ * @brief length of the data page starting at addr, pages never cross a flash page
+ */
+static uint32_t dfu_update_page_len(const dfu_update_t *ctx, uint32_t addr)
+{
+    uint32_t page_size = dfu_storage_geometry()->page_size;
+    uint32_t page_len = page_size - (addr & (page_size - 1));
+    uint32_t left = ctx->dest_addr + ctx->total_len - addr;
+    return (page_len > left) ? left : page_len;
+}
+
+/*
+ * @brief start programming one page, the data is staged by the backend so its buffer can be reused at once
+ */
+static void dfu_update_start_page(dfu_update_t *ctx, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    const dfu_storage_geometry_t *geo = dfu_storage_geometry();
+#if (DFU_ERASE_BLANK_CHECK != 0)
+    dfu_blank_known_drop(addr, len);
+#endif
+    ctx->busy_data = dfu_storage_backend()->program_stage(addr, data, len);
+    dfu_storage_backend()->program_start();
+
+    ctx->busy = true;
+    ctx->busy_addr = addr;
+    ctx->busy_len = len;
+    ctx->busy_readback = (dfu_write_verify == DFU_VERIFY_FULL) ||
+                         (dfu_write_verify == DFU_VERIFY_SAMPLED &&
+                          ((addr / geo->page_size) % DFU_VERIFY_SAMPLE_PAGES) == 0);
+    ctx->busy_tick = HAL_GetTick();
+    ctx->busy_timeout_ms = geo->program_max_ms + 1;
+}
+
+/*
+ * @brief check the erase or page program in flight without waiting for it
+ * @return int 1 if it is still running, 0 once it completed successfully, negative value otherwise
+ */
+static int dfu_update_check_busy(dfu_update_t *ctx)
+{
+    int status = dfu_storage_backend()->status();
+    if (status == DFU_STORAGE_BUSY)
+    {
+        if (HAL_GetTick() - ctx->busy_tick > ctx->busy_timeout_ms)
+        {
+            LOG_ERR("Timeout of the operation at address: 0X%X\r\n", ctx->busy_addr);
+            return -1;
+        }
+        return 1;
+    }
+
+    ctx->busy = false;
+    if (status != DFU_STORAGE_READY)
+    {
+        LOG_ERR("Failed to %s at address: 0X%X\r\n", (ctx->busy_len > 0) ? "program" : "erase", ctx->busy_addr);
+        return -1;
+    }
+    if (ctx->busy_len == 0)
+    {
+#if (DFU_JOURNAL != 0)
+        dfu_journal_erased(ctx->busy_erase_id, ctx->busy_addr);
+#endif
+        return 0;
+    }
+
+    if (ctx->busy_readback)
+    {
+        DFU_PHASE_ENTER(DFU_PHASE_VERIFY);
+        int verify_result = dfu_storage_read(ctx->busy_addr, dfu_stream_buf, ctx->busy_len);
+        if (verify_result == 0)
+        {
+            verify_result = memcmp(dfu_stream_buf, ctx->busy_data, ctx->busy_len);
+        }
+        DFU_PHASE_EXIT(DFU_PHASE_VERIFY);
+        if (verify_result != 0)
+        {
+            LOG_ERR("Failed to write %dB storage at address: 0X%X\r\n", ctx->busy_len, ctx->busy_addr);
+            return -1;
+        }
+    }
+#if (DFU_BLOCK_CRC != 0)
+    if (ctx->table_addr != 0 && ctx->busy_addr >= ctx->table_addr && ctx->busy_addr < ctx->hdr_addr)
+    {
+        // Block table
+        return 0;
+    }
+#endif
+#if (DFU_JOURNAL != 0)
+    if (ctx->busy_addr >= DFU_JOURNAL_ADDR && ctx->busy_addr < DFU_JOURNAL_ADDR + DFU_JOURNAL_SIZE)
+    {
+        return 0;
+    }
+#endif
+    if (ctx->state == DFU_UPDATE_COMMIT)
+    {
+        ctx->header_written += ctx->busy_len;
+    }
+    else
+    {
+        ctx->programmed += ctx->busy_len;
+#if (DFU_JOURNAL != 0)
+        dfu_journal_programmed(ctx->dest_addr + ctx->programmed);
+#endif
+    }
+    return 0;
+}
+
+static void dfu_update_start_erase(dfu_update_t *ctx, uint8_t id, uint32_t addr)
+{
+    dfu_storage_backend()->erase_start(id, addr);
+    ctx->busy = true;
+    ctx->busy_addr = addr;
+    ctx->busy_len = 0;
+    ctx->busy_erase_id = id;
+    ctx->busy_readback = false;
+    ctx->busy_tick = HAL_GetTick();
+    ctx->busy_timeout_ms = dfu_storage_erase_max_ms(id) + 1;
+}
+
+#if (DFU_JOURNAL != 0)
+/*
+ * @brief start programming the journal bits of the last erase or of the units programmed, before the next operation
+ * @return int 1 if a step was done, 0 if the journal is up to date, negative value otherwise
+ */
+static int dfu_update_journal_step(dfu_update_t *ctx)
+{
+    uint32_t addr = 0;
+    const uint8_t *data = NULL;
+    uint32_t len = 0;
+    int result = dfu_journal_next(&addr, &data, &len);
+    if (result > 0)
+    {
+        dfu_update_start_page(ctx, addr, data, len);
+    }
+    return result;
+}
+#endif /* End of (DFU_JOURNAL != 0) */
+
+/*
+ * @brief start the next erase of the image area. The bytes of the unaligned head and tail units that are outside
+ *        the area are kept in dfu_work.erase_keep and programmed back in one step once the unit is erased.
+ * @return int 1 if a step was done, negative value otherwise
+ */
+static int dfu_update_erase_step(dfu_update_t *ctx)
+{
+    const erase_plan_geometry_t *geo = &dfu_storage_geometry()->plan;
+    uint32_t unit_size = geo->types[0].size;
+    uint32_t addr = ctx->erase_addr;
+    uint32_t end = ctx->erase_end;
+
+#if (DFU_JOURNAL != 0)
+    int journal = dfu_update_journal_step(ctx);
+    if (journal != 0)
+    {
+        return journal;
+    }
+#endif
+    if (ctx->keep_len > 0)
+    {
+        uint32_t keep_unit = ctx->keep_start & ~(unit_size - 1);
+        uint32_t keep_end = ctx->keep_start + ctx->keep_len;
+        ctx->keep_len = 0;
+        if (dfu_storage_erase_partial_restore(geo, keep_unit, ctx->keep_start, keep_end) != 0)
+        {
+            return -1;
+        }
+        return 1;
+    }
+    if (addr >= end && ctx->erase_data_pending)
+    {
+        ctx->erase_data_pending = false;
+        ctx->erase_addr = ctx->dest_addr + ctx->resume_len;
+        ctx->erase_end = ctx->dest_addr + ctx->total_len;
+        ctx->erase_run_end = 0;
+        return 1;
+    }
+    if (addr >= end)
+    {
+#if (DFU_COMPRESSED_IMAGE != 0)
+        // The decoder takes over the RAM of the keep buffer
+        if (ctx->compressed)
+        {
+            lz_stream_init(&dfu_work.lz);
+        }
+#endif
+        ctx->state = DFU_UPDATE_PROGRAM;
+        return 1;
+    }
+
+    uint32_t unit_addr = addr & ~(unit_size - 1);
+    uint32_t aligned_end = end & ~(unit_size - 1);
+    if (addr != unit_addr || addr >= aligned_end)
+    {
+        uint32_t part_end = (end < unit_addr + unit_size) ? end : unit_addr + unit_size;
+        int result = dfu_storage_erase_partial_keep(geo, unit_addr, addr, part_end);
+        if (result < 0)
+        {
+            LOG_ERR("Failed to erase %dB at address: 0X%X\r\n", part_end - addr, addr);
+            return -1;
+        }
+        if (result > 0)
+        {
+            dfu_update_start_erase(ctx, geo->types[0].id, unit_addr);
+            ctx->keep_start = addr;
+            ctx->keep_len = part_end - addr;
+        }
+        ctx->erase_addr = part_end;
+        ctx->erased += part_end - addr;
+        return 1;
+    }
+
+    // Blank units are skipped in one step, an erase is started per step
+    erase_plan_op_t op;
+    int result = dfu_storage_erase_next(geo, addr, aligned_end, &ctx->erase_run_end, &op);
+    if (result < 0)
+    {
+        return -1;
+    }
+    if (result > 0)
+    {
+        dfu_update_start_erase(ctx, op.id, op.addr);
+    }
+    ctx->erase_addr += op.size;
+    ctx->erased += op.size;
+    return 1;
+}
+
+#if (DFU_BLOCK_CRC != 0)
+/*
+ * @brief add fed data at offset ctx->received to the CRC of its blocks. The feed runs less than a block ahead of
+ *        programming, the CRCs of the last two blocks fed are enough for the block check.
+ */
+static void dfu_update_fed_blocks(dfu_update_t *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t block_size = 1UL << ctx->block_size_log2;
+    uint32_t offset = ctx->received;
+    while (len > 0)
+    {
+        uint32_t part = block_size - (offset & (block_size - 1));
+        part = (part > len) ? len : part;
+        ctx->fed_block_crc = crc32_update(ctx->fed_block_crc, data, part);
+        offset += part;
+        data += part;
+        len -= part;
+        if ((offset & (block_size - 1)) == 0 || offset == ctx->total_len)
+        {
+            ctx->fed_block_done[((offset - 1) >> ctx->block_size_log2) & 1] = crc32_final(ctx->fed_block_crc);
+            ctx->fed_block_crc = crc32_init();
+        }
+    }
+}
+
+/*
+ * @brief end of the oldest block not checked yet, offset in the image
+ */
+static uint32_t dfu_update_block_end(const dfu_update_t *ctx)
+{
+    uint32_t block_size = 1UL << ctx->block_size_log2;
+    uint32_t left = ctx->total_len - (ctx->verified & ~(block_size - 1));
+    return (ctx->verified & ~(block_size - 1)) + ((left > block_size) ? block_size : left);
+}
+
+/*
+ * @brief read back the next chunk of the oldest programmed block not checked yet. A complete block is checked
+ *        against the block CRCs given with the image, or the CRC of the fed block, and its CRC is programmed in
+ *        the block table once a table page is complete.
+ * @return int 1 if a step was done, negative value otherwise
+ */
+static int dfu_update_block_step(dfu_update_t *ctx)
+{
+    uint32_t block_end = dfu_update_block_end(ctx);
+    uint32_t chunk_len = block_end - ctx->verified;
+    chunk_len = (chunk_len > sizeof(dfu_stream_buf)) ? sizeof(dfu_stream_buf) : chunk_len;
+    if (dfu_storage_read(ctx->dest_addr + ctx->verified, dfu_stream_buf, chunk_len) != 0)
+    {
+        LOG_ERR("Failed to read %dB storage at address: 0X%X\r\n", chunk_len, ctx->dest_addr + ctx->verified);
+        return -1;
+    }
+    ctx->verify_crc = crc32_update(ctx->verify_crc, dfu_stream_buf, chunk_len);
+    ctx->block_crc = crc32_update(ctx->block_crc, dfu_stream_buf, chunk_len);
+    ctx->verified += chunk_len;
+    if (ctx->verified < block_end)
+    {
+        return 1;
+    }
+
+    uint32_t index = (block_end - 1) >> ctx->block_size_log2;
+    uint32_t crc = crc32_final(ctx->block_crc);
+    uint32_t expected = (ctx->src_blocks.p_crcs != NULL) ? dfu_block_crc_get(ctx->src_blocks.p_crcs, index)
+                                                         : ctx->fed_block_done[index & 1];
+    ctx->block_crc = crc32_init();
+    // Blocks programmed before a reset are fed ahead of their check, only the image CRC covers them
+    if (crc != expected && (ctx->src_blocks.p_crcs != NULL || block_end > ctx->resume_len))
+    {
+#if (DFU_JOURNAL != 0)
+        dfu_journal_end();
+#endif
+        LOG_ERR("Block %d at address: 0X%X is corrupted: %x instead of %x\r\n", index,
+                ctx->dest_addr + (index << ctx->block_size_log2), crc, expected);
+        return -1;
+    }
+    ctx->table_crc = crc32_update(ctx->table_crc, &crc, sizeof(crc));
+    uint32_t addr = 0;
+    uint32_t len = dfu_block_page_add(ctx->table_addr, index, dfu_block_count(ctx->total_len, ctx->block_size_log2),
+                                      crc, &addr);
+    if (len > 0)
+    {
+        dfu_update_start_page(ctx, addr, &dfu_block_page[addr % sizeof(dfu_block_page)], len);
+    }
+    return 1;
+}
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+
+/*
+ * @brief start programming the oldest fed page
+ * @return int 1 if a step was done, 0 while waiting for data
+ */
+static int dfu_update_program_step(dfu_update_t *ctx)
+{
+#if (DFU_JOURNAL != 0)
+    int journal = dfu_update_journal_step(ctx);
+    if (journal != 0)
+    {
+        return journal;
+    }
+#endif
+#if (DFU_BLOCK_CRC != 0)
+    // A block is checked once programmed, before the next page
+    if (ctx->table_addr != 0 && ctx->verified < ctx->programmed && dfu_update_block_end(ctx) <= ctx->programmed)
+    {
+        return dfu_update_block_step(ctx);
+    }
+#endif
+    if (ctx->programmed == ctx->total_len && ctx->received == ctx->total_len)
+    {
+        // Blocks checked while programming are not read again
+        ctx->state = DFU_UPDATE_VERIFY;
+        return 1;
+    }
+    if (ctx->page_queued == 0)
+    {
+        return 0;
     }
+    uint32_t addr = ctx->dest_addr + ctx->started;
+    uint32_t len = dfu_update_page_len(ctx, addr);
+    dfu_update_start_page(ctx, addr, ctx->pages[ctx->page_tail], len);
+    ctx->page_tail = (ctx->page_tail + 1) % DFU_UPDATE_BUF_PAGES;
+    ctx->page_queued--;
+    ctx->started += len;
+    return 1;
+}
 
-    // Check version
-	if (IMAGE_FIRMWARE_MAJOR_VERSION    != read_header.image_data_version_major ||
-		IMAGE_FIRMWARE_MINOR_VERSION    != read_header.image_data_version_minor ||
-		IMAGE_FIRMWARE_REVISION_VERSION != read_header.image_data_version_revision )
-	{
-		LOG_WRN("Current version: %d.%d.%d is mismatch with %d.%d.%d in storage\r\n",
-		IMAGE_FIRMWARE_MAJOR_VERSION, IMAGE_FIRMWARE_MINOR_VERSION, IMAGE_FIRMWARE_REVISION_VERSION,
-			read_header.image_data_version_major, read_header.image_data_version_minor, read_header.image_data_version_revision);
-		return -1;
-	}
+/*
+ * @brief CRC of the next chunk of stored data, compared to the CRC of the fed data at the end
+ * @return int 1 if a step was done, negative value otherwise
+ */
+static int dfu_update_verify_step(dfu_update_t *ctx)
+{
+    if (ctx->verified < ctx->total_len)
+    {
+        uint32_t chunk_len = ctx->total_len - ctx->verified;
+        chunk_len = (chunk_len > sizeof(dfu_stream_buf)) ? sizeof(dfu_stream_buf) : chunk_len;
+        if (dfu_storage_read(ctx->dest_addr + ctx->verified, dfu_stream_buf, chunk_len) != 0)
+        {
+            LOG_ERR("Failed to read %dB storage at address: 0X%X\r\n", chunk_len, ctx->dest_addr + ctx->verified);
+            return -1;
+        }
+        ctx->verify_crc = crc32_update(ctx->verify_crc, dfu_stream_buf, chunk_len);
+        ctx->verified += chunk_len;
+        return 1;
+    }
 
-	// Check image type
-	if (IMAGE_TYPE_RFIC_FIRMWARE != read_header.image_data_type)
-	{
-		LOG_WRN("Current image type: %d is mismatch with %d in storage\r\n",
-			IMAGE_TYPE_RFIC_FIRMWARE, read_header.image_data_type);
-		return -1;
-	}
+    uint32_t crc_data = crc32_final(ctx->crc);
+    uint32_t crc_storage = crc32_final(ctx->verify_crc);
+    if (crc_storage != crc_data || (ctx->compressed && crc_data != ctx->payload_crc))
+    {
+#if (DFU_JOURNAL != 0)
+        // Data kept from an other update, or corrupted: the next update starts over
+        dfu_journal_end();
+#endif
+        LOG_ERR("Image data CRC is invalid: %x instead of %x\r\n", crc_storage,
+                ctx->compressed ? ctx->payload_crc : crc_data);
+        return -1;
+    }
+    ctx->header.image_data_crc = crc_data;
+    ctx->header_written = 0;
+    ctx->state = DFU_UPDATE_COMMIT;
+#if (DFU_BLOCK_CRC != 0)
+    if (ctx->table_addr != 0)
+    {
+        // Table header, within the first page of the table
+        dfu_block_table_t table = {
+            .table_magic = DFU_BLOCK_TABLE_MAGIC,
+            .img_data_size = ctx->total_len,
+            .image_data_crc = crc_data,
+            .block_count = (uint16_t) dfu_block_count(ctx->total_len, ctx->block_size_log2),
+            .block_size_log2 = ctx->block_size_log2,
+            .reserved = 0xFF,
+            .table_crc = crc32_final(ctx->table_crc),
+        };
+        dfu_update_start_page(ctx, ctx->table_addr, (const uint8_t *) &table, sizeof(table));
+    }
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+    return 1;
+}
 
-    // Check CRC of the image data in the storage
-    if (dfu_image_validate_data_content(addr) != 0)
+/*
+ * @brief program the next part of the image header, the header may cross a page boundary
+ * @return int 1 if a step was done, 0 once the image is committed
+ */
+static int dfu_update_commit_step(dfu_update_t *ctx)
+{
+    if (ctx->header_written == sizeof(image_header_t))
     {
-        LOG_WRN("CRC check failed\r\n");
+#if (DFU_JOURNAL != 0)
+        dfu_journal_close();
+        int journal = dfu_update_journal_step(ctx);
+        if (journal != 0)
+        {
+            return journal;
+        }
+#endif
+        if (dfu_dir_add(&ctx->header) != 0)
+        {
+            LOG_WRN("Failed to add the image to the directory\r\n");
+        }
+        LOG_INF("Image updated successfully\r\n");
+#if (DFU_ERASE_BLANK_CHECK != 0)
+        dfu_blank_check_report();
+#endif
+        ctx->state = DFU_UPDATE_DONE;
+        return 0;
+    }
+    uint32_t addr = ctx->hdr_addr + ctx->header_written;
+    uint32_t page_size = dfu_storage_geometry()->page_size;
+    uint32_t len = page_size - (addr & (page_size - 1));
+    len = (len > sizeof(image_header_t) - ctx->header_written) ? sizeof(image_header_t) - ctx->header_written : len;
+    dfu_update_start_page(ctx, addr, (const uint8_t *) &ctx->header + ctx->header_written, len);
+    return 1;
+}
+
+/*
+ * @brief one bounded step of the update: completion of the operation in flight or start of the next one
+ * @return int 1 to continue within the time slice, 0 to give the time back, negative value on failure
+ */
+static int dfu_update_step(dfu_update_t *ctx)
+{
+    if (ctx->busy)
+    {
+        int result = dfu_update_check_busy(ctx);
+        if (result < 0)
+        {
+            return -1;
+        }
+        if (result > 0)
+        {
+            // A page program ends within the slice, an erase does not
+            return (ctx->busy_len > 0) ? 1 : 0;
+        }
+    }
+
+    int result = 0;
+    switch (ctx->state)
+    {
+    case DFU_UPDATE_ERASE:
+        DFU_PHASE_ENTER(DFU_PHASE_ERASE);
+        result = dfu_update_erase_step(ctx);
+        DFU_PHASE_EXIT(DFU_PHASE_ERASE);
+        break;
+    case DFU_UPDATE_PROGRAM:
+        DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+        result = dfu_update_program_step(ctx);
+        DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+        break;
+    case DFU_UPDATE_VERIFY:
+        DFU_PHASE_ENTER(DFU_PHASE_COMMIT_CRC);
+        result = dfu_update_verify_step(ctx);
+        DFU_PHASE_EXIT(DFU_PHASE_COMMIT_CRC);
+        break;
+    case DFU_UPDATE_COMMIT:
+        DFU_PHASE_ENTER(DFU_PHASE_PROGRAM);
+        result = dfu_update_commit_step(ctx);
+        DFU_PHASE_EXIT(DFU_PHASE_PROGRAM);
+        break;
+    default:
+        break;
+    }
+    return result;
+}
+
+/*
+ * @brief start a non-blocking update of the image at dest_img_addr: the image area is erased, the data given to
+ *        dfu_update_feed() is programmed, the stored data is checked against the CRC of the fed data and the header
+ *        is committed, all from dfu_update_poll(). Unlike dfu_image_update() the whole area is rewritten.
+ * @param img_meta_data: header of the new image, size, address and CRC are filled in
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_update_begin(dfu_update_t *ctx, const image_header_t *img_meta_data, uint32_t dest_img_addr, uint32_t data_len,
+                     uint32_t hdr_addr)
+{
+    assert(ctx != NULL && img_meta_data != NULL);
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->header = *img_meta_data;
+    ctx->header.img_data_size = data_len;
+    ctx->header.img_data_start_addr = dest_img_addr;
+    ctx->hdr_addr = hdr_addr;
+    ctx->dest_addr = dest_img_addr;
+    ctx->total_len = data_len;
+    ctx->budget_ms = DFU_UPDATE_BUDGET_MS;
+#if (DFU_BLOCK_CRC != 0)
+    // Blocks are checked as soon as they are programmed, their CRCs go to the table below a separate header
+    ctx->table_addr = dfu_block_table_addr(dest_img_addr, data_len, hdr_addr);
+    ctx->block_size_log2 = dfu_block_size_log2(data_len, NULL);
+    ctx->block_crc = crc32_init();
+    ctx->fed_block_crc = crc32_init();
+    ctx->table_crc = crc32_init();
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+    // A header right after the data is erased with it, a separate one (slot header) is erased first
+    ctx->erase_data_pending = (hdr_addr != dest_img_addr + data_len);
+    ctx->erase_addr = !ctx->erase_data_pending ? dest_img_addr : (ctx->table_addr != 0) ? ctx->table_addr : hdr_addr;
+    ctx->erase_end = hdr_addr + sizeof(image_header_t);
+    ctx->crc = crc32_init();
+    ctx->verify_crc = crc32_init();
+
+    if (dfu_storage_backend() == NULL && dfu_storage_probe() != 0)
+    {
+        ctx->state = DFU_UPDATE_ERROR;
         return -1;
     }
+    // Operation left running by an aborted update, its result does not matter
+    if (dfu_storage_wait(dfu_storage_erase_max_ms(dfu_storage_geometry()->chip_erase.id) + 1) == DFU_STORAGE_TIMEOUT)
+    {
+        LOG_ERR("Storage not ready\r\n");
+        ctx->state = DFU_UPDATE_ERROR;
+        return -1;
+    }
+#if (DFU_ERASE_BLANK_CHECK != 0)
+    const erase_plan_geometry_t *geo = &dfu_storage_geometry()->plan;
+    dfu_blank_check_reset();
+    dfu_blank_planned_ms = dfu_blank_check_plan_ms(geo, dest_img_addr, dest_img_addr + data_len);
+    if (ctx->erase_data_pending)
+    {
+        dfu_blank_planned_ms += dfu_blank_check_plan_ms(geo, ctx->erase_addr, ctx->erase_end);
+    }
+#endif
+#if (DFU_JOURNAL != 0)
+    // Data programmed before a reset is kept, the erase and the programming go on after it
+    ctx->resume_len = dfu_journal_begin(&ctx->header, hdr_addr,
+                                        ctx->erase_data_pending ? data_len : data_len + sizeof(image_header_t));
+    ctx->erased = ctx->resume_len;
+    ctx->started = ctx->resume_len;
+    ctx->programmed = ctx->resume_len;
+    if (!ctx->erase_data_pending)
+    {
+        ctx->erase_addr += ctx->resume_len;
+    }
+#endif /* End of (DFU_JOURNAL != 0) */
+    // Left by dfu_update_poll() once the update is done or failed
+    dfu_storage_update_mode(true);
+    ctx->state = DFU_UPDATE_ERASE;
+    return 0;
+}
 
-    LOG_INF("Valid image found at 0x%X, type: %d, length: %d \r\n", 
-        read_header.img_data_start_addr, read_header.image_data_type, read_header.img_data_size);
-    LOG_INF("Version: %d.%d.%d \r\n",
-		read_header.image_data_version_major, read_header.image_data_version_minor, read_header.image_data_version_revision);
-    LOG_INF("CRC: 0x%X \r\n", read_header.image_data_crc);
-#if (DFU_DUMP_IMAGE_DATA != 0)
-    LOG_INF("Data content: \r\n");
-    uint8_t read_data_buf[read_header.img_data_size];
-    memset(read_data_buf, 0, read_header.img_data_size);
-    if (dfu_storage_read(read_header.img_data_start_addr, read_data_buf, read_header.img_data_size) != 0)
+/*
+ * @brief start a non-blocking update from a compressed payload (Host/tools/lz_pack), the payload is then fed with
+ *        dfu_update_feed() and decoded into the page queue
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_update_begin_payload(dfu_update_t *ctx, const image_header_t *img_meta_data, uint32_t dest_img_addr,
+                             const uint8_t *p_payload, uint32_t payload_len, uint32_t hdr_addr)
+{
+#if (DFU_COMPRESSED_IMAGE != 0)
+    const lz_stream_header_t *p_lz = lz_stream_payload_header(p_payload, payload_len);
+    if (p_lz == NULL)
     {
-        LOG_ERR("Failed to read %dB image data at address: 0X%X\r\n", read_header.img_data_size,
-                read_header.img_data_start_addr);
+        LOG_ERR("Not a compressed image\r\n");
         return -1;
     }
-    for (int i = 0; i < read_header.img_data_size; i++)
+    // The CRC of the decompressed image identifies the update in the journal
+    image_header_t header = *img_meta_data;
+    header.image_data_crc = p_lz->raw_crc;
+    if (dfu_update_begin(ctx, &header, dest_img_addr, p_lz->raw_size, hdr_addr) != 0)
     {
-        LOG_INF("%02X ", read_data_buf[i]);
+        return -1;
     }
-    LOG_INF("\r\n");
-#endif /* End of (DFU_DUMP_IMAGE_DATA != 0 */)
+    ctx->compressed = true;
+    ctx->payload_crc = p_lz->raw_crc;
     return 0;
+#else
+    LOG_ERR("Compressed images are not supported\r\n");
+    return -1;
+#endif /* End of (DFU_COMPRESSED_IMAGE != 0) */
 }
 
-/**
- * @brief Update the firmware image in the storage
- * @param addr: address of the image header
- * @return int 
+/*
+ * @brief queue image data, in order. Data can be fed as soon as the update has begun, it is programmed once the
+ *        erase is done. After dfu_update_begin_payload() the data is the compressed payload, only taken once the
+ *        erase is done: the decoder uses the RAM of the erase keep buffer.
+ * @return int number of bytes accepted, less than len when the page queue is full, negative value if the update
+ *         does not take data
  */
-int dfu_fw_image_update(uint8_t* fw_data, uint32_t fw_len, uint32_t addr)
+int dfu_update_feed(dfu_update_t *ctx, const uint8_t *p_data, uint32_t len)
 {
-	int retval = 0;
-    uint32_t header_addr = addr + fw_len;
-    image_header_t default_image_header = {
-        .image_magic = IMAGE_MAGIC_NUMBER,
-        .image_data_type = IMAGE_TYPE_RFIC_FIRMWARE,
-        .image_data_version_major = IMAGE_FIRMWARE_MAJOR_VERSION,
-        .image_data_version_minor = IMAGE_FIRMWARE_MINOR_VERSION,
-        .image_data_version_revision = IMAGE_FIRMWARE_REVISION_VERSION,
-        .img_data_size = fw_len,
-        .img_data_start_addr = addr,
-    };
-    //Check and update new img if needed
-    if (dfu_image_is_valid(header_addr))
-	{
-        uint8_t img_update_retry = 5;
-		LOG_WRN("Invalid image, perform DFU update");
-		// Try to update image with max img_update_retry attempts
-		for (uint8_t retry = 0; retry <= img_update_retry; retry++)
-		{
-			if (retry == img_update_retry)
-			{
-				LOG_ERR("dfu_fw_image_update() Failed to update image after %d attempts", retry);
-				retval = -1;
-				break;
-			}
+    assert(ctx != NULL);
+    if (ctx->state != DFU_UPDATE_ERASE && ctx->state != DFU_UPDATE_PROGRAM)
+    {
+        return -1;
+    }
 
-			if (dfu_image_update(&default_image_header, fw_data, default_image_header.img_data_size, default_image_header.img_data_start_addr) != 0)
-			{
-				LOG_ERR("dfu_fw_image_update() Failed to update image, (%d/%d)", retry + 1, img_update_retry);
-			}
-			else
-			{
-				LOG_INF("Image updated successfully");
-				retval = 0;
-				break;
-			}
-		}
-	}
-    return retval;
+    // Pack header in front of the payload, the caller feeds the whole built-in data
+    uint32_t accepted = (len < ctx->feed_skip) ? len : ctx->feed_skip;
+    ctx->feed_skip -= accepted;
+    p_data += accepted;
+    len -= accepted;
+    if (ctx->compressed && ctx->state == DFU_UPDATE_ERASE)
+    {
+        return (int) accepted;
+    }
+    while (len > 0 && ctx->page_queued < DFU_UPDATE_BUF_PAGES && ctx->received < ctx->total_len)
+    {
+        uint32_t page_addr = ctx->dest_addr + ctx->received - ctx->page_fill;
+        uint32_t page_len = dfu_update_page_len(ctx, page_addr);
+        uint32_t copy_len = (len > page_len - ctx->page_fill) ? page_len - ctx->page_fill : len;
+        uint32_t used_len = copy_len;
+        uint8_t *page = ctx->pages[(ctx->page_tail + ctx->page_queued) % DFU_UPDATE_BUF_PAGES];
+
+#if (DFU_COMPRESSED_IMAGE != 0)
+        if (ctx->compressed)
+        {
+            // Decode the rest of the page, the payload may be shorter or longer than what it decodes to
+            int decoded = lz_stream_decode(&dfu_work.lz, p_data, len, &used_len, &page[ctx->page_fill],
+                                                page_len - ctx->page_fill);
+            if (decoded < 0)
+            {
+                LOG_ERR("Compressed image is corrupted\r\n");
+                ctx->state = DFU_UPDATE_ERROR;
+                return -1;
+            }
+            copy_len = (uint32_t) decoded;
+        }
+        else
+#endif /* End of (DFU_COMPRESSED_IMAGE != 0) */
+        {
+            memcpy(&page[ctx->page_fill], p_data, copy_len);
+        }
+        ctx->crc = crc32_update(ctx->crc, &page[ctx->page_fill], copy_len);
+#if (DFU_BLOCK_CRC != 0)
+        if (ctx->table_addr != 0 && ctx->src_blocks.p_crcs == NULL)
+        {
+            dfu_update_fed_blocks(ctx, &page[ctx->page_fill], copy_len);
+        }
+#endif
+        ctx->page_fill += copy_len;
+        ctx->received += copy_len;
+        p_data += used_len;
+        len -= used_len;
+        accepted += used_len;
+        if (copy_len == 0 && used_len == 0)
+        {
+            break;
+        }
+        if (ctx->page_fill == page_len)
+        {
+            // Pages programmed before a reset are dropped
+            ctx->page_queued += (ctx->received > ctx->resume_len) ? 1 : 0;
+            ctx->page_fill = 0;
+        }
+    }
+    return (int) accepted;
+}
+
+/*
+ * @brief advance the update for at most the time budget, plus one step. Returns early while an erase is running
+ *        or no data is queued. Called from the main loop until DFU_UPDATE_DONE or DFU_UPDATE_ERROR.
+ * @return dfu_update_state_t state after the call
+ */
+dfu_update_state_t dfu_update_poll(dfu_update_t *ctx)
+{
+    assert(ctx != NULL);
+    uint32_t start = HAL_GetTick();
+    while (ctx->state > DFU_UPDATE_IDLE && ctx->state < DFU_UPDATE_DONE)
+    {
+        int result = dfu_update_step(ctx);
+        if (result < 0)
+        {
+            LOG_ERR("Failed to update %dB image at address: 0X%X\r\n", ctx->total_len, ctx->dest_addr);
+            ctx->state = DFU_UPDATE_ERROR;
+        }
+        if (result <= 0 || HAL_GetTick() - start >= ctx->budget_ms)
+        {
+            break;
+        }
+    }
+    if (ctx->state >= DFU_UPDATE_DONE)
+    {
+        dfu_storage_update_mode(false);
+    }
+    return ctx->state;
+}
+
+/*
+ * @brief whether [addr, addr + len) shares an erase unit with the data or header area of the update
+ */
+static bool dfu_update_overlaps(const dfu_update_t *ctx, uint32_t addr, uint32_t len)
+{
+    uint32_t unit_mask = dfu_storage_geometry()->erase[0].size - 1;
+    uint32_t areas[2][2] = {{ctx->dest_addr, ctx->dest_addr + ctx->total_len},
+                            {ctx->hdr_addr, ctx->hdr_addr + sizeof(image_header_t)}};
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        if (addr < ((areas[i][1] + unit_mask) & ~unit_mask) && addr + len > (areas[i][0] & ~unit_mask))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * @brief read the storage while an update runs, between two dfu_update_poll(). The erase or page program in flight
+ *        is suspended for the read and resumed, so the read waits for the suspend latency instead of the end of the
+ *        operation. It waits for the operation if the flash cannot suspend it. The area being updated cannot be read.
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_update_read(dfu_update_t *ctx, uint32_t addr, uint8_t *p_data, uint32_t len)
+{
+    assert(ctx != NULL && p_data != NULL);
+    bool running = (ctx->state > DFU_UPDATE_IDLE && ctx->state < DFU_UPDATE_DONE);
+    if (running && dfu_update_overlaps(ctx, addr, len))
+    {
+        LOG_ERR("Read of %dB at address: 0X%X inside the area being updated\r\n", len, addr);
+        return -1;
+    }
+    if (!running || !ctx->busy)
+    {
+        return dfu_storage_read(addr, p_data, len);
+    }
+
+    uint32_t suspend_tick = HAL_GetTick();
+    int suspended = dfu_storage_suspend();
+    if (suspended < 0)
+    {
+        // Completion handled as dfu_update_poll() does
+        while (ctx->busy)
+        {
+            if (dfu_update_check_busy(ctx) < 0)
+            {
+                ctx->state = DFU_UPDATE_ERROR;
+                return -1;
+            }
+        }
+        return dfu_storage_read(addr, p_data, len);
+    }
+
+    int result = dfu_storage_read(addr, p_data, len);
+    if (suspended > 0)
+    {
+        if (dfu_storage_resume() != 0)
+        {
+            LOG_ERR("Failed to resume the operation at address: 0X%X\r\n", ctx->busy_addr);
+            ctx->state = DFU_UPDATE_ERROR;
+            return -1;
+        }
+        // The timeout only counts the time the operation ran
+        ctx->busy_tick += HAL_GetTick() - suspend_tick;
+    }
+    return result;
+}
+
+/*
+ * @brief time slice of dfu_update_poll(), 0 runs a single step per call
+ */
+void dfu_update_set_budget(dfu_update_t *ctx, uint32_t budget_ms)
+{
+    assert(ctx != NULL);
+    ctx->budget_ms = budget_ms;
+}
+
+/*
+ * @brief progress of the update in percent, erase, programming and verification weighted by bytes
+ */
+uint8_t dfu_update_progress(const dfu_update_t *ctx)
+{
+    assert(ctx != NULL);
+    if (ctx->state == DFU_UPDATE_DONE)
+    {
+        return 100;
+    }
+    uint64_t total = sizeof(image_header_t) + 3 * (uint64_t) ctx->total_len;
+    uint64_t done = (uint64_t) ctx->erased + ctx->programmed + ctx->verified;
+    uint64_t percent = (total > 0) ? done * 100 / total : 0;
+    return (uint8_t) ((percent > 99) ? 99 : percent);
+}
+
+/*
+ * @brief start a non-blocking update of the firmware image into the inactive slot, if the active slot does not
+ *        hold it
+ * @return int 1 if an update was started, 0 if the active image is up to date, negative value otherwise
+ */
+int dfu_fw_image_update_begin(dfu_update_t *ctx, const uint8_t *fw_data, uint32_t fw_len)
+{
+    image_header_t active_header;
+    int active = dfu_slot_active(&active_header);
+    const uint8_t *p_built_in = fw_data;
+    dfu_block_crcs_t blocks;
+    image_header_t header = dfu_fw_image_source(&fw_data, &fw_len, &blocks);
+    if (dfu_fw_image_check(active, &active_header, &header, fw_data, fw_len) == 0)
+    {
+        return 0;
+    }
+    const lz_stream_header_t *p_lz = lz_stream_payload_header(fw_data, fw_len);
+    uint32_t img_len = (p_lz != NULL) ? p_lz->raw_size : fw_len;
+    if (img_len > dfu_slot_size() - DFU_SLOT_HEADER_SIZE)
+    {
+        LOG_ERR("Image of %dB does not fit in a slot\r\n", img_len);
+        return -1;
+    }
+    LOG_WRN("Invalid image, perform DFU update\r\n");
+    uint8_t slot = dfu_slot_next(active);
+    header.img_data_size = img_len;
+    header.img_data_start_addr = dfu_slot_addr(slot);
+    header.image_sequence = (active < 0) ? 1 : active_header.image_sequence + 1;
+    int result = (p_lz != NULL) ? dfu_update_begin_payload(ctx, &header, dfu_slot_addr(slot), fw_data, fw_len,
+                                                           dfu_slot_header_addr(slot))
+                                : dfu_update_begin(ctx, &header, dfu_slot_addr(slot), fw_len,
+                                                   dfu_slot_header_addr(slot));
+    ctx->feed_skip = fw_data - p_built_in;
+#if (DFU_BLOCK_CRC != 0)
+    if (result == 0 && ctx->table_addr != 0)
+    {
+        ctx->src_blocks = blocks;
+        ctx->block_size_log2 = dfu_block_size_log2(ctx->total_len, &ctx->src_blocks);
+    }
+#endif /* End of (DFU_BLOCK_CRC != 0) */
+    return (result == 0) ? 1 : -1;
+}
+
+#if (DFU_PREERASE != 0)
+/******************************************************************************
+ * Idle-time pre-erase
+ *******************************************************************************/
+
+/*
+ * @brief start erasing [addr, addr + len) in idle time, with dfu_preerase_poll(). Only the smallest erase units
+ *        fully inside the range are erased, and not the ones found blank. The units erased or found blank are
+ *        recorded, the next update skips them without reading them unless something is programmed there first.
+ *        Starting an update ends the pre-erase, the update waits for the erase in flight.
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_preerase_begin(dfu_preerase_t *ctx, uint32_t addr, uint32_t len)
+{
+    assert(ctx != NULL);
+    memset(ctx, 0, sizeof(*ctx));
+    if (dfu_storage_backend() == NULL && dfu_storage_probe() != 0)
+    {
+        return -1;
+    }
+    uint32_t unit_size = dfu_storage_geometry()->plan.types[0].size;
+    ctx->addr = (addr + unit_size - 1) & ~(unit_size - 1);
+    ctx->end = (addr + len) & ~(unit_size - 1);
+    ctx->end = (ctx->end > ctx->addr) ? ctx->end : ctx->addr;
+    ctx->run_end = ctx->addr;
+    ctx->update_count = dfu_blank_update_count;
+    return 0;
+}
+
+/*
+ * @brief one step of the pre-erase: check the erase in flight, or blank check the next unit and start erasing the
+ *        run of units it begins. With DFU_PREERASE_SLEEP the CPU sleeps until the next tick while the flash is
+ *        busy. Called from the main loop when there is nothing else to do.
+ * @return int 1 while the pre-erase runs, 0 once the range is blank or an update started, negative value otherwise
+ */
+int dfu_preerase_poll(dfu_preerase_t *ctx)
+{
+    assert(ctx != NULL);
+    if (ctx->update_count != dfu_blank_update_count)
+    {
+        // The update erases what is left itself
+        ctx->busy = false;
+        return 0;
+    }
+    const dfu_storage_ops_t *ops = dfu_storage_backend();
+    if (ctx->busy)
+    {
+        int status = ops->status();
+        if (status == DFU_STORAGE_BUSY)
+        {
+            if (HAL_GetTick() - ctx->busy_tick > ctx->busy_timeout_ms)
+            {
+                LOG_ERR("Timeout of the erase at address: 0X%X\r\n", ctx->busy_addr);
+                return -1;
+            }
+#if (DFU_PREERASE_SLEEP != 0)
+            // Woken up by the next SysTick interrupt
+            HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+#endif
+            return 1;
+        }
+        ctx->busy = false;
+        if (status != DFU_STORAGE_READY)
+        {
+            LOG_ERR("Failed to erase at address: 0X%X\r\n", ctx->busy_addr);
+            return -1;
+        }
+        dfu_blank_known_add(ctx->busy_addr, ctx->busy_addr + ctx->busy_size);
+        ctx->erased += ctx->busy_size;
+        return 1;
+    }
+    if (ctx->addr >= ctx->end)
+    {
+        return 0;
+    }
+
+    erase_plan_op_t op;
+    int result = dfu_storage_erase_next(&dfu_storage_geometry()->plan, ctx->addr, ctx->end, &ctx->run_end, &op);
+    if (result < 0)
+    {
+        return -1;
+    }
+    if (result == 0)
+    {
+        // Merged with the known range when it was skipped from it
+        dfu_blank_known_add(op.addr, op.addr + op.size);
+        ctx->blank += op.size;
+        ctx->addr += op.size;
+        return 1;
+    }
+    if (ops->erase_start(op.id, op.addr) != 0)
+    {
+        LOG_ERR("Failed to erase at address: 0X%X\r\n", ctx->addr);
+        return -1;
+    }
+    ctx->busy = true;
+    ctx->busy_addr = op.addr;
+    ctx->busy_size = op.size;
+    ctx->busy_tick = HAL_GetTick();
+    ctx->busy_timeout_ms = dfu_storage_erase_max_ms(op.id) + 1;
+    ctx->addr += op.size;
+    return 1;
+}
+
+/*
+ * @brief start the pre-erase of the slot the next update writes, data and header. The slot is kept as it is when it
+ *        holds the image dfu_slot_rollback() goes back to, which is always the case with 2 slots once 2 images were
+ *        written: call it once an update is announced or the new image is confirmed, not at every boot.
+ * @return int 0 on success, 1 if the slot is kept for the rollback, negative value otherwise
+ */
+int dfu_fw_image_preerase_begin(dfu_preerase_t *ctx)
+{
+    image_header_t header;
+    int active = dfu_slot_active(&header);
+    uint8_t slot = dfu_slot_next(active);
+    if (active >= 0 && dfu_slot_find(&header, active) == slot)
+    {
+        LOG_INF("Slot %d kept for the rollback, sequence: %d\r\n", slot, header.image_sequence);
+        memset(ctx, 0, sizeof(*ctx));
+        return 1;
+    }
+    return dfu_preerase_begin(ctx, dfu_slot_addr(slot), dfu_slot_size());
 }
+#endif /* End of (DFU_PREERASE != 0) */
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) */
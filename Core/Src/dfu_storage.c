@@ -0,0 +1,274 @@
+/*******************************************************************************
+ * Title                 :   DFU storage backends
+ * Filename              :   dfu_storage.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file dfu_storage.c
+ *  \brief Probe and select the storage backend matching the flash on the bus
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+#include <string.h>
+
+#include "main.h"
+#include "dfu.h"
+#include "dfu_storage.h"
+
+#if (DFU_STORAGE_SPI_STM32 == 1)
+
+/******************************************************************************
+ * Module Variable Definitions
+ *******************************************************************************/
+/* Probe order, the RAM backend only answers once memory is attached */
+static const dfu_storage_ops_t *const dfu_storage_backends[] = {
+#if (DFU_STORAGE_SPI_N25Q == 1)
+    &dfu_storage_n25q,
+#endif
+#if (DFU_STORAGE_SPI_MX25 == 1)
+    &dfu_storage_mx25,
+#endif
+#if (DFU_STORAGE_RAM == 1)
+    &dfu_storage_ram,
+#endif
+};
+
+static const dfu_storage_ops_t *dfu_storage_ops = NULL;
+static dfu_storage_geometry_t dfu_storage_geo;
+static bool dfu_storage_in_update = false;
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+
+/*
+ * @brief probe one backend and use it for every following storage access
+ * @return int 0 on success, negative value if the backend does not drive the flash on the bus
+ */
+int dfu_storage_select(const dfu_storage_ops_t *ops)
+{
+    dfu_storage_geometry_t geo;
+    memset(&geo, 0, sizeof(geo));
+    if (ops == NULL || ops->probe(&geo) != 0)
+    {
+        return -1;
+    }
+    if (geo.page_size == 0 || geo.page_size > FLASH_N25_MAX_WRITE_SIZE || geo.erase_count == 0 ||
+        geo.erase_count > DFU_STORAGE_MAX_ERASE_TYPES || geo.erase[0].size > DFU_ERASE_KEEP_BUF_SIZE)
+    {
+        LOG_ERR("%s: unsupported geometry, page %dB, smallest erase %dB\r\n", ops->name, geo.page_size,
+                geo.erase[0].size);
+        return -1;
+    }
+
+    // Erase planner view of the erase types
+    for (uint8_t i = 0; i < geo.erase_count; i++)
+    {
+        geo.plan_types[i].size = geo.erase[i].size;
+        geo.plan_types[i].time_ms = (DFU_ERASE_COST_TYPICAL != 0) ? geo.erase[i].typ_ms : geo.erase[i].max_ms;
+        geo.plan_types[i].id = geo.erase[i].id;
+    }
+    dfu_storage_geo = geo;
+    dfu_storage_geo.plan.types = dfu_storage_geo.plan_types;
+    dfu_storage_geo.plan.type_count = geo.erase_count;
+    dfu_storage_geo.plan.chip_size = geo.size;
+    dfu_storage_geo.plan.chip_erase_ms =
+        (geo.chip_erase.size == 0) ? 0 : (DFU_ERASE_COST_TYPICAL != 0) ? geo.chip_erase.typ_ms : geo.chip_erase.max_ms;
+    dfu_storage_geo.plan.chip_erase_id = geo.chip_erase.id;
+    dfu_storage_ops = ops;
+    dfu_storage_in_update = false;
+
+    LOG_INF("Storage: %s (%s), ID %02X %02X %02X, %dKB, page %dB, smallest erase %dB%s\r\n", geo.name, ops->name,
+            geo.jedec_id[0], geo.jedec_id[1], geo.jedec_id[2], geo.size / 1024, geo.page_size, geo.erase[0].size,
+            geo.sfdp ? ", SFDP" : "");
+    return 0;
+}
+
+/*
+ * @brief select the first backend recognizing the JEDEC ID of the flash
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_storage_probe(void)
+{
+    for (uint32_t i = 0; i < sizeof(dfu_storage_backends) / sizeof(dfu_storage_backends[0]); i++)
+    {
+        if (dfu_storage_select(dfu_storage_backends[i]) == 0)
+        {
+            return 0;
+        }
+    }
+    LOG_ERR("No supported storage flash found\r\n");
+    return -1;
+}
+
+/*
+ * @brief selected backend, NULL before a successful dfu_storage_probe()/dfu_storage_select()
+ */
+const dfu_storage_ops_t *dfu_storage_backend(void)
+{
+    return dfu_storage_ops;
+}
+
+const dfu_storage_geometry_t *dfu_storage_geometry(void)
+{
+    return (dfu_storage_ops != NULL) ? &dfu_storage_geo : NULL;
+}
+
+/*
+ * @brief wait for the program/erase in flight
+ * @return int DFU_STORAGE_READY, DFU_STORAGE_ERROR or DFU_STORAGE_TIMEOUT
+ */
+int dfu_storage_wait(uint32_t timeout_ms)
+{
+    if (dfu_storage_ops->wait != NULL)
+    {
+        return dfu_storage_ops->wait(timeout_ms);
+    }
+    uint32_t start = HAL_GetTick();
+    for (;;)
+    {
+        int status = dfu_storage_ops->status();
+        if (status != DFU_STORAGE_BUSY)
+        {
+            return status;
+        }
+        if (HAL_GetTick() - start > timeout_ms)
+        {
+            return DFU_STORAGE_TIMEOUT;
+        }
+    }
+}
+
+/*
+ * @brief suspend the program/erase in flight so that the array can be read, the area it programs or erases excepted
+ * @return int 1 if suspended, 0 if it completed first, negative value if the flash cannot suspend it, the operation is
+ *         then still running
+ */
+int dfu_storage_suspend(void)
+{
+    if (dfu_storage_ops == NULL || dfu_storage_ops->suspend == NULL)
+    {
+        return -1;
+    }
+    return dfu_storage_ops->suspend();
+}
+
+/*
+ * @brief resume the operation suspended by dfu_storage_suspend()
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_storage_resume(void)
+{
+    if (dfu_storage_ops == NULL || dfu_storage_ops->resume == NULL)
+    {
+        return -1;
+    }
+    return dfu_storage_ops->resume();
+}
+
+/*
+ * @brief JEDEC ID of the flash, read from the bus (SPI link training)
+ * @return int 0 on success, negative value if there is no flash on a bus
+ */
+int dfu_storage_read_id(uint8_t *id)
+{
+    if (dfu_storage_ops == NULL || dfu_storage_ops->read_id == NULL)
+    {
+        return -1;
+    }
+    return dfu_storage_ops->read_id(id);
+}
+
+/*
+ * @brief read the SFDP tables of the flash, fixed content whatever the array holds (SPI link training)
+ * @return int 0 on success, negative value if the flash has no SFDP tables
+ */
+int dfu_storage_read_sfdp(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    if (dfu_storage_ops == NULL || dfu_storage_ops->read_sfdp == NULL)
+    {
+        return -1;
+    }
+    return dfu_storage_ops->read_sfdp(addr, data, len);
+}
+
+/*
+ * @brief timeout of one erase of the given erase type id, the chip erase one if the id is unknown
+ */
+uint32_t dfu_storage_erase_max_ms(uint8_t id)
+{
+    for (uint8_t i = 0; i < dfu_storage_geo.erase_count; i++)
+    {
+        if (dfu_storage_geo.erase[i].id == id)
+        {
+            return dfu_storage_geo.erase[i].max_ms;
+        }
+    }
+    if (dfu_storage_geo.chip_erase.size != 0)
+    {
+        return dfu_storage_geo.chip_erase.max_ms;
+    }
+    return dfu_storage_geo.erase[dfu_storage_geo.erase_count - 1].max_ms;
+}
+
+/*
+ * @brief switch the flash to its update mode or back to its idle one, nothing is done if it is already in that mode.
+ *        A failed switch leaves the flash in its current mode, the geometry timings hold in both.
+ * @return int 0 on success, negative value otherwise
+ */
+int dfu_storage_update_mode(bool update)
+{
+    if (dfu_storage_ops == NULL || dfu_storage_ops->update_mode == NULL || update == dfu_storage_in_update)
+    {
+        return 0;
+    }
+    // The registers cannot be written while a program/erase runs, an aborted update may have left one
+    if (dfu_storage_wait(dfu_storage_erase_max_ms(dfu_storage_geo.chip_erase.id) + 1) == DFU_STORAGE_TIMEOUT ||
+        dfu_storage_ops->update_mode(update) != 0)
+    {
+        LOG_WRN("%s: failed to %s the update mode\r\n", dfu_storage_ops->name, update ? "enter" : "leave");
+        return -1;
+    }
+    dfu_storage_in_update = update;
+    return 0;
+}
+
+/*
+ * @brief page size, erase types and timings from the SFDP tables, the erase opcodes are the erase ids. geo->size must
+ *        be set first, the chip erase is only offered when it covers exactly geo->size.
+ * @param chip_erase_id: erase id of the chip erase, SFDP does not give its opcode
+ * @param max_page_size: program buffer size of the backend, smaller writes inside a page are always legal
+ * @return int 0 on success, negative value if the tables give no timing, geo is then left untouched
+ */
+int dfu_storage_sfdp_geometry(const sfdp_info_t *sfdp, uint8_t chip_erase_id, uint32_t max_page_size,
+                              dfu_storage_geometry_t *geo)
+{
+    if (sfdp->program_max_us == 0 || sfdp->erase[0].max_ms == 0)
+    {
+        return -1;
+    }
+    geo->page_size = (sfdp->page_size > max_page_size) ? max_page_size : sfdp->page_size;
+    geo->program_max_ms = (sfdp->program_max_us + 999) / 1000;
+    geo->erase_count = 0;
+    for (uint8_t i = 0; i < sfdp->erase_count && geo->erase_count < DFU_STORAGE_MAX_ERASE_TYPES; i++)
+    {
+        geo->erase[geo->erase_count++] = (dfu_storage_erase_t){sfdp->erase[i].size, sfdp->erase[i].opcode,
+                                                               sfdp->erase[i].typ_ms, sfdp->erase[i].max_ms};
+    }
+    memset(&geo->chip_erase, 0, sizeof(geo->chip_erase));
+    if (sfdp->size == geo->size)
+    {
+        geo->chip_erase = (dfu_storage_erase_t){geo->size, chip_erase_id, sfdp->chip_erase_typ_ms,
+                                                sfdp->chip_erase_max_ms};
+    }
+    geo->sfdp = true;
+    return 0;
+}
+
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) */
+
+/*** End of File **************************************************************/
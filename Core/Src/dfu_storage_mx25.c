@@ -0,0 +1,339 @@
+/*******************************************************************************
+ * Title                 :   DFU storage backend of the Macronix MX25R
+ * Filename              :   dfu_storage_mx25.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file dfu_storage_mx25.c
+ *  \brief MX25R backend on top of the MX25Series driver. The geometry comes from the SFDP tables, the chip definition
+ *         is the fallback. Blocking waits sleep through the typical time of the operation before polling WIP. Updates
+ *         may run in another power mode (High Performance), the flash goes back to the attached one afterwards.
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+#include <string.h>
+
+#include "main.h"
+#include "dfu.h"
+#include "dfu_storage.h"
+#include "MX25Series.h"
+
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_SPI_MX25 == 1)
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define MX25_ID_DENSITY_MIN         (0x14) // Density codes are log2(size), 1MB
+#define MX25_ID_DENSITY_MAX         (0x18) // 16MB, largest with 3 address bytes
+#define MX25_ADDRESSABLE_SIZE       (0x1000000) // The driver sends 3 address bytes
+
+#define MX25_US_TO_MS(us)           (((us) + 999) / 1000)
+
+/******************************************************************************
+ * Module Variable Definitions
+ *******************************************************************************/
+static MX25Series_t *mx25_dev = NULL;
+/* Chip definitions of the idle and update power modes */
+static MX25Series_Chip_Info_t *mx25_idle_def = NULL;
+static MX25Series_Chip_Info_t *mx25_update_def = NULL;
+/* Staged pages, the next one is copied while the previous one is programming */
+static uint8_t mx25_page_buf[2][FLASH_N25_MAX_WRITE_SIZE];
+static uint8_t mx25_page_index;
+static uint32_t mx25_page_addr;
+static uint32_t mx25_page_len;
+/* Operation in flight, for mx25_wait() */
+static uint32_t mx25_program_typ_us;
+static uint32_t mx25_op_start_ms;
+static uint32_t mx25_op_typ_us;
+static uint32_t mx25_suspend_ms;
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+
+/*
+ * @brief device driven by the MX25 backend, must be initialized with its chip definition before dfu_init(). That
+ *        definition gives the power mode between updates.
+ * @param update_chip_def: chip definition of the power mode used while updating, NULL to stay in the idle one
+ */
+void dfu_storage_mx25_attach(MX25Series_t *dev, MX25Series_Chip_Info_t *update_chip_def)
+{
+    mx25_dev = dev;
+    mx25_idle_def = (dev != NULL) ? dev->chip_def : NULL;
+    mx25_update_def = update_chip_def;
+}
+
+static int mx25_read_sfdp(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    return MX25Series_HAS_ERROR(MX25Series_read_sfdp(mx25_dev, addr, len, data)) ? -1 : 0;
+}
+
+/*
+ * @brief chip definition geometry, for parts without SFDP timings
+ */
+static void mx25_chip_def_geometry(const MX25Series_Chip_Info_t *chip, dfu_storage_geometry_t *geo)
+{
+    geo->page_size = chip->page_size;
+    geo->program_max_ms = MX25_US_TO_MS(chip->timing.tPP);
+    geo->erase[0] = (dfu_storage_erase_t){4096, MX25Series_Erase_Block_4K, MX25_US_TO_MS(chip->typical.tSE),
+                                          MX25_US_TO_MS(chip->timing.tSE)};
+    geo->erase[1] = (dfu_storage_erase_t){32768, MX25Series_Erase_Block_32K, MX25_US_TO_MS(chip->typical.tBE32K),
+                                          MX25_US_TO_MS(chip->timing.tBE32K)};
+    geo->erase[2] = (dfu_storage_erase_t){65536, MX25Series_Erase_Block_64K, MX25_US_TO_MS(chip->typical.tBE64K),
+                                          MX25_US_TO_MS(chip->timing.tBE64K)};
+    geo->erase_count = 3;
+    geo->chip_erase = (dfu_storage_erase_t){geo->size, MX25Series_Erase_Chip, MX25_US_TO_MS(chip->typical.tCE),
+                                            MX25_US_TO_MS(chip->timing.tCE)};
+}
+
+static int mx25_probe(dfu_storage_geometry_t *geo)
+{
+    int id[3] = {0};
+    if (mx25_dev == NULL || mx25_dev->chip_def == NULL || mx25_idle_def == NULL)
+    {
+        return -1;
+    }
+    MX25Series_read_identification(mx25_dev, &id[0], &id[1], &id[2]);
+    if ((uint8_t) id[0] != mx25_dev->chip_def->manufacturer_id || (uint8_t) id[1] != mx25_dev->chip_def->memory_type ||
+        (uint8_t) id[2] < MX25_ID_DENSITY_MIN || (uint8_t) id[2] > MX25_ID_DENSITY_MAX)
+    {
+        return -1;
+    }
+
+    // L/H is volatile, a reset in the middle of an update leaves the update mode on
+    mx25_dev->chip_def = mx25_idle_def;
+    if (MX25Series_HAS_ERROR(MX25Series_set_power_mode(mx25_dev, mx25_idle_def)))
+    {
+        LOG_WRN("%s: failed to set the idle power mode\r\n", mx25_idle_def->name);
+    }
+
+    const MX25Series_Chip_Info_t *chip = mx25_dev->chip_def;
+    geo->name = chip->name;
+    geo->jedec_id[0] = (uint8_t) id[0];
+    geo->jedec_id[1] = (uint8_t) id[1];
+    geo->jedec_id[2] = (uint8_t) id[2];
+    geo->size = 1UL << (uint8_t) id[2];
+    geo->erase_value = 0xFF;
+    sfdp_info_t sfdp;
+    if (sfdp_parse(mx25_read_sfdp, &sfdp) == 0 && sfdp.addr_mode != SFDP_ADDR_4)
+    {
+        geo->size = (sfdp.size > MX25_ADDRESSABLE_SIZE) ? MX25_ADDRESSABLE_SIZE : (uint32_t) sfdp.size;
+        if (dfu_storage_sfdp_geometry(&sfdp, MX25Series_Erase_Chip, sizeof(mx25_page_buf[0]), geo) == 0)
+        {
+            mx25_program_typ_us = sfdp.program_typ_us;
+            return 0;
+        }
+    }
+    mx25_chip_def_geometry(chip, geo);
+    mx25_program_typ_us = chip->typical.tPP;
+    return 0;
+}
+
+static int mx25_read_id(uint8_t *id)
+{
+    int value[3] = {0};
+    if (MX25Series_HAS_ERROR(MX25Series_read_identification(mx25_dev, &value[0], &value[1], &value[2])))
+    {
+        return -1;
+    }
+    id[0] = (uint8_t) value[0];
+    id[1] = (uint8_t) value[1];
+    id[2] = (uint8_t) value[2];
+    return 0;
+}
+
+static int mx25_read(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    if (MX25Series_HAS_ERROR(MX25Series_read_stored_data(mx25_dev, true, addr, len, data)))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief FAST_READ command kept open, chip select stays low until mx25_read_end()
+ */
+static int mx25_read_begin(uint32_t addr)
+{
+    uint8_t frame[4] = {(uint8_t) (addr >> 16), (uint8_t) (addr >> 8), (uint8_t) addr, mx25_dev->transfer_dummy_byte};
+    MX25Series___enable_cs_pin(mx25_dev, true);
+    MX25Series_status_enum_t result = MX25Series___issue_command(mx25_dev, MX25Series_Command_FAST_READ);
+    result |= MX25Series___write(mx25_dev, sizeof(frame), frame);
+    return MX25Series_HAS_ERROR(result) ? -1 : 0;
+}
+
+static int mx25_read_next(uint8_t *data, uint32_t len)
+{
+    return MX25Series_HAS_ERROR(MX25Series___read(mx25_dev, len, data)) ? -1 : 0;
+}
+
+static void mx25_read_end(void)
+{
+    MX25Series___enable_cs_pin(mx25_dev, false);
+}
+
+static const uint8_t *mx25_program_stage(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    mx25_page_index ^= 1;
+    memcpy(mx25_page_buf[mx25_page_index], data, len);
+    mx25_page_addr = addr;
+    mx25_page_len = len;
+    return mx25_page_buf[mx25_page_index];
+}
+
+static void mx25_op_started(uint32_t typ_us)
+{
+    mx25_op_start_ms = HAL_GetTick();
+    mx25_op_typ_us = typ_us;
+}
+
+static int mx25_program_start(void)
+{
+    MX25Series_status_enum_t result =
+        MX25Series_program_start(mx25_dev, mx25_page_addr, mx25_page_len, mx25_page_buf[mx25_page_index]);
+    if (MX25Series_HAS_ERROR(result))
+    {
+        return -1;
+    }
+    mx25_op_started(mx25_program_typ_us);
+    return MX25Series_HAS_ERROR(result) ? -1 : 0;
+}
+
+/*
+ * @brief the erase ids are the erase opcodes, the block erases are sent directly as the driver only knows the
+ *        datasheet ones
+ */
+static int mx25_erase_start(uint8_t id, uint32_t addr)
+{
+    const dfu_storage_geometry_t *geo = dfu_storage_geometry();
+    uint32_t typ_ms = (id == geo->chip_erase.id) ? geo->chip_erase.typ_ms : 0;
+    for (uint8_t i = 0; i < geo->erase_count; i++)
+    {
+        if (geo->erase[i].id == id)
+        {
+            typ_ms = geo->erase[i].typ_ms;
+        }
+    }
+
+    MX25Series_status_enum_t result = MX25Series_write_enable_checked(mx25_dev);
+    if (MX25Series_HAS_ERROR(result))
+    {
+        return -1;
+    }
+    if (id == MX25Series_Erase_Chip)
+    {
+        result |= MX25Series_erase(mx25_dev, MX25Series_Erase_Chip, 0);
+    }
+    else
+    {
+        uint8_t frame[3] = {(uint8_t) (addr >> 16), (uint8_t) (addr >> 8), (uint8_t) addr};
+        MX25Series___enable_cs_pin(mx25_dev, true);
+        result |= MX25Series___issue_command(mx25_dev, (MX25Series_COMMAND_enum_t) id);
+        result |= MX25Series___write(mx25_dev, sizeof(frame), frame);
+        MX25Series___enable_cs_pin(mx25_dev, false);
+    }
+    mx25_op_started(typ_ms * 1000);
+    return MX25Series_HAS_ERROR(result) ? -1 : 0;
+}
+
+/*
+ * @brief WIP of the status register, then the fail flags of the security register once the operation is over. The
+ *        flags are updated by every program/erase, nothing to clear.
+ */
+static int mx25_status(void)
+{
+    uint8_t sr = MX25Series_SR_WIP;
+    if (MX25Series_HAS_ERROR(MX25Series_read_status_register(mx25_dev, &sr)))
+    {
+        return DFU_STORAGE_ERROR;
+    }
+    if ((sr & MX25Series_SR_WIP) != 0)
+    {
+        return DFU_STORAGE_BUSY;
+    }
+    uint8_t scur = 0;
+    MX25Series_read_security_register(mx25_dev, &scur);
+    if ((scur & (MX25Series_SCUR_P_FAIL | MX25Series_SCUR_E_FAIL)) != 0)
+    {
+        LOG_ERR("Program/erase failed, security register: 0x%X", scur);
+        return DFU_STORAGE_ERROR;
+    }
+    return DFU_STORAGE_READY;
+}
+
+/*
+ * @brief sleep through what is left of the typical time of the operation in flight, then poll WIP
+ */
+static int mx25_wait(uint32_t timeout_ms)
+{
+    uint32_t elapsed_us = (HAL_GetTick() - mx25_op_start_ms) * 1000;
+    uint32_t typ_us = (elapsed_us < mx25_op_typ_us) ? (mx25_op_typ_us - elapsed_us) : 0;
+    if (timeout_ms > UINT32_MAX / 1000)
+    {
+        timeout_ms = UINT32_MAX / 1000;
+    }
+    MX25Series_status_enum_t result = MX25Series_wait_ready(mx25_dev, typ_us, timeout_ms * 1000);
+    if (result == MX25Series_status_error_timeout)
+    {
+        return DFU_STORAGE_TIMEOUT;
+    }
+    return MX25Series_HAS_ERROR(result) ? DFU_STORAGE_ERROR : mx25_status();
+}
+
+static int mx25_suspend(void)
+{
+    bool suspended = false;
+    if (MX25Series_HAS_ERROR(MX25Series_suspend(mx25_dev, &suspended)))
+    {
+        return -1;
+    }
+    mx25_suspend_ms = HAL_GetTick();
+    return suspended ? 1 : 0;
+}
+
+/*
+ * @brief the time spent suspended does not count in the typical time mx25_wait() sleeps through
+ */
+static int mx25_resume(void)
+{
+    mx25_op_start_ms += HAL_GetTick() - mx25_suspend_ms;
+    return MX25Series_HAS_ERROR(MX25Series_resume(mx25_dev)) ? -1 : 0;
+}
+
+static int mx25_update_mode(bool update)
+{
+    if (mx25_update_def == NULL)
+    {
+        return 0;
+    }
+    MX25Series_Chip_Info_t *chip_def = update ? mx25_update_def : mx25_idle_def;
+    return MX25Series_HAS_ERROR(MX25Series_set_power_mode(mx25_dev, chip_def)) ? -1 : 0;
+}
+
+const dfu_storage_ops_t dfu_storage_mx25 = {
+    .name = "mx25",
+    .probe = mx25_probe,
+    .read_id = mx25_read_id,
+    .read_sfdp = mx25_read_sfdp,
+    .read = mx25_read,
+    .read_begin = mx25_read_begin,
+    .read_next = mx25_read_next,
+    .read_end = mx25_read_end,
+    .program_stage = mx25_program_stage,
+    .program_start = mx25_program_start,
+    .erase_start = mx25_erase_start,
+    .status = mx25_status,
+    .wait = mx25_wait,
+    .suspend = mx25_suspend,
+    .resume = mx25_resume,
+    .update_mode = mx25_update_mode,
+};
+
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_SPI_MX25 == 1) */
+
+/*** End of File **************************************************************/
@@ -0,0 +1,283 @@
+/*******************************************************************************
+ * Title                 :   DFU storage backend of the Micron N25Q
+ * Filename              :   dfu_storage_n25q.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file dfu_storage_n25q.c
+ *  \brief N25Q backend: geometry from the SFDP tables, 4-byte addresses above 16MB, FAST_READ above the READ clock
+ *         limit, DMA page program frames, flag status register polling, program/erase suspend
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+
+#include "dfu.h"
+#include "dfu_storage.h"
+#include "n25q128a.h"
+
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_SPI_N25Q == 1)
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define N25Q_ID_MANUFACTURER        (0x20) // Micron
+#define N25Q_ID_TYPE_3V             (0xBA)
+#define N25Q_ID_TYPE_1V8            (0xBB)
+#define N25Q_ID_CAPACITY_8MB        (0x17) // Capacity codes are log2(size) up to 32MB
+#define N25Q_ID_CAPACITY_32MB       (0x19)
+#define N25Q_ID_CAPACITY_64MB       (0x20) // then 0x20 for 64MB and 0x21 for 128MB
+#define N25Q_ADDRESSABLE_SIZE       (0x1000000) // With 3 address bytes
+#define N25Q_FSR_ERRORS             (N25Q128A_FSR_PGERR | N25Q128A_FSR_ERERR | N25Q128A_FSR_PRERR | N25Q128A_FSR_VPPERR)
+#define N25Q_SUSPEND_TIMEOUT_MS     ((N25Q128A_SUSPEND_LATENCY_MAX_US + 999) / 1000)
+
+/******************************************************************************
+ * Module Variable Definitions
+ *******************************************************************************/
+/* Page program frames, the next one is staged while the previous one may still be sent by DMA */
+static uint8_t n25q_page_frame[2][N25Q128A_PAGE_PROG_FRAME_SIZE];
+static uint8_t n25q_frame_index;
+static int n25q_frame_len;
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+static int n25q_read_sfdp(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    N25Q_ReadSFDP(data, addr, len);
+    return 0;
+}
+
+/*
+ * @brief datasheet geometry, for parts without SFDP timings
+ */
+static void n25q_datasheet_geometry(dfu_storage_geometry_t *geo, bool chip_erase)
+{
+    geo->page_size = N25Q128A_PAGE_SIZE;
+    geo->program_max_ms = N25Q128A_PAGE_PROG_MAX_TIME;
+    geo->erase[0] = (dfu_storage_erase_t){N25Q128A_SUBSECTOR_SIZE, SUBSECTOR_ERASE_CMD,
+                                          N25Q128A_SUBSECTOR_ERASE_TYP_TIME, N25Q128A_SUBSECTOR_ERASE_MAX_TIME};
+    geo->erase[1] = (dfu_storage_erase_t){N25Q128A_SECTOR_SIZE, SECTOR_ERASE_CMD, N25Q128A_SECTOR_ERASE_TYP_TIME,
+                                          N25Q128A_SECTOR_ERASE_MAX_TIME};
+    geo->erase_count = 2;
+    if (chip_erase)
+    {
+        geo->chip_erase = (dfu_storage_erase_t){geo->size, BULK_ERASE_CMD, N25Q128A_BULK_ERASE_TYP_TIME,
+                                                N25Q128A_BULK_ERASE_MAX_TIME};
+    }
+}
+
+static int n25q_probe(dfu_storage_geometry_t *geo)
+{
+    uint8_t id[3] = {0};
+    N25Q_ReadID(id, sizeof(id));
+    if (id[0] != N25Q_ID_MANUFACTURER || (id[1] != N25Q_ID_TYPE_3V && id[1] != N25Q_ID_TYPE_1V8))
+    {
+        return -1;
+    }
+    uint64_t chip_size;
+    if (id[2] >= N25Q_ID_CAPACITY_8MB && id[2] <= N25Q_ID_CAPACITY_32MB)
+    {
+        chip_size = 1ULL << id[2];
+    }
+    else if (id[2] == N25Q_ID_CAPACITY_64MB || id[2] == N25Q_ID_CAPACITY_64MB + 1)
+    {
+        chip_size = (64ULL << 20) << (id[2] - N25Q_ID_CAPACITY_64MB);
+    }
+    else
+    {
+        return -1;
+    }
+
+    // Above 16MB the whole array needs the 4-byte address mode, when the SFDP tables say how to enter it
+    sfdp_info_t sfdp;
+    bool has_sfdp = (sfdp_parse(n25q_read_sfdp, &sfdp) == 0);
+    uint64_t addressable = N25Q_ADDRESSABLE_SIZE;
+    if (has_sfdp)
+    {
+        chip_size = sfdp.size;
+        if (chip_size > N25Q_ADDRESSABLE_SIZE && sfdp.addr_mode == SFDP_ADDR_3_OR_4 &&
+            (sfdp.enter_4b || sfdp.enter_4b_wren) && N25Q_Enter4ByteAddressMode() == 0)
+        {
+            addressable = chip_size;
+        }
+    }
+
+    geo->name = (chip_size > addressable) ? "N25Q (first 16MB)" : "N25Q";
+    geo->jedec_id[0] = id[0];
+    geo->jedec_id[1] = id[1];
+    geo->jedec_id[2] = id[2];
+    geo->size = (uint32_t) ((chip_size > addressable) ? addressable : chip_size);
+    geo->erase_value = 0xFF;
+    // A bulk erase would also wipe the part beyond the addressable range
+    if (!has_sfdp || dfu_storage_sfdp_geometry(&sfdp, BULK_ERASE_CMD, N25Q128A_PAGE_SIZE, geo) != 0)
+    {
+        n25q_datasheet_geometry(geo, chip_size <= addressable);
+    }
+    N25Q_ClearFlagStatusRegister();
+    return 0;
+}
+
+static int n25q_read_id(uint8_t *id)
+{
+    N25Q_ReadID(id, 3);
+    return 0;
+}
+
+/*
+ * @brief READ is limited to N25Q128A_READ_MAX_FREQ, above it FAST_READ is used. The dummy cycles are set up on
+ *        the first fast read, the default ones are kept if the flash does not take them.
+ */
+static bool n25q_fast_read(void)
+{
+#if (DFU_N25Q_FAST_READ == 2)
+    bool fast = true;
+#elif (DFU_N25Q_FAST_READ == 1)
+    bool fast = (N25Q_GetClockFrequency() > N25Q128A_READ_MAX_FREQ);
+#else
+    bool fast = false;
+#endif
+    static bool dummy_cycles_set = false;
+    if (fast && !dummy_cycles_set)
+    {
+        dummy_cycles_set = true;
+        if (N25Q_SetReadDummyCycles(FLASH_N25_FAST_READ_DUMMY_CYCLES) != 0)
+        {
+            LOG_WRN("Failed to set %d FAST_READ dummy cycles, using the default ones\r\n",
+                    FLASH_N25_FAST_READ_DUMMY_CYCLES);
+        }
+    }
+    return fast;
+}
+
+static int n25q_read(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    if (n25q_fast_read())
+    {
+        N25Q_FastReadDataFromAddress(data, addr, len);
+    }
+    else
+    {
+        N25Q_ReadDataFromAddress(data, addr, len);
+    }
+    return 0;
+}
+
+static int n25q_read_begin(uint32_t addr)
+{
+    N25Q_BeginRead(addr, n25q_fast_read());
+    return 0;
+}
+
+static int n25q_read_next(uint8_t *data, uint32_t len)
+{
+    return N25Q_ContinueRead(data, len);
+}
+
+static void n25q_read_end(void)
+{
+    N25Q_EndRead();
+}
+
+static const uint8_t *n25q_program_stage(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    n25q_frame_index ^= 1;
+    n25q_frame_len = N25Q_StagePageProgram(n25q_page_frame[n25q_frame_index], data, addr, len);
+    return &n25q_page_frame[n25q_frame_index][n25q_frame_len - len];
+}
+
+static int n25q_program_start(void)
+{
+    N25Q_StartPageProgram(n25q_page_frame[n25q_frame_index], n25q_frame_len);
+    return 0;
+}
+
+/*
+ * @brief the erase ids are the erase opcodes, the datasheet ones or the SFDP ones
+ */
+static int n25q_erase_start(uint8_t id, uint32_t addr)
+{
+    if (id == BULK_ERASE_CMD)
+    {
+        N25Q_NonBlockingBulkErase();
+    }
+    else
+    {
+        N25Q_NonBlockingErase(id, addr);
+    }
+    return 0;
+}
+
+/*
+ * @brief map the flag status register to a DFU_STORAGE_* status, the error flags are cleared once reported
+ */
+static int n25q_fsr_status(int fsr)
+{
+    if ((fsr & N25Q128A_FSR_READY) == 0)
+    {
+        return DFU_STORAGE_BUSY;
+    }
+    if ((fsr & N25Q_FSR_ERRORS) != 0)
+    {
+        LOG_ERR("Program/erase failed, flag status: 0x%X", fsr);
+        N25Q_ClearFlagStatusRegister();
+        return DFU_STORAGE_ERROR;
+    }
+    return DFU_STORAGE_READY;
+}
+
+static int n25q_status(void)
+{
+    return n25q_fsr_status(N25Q_ReadFlagStatusRegister());
+}
+
+static int n25q_wait(uint32_t timeout_ms)
+{
+    int fsr = N25Q_WaitReady(timeout_ms);
+    return (fsr < 0) ? DFU_STORAGE_TIMEOUT : n25q_fsr_status(fsr);
+}
+
+/*
+ * @brief a bulk erase cannot be suspended, the suspend times out and the erase goes on
+ */
+static int n25q_suspend(void)
+{
+    int fsr = N25Q_ProgramEraseSuspend(N25Q_SUSPEND_TIMEOUT_MS);
+    if (fsr < 0)
+    {
+        return -1;
+    }
+    return ((fsr & (N25Q128A_FSR_ERSUS | N25Q128A_FSR_PGSUS)) != 0) ? 1 : 0;
+}
+
+static int n25q_resume(void)
+{
+    N25Q_ProgramEraseResume();
+    return 0;
+}
+
+const dfu_storage_ops_t dfu_storage_n25q = {
+    .name = "n25q",
+    .probe = n25q_probe,
+    .read_id = n25q_read_id,
+    .read_sfdp = n25q_read_sfdp,
+    .read = n25q_read,
+    .read_begin = n25q_read_begin,
+    .read_next = n25q_read_next,
+    .read_end = n25q_read_end,
+    .program_stage = n25q_program_stage,
+    .program_start = n25q_program_start,
+    .erase_start = n25q_erase_start,
+    .status = n25q_status,
+    .wait = n25q_wait,
+    .suspend = n25q_suspend,
+    .resume = n25q_resume,
+    .update_mode = NULL,
+};
+
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_SPI_N25Q == 1) */
+
+/*** End of File **************************************************************/
@@ -0,0 +1,187 @@
+/*******************************************************************************
+ * Title                 :   DFU storage backend in RAM
+ * Filename              :   dfu_storage_ram.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file dfu_storage_ram.c
+ *  \brief NOR flash model in a RAM buffer, used to test the DFU module without a flash part. Programming can only
+ *         clear bits and erases set whole blocks to 0xFF, operations complete immediately.
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+#include <string.h>
+
+#include "dfu.h"
+#include "dfu_storage.h"
+
+#if (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_RAM == 1)
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define RAM_PAGE_SIZE               (256)
+#define RAM_ERASE_4K                (1)
+#define RAM_ERASE_64K               (2)
+#define RAM_ERASE_CHIP              (3)
+
+/******************************************************************************
+ * Module Variable Definitions
+ *******************************************************************************/
+static uint8_t *ram_mem = NULL;
+static uint32_t ram_size;
+static uint8_t ram_page_buf[2][RAM_PAGE_SIZE];
+static uint8_t ram_page_index;
+static uint32_t ram_page_addr;
+static uint32_t ram_page_len;
+static int ram_result = DFU_STORAGE_READY;
+static uint32_t ram_read_addr;
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+
+/*
+ * @brief memory used as flash by the RAM backend, size is a multiple of 64KB. Probing fails until it is attached.
+ */
+void dfu_storage_ram_attach(uint8_t *mem, uint32_t size)
+{
+    ram_mem = mem;
+    ram_size = size;
+}
+
+static int ram_probe(dfu_storage_geometry_t *geo)
+{
+    if (ram_mem == NULL || ram_size == 0 || (ram_size & 0xFFFF) != 0)
+    {
+        return -1;
+    }
+    geo->name = "RAM";
+    geo->size = ram_size;
+    geo->page_size = RAM_PAGE_SIZE;
+    geo->erase_value = 0xFF;
+    geo->program_max_ms = 1;
+    geo->erase[0] = (dfu_storage_erase_t){4096, RAM_ERASE_4K, 1, 1};
+    geo->erase[1] = (dfu_storage_erase_t){65536, RAM_ERASE_64K, 2, 2};
+    geo->erase_count = 2;
+    geo->chip_erase = (dfu_storage_erase_t){ram_size, RAM_ERASE_CHIP, ram_size >> 16, ram_size >> 16};
+    return 0;
+}
+
+static int ram_read(uint32_t addr, uint8_t *data, uint32_t len)
+{
+    if (addr > ram_size || len > ram_size - addr)
+    {
+        return -1;
+    }
+    memcpy(data, &ram_mem[addr], len);
+    return 0;
+}
+
+static int ram_read_begin(uint32_t addr)
+{
+    ram_read_addr = addr;
+    return 0;
+}
+
+static int ram_read_next(uint8_t *data, uint32_t len)
+{
+    int result = ram_read(ram_read_addr, data, len);
+    ram_read_addr += len;
+    return result;
+}
+
+static void ram_read_end(void)
+{
+}
+
+static const uint8_t *ram_program_stage(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    ram_page_index ^= 1;
+    memcpy(ram_page_buf[ram_page_index], data, len);
+    ram_page_addr = addr;
+    ram_page_len = len;
+    return ram_page_buf[ram_page_index];
+}
+
+static int ram_program_start(void)
+{
+    if (ram_page_addr > ram_size || ram_page_len > ram_size - ram_page_addr ||
+        (ram_page_addr & (RAM_PAGE_SIZE - 1)) + ram_page_len > RAM_PAGE_SIZE)
+    {
+        ram_result = DFU_STORAGE_ERROR;
+        return -1;
+    }
+    for (uint32_t i = 0; i < ram_page_len; i++)
+    {
+        ram_mem[ram_page_addr + i] &= ram_page_buf[ram_page_index][i];
+    }
+    ram_result = DFU_STORAGE_READY;
+    return 0;
+}
+
+static int ram_erase_start(uint8_t id, uint32_t addr)
+{
+    uint32_t size;
+    switch (id)
+    {
+    case RAM_ERASE_4K:
+        size = 4096;
+        break;
+    case RAM_ERASE_64K:
+        size = 65536;
+        break;
+    case RAM_ERASE_CHIP:
+        addr = 0;
+        size = ram_size;
+        break;
+    default:
+        return -1;
+    }
+    addr &= ~(size - 1);
+    if (addr >= ram_size)
+    {
+        ram_result = DFU_STORAGE_ERROR;
+        return -1;
+    }
+    memset(&ram_mem[addr], 0xFF, size);
+    ram_result = DFU_STORAGE_READY;
+    return 0;
+}
+
+/*
+ * @brief operations complete when started, the status is the one of the last operation
+ */
+static int ram_status(void)
+{
+    int result = ram_result;
+    ram_result = DFU_STORAGE_READY;
+    return result;
+}
+
+const dfu_storage_ops_t dfu_storage_ram = {
+    .name = "ram",
+    .probe = ram_probe,
+    .read_id = NULL,
+    .read_sfdp = NULL,
+    .read = ram_read,
+    .read_begin = ram_read_begin,
+    .read_next = ram_read_next,
+    .read_end = ram_read_end,
+    .program_stage = ram_program_stage,
+    .program_start = ram_program_start,
+    .erase_start = ram_erase_start,
+    .status = ram_status,
+    .wait = NULL,
+    .suspend = NULL,
+    .resume = NULL,
+    .update_mode = NULL,
+};
+
+#endif /* End of (DFU_STORAGE_SPI_STM32 == 1) && (DFU_STORAGE_RAM == 1) */
+
+/*** End of File **************************************************************/
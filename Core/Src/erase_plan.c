@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * Title                 :   Erase planner
+ * Filename              :   erase_plan.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file erase_plan.c
+ *  \brief Cover a flash range with the cheapest mix of erase sizes
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+
+#include "erase_plan.h"
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+
+/*
+ * @brief cheapest time to erase one aligned block of erase type "type", either with a single erase of that type or
+ *        with the cheapest cover of its sub-blocks
+ */
+static uint32_t erase_plan_block_cost(const erase_plan_geometry_t *geo, uint8_t type)
+{
+    uint32_t cost = geo->types[0].time_ms;
+    for (uint8_t i = 1; i <= type; i++)
+    {
+        uint32_t split_cost = cost * (geo->types[i].size / geo->types[i - 1].size);
+        cost = (geo->types[i].time_ms < split_cost) ? geo->types[i].time_ms : split_cost;
+    }
+    return cost;
+}
+
+/*
+ * @brief next erase operation to cover [addr, end)
+ * @param geo: erase sizes and timings of the device
+ * @param addr: start of the remaining range, aligned to the smallest erase size
+ * @param end: end of the range, aligned to the smallest erase size
+ * @param[out] op: erase operation, op->addr == addr
+ * @return int 0 on success, negative value otherwise
+ */
+int erase_plan_next(const erase_plan_geometry_t *geo, uint32_t addr, uint32_t end, erase_plan_op_t *op)
+{
+    if (geo == NULL || op == NULL || geo->type_count == 0 || addr >= end ||
+        ((addr | end) & (geo->types[0].size - 1)) != 0)
+    {
+        return -1;
+    }
+
+    // Whole device: chip erase if cheaper than the block erases
+    uint8_t largest = geo->type_count - 1;
+    if (geo->chip_erase_ms != 0 && addr == 0 && end >= geo->chip_size &&
+        (uint64_t) geo->chip_erase_ms <=
+            (uint64_t) erase_plan_block_cost(geo, largest) * (geo->chip_size / geo->types[largest].size))
+    {
+        *op = (erase_plan_op_t){.addr = 0, .size = geo->chip_size, .time_ms = geo->chip_erase_ms,
+                                .id = geo->chip_erase_id};
+        return 0;
+    }
+
+    // Largest erase aligned on addr that stays inside the range
+    uint8_t type = largest;
+    while (type > 0 && (((addr & (geo->types[type].size - 1)) != 0) || (end - addr) < geo->types[type].size))
+    {
+        type--;
+    }
+    // Smaller erases if they cover the same block faster
+    while (type > 0 && geo->types[type].time_ms >
+                           erase_plan_block_cost(geo, type - 1) * (geo->types[type].size / geo->types[type - 1].size))
+    {
+        type--;
+    }
+    *op = (erase_plan_op_t){.addr = addr, .size = geo->types[type].size, .time_ms = geo->types[type].time_ms,
+                            .id = geo->types[type].id};
+    return 0;
+}
+
+/*
+ * @brief expected time to erase [addr, end) following the plan
+ * @return uint32_t time in ms, 0 if the range cannot be planned
+ */
+uint32_t erase_plan_cost_ms(const erase_plan_geometry_t *geo, uint32_t addr, uint32_t end)
+{
+    uint32_t cost = 0;
+    erase_plan_op_t op;
+    while (addr < end && erase_plan_next(geo, addr, end, &op) == 0)
+    {
+        cost += op.time_ms;
+        addr += op.size;
+    }
+    return cost;
+}
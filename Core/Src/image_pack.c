@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * Title                 :   Packed image
+ * Filename              :   image_pack.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file image_pack.c
+ *  \brief Find an image in a pack made by Host/tools/image_pack
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+
+#include "crc32.h"
+#include "image_pack.h"
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+/*
+ * @brief whether [offset, offset + len) is inside a pack of total_len bytes
+ */
+static bool image_pack_in_range(uint32_t total_len, uint32_t offset, uint32_t len)
+{
+    return offset <= total_len && len <= total_len - offset;
+}
+
+/*
+ * @brief check one entry of the table against the pack bounds
+ */
+static bool image_pack_entry_valid(const image_pack_entry_t *p_entry, uint32_t total_len)
+{
+    if (p_entry->header.image_magic != IMAGE_MAGIC_NUMBER ||
+        !image_pack_in_range(total_len, p_entry->payload_offset, p_entry->payload_len))
+    {
+        return false;
+    }
+    if ((p_entry->flags & IMAGE_PACK_FLAG_BLOCK_CRC) == 0)
+    {
+        return true;
+    }
+    if (p_entry->block_size_log2 >= 32)
+    {
+        return false;
+    }
+    uint32_t block_size = 1UL << p_entry->block_size_log2;
+    uint32_t block_count = p_entry->header.img_data_size / block_size +
+                           ((p_entry->header.img_data_size % block_size) != 0);
+    return block_count <= total_len / sizeof(uint32_t) &&
+           image_pack_in_range(total_len, p_entry->block_crc_offset, block_count * sizeof(uint32_t));
+}
+
+/*
+ * @brief find the image of the given type in a pack
+ * @param p_data: the pack, or any other data
+ * @return const image_pack_entry_t* entry of the image, NULL if p_data is not a valid pack or has no such image
+ */
+const image_pack_entry_t *image_pack_find(const void *p_data, uint32_t len, uint8_t image_type)
+{
+    const image_pack_header_t *p_header = (const image_pack_header_t *) p_data;
+    if (p_data == NULL || len < sizeof(image_pack_header_t) || p_header->magic != IMAGE_PACK_MAGIC ||
+        p_header->total_len > len || p_header->image_count > IMAGE_PACK_MAX_IMAGES)
+    {
+        return NULL;
+    }
+    uint32_t table_len = p_header->image_count * sizeof(image_pack_entry_t);
+    if (!image_pack_in_range(p_header->total_len, sizeof(image_pack_header_t), table_len))
+    {
+        return NULL;
+    }
+    const image_pack_entry_t *p_entries = (const image_pack_entry_t *) (p_header + 1);
+    if (crc32(p_entries, table_len) != p_header->entries_crc)
+    {
+        return NULL;
+    }
+    for (uint8_t i = 0; i < p_header->image_count; i++)
+    {
+        if (!image_pack_entry_valid(&p_entries[i], p_header->total_len))
+        {
+            return NULL;
+        }
+        if (p_entries[i].header.image_data_type == image_type)
+        {
+            return &p_entries[i];
+        }
+    }
+    return NULL;
+}
+
+/*** End of File **************************************************************/
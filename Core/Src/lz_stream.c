@@ -0,0 +1,269 @@
+/*******************************************************************************
+ * Title                 :   Streaming LZ decoder
+ * Filename              :   lz_stream.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file lz_stream.c
+ *  \brief Decode compressed image payloads in fixed-size windows
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+#include <string.h>
+
+#include "lz_stream.h"
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define LZ_STREAM_LEN_EXT           (15) // Nibble value announcing extra length bytes
+
+/******************************************************************************
+ * Module Typedefs
+ *******************************************************************************/
+enum
+{
+    LZ_STATE_HEADER = 0,
+    LZ_STATE_STORED,
+    LZ_STATE_TOKEN,
+    LZ_STATE_LITERAL_EXT,
+    LZ_STATE_LITERALS,
+    LZ_STATE_OFFSET_LOW,
+    LZ_STATE_OFFSET_HIGH,
+    LZ_STATE_MATCH_EXT,
+    LZ_STATE_MATCH,
+};
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+
+/*
+ * @brief check that p_data starts with a payload header
+ * @return const lz_stream_header_t* the header, NULL if p_data is not a payload
+ */
+const lz_stream_header_t *lz_stream_payload_header(const void *p_data, uint32_t len)
+{
+    const lz_stream_header_t *p_header = (const lz_stream_header_t *) p_data;
+    if (p_data == NULL || len < sizeof(lz_stream_header_t) || p_header->magic != LZ_STREAM_MAGIC)
+    {
+        return NULL;
+    }
+    return p_header;
+}
+
+void lz_stream_init(lz_stream_t *s)
+{
+    memset(&s->header, 0, sizeof(s->header));
+    s->header_len = 0;
+    s->state = LZ_STATE_HEADER;
+    s->error = false;
+    s->out_pos = 0;
+    s->literal_len = 0;
+    s->match_len = 0;
+    s->match_offset = 0;
+}
+
+/*
+ * @brief true once the whole decompressed data has been produced
+ */
+bool lz_stream_done(const lz_stream_t *s)
+{
+    return (s->state != LZ_STATE_HEADER) && (s->out_pos == s->header.raw_size);
+}
+
+static inline void lz_stream_emit(lz_stream_t *s, uint8_t byte, uint8_t *out)
+{
+    *out = byte;
+    s->window[s->out_pos & ((1UL << s->header.window_bits) - 1)] = byte;
+    s->out_pos++;
+}
+
+/*
+ * @brief decode up to out_len bytes from in_len bytes of payload
+ *        Stops when the output is full, the input is exhausted or the data is complete. The payload is fed in order
+ *        starting with its header, consumed input must not be passed again.
+ * @param p_consumed input bytes used
+ * @return int number of bytes written to out, negative value on corrupted payload
+ */
+int lz_stream_decode(lz_stream_t *s, const uint8_t *in, uint32_t in_len, uint32_t *p_consumed,
+                     uint8_t *out, uint32_t out_len)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+    uint32_t n;
+
+    if (s->error)
+    {
+        *p_consumed = 0;
+        return -1;
+    }
+
+    while (op < out_len)
+    {
+        if (s->state != LZ_STATE_HEADER && s->out_pos == s->header.raw_size)
+        {
+            break;
+        }
+        switch (s->state)
+        {
+        case LZ_STATE_HEADER:
+            n = sizeof(s->header) - s->header_len;
+            if (n > in_len - ip)
+            {
+                n = in_len - ip;
+            }
+            memcpy((uint8_t *) &s->header + s->header_len, &in[ip], n);
+            ip += n;
+            s->header_len += n;
+            if (s->header_len < sizeof(s->header))
+            {
+                goto out;
+            }
+            if (s->header.magic != LZ_STREAM_MAGIC || s->header.window_bits < LZ_STREAM_MIN_WINDOW_BITS ||
+                s->header.window_bits > LZ_STREAM_MAX_WINDOW_BITS)
+            {
+                goto corrupted;
+            }
+            s->state = (s->header.flags & LZ_STREAM_FLAG_COMPRESSED) ? LZ_STATE_TOKEN : LZ_STATE_STORED;
+            break;
+
+        case LZ_STATE_STORED:
+            n = s->header.raw_size - s->out_pos;
+            n = (n < out_len - op) ? n : out_len - op;
+            n = (n < in_len - ip) ? n : in_len - ip;
+            if (n == 0)
+            {
+                goto out;
+            }
+            // Stored data has no matches, the history is not needed
+            memcpy(&out[op], &in[ip], n);
+            ip += n;
+            op += n;
+            s->out_pos += n;
+            break;
+
+        case LZ_STATE_TOKEN:
+            if (ip == in_len)
+            {
+                goto out;
+            }
+            s->literal_len = in[ip] >> 4;
+            s->match_len = in[ip] & 0x0F;
+            ip++;
+            s->state = (s->literal_len == LZ_STREAM_LEN_EXT) ? LZ_STATE_LITERAL_EXT : LZ_STATE_LITERALS;
+            break;
+
+        case LZ_STATE_LITERAL_EXT:
+            if (ip == in_len)
+            {
+                goto out;
+            }
+            s->literal_len += in[ip];
+            if (in[ip++] != 0xFF)
+            {
+                s->state = LZ_STATE_LITERALS;
+            }
+            break;
+
+        case LZ_STATE_LITERALS:
+            if (s->literal_len == 0)
+            {
+                // The last sequence ends with its literals
+                s->state = LZ_STATE_OFFSET_LOW;
+                break;
+            }
+            if (s->literal_len > s->header.raw_size - s->out_pos)
+            {
+                goto corrupted;
+            }
+            n = (s->literal_len < out_len - op) ? s->literal_len : out_len - op;
+            n = (n < in_len - ip) ? n : in_len - ip;
+            if (n == 0)
+            {
+                goto out;
+            }
+            s->literal_len -= n;
+            while (n--)
+            {
+                lz_stream_emit(s, in[ip++], &out[op++]);
+            }
+            break;
+
+        case LZ_STATE_OFFSET_LOW:
+            if (ip == in_len)
+            {
+                goto out;
+            }
+            s->match_offset = in[ip++];
+            s->state = LZ_STATE_OFFSET_HIGH;
+            break;
+
+        case LZ_STATE_OFFSET_HIGH:
+            if (ip == in_len)
+            {
+                goto out;
+            }
+            s->match_offset |= (uint32_t) in[ip++] << 8;
+            if (s->match_offset == 0 || s->match_offset > (1UL << s->header.window_bits) ||
+                s->match_offset > s->out_pos)
+            {
+                goto corrupted;
+            }
+            s->state = (s->match_len == LZ_STREAM_LEN_EXT) ? LZ_STATE_MATCH_EXT : LZ_STATE_MATCH;
+            s->match_len += LZ_STREAM_MIN_MATCH;
+            break;
+
+        case LZ_STATE_MATCH_EXT:
+            if (ip == in_len)
+            {
+                goto out;
+            }
+            s->match_len += in[ip];
+            if (in[ip++] != 0xFF)
+            {
+                s->state = LZ_STATE_MATCH;
+            }
+            break;
+
+        case LZ_STATE_MATCH:
+        {
+            if (s->match_len > s->header.raw_size - s->out_pos)
+            {
+                goto corrupted;
+            }
+            uint32_t mask = (1UL << s->header.window_bits) - 1;
+            n = (s->match_len < out_len - op) ? s->match_len : out_len - op;
+            s->match_len -= n;
+            // Byte by byte, the match may overlap the bytes it produces
+            while (n--)
+            {
+                lz_stream_emit(s, s->window[(s->out_pos - s->match_offset) & mask], &out[op++]);
+            }
+            if (s->match_len == 0)
+            {
+                s->state = LZ_STATE_TOKEN;
+            }
+            break;
+        }
+
+        default:
+            goto corrupted;
+        }
+    }
+
+out:
+    *p_consumed = ip;
+    return (int) op;
+
+corrupted:
+    s->error = true;
+    *p_consumed = ip;
+    return -1;
+}
+
+/*** End of File **************************************************************/
@@ -19,6 +19,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "adc.h"
+#include "dma.h"
 #include "gpio.h"
 #include "spi.h"
 #include "usart.h"
@@ -33,6 +34,9 @@
 
 #include "n25q128a.h"
 #include "dfu.h"
+#include "dfu_storage.h"
+#include "MX25Series.h"
+#include "spi_link.h"
 
 /* USER CODE END Includes */
 
@@ -86,6 +90,15 @@ const uint8_t* fw_binary_data_end = (uint8_t*) &_end_fw_data;
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
+#if (FLASH_TEST_N25Q != 0)
+#define FW_UPDATE_MAX_RETRY                     (5)
+static dfu_update_t fw_update;
+#if (DFU_PREERASE != 0)
+static dfu_preerase_t fw_preerase;
+#endif
+/* MX25 on the flash SPI, used by the DFU when the board carries it instead of the N25Q */
+static MX25Series_t fw_storage_mx25;
+#endif /* End of (FLASH_TEST_N25Q != 0) */
 
 /* USER CODE END PV */
 
@@ -97,6 +110,31 @@ void SystemClock_Config(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+#if (FLASH_TEST_N25Q != 0)
+/*
+ * @brief run the flash SPI2 at the fastest clock the link carries. The reference region is the start of the SFDP
+ *        space: the array may be blank, all 0xFF would not show late sampling or a MISO stuck high. SPI1 is not
+ *        trained, the DFU flash is on SPI2 and the flash on SPI1 is read by the nRF.
+ */
+static void fw_storage_train_link(void)
+{
+    spi_link_probe_t probe = {
+        .read_id = dfu_storage_read_id,
+        .read = dfu_storage_read_sfdp,
+        .ref_addr = 0,
+        .ref_len = SPI_LINK_SFDP_REF_LEN,
+    };
+    spi_link_result_t link;
+    if (spi_link_train(&hspi2, &probe, &link) != 0)
+    {
+        printf("[WRN] SPI2 link training failed, staying at %lu Hz \r\n", spi_link_clock_hz(&hspi2));
+        return;
+    }
+    printf("[INF] SPI2 link: %lu Hz, fastest passing %lu Hz, first failing %lu Hz \r\n", link.clock_hz,
+           link.fastest_hz, link.failed_hz);
+}
+#endif /* End of (FLASH_TEST_N25Q != 0) */
+
 #define PUTCHAR_PROTOTYPE int __io_putchar(int ch)
 /**
  * @brief  Retargets the C library printf function to the USART.
@@ -241,21 +279,46 @@ int main(void)
 
     /* Initialize all configured peripherals */
     MX_GPIO_Init();
+    MX_DMA_Init();
     MX_ADC1_Init();
     MX_SPI1_Init();
     MX_SPI2_Init();
     MX_USART1_UART_Init();
     MX_USART2_UART_Init();
     /* USER CODE BEGIN 2 */
-    if (flash_n25q_init() != 0)
+    // Also drives the reset/write protect pins (DQ3/DQ2) high, both parts need it for SPI operation
+    MX25Series_init(&fw_storage_mx25, &MX25R6435F_Chip_Def_Low_Power, SPI2_NSS_PIN_NUMBER, FLASH_RESET_PIN_NUMBER,
+                    FLASH_WP_PIN_NUMBER, 0, &hspi2);
+    // Ultra Low Power between updates, High Performance while updating
+    dfu_storage_mx25_attach(&fw_storage_mx25, &MX25R6435F_Chip_Def_High_Performance);
+    if (dfu_init(NULL) != 0)
+    {
+        printf("[ERR] dfu_init() failed \r\n");
+    }
+    else if (dfu_storage_backend() == &dfu_storage_n25q && flash_n25q_init() != 0)
     {
         printf("[ERR] flash_n25q_init() failed \r\n");
     }
+    else
+    {
+        fw_storage_train_link();
+    }
 
-    if (dfu_fw_image_update(fw_binary_data_start, fw_binary_data_end - fw_binary_data_start, FLASH_N25_FW_START_ADDR) != 0)
+    // The update runs from the main loop, dfu_update_poll() returns within the DFU_UPDATE_BUDGET_MS time slice
+    uint32_t fw_len = fw_binary_data_end - fw_binary_data_start;
+    uint32_t fw_fed = 0;
+    uint8_t fw_update_retry = 0;
+    bool fw_updating = false;
+    int result = dfu_fw_image_update_begin(&fw_update, fw_binary_data_start, fw_len);
+    if (result < 0)
     {
-        printf("[ERR] dfu_fw_image_update() failed \r\n");
+        printf("[ERR] dfu_fw_image_update_begin() failed \r\n");
     }
+    fw_updating = (result > 0);
+#if (DFU_PREERASE != 0)
+    // Not at boot: the known blank range is lost at reset, the whole slot would be read again every time
+    bool fw_preerasing = false;
+#endif
 
     /* USER CODE END 2 */
 
@@ -266,6 +329,45 @@ int main(void)
         /* USER CODE END WHILE */
 
         /* USER CODE BEGIN 3 */
+        if (fw_updating)
+        {
+            int accepted = dfu_update_feed(&fw_update, fw_binary_data_start + fw_fed, fw_len - fw_fed);
+            fw_fed += (accepted > 0) ? accepted : 0;
+            dfu_update_state_t state = dfu_update_poll(&fw_update);
+            if (state == DFU_UPDATE_DONE)
+            {
+                fw_updating = false;
+#if (DFU_PREERASE != 0)
+                // The new image is confirmed, the slot after it is erased in idle time unless it holds the rollback
+                fw_preerasing = (dfu_fw_image_preerase_begin(&fw_preerase) == 0);
+#endif
+            }
+            else if (state == DFU_UPDATE_ERROR)
+            {
+                fw_update_retry++;
+                printf("[ERR] Failed to update image, (%d/%d) \r\n", fw_update_retry, FW_UPDATE_MAX_RETRY);
+                // The trained clock may be marginal, retry one step slower
+                if (spi_link_fallback(&hspi2) == 0)
+                {
+                    printf("[WRN] SPI2 link slowed down to %lu Hz \r\n", spi_link_clock_hz(&hspi2));
+                }
+                fw_fed = 0;
+                fw_updating = (fw_update_retry < FW_UPDATE_MAX_RETRY) &&
+                              (dfu_fw_image_update_begin(&fw_update, fw_binary_data_start, fw_len) > 0);
+            }
+        }
+#if (DFU_PREERASE != 0)
+        else if (fw_preerasing)
+        {
+            // Sleeps while an erase runs
+            int preerase_result = dfu_preerase_poll(&fw_preerase);
+            if (preerase_result < 0)
+            {
+                printf("[ERR] Failed to pre-erase the next update area \r\n");
+            }
+            fw_preerasing = (preerase_result > 0);
+        }
+#endif
     }
     /* USER CODE END 3 */
 }
@@ -38,7 +38,7 @@
 #endif /* End of (FLASH_N25_DBG_MSG_EN != 0) */
 
 
-#define SlaveSelect()           HAL_GPIO_WritePin(SPI2_NSS_GPIO_Port, SPI2_NSS_Pin, GPIO_PIN_RESET)
+#define SlaveSelect()           do { m_SPI__WaitIdle(); HAL_GPIO_WritePin(SPI2_NSS_GPIO_Port, SPI2_NSS_Pin, GPIO_PIN_RESET); } while (0)
 #define SlaveDeSelect()         HAL_GPIO_WritePin(SPI2_NSS_GPIO_Port, SPI2_NSS_Pin, GPIO_PIN_SET)
 /******************************************************************************
 * Module Typedefs
@@ -75,12 +75,39 @@
  * Riccardo Pozza <r.pozza@surrey.ac.uk>
  */
 #include <stdbool.h>
+#include <string.h>
 
 #include "n25q128a.h"
 #include "spi.h"
 
 
 #define SPI_MAX_TIMEOUT     3000
+#define SPI_MAX_DMA_SIZE    0xFFFF
+
+/* FAST_READ dummy bytes, as set by N25Q_SetReadDummyCycles() (default 8 cycles) */
+static int m_FastReadDummyBytes = N25Q128A_DUMMY_CYCLES_READ / 8;
+
+/* Address bytes of the array commands, 4 after N25Q_Enter4ByteAddressMode() */
+static int m_AddressBytes = 3;
+
+/* Transfer time margin: 8ms per KB covers SCK down to 125kHz */
+#define m_SPI__Timeout(length)  (SPI_MAX_TIMEOUT + ((uint32_t)(length) >> 7))
+
+/* Wait for the end of a DMA transfer left running by N25Q_StartPageProgram() */
+static void m_SPI__WaitIdle(void) {
+#if (FLASH_N25_SPI_USE_DMA != 0)
+	SPI_DMA_Wait(&hspi2, m_SPI__Timeout(N25Q128A_PAGE_PROG_FRAME_SIZE));
+#endif
+}
+
+#if (FLASH_N25_SPI_USE_DMA != 0)
+static void m_SPI__DeselectCallback(SPI_HandleTypeDef *hspi, HAL_StatusTypeDef status, void *arg) {
+	(void)hspi;
+	(void)status;
+	(void)arg;
+	SlaveDeSelect();
+}
+#endif
 
 int m_SPI__writebyte(uint8_t data) {
 	uint8_t transmit_byte = data;
@@ -90,13 +117,54 @@ int m_SPI__writebyte(uint8_t data) {
     return 0;
 }
 
-int m_SPI__ReadNBytes(uint8_t * rxBuffer, int length) {
-    if (HAL_SPI_Receive(&hspi2, (uint8_t *)rxBuffer, length, SPI_MAX_TIMEOUT) != HAL_OK) {
+/* Send a buffer in one transfer, DMA for the long ones */
+int m_SPI__WriteNBytes(uint8_t * txBuffer, int length) {
+#if (FLASH_N25_SPI_USE_DMA != 0)
+    if (length >= FLASH_N25_SPI_DMA_MIN_SIZE && length <= SPI_MAX_DMA_SIZE) {
+        if (SPI_DMA_Transmit(&hspi2, txBuffer, length, NULL, NULL) != HAL_OK ||
+            SPI_DMA_Wait(&hspi2, m_SPI__Timeout(length)) != HAL_OK) {
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    if (HAL_SPI_Transmit(&hspi2, txBuffer, length, SPI_MAX_TIMEOUT) != HAL_OK) {
         return -1;
     }
     return 0;
 }
 
+/* Command and 3 or 4-byte address in a single transfer */
+int m_SPI__WriteCommandAddress(uint8_t command, int address) {
+    uint8_t header[5] = {command};
+    for (int i = 0; i < m_AddressBytes; i++) {
+        header[1 + i] = ((uint32_t)address >> (8 * (m_AddressBytes - 1 - i))) & 0xFF;
+    }
+    dbgprintf("Starting Address: %X\r\n", address);
+    return m_SPI__WriteNBytes(header, 1 + m_AddressBytes);
+}
+
+/* Receive straight into rxBuffer, DMA for the long reads (split in 64KB transfers) */
+int m_SPI__ReadNBytes(uint8_t * rxBuffer, int length) {
+    while (length > 0) {
+        int chunk = (length > SPI_MAX_DMA_SIZE) ? SPI_MAX_DMA_SIZE : length;
+#if (FLASH_N25_SPI_USE_DMA != 0)
+        if (chunk >= FLASH_N25_SPI_DMA_MIN_SIZE) {
+            if (SPI_DMA_Receive(&hspi2, rxBuffer, chunk, NULL, NULL) != HAL_OK ||
+                SPI_DMA_Wait(&hspi2, m_SPI__Timeout(chunk)) != HAL_OK) {
+                return -1;
+            }
+        } else
+#endif
+        if (HAL_SPI_Receive(&hspi2, (uint8_t *)rxBuffer, chunk, SPI_MAX_TIMEOUT) != HAL_OK) {
+            return -1;
+        }
+        rxBuffer += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
 int m_SPI__ReadByte(void) {
     uint8_t rxBuffer;
     if (HAL_SPI_Receive(&hspi2, (uint8_t *)&rxBuffer, 1, SPI_MAX_TIMEOUT) != HAL_OK) {
@@ -168,26 +236,139 @@ void N25Q_ReadID(uint8_t * id_string, int length) {
 	testprintf("Ended!\r\n");
 }
 
+/*
+ * Read the SFDP tables: 3 address bytes and 8 dummy cycles, whatever the address mode.
+ */
+void N25Q_ReadSFDP(uint8_t * dataBuffer, int startingAddress, int length) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	uint8_t header[5] = {READ_SERIAL_FLASH_DISCO_PARAM_CMD, (startingAddress >> 16) & 0xFF,
+	                     (startingAddress >> 8) & 0xFF, startingAddress & 0xFF, 0xFF};
+	SlaveSelect();
+	m_SPI__WriteNBytes(header, sizeof(header));
+	m_SPI__ReadNBytes(dataBuffer, length);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+}
+
+/*
+ * Switch the array commands to 4-byte addresses, for the parts above 16MB.
+ * Returns 0 on success, -1 if the flag status register does not show the 4-byte mode.
+ */
+int N25Q_Enter4ByteAddressMode(void) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	N25Q_WriteEnable();
+	SlaveSelect();
+	m_SPI__writebyte(ENTER_4_BYTE_ADDR_MODE_CMD);
+	SlaveDeSelect();
+
+	int fsr = N25Q_ReadFlagStatusRegister();
+	if (fsr < 0 || (fsr & N25Q128A_FSR_ADDR4) == 0) {
+		return -1;
+	}
+	m_AddressBytes = 4;
+
+	testprintf("Ended!\r\n");
+	return 0;
+}
+
 void N25Q_ReadDataFromAddress(uint8_t * dataBuffer, int startingAddress, int length) {
 	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
 
 	dbgprintf("Reading Data From ");
 
 	SlaveSelect();
-	m_SPI__writebyte(READ_CMD);
-	dbgprintf("Starting Address: ");
-	for (int i=2; i>=0; i--){
-		int addressByte = (startingAddress >> 8*i) & 0xFF;
-		dbgprintf("%X ", addressByte);
-		m_SPI__writebyte(addressByte);
-	}
-	dbgprintf("\r\n");
+	m_SPI__WriteCommandAddress(READ_CMD, startingAddress);
 	m_SPI__ReadNBytes(dataBuffer,length);
 	SlaveDeSelect();
 
 	testprintf("Ended!\r\n");
 }
 
+void N25Q_FastReadDataFromAddress(uint8_t * dataBuffer, int startingAddress, int length) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	N25Q_BeginRead(startingAddress, true);
+	m_SPI__ReadNBytes(dataBuffer,length);
+	N25Q_EndRead();
+
+	testprintf("Ended!\r\n");
+}
+
+/*
+ * Set the FAST_READ dummy clock cycles in the volatile configuration register.
+ * The bus runs 8-bit frames, so only whole dummy bytes (8 cycles, the register allows 1 to 15) are supported.
+ * Returns 0 on success, -1 if the value is not supported or was not taken.
+ */
+int N25Q_SetReadDummyCycles(int cycles) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	if (cycles <= 0 || cycles > 15 || (cycles % 8) != 0) {
+		return -1;
+	}
+
+	SlaveSelect();
+	m_SPI__writebyte(READ_VOL_CFG_REG_CMD);
+	int vcr = m_SPI__ReadByte();
+	SlaveDeSelect();
+	if (vcr < 0) {
+		return -1;
+	}
+	vcr = (vcr & ~N25Q128A_VCR_NB_DUMMY) | (cycles << 4);
+
+	N25Q_WriteEnable();
+	SlaveSelect();
+	m_SPI__writebyte(WRITE_VOL_CFG_REG_CMD);
+	m_SPI__writebyte(vcr);
+	SlaveDeSelect();
+
+	SlaveSelect();
+	m_SPI__writebyte(READ_VOL_CFG_REG_CMD);
+	int readback = m_SPI__ReadByte();
+	SlaveDeSelect();
+	if (readback != vcr) {
+		return -1;
+	}
+	m_FastReadDummyBytes = cycles / 8;
+
+	testprintf("Ended!\r\n");
+	return 0;
+}
+
+/* SCK frequency of the flash bus */
+uint32_t N25Q_GetClockFrequency(void) {
+	uint32_t prescaler_shift = ((hspi2.Init.BaudRatePrescaler >> SPI_CR1_BR_Pos) & 0x7) + 1;
+	return HAL_RCC_GetPCLK1Freq() >> prescaler_shift;
+}
+
+/*
+ * Continuous read: a single READ/FAST_READ command, then any number of N25Q_ContinueRead()
+ * calls stream the following bytes (the address increments and wraps at the end of the array)
+ * until N25Q_EndRead(). No other driver call is allowed in between.
+ */
+void N25Q_BeginRead(int startingAddress, bool fast) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	uint8_t dummy[1] = {0xFF};
+	SlaveSelect();
+	m_SPI__WriteCommandAddress(fast ? FAST_READ_CMD : READ_CMD, startingAddress);
+	for (int i = 0; fast && i < m_FastReadDummyBytes; i++) {
+		m_SPI__WriteNBytes(dummy, sizeof(dummy));
+	}
+
+	testprintf("Ended!\r\n");
+}
+
+int N25Q_ContinueRead(uint8_t * dataBuffer, int length) {
+	return m_SPI__ReadNBytes(dataBuffer, length);
+}
+
+void N25Q_EndRead(void) {
+	SlaveDeSelect();
+}
+
 void N25Q_ProgramFromAddress(uint8_t* dataBuffer, int startingAddress, int length){
 	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
 
@@ -198,20 +379,8 @@ void N25Q_ProgramFromAddress(uint8_t* dataBuffer, int startingAddress, int lengt
 	N25Q_WriteEnable();
 
 	SlaveSelect();
-	m_SPI__writebyte(PAGE_PROG_CMD);
-	dbgprintf("Starting Address: ");
-	for (int i=2; i>=0; i--){
-		int addressByte = (startingAddress >> 8*i) & 0xFF;
-		dbgprintf("%X ", addressByte);
-		m_SPI__writebyte(addressByte);
-	}
-	dbgprintf("\r\n");
-	dbgprintf("Data Written:\r\n");
-	for (int z=0; z<length; z++){
-		dbgprintf("%X ", dataBuffer[z]);
-		m_SPI__writebyte(dataBuffer[z]);
-	}
-	dbgprintf("\r\n");
+	m_SPI__WriteCommandAddress(PAGE_PROG_CMD, startingAddress);
+	m_SPI__WriteNBytes(dataBuffer, length);
 	SlaveDeSelect();
 
 	while (N25Q_isBusy());
@@ -229,25 +398,79 @@ void N25Q_NonBlockingProgramFromAddress(uint8_t * dataBuffer, int startingAddres
 	N25Q_WriteEnable();
 
 	SlaveSelect();
-	m_SPI__writebyte(PAGE_PROG_CMD);
-	dbgprintf("Starting Address: ");
-	for (int i=2; i>=0; i--){
-		int addressByte = (startingAddress >> 8*i) & 0xFF;
-		dbgprintf("%X ", addressByte);
-		m_SPI__writebyte(addressByte);
+	m_SPI__WriteCommandAddress(PAGE_PROG_CMD, startingAddress);
+	m_SPI__WriteNBytes(dataBuffer, length);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+}
+
+/*
+ * Build the page program frame (command, address, data) for N25Q_StartPageProgram(),
+ * so it can be prepared while the previous page is still programming.
+ * frame must hold N25Q128A_PAGE_PROG_FRAME_SIZE bytes, length must not cross a page.
+ * Returns the frame length.
+ */
+int N25Q_StagePageProgram(uint8_t * frame, const uint8_t * dataBuffer, int startingAddress, int length) {
+	frame[0] = PAGE_PROG_CMD;
+	for (int i = 0; i < m_AddressBytes; i++) {
+		frame[1 + i] = ((uint32_t)startingAddress >> (8 * (m_AddressBytes - 1 - i))) & 0xFF;
 	}
-	dbgprintf("\r\n");
-	dbgprintf("Data Written:\r\n");
-	for (int z=0; z<length; z++){
-		dbgprintf("%X ", dataBuffer[z]);
-		m_SPI__writebyte(dataBuffer[z]);
+	memcpy(&frame[1 + m_AddressBytes], dataBuffer, length);
+	return 1 + m_AddressBytes + length;
+}
+
+/*
+ * Send a staged page program frame in a single transfer and return without waiting,
+ * completion is checked with N25Q_WaitReady().
+ * With FLASH_N25_SPI_USE_DMA the frame is still being sent on return (the chip select
+ * is released from the DMA completion), so it must not be modified until the next
+ * driver call, which waits for the bus.
+ */
+void N25Q_StartPageProgram(uint8_t * frame, int frameLength) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	N25Q_WriteEnable();
+
+	SlaveSelect();
+#if (FLASH_N25_SPI_USE_DMA != 0)
+	if (SPI_DMA_Transmit(&hspi2, frame, frameLength, m_SPI__DeselectCallback, NULL) == HAL_OK) {
+		testprintf("Started!\r\n");
+		return;
 	}
-	dbgprintf("\r\n");
+#endif
+	HAL_SPI_Transmit(&hspi2, frame, frameLength, SPI_MAX_TIMEOUT);
 	SlaveDeSelect();
 
 	testprintf("Ended!\r\n");
 }
 
+/*
+ * Wait for the end of a program/erase, polling the flag status register
+ * continuously inside a single command (one status byte per poll).
+ * Returns the final flag status register (error bits included), -1 on timeout.
+ */
+int N25Q_WaitReady(uint32_t timeout_ms) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	uint32_t start = HAL_GetTick();
+	int retval;
+
+	SlaveSelect();
+	m_SPI__writebyte(READ_FLAG_STATUS_REG_CMD);
+	do {
+		retval = m_SPI__ReadByte();
+		if ((retval & N25Q128A_FSR_READY) == 0 && (HAL_GetTick() - start) > timeout_ms) {
+			retval = -1;
+			break;
+		}
+	} while ((retval & N25Q128A_FSR_READY) == 0);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+	return retval;
+}
+
 void N25Q_WriteDisable(void) {
 	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
 
@@ -281,14 +504,8 @@ int N25Q_ReadLockRegister(int startingAddress) {
 	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
 
 	SlaveSelect();
-	m_SPI__writebyte(READ_LOCK_REG_CMD);
-	dbgprintf("Read Lock Register From Starting Address: ");
-	for (int i=2; i>=0; i--){
-		int addressByte = (startingAddress >> 8*i) & 0xFF;
-		dbgprintf("%X ", addressByte);
-		m_SPI__writebyte(addressByte);
-	}
-	dbgprintf("\r\n");
+	dbgprintf("Read Lock Register ");
+	m_SPI__WriteCommandAddress(READ_LOCK_REG_CMD, startingAddress);
 	int retval = m_SPI__ReadByte();
 	SlaveDeSelect();
 
@@ -302,11 +519,7 @@ void N25Q_WriteLockRegister(int startingAddress, int lock_mask) {
 	N25Q_WriteEnable();
 
 	SlaveSelect();
-	m_SPI__writebyte(WRITE_LOCK_REG_CMD);
-	for (int i=2; i>=0; i--){
-		int addressByte = (startingAddress >> 8*i) & 0xFF;
-		m_SPI__writebyte(addressByte);
-	}
+	m_SPI__WriteCommandAddress(WRITE_LOCK_REG_CMD, startingAddress);
 	m_SPI__writebyte(lock_mask);
 	SlaveDeSelect();
 
@@ -334,14 +547,8 @@ void N25Q_SubSectorErase(int startingAddress) {
 	N25Q_WriteEnable();
 
 	SlaveSelect();
-	m_SPI__writebyte(SUBSECTOR_ERASE_CMD);
-	dbgprintf("Subsector Erase From Starting Address: ");
-	for (int i=2; i>=0; i--){
-		int addressByte = (startingAddress >> 8*i) & 0xFF;
-		dbgprintf("%X ", addressByte);
-		m_SPI__writebyte(addressByte);
-	}
-	dbgprintf("\r\n");
+	dbgprintf("Subsector Erase ");
+	m_SPI__WriteCommandAddress(SUBSECTOR_ERASE_CMD, startingAddress);
 	SlaveDeSelect();
 
 	while (N25Q_isBusy()){
@@ -356,14 +563,8 @@ void N25Q_SectorErase(int startingAddress) {
 	N25Q_WriteEnable();
 
 	SlaveSelect();
-	m_SPI__writebyte(SECTOR_ERASE_CMD);
-	dbgprintf("Sector Erase From Starting Address: ");
-	for (int i=2; i>=0; i--){
-		int addressByte = (startingAddress >> 8*i) & 0xFF;
-		dbgprintf("%X ", addressByte);
-		m_SPI__writebyte(addressByte);
-	}
-	dbgprintf("\r\n");
+	dbgprintf("Sector Erase ");
+	m_SPI__WriteCommandAddress(SECTOR_ERASE_CMD, startingAddress);
 	SlaveDeSelect();
 
 	while (N25Q_isBusy()){
@@ -372,6 +573,52 @@ void N25Q_SectorErase(int startingAddress) {
 	testprintf("Ended!\r\n");
 }
 
+/*
+ * Start a subsector/sector erase and return without waiting,
+ * completion is checked with N25Q_ReadFlagStatusRegister() or N25Q_WaitReady().
+ */
+void N25Q_NonBlockingSubSectorErase(int startingAddress) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	N25Q_WriteEnable();
+
+	SlaveSelect();
+	dbgprintf("Subsector Erase ");
+	m_SPI__WriteCommandAddress(SUBSECTOR_ERASE_CMD, startingAddress);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+}
+
+void N25Q_NonBlockingSectorErase(int startingAddress) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	N25Q_WriteEnable();
+
+	SlaveSelect();
+	dbgprintf("Sector Erase ");
+	m_SPI__WriteCommandAddress(SECTOR_ERASE_CMD, startingAddress);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+}
+
+/*
+ * Start an erase with any address erase command, as reported by the SFDP tables.
+ */
+void N25Q_NonBlockingErase(int command, int startingAddress) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	N25Q_WriteEnable();
+
+	SlaveSelect();
+	dbgprintf("Erase %X ", command);
+	m_SPI__WriteCommandAddress(command, startingAddress);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+}
+
 void N25Q_BulkErase(void) {
 	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
 
@@ -401,6 +648,32 @@ void N25Q_NonBlockingBulkErase(void) {
 	testprintf("Ended!\r\n");
 }
 
+/*
+ * Suspend the program/erase in progress and wait until the flash is ready.
+ * Returns the flag status register, ERSUS or PGSUS set if an operation was
+ * suspended (it may have completed instead), -1 on timeout.
+ */
+int N25Q_ProgramEraseSuspend(uint32_t timeout_ms) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	SlaveSelect();
+	m_SPI__writebyte(PROG_ERASE_SUSPEND_CMD);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+	return N25Q_WaitReady(timeout_ms);
+}
+
+void N25Q_ProgramEraseResume(void) {
+	testprintf("\r\nEntering %s ...", __PRETTY_FUNCTION__);
+
+	SlaveSelect();
+	m_SPI__writebyte(PROG_ERASE_RESUME_CMD);
+	SlaveDeSelect();
+
+	testprintf("Ended!\r\n");
+}
+
 
 
 #if defined(TARGET_ARCH_PRO)
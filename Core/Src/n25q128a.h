@@ -42,6 +42,8 @@
 #endif
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
 
 /** @addtogroup BSP
   * @{
@@ -74,14 +76,25 @@
 #define N25Q128A_SECTOR_SIZE                 0x10000   /* 256 sectors of 64KBytes */
 #define N25Q128A_SUBSECTOR_SIZE              0x1000    /* 4096 subsectors of 4kBytes */
 #define N25Q128A_PAGE_SIZE                   0x100     /* 65536 pages of 256 bytes */
+#define N25Q128A_PAGE_PROG_FRAME_SIZE        (5 + N25Q128A_PAGE_SIZE) /* Command, up to 4 address bytes and one page */
 
 #define N25Q128A_DUMMY_CYCLES_READ           8
 #define N25Q128A_DUMMY_CYCLES_READ_QUAD      10
 
+#define N25Q128A_READ_MAX_FREQ               54000000  /* READ (0x03) clock limit, FAST_READ above it */
+#define N25Q128A_FAST_READ_MAX_FREQ          108000000
+
+#define N25Q128A_PAGE_PROG_MAX_TIME          5
 #define N25Q128A_BULK_ERASE_MAX_TIME         250000
 #define N25Q128A_SECTOR_ERASE_MAX_TIME       3000
 #define N25Q128A_SUBSECTOR_ERASE_MAX_TIME    800
 
+#define N25Q128A_BULK_ERASE_TYP_TIME         170000
+#define N25Q128A_SECTOR_ERASE_TYP_TIME       700
+#define N25Q128A_SUBSECTOR_ERASE_TYP_TIME    250
+
+#define N25Q128A_SUSPEND_LATENCY_MAX_US      30        /* Program/erase suspend latency, in us */
+
 /**
   * @brief  N25Q128A Commands
   */
@@ -95,6 +108,10 @@
 #define MULTIPLE_IO_READ_ID_CMD              0xAF
 #define READ_SERIAL_FLASH_DISCO_PARAM_CMD    0x5A
 
+/* Address Mode Operations */
+#define ENTER_4_BYTE_ADDR_MODE_CMD           0xB7
+#define EXIT_4_BYTE_ADDR_MODE_CMD            0xE9
+
 /* Read Operations */
 #define READ_CMD                             0x03
 #define FAST_READ_CMD                        0x0B
@@ -177,6 +194,7 @@
 #define N25Q128A_EVCR_QUAD                   ((uint8_t)0x80)    /*!< Quad I/O protocol */
 
 /* Flag Status Register */
+#define N25Q128A_FSR_ADDR4                   ((uint8_t)0x01)    /*!< 4-byte address mode */
 #define N25Q128A_FSR_PRERR                   ((uint8_t)0x02)    /*!< Protection error */
 #define N25Q128A_FSR_PGSUS                   ((uint8_t)0x04)    /*!< Program operation suspended */
 #define N25Q128A_FSR_VPPERR                  ((uint8_t)0x08)    /*!< Invalid voltage during program or erase */
@@ -192,6 +210,39 @@
 /** @defgroup N25Q128A_Exported_Functions
   * @{
   */
+int N25Q_ReadStatusRegister(void);
+void N25Q_WriteStatusRegister(int status_mask);
+int N25Q_ReadFlagStatusRegister(void);
+void N25Q_ClearFlagStatusRegister(void);
+int N25Q_ReadLockRegister(int startingAddress);
+void N25Q_WriteLockRegister(int startingAddress, int lock_mask);
+bool N25Q_isBusy(void);
+void N25Q_WriteEnable(void);
+void N25Q_WriteDisable(void);
+void N25Q_ReadID(uint8_t * id_string, int length);
+void N25Q_ReadSFDP(uint8_t * dataBuffer, int startingAddress, int length);
+int N25Q_Enter4ByteAddressMode(void);
+void N25Q_ReadDataFromAddress(uint8_t * dataBuffer, int startingAddress, int length);
+void N25Q_FastReadDataFromAddress(uint8_t * dataBuffer, int startingAddress, int length);
+int N25Q_SetReadDummyCycles(int cycles);
+uint32_t N25Q_GetClockFrequency(void);
+void N25Q_BeginRead(int startingAddress, bool fast);
+int N25Q_ContinueRead(uint8_t * dataBuffer, int length);
+void N25Q_EndRead(void);
+void N25Q_ProgramFromAddress(uint8_t * dataBuffer, int startingAddress, int length);
+void N25Q_NonBlockingProgramFromAddress(uint8_t * dataBuffer, int startingAddress, int length);
+int N25Q_StagePageProgram(uint8_t * frame, const uint8_t * dataBuffer, int startingAddress, int length);
+void N25Q_StartPageProgram(uint8_t * frame, int frameLength);
+int N25Q_WaitReady(uint32_t timeout_ms);
+void N25Q_SubSectorErase(int startingAddress);
+void N25Q_SectorErase(int startingAddress);
+void N25Q_NonBlockingSubSectorErase(int startingAddress);
+void N25Q_NonBlockingSectorErase(int startingAddress);
+void N25Q_NonBlockingErase(int command, int startingAddress);
+void N25Q_BulkErase(void);
+void N25Q_NonBlockingBulkErase(void);
+int N25Q_ProgramEraseSuspend(uint32_t timeout_ms);
+void N25Q_ProgramEraseResume(void);
 /**
   * @}
   */
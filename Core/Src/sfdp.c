@@ -0,0 +1,289 @@
+/*******************************************************************************
+ * Title                 :   SFDP parser
+ * Filename              :   sfdp.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file sfdp.c
+ *  \brief JESD216 Basic Flash Parameter Table and sector map parser
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stddef.h>
+#include <string.h>
+
+#include "sfdp.h"
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define SFDP_SIGNATURE              (0x50444653UL) // "SFDP"
+#define SFDP_HEADER_SIZE            (8)
+#define SFDP_PARAM_HEADER_SIZE      (8)
+#define SFDP_BFPT_ID                (0xFF00)
+#define SFDP_SECTOR_MAP_ID          (0xFF81)
+#define SFDP_BFPT_MIN_DWORDS        (9)  // JESD216 first revision
+#define SFDP_BFPT_TIMING_DWORDS     (11) // JESD216A adds the erase/program timings
+#define SFDP_BFPT_MAX_DWORDS        (16) // Nothing used beyond the 4-byte address DWORD
+#define SFDP_SECTOR_MAP_MAX_DWORDS  (64)
+#define SFDP_DEFAULT_PAGE_SIZE      (256)
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+static uint32_t sfdp_dword(const uint8_t *data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/*
+ * @brief read "count" DWORDs, little endian in the SFDP space
+ */
+static int sfdp_read_dwords(sfdp_read_t read, uint32_t addr, uint32_t *dwords, uint32_t count)
+{
+    uint8_t raw[4];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (read(addr + 4 * i, raw, sizeof(raw)) != 0)
+        {
+            return -1;
+        }
+        dwords[i] = sfdp_dword(raw);
+    }
+    return 0;
+}
+
+/*
+ * @brief block erase time: 5-bit count and 2-bit unit of 1ms, 16ms, 128ms or 1s
+ */
+static uint32_t sfdp_erase_time_ms(uint32_t field)
+{
+    static const uint32_t unit_ms[4] = {1, 16, 128, 1000};
+    return ((field & 0x1F) + 1) * unit_ms[(field >> 5) & 0x03];
+}
+
+/*
+ * @brief chip erase time: 5-bit count and 2-bit unit of 16ms, 256ms, 4s or 64s
+ */
+static uint32_t sfdp_chip_erase_time_ms(uint32_t field)
+{
+    static const uint32_t unit_ms[4] = {16, 256, 4000, 64000};
+    return ((field & 0x1F) + 1) * unit_ms[(field >> 5) & 0x03];
+}
+
+/*
+ * @brief fast read descriptor: wait states, mode clocks and instruction on 16 bits
+ */
+static sfdp_fast_read_t sfdp_fast_read(bool supported, uint32_t field)
+{
+    sfdp_fast_read_t mode = {0};
+    if (supported)
+    {
+        mode.dummy_cycles = field & 0x1F;
+        mode.mode_cycles = (field >> 5) & 0x07;
+        mode.opcode = (field >> 8) & 0xFF;
+    }
+    return mode;
+}
+
+/*
+ * @brief erase types allowed in every region of every sector map configuration. Without running the configuration
+ *        detection commands the active map is unknown, so the mask covers all of them.
+ * @return int bitmask of the BFPT erase types (bit 0 for type 1), negative value if the map is malformed
+ */
+static int sfdp_sector_map_erase_mask(sfdp_read_t read, uint32_t addr, uint32_t dword_count)
+{
+    uint32_t map[SFDP_SECTOR_MAP_MAX_DWORDS];
+    if (dword_count > SFDP_SECTOR_MAP_MAX_DWORDS)
+    {
+        dword_count = SFDP_SECTOR_MAP_MAX_DWORDS;
+    }
+    if (sfdp_read_dwords(read, addr, map, dword_count) != 0)
+    {
+        return -1;
+    }
+
+    int mask = (1 << SFDP_ERASE_TYPES) - 1;
+    bool found = false;
+    uint32_t i = 0;
+    while (i < dword_count)
+    {
+        uint32_t descriptor = map[i];
+        if ((descriptor & 0x02) == 0)
+        {
+            // Configuration detection command, instruction and address DWORDs
+            i += 2;
+        }
+        else
+        {
+            uint32_t regions = ((descriptor >> 16) & 0xFF) + 1;
+            if (i + regions >= dword_count)
+            {
+                return -1;
+            }
+            for (uint32_t r = 1; r <= regions; r++)
+            {
+                mask &= map[i + r] & 0x0F;
+            }
+            found = true;
+            i += 1 + regions;
+        }
+        if ((descriptor & 0x01) != 0)
+        {
+            break;
+        }
+    }
+    return found ? mask : -1;
+}
+
+/*
+ * @brief read and decode the SFDP tables of the flash
+ * @param read: SFDP read callback
+ * @param[out] info: decoded parameters
+ * @return int 0 on success, negative value if there is no valid SFDP
+ */
+int sfdp_parse(sfdp_read_t read, sfdp_info_t *info)
+{
+    uint8_t header[SFDP_HEADER_SIZE];
+    if (read == NULL || info == NULL || read(0, header, sizeof(header)) != 0 || sfdp_dword(header) != SFDP_SIGNATURE)
+    {
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+
+    // Latest BFPT of major revision 1 and the sector map, if any
+    uint32_t bfpt_addr = 0;
+    uint32_t bfpt_dwords = 0;
+    uint32_t map_addr = 0;
+    uint32_t map_dwords = 0;
+    uint32_t header_count = (uint32_t) header[6] + 1;
+    for (uint32_t i = 0; i < header_count; i++)
+    {
+        uint8_t param[SFDP_PARAM_HEADER_SIZE];
+        if (read(SFDP_HEADER_SIZE + i * SFDP_PARAM_HEADER_SIZE, param, sizeof(param)) != 0)
+        {
+            return -1;
+        }
+        uint16_t id = ((uint16_t) param[7] << 8) | param[0];
+        uint32_t addr = (uint32_t) param[4] | ((uint32_t) param[5] << 8) | ((uint32_t) param[6] << 16);
+        if (id == SFDP_BFPT_ID && param[2] == 1 && (bfpt_dwords == 0 || param[1] >= info->minor))
+        {
+            info->major = param[2];
+            info->minor = param[1];
+            bfpt_addr = addr;
+            bfpt_dwords = param[3];
+        }
+        else if (id == SFDP_SECTOR_MAP_ID)
+        {
+            map_addr = addr;
+            map_dwords = param[3];
+        }
+    }
+    if (bfpt_dwords < SFDP_BFPT_MIN_DWORDS)
+    {
+        return -1;
+    }
+
+    uint32_t dw[SFDP_BFPT_MAX_DWORDS] = {0};
+    if (bfpt_dwords > SFDP_BFPT_MAX_DWORDS)
+    {
+        bfpt_dwords = SFDP_BFPT_MAX_DWORDS;
+    }
+    if (sfdp_read_dwords(read, bfpt_addr, dw, bfpt_dwords) != 0)
+    {
+        return -1;
+    }
+
+    // DWORD 1: address bytes and fast read support, DWORD 2: density
+    uint32_t addr_bytes = (dw[0] >> 17) & 0x03;
+    if (addr_bytes > SFDP_ADDR_4)
+    {
+        return -1;
+    }
+    info->addr_mode = (sfdp_addr_mode_t) addr_bytes;
+    if ((dw[1] & 0x80000000UL) != 0)
+    {
+        uint32_t bits_log2 = dw[1] & 0x7FFFFFFFUL;
+        if (bits_log2 < 3 || bits_log2 > 63)
+        {
+            return -1;
+        }
+        info->size = 1ULL << (bits_log2 - 3);
+    }
+    else
+    {
+        info->size = ((uint64_t) dw[1] + 1) / 8;
+    }
+
+    // DWORDs 3 and 4: fast read instructions
+    info->fast_read[SFDP_FAST_READ_1_4_4] = sfdp_fast_read((dw[0] & (1UL << 21)) != 0, dw[2] & 0xFFFF);
+    info->fast_read[SFDP_FAST_READ_1_1_4] = sfdp_fast_read((dw[0] & (1UL << 22)) != 0, dw[2] >> 16);
+    info->fast_read[SFDP_FAST_READ_1_1_2] = sfdp_fast_read((dw[0] & (1UL << 16)) != 0, dw[3] & 0xFFFF);
+    info->fast_read[SFDP_FAST_READ_1_2_2] = sfdp_fast_read((dw[0] & (1UL << 20)) != 0, dw[3] >> 16);
+
+    // DWORDs 8 and 9: erase types, DWORD 10: their typical times and the typical to maximum multiplier
+    bool timing = (bfpt_dwords >= SFDP_BFPT_TIMING_DWORDS);
+    uint32_t erase_multiplier = 2 * ((dw[9] & 0x0F) + 1);
+    int allowed = (1 << SFDP_ERASE_TYPES) - 1;
+    if (map_dwords != 0)
+    {
+        allowed = sfdp_sector_map_erase_mask(read, map_addr, map_dwords);
+        if (allowed < 0)
+        {
+            return -1;
+        }
+        info->sector_map = true;
+    }
+    for (uint8_t type = 0; type < SFDP_ERASE_TYPES; type++)
+    {
+        uint32_t field = (dw[7 + type / 2] >> (16 * (type % 2))) & 0xFFFF;
+        uint8_t size_log2 = field & 0xFF;
+        if (size_log2 == 0 || size_log2 > 31 || (allowed & (1 << type)) == 0)
+        {
+            continue;
+        }
+        sfdp_erase_t erase = {.size = 1UL << size_log2, .opcode = (uint8_t) (field >> 8)};
+        if (timing)
+        {
+            erase.typ_ms = sfdp_erase_time_ms(dw[9] >> (4 + 7 * type));
+            erase.max_ms = erase.typ_ms * erase_multiplier;
+        }
+        // Insert by increasing size
+        uint8_t pos = info->erase_count;
+        while (pos > 0 && info->erase[pos - 1].size > erase.size)
+        {
+            info->erase[pos] = info->erase[pos - 1];
+            pos--;
+        }
+        info->erase[pos] = erase;
+        info->erase_count++;
+    }
+    if (info->erase_count == 0)
+    {
+        return -1;
+    }
+
+    // DWORD 11: page size, program and chip erase times. The first revision only says whether pages are >= 64 bytes
+    if (timing)
+    {
+        info->page_size = 1UL << ((dw[10] >> 4) & 0x0F);
+        info->program_typ_us = (((dw[10] >> 8) & 0x1F) + 1) * (((dw[10] & (1UL << 13)) != 0) ? 64 : 8);
+        info->program_max_us = info->program_typ_us * 2 * ((dw[10] & 0x0F) + 1);
+        info->chip_erase_typ_ms = sfdp_chip_erase_time_ms(dw[10] >> 24);
+        info->chip_erase_max_ms = info->chip_erase_typ_ms * erase_multiplier;
+    }
+    else
+    {
+        info->page_size = ((dw[0] & 0x04) != 0) ? SFDP_DEFAULT_PAGE_SIZE : 1;
+    }
+
+    // DWORD 16: how to enter the 4-byte address mode
+    info->enter_4b = ((dw[15] >> 24) & 0x01) != 0;
+    info->enter_4b_wren = ((dw[15] >> 24) & 0x02) != 0;
+    return 0;
+}
+
+/*** End of File **************************************************************/
@@ -21,11 +21,23 @@
 #include "spi.h"
 
 /* USER CODE BEGIN 0 */
+typedef struct
+{
+  volatile bool busy;
+  volatile HAL_StatusTypeDef status;
+  spi_dma_callback_t callback;
+  void *arg;
+} spi_dma_state_t;
 
+static spi_dma_state_t spi_dma_state[2];
 /* USER CODE END 0 */
 
 SPI_HandleTypeDef hspi1;
 SPI_HandleTypeDef hspi2;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
+DMA_HandleTypeDef hdma_spi2_rx;
+DMA_HandleTypeDef hdma_spi2_tx;
 
 /* SPI1 init function */
 void MX_SPI1_Init(void)
@@ -121,6 +133,41 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* spiHandle)
     GPIO_InitStruct.Alternate = GPIO_AF0_SPI1;
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
+    /* SPI1 DMA Init */
+    /* SPI1_RX Init */
+    hdma_spi1_rx.Instance = DMA1_Channel3;
+    hdma_spi1_rx.Init.Request = DMA_REQUEST_SPI1_RX;
+    hdma_spi1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_spi1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&hdma_spi1_rx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle,hdmarx,hdma_spi1_rx);
+
+    /* SPI1_TX Init */
+    hdma_spi1_tx.Instance = DMA1_Channel4;
+    hdma_spi1_tx.Init.Request = DMA_REQUEST_SPI1_TX;
+    hdma_spi1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_spi1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&hdma_spi1_tx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle,hdmatx,hdma_spi1_tx);
+
   /* USER CODE BEGIN SPI1_MspInit 1 */
 
   /* USER CODE END SPI1_MspInit 1 */
@@ -154,6 +201,41 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* spiHandle)
     GPIO_InitStruct.Alternate = GPIO_AF0_SPI2;
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
+    /* SPI2 DMA Init */
+    /* SPI2_RX Init */
+    hdma_spi2_rx.Instance = DMA1_Channel1;
+    hdma_spi2_rx.Init.Request = DMA_REQUEST_SPI2_RX;
+    hdma_spi2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_spi2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi2_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi2_rx.Init.Mode = DMA_NORMAL;
+    hdma_spi2_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&hdma_spi2_rx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle,hdmarx,hdma_spi2_rx);
+
+    /* SPI2_TX Init */
+    hdma_spi2_tx.Instance = DMA1_Channel2;
+    hdma_spi2_tx.Init.Request = DMA_REQUEST_SPI2_TX;
+    hdma_spi2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_spi2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi2_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi2_tx.Init.Mode = DMA_NORMAL;
+    hdma_spi2_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&hdma_spi2_tx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle,hdmatx,hdma_spi2_tx);
+
   /* USER CODE BEGIN SPI2_MspInit 1 */
 
   /* USER CODE END SPI2_MspInit 1 */
@@ -178,6 +260,9 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
     */
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_3|GPIO_PIN_4|GPIO_PIN_5);
 
+    /* SPI1 DMA DeInit */
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
   /* USER CODE BEGIN SPI1_MspDeInit 1 */
 
   /* USER CODE END SPI1_MspDeInit 1 */
@@ -199,6 +284,9 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
 
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_13);
 
+    /* SPI2 DMA DeInit */
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
   /* USER CODE BEGIN SPI2_MspDeInit 1 */
 
   /* USER CODE END SPI2_MspDeInit 1 */
@@ -206,5 +294,108 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
 }
 
 /* USER CODE BEGIN 1 */
+static spi_dma_state_t *SPI_DMA_State(SPI_HandleTypeDef *hspi)
+{
+  return (hspi->Instance == SPI1) ? &spi_dma_state[0] : &spi_dma_state[1];
+}
+
+static HAL_StatusTypeDef SPI_DMA_Start(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size,
+                                       spi_dma_callback_t callback, void *arg)
+{
+  spi_dma_state_t *state = SPI_DMA_State(hspi);
+  if (state->busy)
+  {
+    return HAL_BUSY;
+  }
+  state->callback = callback;
+  state->arg = arg;
+  state->status = HAL_OK;
+  state->busy = true;
+
+  HAL_StatusTypeDef status = (pRxData != NULL) ? HAL_SPI_Receive_DMA(hspi, pRxData, Size)
+                                               : HAL_SPI_Transmit_DMA(hspi, pTxData, Size);
+  if (status != HAL_OK)
+  {
+    state->busy = false;
+  }
+  return status;
+}
+
+static void SPI_DMA_Complete(SPI_HandleTypeDef *hspi, HAL_StatusTypeDef status)
+{
+  spi_dma_state_t *state = SPI_DMA_State(hspi);
+  state->status = status;
+  state->busy = false;
+  if (state->callback != NULL)
+  {
+    state->callback(hspi, status, state->arg);
+  }
+}
+
+/**
+  * @brief  Start sending Size bytes from pData with the TX DMA channel of the bus.
+  *         pData must stay valid until the end of the transfer, callback (may be
+  *         NULL) runs from the DMA interrupt once the last byte left the shift register.
+  * @retval HAL_BUSY if a DMA transfer is already running on the bus
+  */
+HAL_StatusTypeDef SPI_DMA_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size,
+                                   spi_dma_callback_t callback, void *arg)
+{
+  return SPI_DMA_Start(hspi, pData, NULL, Size, callback, arg);
+}
+
+/**
+  * @brief  Start receiving Size bytes straight into pData with the RX DMA channel
+  *         (the TX channel clocks out the dummy bytes), see SPI_DMA_Transmit().
+  */
+HAL_StatusTypeDef SPI_DMA_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size,
+                                  spi_dma_callback_t callback, void *arg)
+{
+  return SPI_DMA_Start(hspi, NULL, pData, Size, callback, arg);
+}
+
+bool SPI_DMA_IsBusy(SPI_HandleTypeDef *hspi)
+{
+  return SPI_DMA_State(hspi)->busy;
+}
+
+/**
+  * @brief  Wait for the end of the DMA transfer of the bus, aborting it on timeout.
+  * @retval status of the transfer
+  */
+HAL_StatusTypeDef SPI_DMA_Wait(SPI_HandleTypeDef *hspi, uint32_t Timeout)
+{
+  spi_dma_state_t *state = SPI_DMA_State(hspi);
+  uint32_t tickstart = HAL_GetTick();
+  while (state->busy)
+  {
+    if ((HAL_GetTick() - tickstart) > Timeout)
+    {
+      HAL_SPI_Abort(hspi);
+      state->busy = false;
+      return HAL_TIMEOUT;
+    }
+  }
+  return state->status;
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  SPI_DMA_Complete(hspi, HAL_OK);
+}
+
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  SPI_DMA_Complete(hspi, HAL_OK);
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  SPI_DMA_Complete(hspi, HAL_OK);
+}
 
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+  SPI_DMA_Complete(hspi, HAL_ERROR);
+}
 /* USER CODE END 1 */
@@ -0,0 +1,154 @@
+/*******************************************************************************
+ * Title                 :   SPI link training
+ * Filename              :   spi_link.c
+ * Origin Date           :   2026/10/17
+ * Version               :   0.0.0
+ * Notes                 :   None
+ *******************************************************************************/
+
+/** \file spi_link.c
+ *  \brief Step the SPI prescaler down while the JEDEC ID and the CRC of a reference region still read back right
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "spi_link.h"
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define SPI_LINK_BR_MAX             (7) // Prescaler 256
+#define SPI_LINK_CHUNK_SIZE         (64)
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+static uint32_t spi_link_br(const SPI_HandleTypeDef *hspi)
+{
+    return (hspi->Init.BaudRatePrescaler >> SPI_CR1_BR_Pos) & SPI_LINK_BR_MAX;
+}
+
+static int spi_link_set_br(SPI_HandleTypeDef *hspi, uint32_t br)
+{
+    hspi->Init.BaudRatePrescaler = br << SPI_CR1_BR_Pos;
+    return (HAL_SPI_Init(hspi) == HAL_OK) ? 0 : -1;
+}
+
+static uint32_t spi_link_br_clock_hz(uint32_t br)
+{
+    return HAL_RCC_GetPCLK1Freq() >> (br + 1);
+}
+
+/*
+ * @brief SCK frequency currently configured on the bus
+ */
+uint32_t spi_link_clock_hz(const SPI_HandleTypeDef *hspi)
+{
+    return spi_link_br_clock_hz(spi_link_br(hspi));
+}
+
+/*
+ * @brief read the JEDEC ID and the CRC of the reference region at the current prescaler
+ */
+static int spi_link_sample(const spi_link_probe_t *probe, uint8_t *id, uint32_t *crc)
+{
+    uint8_t chunk[SPI_LINK_CHUNK_SIZE];
+    if (probe->read_id(id) != 0)
+    {
+        return -1;
+    }
+    uint32_t value = crc32_init();
+    for (uint32_t offset = 0; offset < probe->ref_len; offset += sizeof(chunk))
+    {
+        uint32_t len = (probe->ref_len - offset > sizeof(chunk)) ? sizeof(chunk) : probe->ref_len - offset;
+        if (probe->read(probe->ref_addr + offset, chunk, len) != 0)
+        {
+            return -1;
+        }
+        value = crc32_update(value, chunk, len);
+    }
+    *crc = crc32_final(value);
+    return 0;
+}
+
+/*
+ * @brief train the link of one bus: the prescaler configured on hspi is the reference, known to work
+ * @param[out] result: setting locked in, may be NULL
+ * @return int 0 on success, negative value if the reference read fails, the prescaler is then left unchanged
+ */
+int spi_link_train(SPI_HandleTypeDef *hspi, const spi_link_probe_t *probe, spi_link_result_t *result)
+{
+    uint8_t ref_id[SPI_LINK_ID_LEN];
+    uint8_t id[SPI_LINK_ID_LEN];
+    uint32_t ref_crc;
+    uint32_t crc;
+    uint32_t ref_br = spi_link_br(hspi);
+
+    // An ID of all 0 or all 1 is an empty bus, not a flash
+    if (spi_link_sample(probe, ref_id, &ref_crc) != 0 || (ref_id[0] == 0x00 && ref_id[1] == 0x00) ||
+        (ref_id[0] == 0xFF && ref_id[1] == 0xFF))
+    {
+        return -1;
+    }
+
+    uint32_t fastest_br = ref_br;
+    uint32_t failed_br = SPI_LINK_BR_MAX + 1;
+    for (uint32_t br = ref_br; br-- > 0;)
+    {
+        bool passed = (spi_link_set_br(hspi, br) == 0);
+        for (uint32_t pass = 0; pass < SPI_LINK_PASSES && passed; pass++)
+        {
+            passed = (spi_link_sample(probe, id, &crc) == 0 && memcmp(id, ref_id, sizeof(id)) == 0 &&
+                      crc == ref_crc);
+        }
+        if (!passed)
+        {
+            failed_br = br;
+            break;
+        }
+        fastest_br = br;
+    }
+
+    // Margin below the fastest passing setting, never slower than the reference
+    uint32_t locked_br = fastest_br + SPI_LINK_MARGIN_STEPS;
+    if (locked_br > ref_br)
+    {
+        locked_br = ref_br;
+    }
+    if (spi_link_set_br(hspi, locked_br) != 0 || spi_link_sample(probe, id, &crc) != 0 ||
+        memcmp(id, ref_id, sizeof(id)) != 0 || crc != ref_crc)
+    {
+        spi_link_set_br(hspi, ref_br);
+        locked_br = ref_br;
+    }
+
+    if (result != NULL)
+    {
+        result->prescaler = hspi->Init.BaudRatePrescaler;
+        result->clock_hz = spi_link_br_clock_hz(locked_br);
+        result->fastest_hz = spi_link_br_clock_hz(fastest_br);
+        result->failed_hz = (failed_br > SPI_LINK_BR_MAX) ? 0 : spi_link_br_clock_hz(failed_br);
+    }
+    return 0;
+}
+
+/*
+ * @brief step the bus one prescaler slower, after errors on a trained link
+ * @return int 0 on success, negative value if the bus already runs at the slowest setting
+ */
+int spi_link_fallback(SPI_HandleTypeDef *hspi)
+{
+    uint32_t br = spi_link_br(hspi);
+    if (br >= SPI_LINK_BR_MAX)
+    {
+        return -1;
+    }
+    return spi_link_set_br(hspi, br + 1);
+}
+
+/*** End of File **************************************************************/
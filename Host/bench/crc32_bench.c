@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * Title                 :   CRC32 kernel benchmark
+ * Filename              :   crc32_bench.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host benchmark, built once per CRC32_KERNEL
+ *******************************************************************************/
+
+/** \file crc32_bench.c
+ *  \brief Measure the throughput of the selected CRC32 kernel
+ *
+ *  Usage: crc32_bench_<kernel> [size in KB] [iterations]
+ *  Prints one JSON object with the kernel name, throughput in MB/s and the
+ *  flash/RAM used by its lookup table.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crc32.h"
+
+#define CRC32_CHECK_VALUE       (0xCBF43926UL) // CRC32 of "123456789"
+
+static double bench_now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t size = (argc > 1) ? (uint32_t) atoi(argv[1]) * 1024 : 1024 * 1024;
+    uint32_t iterations = (argc > 2) ? (uint32_t) atoi(argv[2]) : 64;
+
+    if (crc32("123456789", 9) != CRC32_CHECK_VALUE)
+    {
+        fprintf(stderr, "%s: wrong check value 0x%08X\n", crc32_kernel_name(), crc32("123456789", 9));
+        return 1;
+    }
+
+    uint8_t *buf = malloc(size + 8);
+    if (buf == NULL)
+    {
+        return 1;
+    }
+    srand(1);
+    for (uint32_t i = 0; i < size + 8; i++)
+    {
+        buf[i] = (uint8_t) rand();
+    }
+
+    // Incremental updates with odd split points and misaligned starts must match the one-shot result
+    uint32_t expected = crc32(buf + 1, size);
+    uint32_t crc = crc32_init();
+    for (uint32_t offset = 0, step = 1; offset < size; step = step * 3 + 1)
+    {
+        uint32_t len = (size - offset < step) ? size - offset : step;
+        crc = crc32_update(crc, buf + 1 + offset, len);
+        offset += len;
+    }
+    if (crc32_final(crc) != expected)
+    {
+        fprintf(stderr, "%s: incremental CRC mismatch\n", crc32_kernel_name());
+        return 1;
+    }
+
+    volatile uint32_t sink = 0;
+    double start = bench_now_sec();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        sink ^= crc32(buf, size);
+    }
+    double elapsed = bench_now_sec() - start;
+    (void) sink;
+
+    printf("{\"kernel\": \"%s\", \"bytes\": %u, \"iterations\": %u, \"mb_per_s\": %.1f, "
+           "\"table_flash_bytes\": %u, \"table_ram_bytes\": 0}\n",
+           crc32_kernel_name(), size, iterations, (double) size * iterations / elapsed / 1e6,
+           crc32_kernel_table_size());
+    free(buf);
+    return 0;
+}
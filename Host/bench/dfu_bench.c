@@ -0,0 +1,426 @@
+/*******************************************************************************
+ * Title                 :   DFU throughput benchmark
+ * Filename              :   dfu_bench.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host benchmark on the simulated flash
+ *******************************************************************************/
+
+/** \file dfu_bench.c
+ *  \brief Time dfu_fw_image_update() and the boot validation over a sweep of image sizes
+ *
+ *  Usage: dfu_bench [-p n25q128a|n25q256a] [-s prescaler] [-t timing %] [-n min KB] [-m max KB] [-V verify KB]
+ *  For each image size (x4 steps, 1KB to one slot by default) a blank simulated
+ *  flash is updated with dfu_fw_image_update(), then the active slot is
+ *  selected with dfu_slot_active() as the bootloader does. The same image is
+ *  written to the other slot (not measured), and finally an incremental
+ *  release (DFU_BENCH_CHANGE_SIZE bytes changed in the middle of the image)
+ *  is written with dfu_slot_update() over the slot holding the first copy,
+ *  as in the steady state of a device that went through two releases. Prints one JSON
+ *  document with the simulated time, bus activity and passes over the image
+ *  of each phase (see dfu_phase_t), to be compared between commits.
+ *
+ *  The write verification levels (dfu_verify_t) are then compared on one
+ *  image size: update time and share of the programmed bytes read back, and
+ *  which step catches silent program faults (one bit left at 1 every
+ *  DFU_BENCH_FAULT_INTERVAL pages): the storage write itself, or only the
+ *  CRC of the stored image before the header is committed.
+ *
+ *  Last, the same image is written with the non-blocking API while the main
+ *  loop reads DFU_BENCH_READ_SIZE bytes of the other slot every
+ *  DFU_BENCH_READ_INTERVAL_MS with dfu_update_read(): the read latency and the
+ *  update time are compared between suspending the erase/program in flight
+ *  and waiting for it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "dfu.h"
+#include "dfu_profile.h"
+#include "dfu_storage.h"
+#include "hal_sim.h"
+#include "main.h"
+#include "spi.h"
+
+#define DFU_BENCH_MAX_IMAGE             (DFU_SLOT_SIZE - DFU_SLOT_HEADER_SIZE) // Largest image in a slot
+#define DFU_BENCH_CHANGE_SIZE           (1024) // Bytes changed by the incremental release, at most 1/16 of the image
+#define DFU_BENCH_FAULT_INTERVAL        (64) // Page programs between two silent faults in the verification runs
+#define DFU_BENCH_READ_SIZE             (16) // Bytes of each read during the update
+#define DFU_BENCH_READ_INTERVAL_MS      (10) // Simulated time between two reads during the update
+
+static const char *const dfu_bench_verify_names[] = {
+    [DFU_VERIFY_FSR] = "fsr",
+    [DFU_VERIFY_SAMPLED] = "sampled",
+    [DFU_VERIFY_CRC] = "crc",
+    [DFU_VERIFY_FULL] = "full",
+};
+
+static uint32_t dfu_bench_prescaler(unsigned divider)
+{
+    uint32_t br = 0;
+    while ((2u << br) < divider && br < 7)
+    {
+        br++;
+    }
+    return br << SPI_CR1_BR_Pos;
+}
+
+static void dfu_bench_print_phase(const dfu_profile_phase_t *p, uint32_t size, const char *indent)
+{
+    double time_s = p->time_ns / 1e9;
+    printf("%s\"time_s\": %.6f, \"bytes_per_s\": %.1f, \"bus_s\": %.6f, \"busy_s\": %.6f,\n", indent, time_s,
+           (time_s > 0) ? size / time_s : 0.0, p->bus_ns / 1e9, p->busy_ns / 1e9);
+    printf("%s\"spi_transactions\": %llu, \"spi_bytes\": %llu, \"erase_ops\": %llu, \"program_ops\": %llu, "
+           "\"busy_polls\": %llu,\n",
+           indent, (unsigned long long) p->spi_transactions, (unsigned long long) p->spi_bytes,
+           (unsigned long long) p->erase_ops, (unsigned long long) p->program_ops,
+           (unsigned long long) p->busy_polls);
+    printf("%s\"erase_passes\": %.3f, \"program_passes\": %.3f, \"read_passes\": %.3f, \"crc_passes\": %.3f",
+           indent, (double) p->erase_bytes / size, (double) p->program_bytes / size, (double) p->read_bytes / size,
+           (double) p->crc_bytes / size);
+}
+
+static void dfu_bench_print_run(const char *name, uint32_t size, int result, bool last)
+{
+    dfu_profile_phase_t total = dfu_profile_total();
+    printf("      \"%s\": {\n        \"result\": %d,\n", name, result);
+    dfu_bench_print_phase(&total, size, "        ");
+    printf(",\n        \"phases\": {\n");
+    for (uint32_t phase = 0; phase <= DFU_PROFILE_OTHER; phase++)
+    {
+        printf("          \"%s\": {\n", dfu_profile_phase_name(phase));
+        dfu_bench_print_phase(dfu_profile_phase(phase), size, "            ");
+        printf("\n          }%s\n", (phase < DFU_PROFILE_OTHER) ? "," : "");
+    }
+    printf("        }\n      }%s\n", last ? "" : ",");
+}
+
+static flash_sim_t *dfu_bench_setup(flash_sim_part_t part, unsigned divider, uint32_t timing_scale)
+{
+    hal_sim_init(NULL);
+    flash_sim_t *flash = flash_sim_create(part, NULL);
+    if (flash == NULL)
+    {
+        return NULL;
+    }
+    flash_sim_set_timing_scale(flash, timing_scale);
+    MX_SPI2_Init();
+    hspi2.Init.BaudRatePrescaler = dfu_bench_prescaler(divider);
+    hal_sim_attach_flash(&hspi2, SPI2_NSS_GPIO_Port, SPI2_NSS_Pin, flash);
+    if (dfu_init(NULL) != 0)
+    {
+        flash_sim_destroy(flash);
+        return NULL;
+    }
+    return flash;
+}
+
+/*
+ * @brief full update of a blank flash at each verification level, without then with silent program faults
+ * @return int 0 if every clean update passed and every faulty one was rejected
+ */
+static int dfu_bench_verify_levels(const uint8_t *fw, uint32_t fw_len, flash_sim_part_t part, unsigned divider,
+                                   uint32_t timing_scale)
+{
+    int retval = 0;
+    dfu_verify_t saved = dfu_get_write_verify();
+    printf("  \"verify_levels\": {\n    \"size\": %u,\n    \"fault_interval_pages\": %u,\n    \"levels\": [\n", fw_len,
+           DFU_BENCH_FAULT_INTERVAL);
+    for (uint32_t level = DFU_VERIFY_FSR; level <= DFU_VERIFY_FULL; level++)
+    {
+        dfu_set_write_verify((dfu_verify_t) level);
+
+        flash_sim_t *flash = dfu_bench_setup(part, divider, timing_scale);
+        if (flash == NULL)
+        {
+            return -1;
+        }
+        dfu_profile_start(flash);
+        int result = dfu_fw_image_update((uint8_t *) fw, fw_len);
+        dfu_profile_stop();
+        dfu_profile_phase_t total = dfu_profile_total();
+        const dfu_profile_phase_t *verify = dfu_profile_phase(DFU_PHASE_VERIFY);
+        double time_s = total.time_ns / 1e9;
+        printf("      {\n        \"level\": \"%s\",\n        \"result\": %d, \"time_s\": %.6f, \"bytes_per_s\": %.1f, "
+               "\"verify_s\": %.6f,\n        \"readback_fraction\": %.3f,\n",
+               dfu_bench_verify_names[level], result, time_s, (time_s > 0) ? fw_len / time_s : 0.0,
+               verify->time_ns / 1e9, (total.program_bytes > 0) ? (double) verify->read_bytes / total.program_bytes : 0.0);
+        flash_sim_destroy(flash);
+
+        // Single update attempt (dfu_fw_image_update() retries) with silent faults: caught by the storage write,
+        // or only by the commit CRC
+        flash = dfu_bench_setup(part, divider, timing_scale);
+        if (flash == NULL)
+        {
+            return -1;
+        }
+        flash_sim_set_program_faults(flash, DFU_BENCH_FAULT_INTERVAL);
+        image_header_t header = {
+            .image_magic = IMAGE_MAGIC_NUMBER,
+            .image_data_type = IMAGE_TYPE_RFIC_FIRMWARE,
+            .image_data_version_major = IMAGE_FIRMWARE_MAJOR_VERSION,
+            .image_data_version_minor = IMAGE_FIRMWARE_MINOR_VERSION,
+            .image_data_version_revision = IMAGE_FIRMWARE_REVISION_VERSION,
+        };
+        dfu_profile_start(flash);
+        int fault_result = dfu_image_update(&header, (uint8_t *) fw, fw_len, FLASH_N25_FW_START_ADDR);
+        dfu_profile_stop();
+        bool commit_reached = dfu_profile_phase(DFU_PHASE_COMMIT_CRC)->read_bytes > 0;
+        const char *detected = (fault_result == 0) ? "none" : (commit_reached ? "commit_crc" : "write");
+        printf("        \"faults_injected\": %llu, \"fault_result\": %d, \"fault_detected_by\": \"%s\"\n      }%s\n",
+               (unsigned long long) flash_sim_stats(flash)->injected_faults, fault_result, detected,
+               (level < DFU_VERIFY_FULL) ? "," : "");
+        if (result != 0 || (fault_result == 0 && flash_sim_stats(flash)->injected_faults > 0))
+        {
+            fprintf(stderr, "verify level %s: update %d, faulty update %d\n", dfu_bench_verify_names[level], result,
+                    fault_result);
+            retval = -1;
+        }
+        flash_sim_destroy(flash);
+    }
+    printf("    ]\n  }");
+    dfu_set_write_verify(saved);
+    return retval;
+}
+
+/*
+ * @brief non-blocking update over stale slots with periodic reads of the other slot, the storage backend suspends
+ *        the operation in flight for each read, then a copy of it without suspend waits for the operation
+ * @return int 0 if both updates completed without any flash violation
+ */
+static int dfu_bench_read_latency(const uint8_t *fw, uint32_t fw_len, flash_sim_part_t part, unsigned divider,
+                                  uint32_t timing_scale)
+{
+    static const char *const mode_names[2] = {"suspend", "wait"};
+    static dfu_update_t update;
+    static dfu_storage_ops_t wait_ops;
+    uint8_t data[DFU_BENCH_READ_SIZE];
+    int retval = 0;
+
+    printf(",\n  \"read_latency\": {\n    \"size\": %u,\n    \"read_size\": %u,\n    \"read_interval_ms\": %u,\n"
+           "    \"modes\": [\n",
+           fw_len, DFU_BENCH_READ_SIZE, DFU_BENCH_READ_INTERVAL_MS);
+    for (uint32_t mode = 0; mode < 2; mode++)
+    {
+        flash_sim_t *flash = dfu_bench_setup(part, divider, timing_scale);
+        if (flash == NULL)
+        {
+            return -1;
+        }
+        // Stale data in both slots, as after earlier releases, so that the update erases
+        for (uint8_t slot = 0; slot < 2; slot++)
+        {
+            memset(flash_sim_memory(flash) + dfu_slot_addr(slot), 0x00, dfu_slot_size());
+        }
+        if (mode == 1)
+        {
+            wait_ops = *dfu_storage_backend();
+            wait_ops.suspend = NULL;
+            wait_ops.resume = NULL;
+            dfu_storage_select(&wait_ops);
+        }
+
+        uint64_t start_ns = hal_sim_now_ns();
+        int result = dfu_fw_image_update_begin(&update, fw, fw_len);
+        uint32_t read_addr = (update.dest_addr == dfu_slot_addr(0)) ? dfu_slot_addr(1) : dfu_slot_addr(0);
+        uint64_t next_read_ns = start_ns;
+        uint64_t reads = 0;
+        uint64_t busy_reads = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+        uint32_t fed = 0;
+        dfu_update_state_t state = (result == 1) ? DFU_UPDATE_ERASE : DFU_UPDATE_ERROR;
+        while (state != DFU_UPDATE_DONE && state != DFU_UPDATE_ERROR)
+        {
+            int accepted = dfu_update_feed(&update, fw + fed, fw_len - fed);
+            fed += (accepted > 0) ? (uint32_t) accepted : 0;
+            state = dfu_update_poll(&update);
+            if (hal_sim_now_ns() >= next_read_ns)
+            {
+                bool busy = update.busy;
+                uint64_t read_ns = hal_sim_now_ns();
+                if (dfu_update_read(&update, read_addr, data, sizeof(data)) != 0)
+                {
+                    state = DFU_UPDATE_ERROR;
+                }
+                read_ns = hal_sim_now_ns() - read_ns;
+                reads++;
+                busy_reads += busy ? 1 : 0;
+                total_ns += read_ns;
+                max_ns = (read_ns > max_ns) ? read_ns : max_ns;
+                next_read_ns = hal_sim_now_ns() + DFU_BENCH_READ_INTERVAL_MS * 1000000ULL;
+            }
+        }
+        double time_s = (hal_sim_now_ns() - start_ns) / 1e9;
+        printf("      {\n        \"mode\": \"%s\",\n        \"result\": %d, \"time_s\": %.6f, \"reads\": %llu, "
+               "\"reads_during_operation\": %llu,\n        \"max_read_us\": %.1f, \"mean_read_us\": %.1f\n      }%s\n",
+               mode_names[mode], (state == DFU_UPDATE_DONE) ? 0 : -1, time_s, (unsigned long long) reads,
+               (unsigned long long) busy_reads, max_ns / 1e3, (reads > 0) ? total_ns / 1e3 / reads : 0.0,
+               (mode == 0) ? "," : "");
+        if (state != DFU_UPDATE_DONE || flash_sim_stats(flash)->violations != 0)
+        {
+            fprintf(stderr, "read latency %s: update %s, %llu violations\n", mode_names[mode],
+                    (state == DFU_UPDATE_DONE) ? "done" : "failed",
+                    (unsigned long long) flash_sim_stats(flash)->violations);
+            retval = -1;
+        }
+        flash_sim_destroy(flash);
+    }
+    printf("    ]\n  }");
+    return retval;
+}
+
+int main(int argc, char **argv)
+{
+    flash_sim_part_t part = FLASH_SIM_N25Q128A;
+    unsigned divider = 256;
+    uint32_t timing_scale = 100;
+    uint32_t min_size = 1024;
+    uint32_t max_size = DFU_BENCH_MAX_IMAGE;
+    uint32_t verify_size = 256UL * 1024;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:s:t:n:m:V:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            part = !strcmp(optarg, "n25q256a") ? FLASH_SIM_N25Q256A : FLASH_SIM_N25Q128A;
+            break;
+        case 's':
+            divider = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            timing_scale = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            min_size = strtoul(optarg, NULL, 0) * 1024;
+            break;
+        case 'm':
+            max_size = strtoul(optarg, NULL, 0) * 1024;
+            break;
+        case 'V':
+            verify_size = strtoul(optarg, NULL, 0) * 1024;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p part] [-s prescaler] [-t timing %%] [-n min KB] [-m max KB] [-V verify KB]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    uint32_t fw_size = (verify_size > max_size) ? verify_size : max_size;
+    if (fw_size > DFU_BENCH_MAX_IMAGE)
+    {
+        fw_size = DFU_BENCH_MAX_IMAGE;
+        verify_size = (verify_size > fw_size) ? fw_size : verify_size;
+    }
+    uint8_t *fw = malloc(fw_size > max_size ? fw_size : max_size);
+    if (fw == NULL || min_size == 0)
+    {
+        return 1;
+    }
+    srand(1);
+    for (uint32_t i = 0; i < fw_size; i++)
+    {
+        fw[i] = (uint8_t) rand();
+    }
+
+    int retval = 0;
+    bool first = true;
+    // Sizes grow 4x, the last one is max_size itself
+    for (uint32_t size = min_size; size <= max_size;
+         size = (size == max_size) ? max_size + 1 : ((size > max_size / 4) ? max_size : size * 4))
+    {
+        flash_sim_t *flash = dfu_bench_setup(part, divider, timing_scale);
+        if (flash == NULL)
+        {
+            return 1;
+        }
+
+        if (first)
+        {
+            printf("{\n  \"part\": \"%s\",\n  \"spi_hz\": %u,\n  \"timing_scale_percent\": %u,\n"
+                   "  \"crc32_kernel\": \"%s\",\n  \"chunk_size\": %u,\n  \"results\": [\n",
+                   flash_sim_name(flash), hal_sim_spi_clock_hz(&hspi2), timing_scale, crc32_kernel_name(),
+                   DFU_STREAM_CHUNK_SIZE);
+        }
+        else
+        {
+            printf(",\n");
+        }
+        first = false;
+
+        // The image must fit in a slot
+        uint32_t fw_len = (size > DFU_BENCH_MAX_IMAGE) ? DFU_BENCH_MAX_IMAGE : size;
+        printf("    {\n      \"size\": %u,\n", fw_len);
+
+        dfu_profile_start(flash);
+        int result = dfu_fw_image_update(fw, fw_len);
+        dfu_profile_stop();
+        dfu_bench_print_run("update", fw_len, result, false);
+
+        image_header_t header = {
+            .image_magic = IMAGE_MAGIC_NUMBER,
+            .image_data_type = IMAGE_TYPE_RFIC_FIRMWARE,
+            .image_data_version_major = IMAGE_FIRMWARE_MAJOR_VERSION,
+            .image_data_version_minor = IMAGE_FIRMWARE_MINOR_VERSION,
+            .image_data_version_revision = IMAGE_FIRMWARE_REVISION_VERSION,
+        };
+        image_header_t active_header;
+        dfu_profile_start(flash);
+        int boot_result = (dfu_slot_active(&active_header) >= 0) ? 0 : -1;
+        dfu_profile_stop();
+        dfu_bench_print_run("boot", fw_len, boot_result, false);
+
+        // Same image in the other slot
+        image_header_t copy_header = header;
+        int copy_result = (dfu_slot_update(&copy_header, fw, fw_len) >= 0) ? 0 : -1;
+
+        // Incremental release: a few bytes changed in the middle of the image
+        uint32_t change_len = (fw_len / 16 < DFU_BENCH_CHANGE_SIZE) ? fw_len / 16 : DFU_BENCH_CHANGE_SIZE;
+        for (uint32_t i = 0; i < change_len; i++)
+        {
+            fw[fw_len / 2 + i] ^= 0x5A;
+        }
+        dfu_profile_start(flash);
+        int incremental_result = (dfu_slot_update(&header, fw, fw_len) >= 0) ? 0 : -1;
+        dfu_profile_stop();
+        for (uint32_t i = 0; i < change_len; i++)
+        {
+            fw[fw_len / 2 + i] ^= 0x5A;
+        }
+        printf("      \"incremental_changed_bytes\": %u,\n", change_len);
+        dfu_bench_print_run("incremental", fw_len, incremental_result, true);
+        printf("    }");
+        fflush(stdout);
+
+        if (result != 0 || boot_result != 0 || copy_result != 0 || incremental_result != 0 ||
+            flash_sim_stats(flash)->violations != 0)
+        {
+            fprintf(stderr, "%u bytes: update %d, boot validation %d, slot copy %d, incremental update %d, %llu violations\n",
+                    fw_len, result, boot_result, copy_result, incremental_result,
+                    (unsigned long long) flash_sim_stats(flash)->violations);
+            retval = 1;
+        }
+        flash_sim_destroy(flash);
+    }
+    printf("\n  ]");
+    if (verify_size > 0)
+    {
+        printf(",\n");
+        if (dfu_bench_verify_levels(fw, verify_size, part, divider, timing_scale) != 0)
+        {
+            retval = 1;
+        }
+        if (dfu_bench_read_latency(fw, verify_size, part, divider, timing_scale) != 0)
+        {
+            retval = 1;
+        }
+    }
+    printf("\n}\n");
+    free(fw);
+    return retval;
+}
@@ -0,0 +1,162 @@
+/*******************************************************************************
+ * Title                 :   Compressed payload benchmark
+ * Filename              :   lz_bench.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host benchmark
+ *******************************************************************************/
+
+/** \file lz_bench.c
+ *  \brief Measure the compression ratio and decode throughput of image payloads
+ *
+ *  Usage: lz_bench [-n iterations] image...
+ *  For every image and every decoder window size, prints one JSON object with
+ *  the payload size, the ratio and the decode throughput in MB/s. Decoding
+ *  pulls one flash page (FLASH_N25_MAX_WRITE_SIZE) at a time and gets the
+ *  payload in DFU_STREAM_BUF_SIZE chunks, as dfu_update_feed() does, and the
+ *  output is compared with the image.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "lz_encode.h"
+#include "lz_stream.h"
+
+#define LZ_BENCH_OUT_CHUNK      (256) // FLASH_N25_MAX_WRITE_SIZE
+#define LZ_BENCH_IN_CHUNK       (512) // DFU_STREAM_BUF_SIZE
+
+static double bench_now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint8_t *lz_bench_load(const char *path, uint32_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (data != NULL && fread(data, 1, size, f) != (size_t) size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = (uint32_t) size;
+    return data;
+}
+
+/* Decode the whole payload in page windows, returns the decoded length, negative value on error */
+static int lz_bench_decode(lz_stream_t *s, const uint8_t *payload, uint32_t payload_len, uint8_t *out,
+                           uint32_t out_cap)
+{
+    uint32_t in_pos = 0;
+    uint32_t out_pos = 0;
+    lz_stream_init(s);
+    while (!lz_stream_done(s))
+    {
+        uint32_t in_len = payload_len - in_pos;
+        uint32_t out_len = out_cap - out_pos;
+        uint32_t consumed;
+        in_len = (in_len < LZ_BENCH_IN_CHUNK) ? in_len : LZ_BENCH_IN_CHUNK;
+        out_len = (out_len < LZ_BENCH_OUT_CHUNK) ? out_len : LZ_BENCH_OUT_CHUNK;
+        int produced = lz_stream_decode(s, &payload[in_pos], in_len, &consumed, &out[out_pos], out_len);
+        if (produced < 0 || (produced == 0 && consumed == 0))
+        {
+            return -1;
+        }
+        in_pos += consumed;
+        out_pos += produced;
+    }
+    return (int) out_pos;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        if (opt == 'n')
+        {
+            iterations = (uint32_t) atoi(optarg);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n iterations] image...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc)
+    {
+        fprintf(stderr, "Usage: %s [-n iterations] image...\n", argv[0]);
+        return 1;
+    }
+
+    static lz_stream_t stream;
+    int result = 0;
+    for (int i = optind; i < argc && result == 0; i++)
+    {
+        uint32_t raw_len;
+        uint8_t *raw = lz_bench_load(argv[i], &raw_len);
+        uint8_t *payload = (raw != NULL) ? malloc(LZ_ENCODE_BOUND(raw_len)) : NULL;
+        uint8_t *out = (raw != NULL) ? malloc(raw_len + 1) : NULL;
+        if (payload == NULL || out == NULL)
+        {
+            free(raw);
+            return 1;
+        }
+
+        for (uint8_t bits = LZ_STREAM_MIN_WINDOW_BITS; bits <= LZ_STREAM_MAX_WINDOW_BITS; bits++)
+        {
+            double start = bench_now_sec();
+            int payload_len = lz_encode(raw, raw_len, bits, payload, LZ_ENCODE_BOUND(raw_len));
+            double encode_sec = bench_now_sec() - start;
+            if (payload_len < 0)
+            {
+                fprintf(stderr, "%s: encoding failed\n", argv[i]);
+                result = 1;
+                break;
+            }
+
+            int decoded = 0;
+            start = bench_now_sec();
+            for (uint32_t n = 0; n < iterations && decoded >= 0; n++)
+            {
+                decoded = lz_bench_decode(&stream, payload, payload_len, out, raw_len + 1);
+            }
+            double decode_sec = bench_now_sec() - start;
+            if (decoded != (int) raw_len || memcmp(out, raw, raw_len) != 0 ||
+                crc32(out, raw_len) != ((const lz_stream_header_t *) payload)->raw_crc)
+            {
+                fprintf(stderr, "%s: window %u, decoded image does not match\n", argv[i], 1u << bits);
+                result = 1;
+                break;
+            }
+
+            printf("{\"image\": \"%s\", \"raw_bytes\": %u, \"window_bytes\": %u, \"payload_bytes\": %d, "
+                   "\"ratio\": %.3f, \"compressed\": %s, \"encode_ms\": %.2f, \"decode_mb_per_s\": %.1f, "
+                   "\"decoder_ram_bytes\": %u}\n",
+                   argv[i], raw_len, 1u << bits, payload_len, payload_len ? (double) raw_len / payload_len : 0.0,
+                   (((const lz_stream_header_t *) payload)->flags & LZ_STREAM_FLAG_COMPRESSED) ? "true" : "false",
+                   encode_sec * 1e3, (double) raw_len * iterations / decode_sec / 1e6,
+                   (uint32_t) sizeof(lz_stream_t));
+        }
+        free(raw);
+        free(payload);
+        free(out);
+    }
+    return result;
+}
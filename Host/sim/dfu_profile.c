@@ -0,0 +1,167 @@
+/*******************************************************************************
+ * Title                 :   DFU phase profiler
+ * Filename              :   dfu_profile.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host build only
+ *******************************************************************************/
+
+/** \file dfu_profile.c
+ *  \brief dfu_phase_hook() implementation on top of the simulated clock and flash statistics
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <string.h>
+
+#include "crc32.h"
+#include "dfu_profile.h"
+#include "hal_sim.h"
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define DFU_PROFILE_MAX_DEPTH           (8)
+
+/******************************************************************************
+ * Module Variable Definitions
+ *******************************************************************************/
+static const char *const dfu_profile_names[DFU_PHASE_COUNT + 1] = {
+    [DFU_PHASE_ERASE] = "erase",
+    [DFU_PHASE_DIFF] = "diff",
+    [DFU_PHASE_PROGRAM] = "program",
+    [DFU_PHASE_VERIFY] = "verify",
+    [DFU_PHASE_COMMIT_CRC] = "commit_crc",
+    [DFU_PHASE_VALIDATE] = "validate",
+    [DFU_PROFILE_OTHER] = "other",
+};
+
+static flash_sim_t *dfu_profile_flash;
+static dfu_profile_phase_t dfu_profile_phases[DFU_PHASE_COUNT + 1];
+static uint32_t dfu_profile_stack[DFU_PROFILE_MAX_DEPTH];
+static uint32_t dfu_profile_depth;
+
+/* Counters at the last mark */
+static uint64_t dfu_profile_mark_ns;
+static flash_sim_stats_t dfu_profile_mark_stats;
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+static uint32_t dfu_profile_current(void)
+{
+    return (dfu_profile_depth > 0) ? dfu_profile_stack[dfu_profile_depth - 1] : DFU_PROFILE_OTHER;
+}
+
+/*
+ * @brief charge the activity since the last mark to the innermost open phase
+ */
+static void dfu_profile_mark(void)
+{
+    if (dfu_profile_flash == NULL)
+    {
+        return;
+    }
+    const flash_sim_stats_t *now = flash_sim_stats(dfu_profile_flash);
+    const flash_sim_stats_t *last = &dfu_profile_mark_stats;
+    dfu_profile_phase_t *p = &dfu_profile_phases[dfu_profile_current()];
+
+    p->time_ns += hal_sim_now_ns() - dfu_profile_mark_ns;
+    p->bus_ns += now->bus_ns - last->bus_ns;
+    p->busy_ns += now->busy_ns - last->busy_ns;
+    p->spi_transactions += now->frames - last->frames;
+    p->spi_bytes += now->bytes - last->bytes;
+    p->erase_ops += now->erase_ops - last->erase_ops;
+    p->erase_bytes += now->erase_bytes - last->erase_bytes;
+    p->program_ops += now->program_ops - last->program_ops;
+    p->program_bytes += now->program_bytes - last->program_bytes;
+    p->read_bytes += now->read_bytes - last->read_bytes;
+    p->busy_polls += now->busy_polls - last->busy_polls;
+
+    dfu_profile_mark_ns = hal_sim_now_ns();
+    dfu_profile_mark_stats = *now;
+}
+
+void dfu_profile_start(flash_sim_t *flash)
+{
+    dfu_profile_flash = flash;
+    dfu_profile_depth = 0;
+    memset(dfu_profile_phases, 0, sizeof(dfu_profile_phases));
+    dfu_profile_mark_ns = hal_sim_now_ns();
+    dfu_profile_mark_stats = *flash_sim_stats(flash);
+}
+
+void dfu_profile_stop(void)
+{
+    dfu_profile_mark();
+    dfu_profile_flash = NULL;
+}
+
+const dfu_profile_phase_t *dfu_profile_phase(uint32_t phase)
+{
+    return (phase <= DFU_PROFILE_OTHER) ? &dfu_profile_phases[phase] : NULL;
+}
+
+const char *dfu_profile_phase_name(uint32_t phase)
+{
+    return (phase <= DFU_PROFILE_OTHER) ? dfu_profile_names[phase] : "unknown";
+}
+
+dfu_profile_phase_t dfu_profile_total(void)
+{
+    dfu_profile_phase_t total = {0};
+    for (uint32_t i = 0; i <= DFU_PROFILE_OTHER; i++)
+    {
+        const dfu_profile_phase_t *p = &dfu_profile_phases[i];
+        total.time_ns += p->time_ns;
+        total.bus_ns += p->bus_ns;
+        total.busy_ns += p->busy_ns;
+        total.spi_transactions += p->spi_transactions;
+        total.spi_bytes += p->spi_bytes;
+        total.erase_ops += p->erase_ops;
+        total.erase_bytes += p->erase_bytes;
+        total.program_ops += p->program_ops;
+        total.program_bytes += p->program_bytes;
+        total.read_bytes += p->read_bytes;
+        total.busy_polls += p->busy_polls;
+        total.crc_bytes += p->crc_bytes;
+    }
+    return total;
+}
+
+void dfu_phase_hook(dfu_phase_t phase, bool enter)
+{
+    dfu_profile_mark();
+    if (enter)
+    {
+        if (dfu_profile_depth < DFU_PROFILE_MAX_DEPTH)
+        {
+            dfu_profile_stack[dfu_profile_depth++] = phase;
+        }
+    }
+    else if (dfu_profile_depth > 0)
+    {
+        dfu_profile_depth--;
+    }
+}
+
+/* ====================== CRC32 link time wrappers ====================== */
+uint32_t __real_crc32(const void *buf, uint32_t size);
+uint32_t __real_crc32_update(uint32_t crc, const void *buf, uint32_t size);
+
+static void dfu_profile_crc(uint32_t size)
+{
+    hal_sim_advance_ns((uint64_t) size * hal_sim_config()->crc_cpu_byte_ns);
+    dfu_profile_phases[dfu_profile_current()].crc_bytes += size;
+}
+
+uint32_t __wrap_crc32(const void *buf, uint32_t size)
+{
+    dfu_profile_crc(size);
+    return __real_crc32(buf, size);
+}
+
+uint32_t __wrap_crc32_update(uint32_t crc, const void *buf, uint32_t size)
+{
+    dfu_profile_crc(size);
+    return __real_crc32_update(crc, buf, size);
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * Title                 :   DFU phase profiler
+ * Filename              :   dfu_profile.h
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host build only
+ *******************************************************************************/
+
+/** \file dfu_profile.h
+ *  \brief Per-phase simulated time and flash activity of the DFU code
+ *
+ *  dfu.c is built with DFU_PROFILE_PHASES=1 and marks its phases with
+ *  DFU_PHASE_ENTER()/DFU_PHASE_EXIT(). Everything that happens between two
+ *  marks (simulated time, SPI traffic, array operations) is charged to the
+ *  innermost open phase, or to "other" when no phase is open.
+ *
+ *  crc32() and crc32_update() are wrapped at link time (-Wl,--wrap) to count
+ *  the CRC passes and charge their CPU time (hal_sim_config_t.crc_cpu_byte_ns).
+ */
+#ifndef DFU_PROFILE_H_
+#define DFU_PROFILE_H_
+
+#include <stdint.h>
+
+#include "dfu.h"
+#include "flash_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DFU_PROFILE_OTHER               (DFU_PHASE_COUNT) // Slot for activity outside any phase
+
+typedef struct
+{
+    uint64_t time_ns;           // Simulated time
+    uint64_t bus_ns;            // SCK time while the flash was selected
+    uint64_t busy_ns;           // Array program/erase time that ended in the phase
+    uint64_t spi_transactions;  // Chip select cycles
+    uint64_t spi_bytes;
+    uint64_t erase_ops;
+    uint64_t erase_bytes;
+    uint64_t program_ops;
+    uint64_t program_bytes;
+    uint64_t read_bytes;        // Bytes read from the array
+    uint64_t busy_polls;
+    uint64_t crc_bytes;         // Bytes run through crc32()/crc32_update()
+} dfu_profile_phase_t;
+
+/**
+ * @brief start a new measurement on the given flash model, clears all counters
+ */
+void dfu_profile_start(flash_sim_t *flash);
+
+/**
+ * @brief close the measurement, charging the activity since the last mark
+ */
+void dfu_profile_stop(void);
+
+/**
+ * @param phase: dfu_phase_t value or DFU_PROFILE_OTHER
+ */
+const dfu_profile_phase_t *dfu_profile_phase(uint32_t phase);
+const char *dfu_profile_phase_name(uint32_t phase);
+
+/**
+ * @brief sum of all phases, including DFU_PROFILE_OTHER
+ */
+dfu_profile_phase_t dfu_profile_total(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFU_PROFILE_H_ */
@@ -0,0 +1,1117 @@
+/*******************************************************************************
+ * Title                 :   SPI NOR flash simulator
+ * Filename              :   flash_sim.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host build only
+ *******************************************************************************/
+
+/** \file flash_sim.c
+ *  \brief Command level model of the N25Q128A/N25Q256A and MX25R6435F
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flash_sim.h"
+#include "hal_sim.h"
+#include "MX25Series.h"
+#include "n25q128a.h"
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define FLASH_SIM_PAGE_SIZE             (256)
+#define FLASH_SIM_ID_LEN                (20)
+
+/* SFDP space: header, one parameter header and a 16 DWORD Basic Flash Parameter Table (JESD216B) */
+#define FLASH_SIM_SFDP_BFPT_ADDR        (0x30)
+#define FLASH_SIM_SFDP_BFPT_DWORDS      (16)
+#define FLASH_SIM_SFDP_SIZE             (FLASH_SIM_SFDP_BFPT_ADDR + 4 * FLASH_SIM_SFDP_BFPT_DWORDS)
+
+/* Typical times published in the SFDP tables, the model itself runs the maximum ones */
+#define FLASH_SIM_N25Q_PP_TYP_US        (500)
+#define FLASH_SIM_MX25_PP_TYP_US        (850)
+#define FLASH_SIM_MX25_SE_TYP_MS        (40)
+#define FLASH_SIM_MX25_BE32K_TYP_MS     (160)
+#define FLASH_SIM_MX25_BE64K_TYP_MS     (320)
+#define FLASH_SIM_MX25_CE_TYP_MS        (50000)
+
+/* Opcodes not defined by the driver headers */
+#define FLASH_SIM_CMD_ENTER_4B_ADDR     (0xB7)
+#define FLASH_SIM_CMD_EXIT_4B_ADDR      (0xE9)
+#define FLASH_SIM_CMD_CHIP_ERASE_ALT    (0x60)
+
+/* N25Q write status register cycle time (ms) */
+#define FLASH_SIM_N25Q_WRSR_MAX_TIME    (8)
+
+/* MX25 security register */
+#define FLASH_SIM_MX25_SCUR_PSB         (0x04)
+#define FLASH_SIM_MX25_SCUR_ESB         (0x08)
+#define FLASH_SIM_MX25_SCUR_P_FAIL      (0x20)
+#define FLASH_SIM_MX25_SCUR_E_FAIL      (0x40)
+
+/******************************************************************************
+ * Module Typedefs
+ *******************************************************************************/
+typedef enum
+{
+    FLASH_SIM_OP_NONE = 0,
+    FLASH_SIM_OP_READ,          // Array read, address then data out
+    FLASH_SIM_OP_PROGRAM,       // Page program, address then data in
+    FLASH_SIM_OP_ERASE,         // Sector/block erase, address
+    FLASH_SIM_OP_CHIP_ERASE,
+    FLASH_SIM_OP_REG_OUT,       // Register read, data out
+    FLASH_SIM_OP_REG_IN,        // Register write, data in
+    FLASH_SIM_OP_SIMPLE,        // No address nor data
+    FLASH_SIM_OP_SFDP,          // SFDP read, 3 address bytes, dummy byte then data out
+} flash_sim_op_t;
+
+typedef enum
+{
+    FLASH_SIM_BUSY_OTHER = 0,   // Chip erase, register write: cannot be suspended
+    FLASH_SIM_BUSY_PROGRAM,
+    FLASH_SIM_BUSY_ERASE,
+} flash_sim_busy_t;
+
+typedef struct
+{
+    uint32_t page_program_us;
+    uint32_t erase_4k_us;
+    uint32_t erase_32k_us;
+    uint32_t erase_64k_us;
+    uint32_t erase_chip_us;
+    uint32_t write_status_us;
+    uint32_t suspend_us;        // Program/erase suspend latency
+    uint32_t erase_resume_us;   // Minimum erase progress between a resume and the next suspend, 0 for none
+} flash_sim_timing_t;
+
+struct flash_sim
+{
+    flash_sim_part_t part;
+    uint8_t *mem;
+    uint32_t size;
+    int fd;
+    uint32_t timing_scale;
+    bool strict;
+    uint32_t fault_interval;    // Page programs between two silent bit faults, 0 for none
+    uint8_t sfdp[FLASH_SIM_SFDP_SIZE];
+
+    /* Registers */
+    uint8_t sr;             // Status register (WIP/WEL are derived)
+    bool wel;
+    uint8_t fsr_errors;     // N25Q flag status register error bits
+    uint8_t vcr;            // N25Q volatile configuration register
+    uint8_t cr[2];          // MX25 configuration register 1/2
+    uint8_t scur;           // MX25 security register
+    bool addr_4byte;
+    bool deep_power_down;
+    uint64_t byte_ns;       // SCK time of the last byte, for the clock limits
+
+    /* Busy state */
+    bool busy;
+    uint64_t busy_start_ns;
+    uint64_t busy_until_ns;
+    flash_sim_busy_t busy_kind;
+    uint32_t busy_addr;         // Page or block of the program/erase, unreadable while it is suspended
+    uint32_t busy_size;
+
+    /* Suspend state */
+    bool suspending;            // Suspend latency running, the operation is suspended once busy ends
+    bool suspended;
+    uint64_t suspend_left_ns;   // Time the suspended operation still needs
+    uint64_t resume_ns;         // Time of the last resume
+
+    /* Current frame */
+    bool selected;
+    uint8_t opcode;
+    flash_sim_op_t op;
+    bool op_ignored;
+    uint32_t pos;
+    uint32_t addr_len;
+    uint32_t dummy_len;
+    uint32_t addr;
+    uint32_t data_pos;
+    uint8_t reg_in[4];
+    uint8_t page_buf[FLASH_SIM_PAGE_SIZE];
+    uint8_t page_mask[FLASH_SIM_PAGE_SIZE];
+    uint32_t erase_size;
+    bool frame_violation;       // Violation already counted for the current frame
+
+    flash_sim_stats_t stats;
+};
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+static bool flash_sim_is_n25q(const flash_sim_t *sim)
+{
+    return sim->part == FLASH_SIM_N25Q128A || sim->part == FLASH_SIM_N25Q256A;
+}
+
+static flash_sim_timing_t flash_sim_timing(const flash_sim_t *sim)
+{
+    flash_sim_timing_t timing = {0};
+    if (flash_sim_is_n25q(sim))
+    {
+        timing.page_program_us = N25Q128A_PAGE_PROG_MAX_TIME * 1000;
+        timing.erase_4k_us = N25Q128A_SUBSECTOR_ERASE_MAX_TIME * 1000;
+        timing.erase_64k_us = N25Q128A_SECTOR_ERASE_MAX_TIME * 1000;
+        timing.erase_chip_us = N25Q128A_BULK_ERASE_MAX_TIME * 1000;
+        timing.write_status_us = FLASH_SIM_N25Q_WRSR_MAX_TIME * 1000;
+        timing.suspend_us = N25Q128A_SUSPEND_LATENCY_MAX_US;
+    }
+    else
+    {
+        // L/H bit of configuration register 2 selects the High Performance timing
+        const MX25Series_Chip_Info_t *chip = (sim->cr[1] & MX25Series_CR_LH) ? &MX25R6435F_Chip_Def_High_Performance
+                                                                              : &MX25R6435F_Chip_Def_Low_Power;
+        timing.page_program_us = chip->timing.tPP;
+        timing.erase_4k_us = chip->timing.tSE;
+        timing.erase_32k_us = chip->timing.tBE32K;
+        timing.erase_64k_us = chip->timing.tBE64K;
+        timing.erase_chip_us = chip->timing.tCE;
+        timing.write_status_us = chip->timing.tWSR;
+        timing.suspend_us = chip->timing.tSUS;
+        timing.erase_resume_us = chip->timing.tERS;
+    }
+    return timing;
+}
+
+/*
+ * @brief retire a finished program/erase operation, or the suspend latency of one
+ */
+static void flash_sim_update(flash_sim_t *sim)
+{
+    if (sim->busy && hal_sim_now_ns() >= sim->busy_until_ns)
+    {
+        sim->busy = false;
+        sim->stats.busy_ns += sim->busy_until_ns - sim->busy_start_ns;
+        if (sim->suspending)
+        {
+            sim->suspending = false;
+            sim->suspended = true;
+            return;
+        }
+        sim->wel = false;
+    }
+}
+
+static void flash_sim_start_busy_ns(flash_sim_t *sim, uint64_t duration_ns)
+{
+    sim->busy = true;
+    sim->busy_start_ns = hal_sim_now_ns();
+    sim->busy_until_ns = sim->busy_start_ns + duration_ns;
+}
+
+static void flash_sim_start_busy(flash_sim_t *sim, uint32_t duration_us)
+{
+    flash_sim_start_busy_ns(sim, (uint64_t) duration_us * 1000ULL * sim->timing_scale / 100ULL);
+    sim->busy_kind = FLASH_SIM_BUSY_OTHER;
+}
+
+/*
+ * @brief PGM/ERS Suspend: the operation stops after the suspend latency, unless it ends first. Chip erases and
+ *        register writes are not suspended.
+ */
+static void flash_sim_suspend(flash_sim_t *sim)
+{
+    flash_sim_timing_t timing = flash_sim_timing(sim);
+    uint64_t now = hal_sim_now_ns();
+    uint64_t latency_ns = (uint64_t) timing.suspend_us * 1000ULL;
+
+    flash_sim_update(sim);
+    if (!sim->busy || sim->suspending || sim->busy_kind == FLASH_SIM_BUSY_OTHER ||
+        sim->busy_until_ns - now <= latency_ns)
+    {
+        return;
+    }
+    // An erase suspended again too soon after its resume does not progress
+    if (sim->busy_kind == FLASH_SIM_BUSY_ERASE && sim->resume_ns != 0 &&
+        now - sim->resume_ns < (uint64_t) timing.erase_resume_us * 1000ULL)
+    {
+        sim->stats.violations++;
+    }
+    sim->suspend_left_ns = sim->busy_until_ns - now - latency_ns;
+    sim->stats.busy_ns += now - sim->busy_start_ns;
+    sim->busy_start_ns = now;
+    sim->busy_until_ns = now + latency_ns;
+    sim->suspending = true;
+}
+
+static void flash_sim_resume(flash_sim_t *sim)
+{
+    flash_sim_update(sim);
+    if (!sim->suspended)
+    {
+        return;
+    }
+    sim->suspended = false;
+    sim->resume_ns = hal_sim_now_ns();
+    flash_sim_start_busy_ns(sim, sim->suspend_left_ns);
+}
+
+/*
+ * @brief whether addr is in the page or block of the suspended operation
+ */
+static bool flash_sim_in_suspended(const flash_sim_t *sim, uint32_t addr)
+{
+    return sim->suspended && addr - sim->busy_addr < sim->busy_size;
+}
+
+static uint8_t flash_sim_status(flash_sim_t *sim)
+{
+    flash_sim_update(sim);
+    if (sim->busy)
+    {
+        sim->stats.busy_polls++;
+    }
+    return (sim->sr & ~(N25Q128A_SR_WIP | N25Q128A_SR_WREN)) | (sim->busy ? N25Q128A_SR_WIP : 0) |
+           (sim->wel ? N25Q128A_SR_WREN : 0);
+}
+
+/*
+ * @brief suspend flags, N25Q flag status register or MX25 security register layout
+ */
+static uint8_t flash_sim_suspend_flags(const flash_sim_t *sim, uint8_t program_flag, uint8_t erase_flag)
+{
+    if (!sim->suspended)
+    {
+        return 0;
+    }
+    return (sim->busy_kind == FLASH_SIM_BUSY_ERASE) ? erase_flag : program_flag;
+}
+
+static uint8_t flash_sim_flag_status(flash_sim_t *sim)
+{
+    flash_sim_update(sim);
+    if (sim->busy)
+    {
+        sim->stats.busy_polls++;
+    }
+    return sim->fsr_errors | (sim->busy ? 0 : N25Q128A_FSR_READY) | (sim->addr_4byte ? 0x01 : 0) |
+           flash_sim_suspend_flags(sim, N25Q128A_FSR_PGSUS, N25Q128A_FSR_ERSUS);
+}
+
+static uint8_t flash_sim_id_byte(const flash_sim_t *sim, uint32_t index)
+{
+    if (flash_sim_is_n25q(sim))
+    {
+        // Manufacturer, memory type, capacity, remaining ID length, then zeroed extended ID/UID
+        static const uint8_t n25q_id[4] = {0x20, 0xBA, 0x18, 0x10};
+        if (index >= FLASH_SIM_ID_LEN)
+        {
+            return 0x00;
+        }
+        if (index == 2)
+        {
+            return (sim->part == FLASH_SIM_N25Q256A) ? 0x19 : 0x18;
+        }
+        return (index < sizeof(n25q_id)) ? n25q_id[index] : 0x00;
+    }
+    static const uint8_t mx25_id[3] = {MX25R6435F_MANUFACTURER_ID, MX25R6435F_MEMORY_TYPE, MX25R6435F_MEMORY_DENSITY};
+    return mx25_id[index % sizeof(mx25_id)];
+}
+
+/*
+ * @brief SFDP time field: 5-bit count of the smallest unit that fits, rounded up, then the unit index
+ */
+static uint32_t flash_sim_sfdp_time(uint32_t value, const uint32_t *unit, uint32_t unit_count, uint32_t *encoded)
+{
+    uint32_t index = 0;
+    while (index + 1 < unit_count && (value + unit[index] - 1) / unit[index] > 32)
+    {
+        index++;
+    }
+    uint32_t count = (value + unit[index] - 1) / unit[index];
+    count = (count == 0) ? 1 : (count > 32) ? 32 : count;
+    *encoded = (count * unit[index]);
+    return (index << 5) | (count - 1);
+}
+
+/*
+ * @brief typical to maximum multiplier field, 2 * (field + 1) covering every maximum time
+ */
+static uint32_t flash_sim_sfdp_multiplier(const uint32_t *typ, const uint32_t *max, uint32_t count)
+{
+    uint32_t field = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        while (field < 15 && (uint64_t) typ[i] * 2 * (field + 1) < max[i])
+        {
+            field++;
+        }
+    }
+    return field;
+}
+
+static void flash_sim_put_dword(uint8_t *dst, uint32_t value)
+{
+    dst[0] = (uint8_t) value;
+    dst[1] = (uint8_t) (value >> 8);
+    dst[2] = (uint8_t) (value >> 16);
+    dst[3] = (uint8_t) (value >> 24);
+}
+
+/*
+ * @brief SFDP tables of the part, consistent with the model: sizes, opcodes, typical times and the maximum times
+ *        the model runs. The MX25 maximums are the Low Power ones, the slowest mode.
+ */
+static void flash_sim_build_sfdp(flash_sim_t *sim)
+{
+    static const uint32_t erase_unit_ms[4] = {1, 16, 128, 1000};
+    static const uint32_t chip_unit_ms[4] = {16, 256, 4000, 64000};
+    static const uint32_t program_unit_us[2] = {8, 64};
+    uint32_t dw[FLASH_SIM_SFDP_BFPT_DWORDS] = {0};
+    uint32_t erase_size_log2[3] = {12, 16, 0};
+    uint32_t erase_opcode[3] = {SUBSECTOR_ERASE_CMD, SECTOR_ERASE_CMD, 0};
+    uint32_t typ_ms[4] = {0};
+    uint32_t max_ms[4] = {0};
+    uint32_t program_typ_us;
+    uint32_t program_max_us;
+    uint32_t erase_count;
+    bool n25q = flash_sim_is_n25q(sim);
+
+    if (n25q)
+    {
+        erase_count = 2;
+        typ_ms[0] = N25Q128A_SUBSECTOR_ERASE_TYP_TIME;
+        typ_ms[1] = N25Q128A_SECTOR_ERASE_TYP_TIME;
+        typ_ms[2] = N25Q128A_BULK_ERASE_TYP_TIME; // Chip erase after the erase types
+        max_ms[0] = N25Q128A_SUBSECTOR_ERASE_MAX_TIME;
+        max_ms[1] = N25Q128A_SECTOR_ERASE_MAX_TIME;
+        max_ms[2] = N25Q128A_BULK_ERASE_MAX_TIME;
+        program_typ_us = FLASH_SIM_N25Q_PP_TYP_US;
+        program_max_us = N25Q128A_PAGE_PROG_MAX_TIME * 1000;
+    }
+    else
+    {
+        const MX25Series_Chip_Info_t *chip = &MX25R6435F_Chip_Def_Low_Power;
+        erase_count = 3;
+        erase_size_log2[1] = 15;
+        erase_size_log2[2] = 16;
+        erase_opcode[1] = MX25Series_Command_BE32K;
+        erase_opcode[2] = MX25Series_Command_BE64K;
+        typ_ms[0] = FLASH_SIM_MX25_SE_TYP_MS;
+        typ_ms[1] = FLASH_SIM_MX25_BE32K_TYP_MS;
+        typ_ms[2] = FLASH_SIM_MX25_BE64K_TYP_MS;
+        typ_ms[3] = FLASH_SIM_MX25_CE_TYP_MS;
+        max_ms[0] = chip->timing.tSE / 1000;
+        max_ms[1] = chip->timing.tBE32K / 1000;
+        max_ms[2] = chip->timing.tBE64K / 1000;
+        max_ms[3] = chip->timing.tCE / 1000;
+        program_typ_us = FLASH_SIM_MX25_PP_TYP_US;
+        program_max_us = chip->timing.tPP;
+    }
+
+    // Header, then the BFPT parameter header
+    memcpy(sim->sfdp, "SFDP", 4);
+    sim->sfdp[4] = 6;
+    sim->sfdp[5] = 1;
+    sim->sfdp[6] = 0;
+    sim->sfdp[7] = 0xFF;
+    uint8_t bfpt_header[8] = {0x00, 6, 1, FLASH_SIM_SFDP_BFPT_DWORDS, FLASH_SIM_SFDP_BFPT_ADDR, 0, 0, 0xFF};
+    memcpy(&sim->sfdp[8], bfpt_header, sizeof(bfpt_header));
+
+    // DWORD 1: 4KB erase, 64 byte+ write granularity, 1-1-2/1-2-2/1-4-4/1-1-4 reads, address bytes
+    dw[0] = 0x01 | 0x04 | ((uint32_t) SUBSECTOR_ERASE_CMD << 8) | (1UL << 16) | (1UL << 20) | (1UL << 21) |
+            (1UL << 22) | ((sim->part == FLASH_SIM_N25Q256A) ? (1UL << 17) : 0) | 0xFF800000UL;
+    dw[1] = sim->size * 8 - 1;
+    // DWORDs 3 and 4: 1-4-4 (EBh, 10 cycles), 1-1-4 (6Bh, 8), 1-1-2 (3Bh, 8) and 1-2-2 (BBh, 8 with mode bits)
+    dw[2] = ((uint32_t) QUAD_INOUT_FAST_READ_CMD << 8) | (n25q ? 10 : 0x44) |
+            (((uint32_t) QUAD_OUT_FAST_READ_CMD << 8 | 8) << 16);
+    dw[3] = ((uint32_t) DUAL_OUT_FAST_READ_CMD << 8 | 8) | (((uint32_t) DUAL_INOUT_FAST_READ_CMD << 8 | 0x04) << 16);
+    dw[4] = 0xFFFFFFEEUL;
+    dw[5] = 0xFFFF0000UL;
+    dw[6] = 0xFFFF0000UL;
+    // DWORDs 8 and 9: erase types
+    dw[7] = 12 | ((uint32_t) erase_opcode[0] << 8) | (erase_size_log2[1] << 16) | (erase_opcode[1] << 24);
+    dw[8] = (erase_count > 2) ? (erase_size_log2[2] | (erase_opcode[2] << 8)) : 0;
+
+    // DWORD 10: typical erase times and their maximum multiplier, DWORD 11: page size, program and chip erase times
+    uint32_t encoded_ms[4] = {0};
+    for (uint32_t i = 0; i < erase_count; i++)
+    {
+        dw[9] |= flash_sim_sfdp_time(typ_ms[i], erase_unit_ms, 4, &encoded_ms[i]) << (4 + 7 * i);
+    }
+    uint32_t chip_field = flash_sim_sfdp_time(typ_ms[erase_count], chip_unit_ms, 4, &encoded_ms[erase_count]);
+    dw[9] |= flash_sim_sfdp_multiplier(encoded_ms, max_ms, erase_count + 1);
+    uint32_t encoded_us;
+    uint32_t program_field = flash_sim_sfdp_time(program_typ_us, program_unit_us, 2, &encoded_us);
+    dw[10] = flash_sim_sfdp_multiplier(&encoded_us, &program_max_us, 1) | (8 << 4) | (program_field << 8) |
+             (chip_field << 24);
+
+    // DWORD 16: 4-byte address mode entered with WREN then B7h, left with WREN then E9h
+    if (sim->part == FLASH_SIM_N25Q256A)
+    {
+        dw[15] = (0x02UL << 24) | (0x02UL << 14);
+    }
+    for (uint32_t i = 0; i < FLASH_SIM_SFDP_BFPT_DWORDS; i++)
+    {
+        flash_sim_put_dword(&sim->sfdp[FLASH_SIM_SFDP_BFPT_ADDR + 4 * i], dw[i]);
+    }
+}
+
+/*
+ * @brief decode the opcode of a new frame
+ */
+static void flash_sim_decode(flash_sim_t *sim, uint8_t opcode)
+{
+    bool n25q = flash_sim_is_n25q(sim);
+    uint32_t addr_len = sim->addr_4byte ? 4 : 3;
+
+    sim->opcode = opcode;
+    sim->op = FLASH_SIM_OP_NONE;
+    sim->addr_len = 0;
+    sim->dummy_len = 0;
+
+    if (sim->deep_power_down && !(!n25q && opcode == MX25Series_Command_RES))
+    {
+        sim->op_ignored = true;
+        return;
+    }
+
+    switch (opcode)
+    {
+    case READ_CMD:
+        sim->op = FLASH_SIM_OP_READ;
+        sim->addr_len = addr_len;
+        break;
+    case FAST_READ_CMD:
+        sim->op = FLASH_SIM_OP_READ;
+        sim->addr_len = addr_len;
+        if (n25q)
+        {
+            // Dummy clock cycles from VCR[7:4], 0 and 15 select the default 8 cycles
+            uint32_t cycles = (sim->vcr >> 4) & 0x0F;
+            cycles = (cycles == 0 || cycles == 0x0F) ? N25Q128A_DUMMY_CYCLES_READ : cycles;
+            sim->dummy_len = (cycles + 7) / 8;
+        }
+        else
+        {
+            sim->dummy_len = 1;
+        }
+        break;
+    case PAGE_PROG_CMD:
+        sim->op = FLASH_SIM_OP_PROGRAM;
+        sim->addr_len = addr_len;
+        memset(sim->page_buf, 0xFF, sizeof(sim->page_buf));
+        memset(sim->page_mask, 0, sizeof(sim->page_mask));
+        break;
+    case SUBSECTOR_ERASE_CMD: // MX25Series_Command_SE
+        sim->op = FLASH_SIM_OP_ERASE;
+        sim->addr_len = addr_len;
+        sim->erase_size = 0x1000;
+        break;
+    case SECTOR_ERASE_CMD: // MX25Series_Command_BE64K
+        sim->op = FLASH_SIM_OP_ERASE;
+        sim->addr_len = addr_len;
+        sim->erase_size = 0x10000;
+        break;
+    case MX25Series_Command_BE32K:
+        if (!n25q)
+        {
+            sim->op = FLASH_SIM_OP_ERASE;
+            sim->addr_len = addr_len;
+            sim->erase_size = 0x8000;
+        }
+        break;
+    case BULK_ERASE_CMD:
+        sim->op = FLASH_SIM_OP_CHIP_ERASE;
+        break;
+    case FLASH_SIM_CMD_CHIP_ERASE_ALT:
+        sim->op = n25q ? FLASH_SIM_OP_NONE : FLASH_SIM_OP_CHIP_ERASE;
+        break;
+    case WRITE_ENABLE_CMD:
+    case WRITE_DISABLE_CMD:
+    case PROG_ERASE_SUSPEND_CMD: // MX25Series_Command_PGM_ERS_Suspend
+    case PROG_ERASE_RESUME_CMD:  // MX25Series_Command_PGM_ERS_Resume
+        sim->op = FLASH_SIM_OP_SIMPLE;
+        break;
+    case READ_STATUS_REG_CMD:
+    case READ_ID_CMD2:
+        sim->op = FLASH_SIM_OP_REG_OUT;
+        break;
+    case WRITE_STATUS_REG_CMD:
+        sim->op = FLASH_SIM_OP_REG_IN;
+        break;
+    case READ_ID_CMD: // N25Q only
+    case READ_FLAG_STATUS_REG_CMD:
+    case READ_VOL_CFG_REG_CMD:
+        sim->op = n25q ? FLASH_SIM_OP_REG_OUT : FLASH_SIM_OP_NONE;
+        break;
+    case CLEAR_FLAG_STATUS_REG_CMD:
+        sim->op = n25q ? FLASH_SIM_OP_SIMPLE : FLASH_SIM_OP_NONE;
+        break;
+    case WRITE_VOL_CFG_REG_CMD:
+        sim->op = n25q ? FLASH_SIM_OP_REG_IN : FLASH_SIM_OP_NONE;
+        break;
+    case READ_LOCK_REG_CMD:
+        if (n25q)
+        {
+            sim->op = FLASH_SIM_OP_REG_OUT;
+            sim->addr_len = addr_len;
+        }
+        break;
+    case FLASH_SIM_CMD_ENTER_4B_ADDR:
+    case FLASH_SIM_CMD_EXIT_4B_ADDR:
+        sim->op = (sim->part == FLASH_SIM_N25Q256A) ? FLASH_SIM_OP_SIMPLE : FLASH_SIM_OP_NONE;
+        break;
+    case MX25Series_Command_RDCR:
+    case MX25Series_Command_RDSCUR:
+        sim->op = n25q ? FLASH_SIM_OP_NONE : FLASH_SIM_OP_REG_OUT;
+        break;
+    case MX25Series_Command_RES:
+        if (!n25q)
+        {
+            sim->op = FLASH_SIM_OP_REG_OUT;
+            sim->dummy_len = 3;
+        }
+        break;
+    case MX25Series_Command_REMS:
+        if (!n25q)
+        {
+            sim->op = FLASH_SIM_OP_REG_OUT;
+            sim->dummy_len = 3;
+        }
+        break;
+    case MX25Series_Command_DP:
+        sim->op = n25q ? FLASH_SIM_OP_NONE : FLASH_SIM_OP_SIMPLE;
+        break;
+    case READ_SERIAL_FLASH_DISCO_PARAM_CMD: // MX25Series_Command_RDSFDP
+        sim->op = FLASH_SIM_OP_SFDP;
+        sim->addr_len = 3;
+        sim->dummy_len = 1;
+        break;
+    default:
+        break;
+    }
+
+    if (sim->op == FLASH_SIM_OP_NONE)
+    {
+        sim->op_ignored = true;
+        sim->stats.ignored_cmds++;
+        return;
+    }
+
+    // Only status reads and suspend are accepted while a program/erase cycle is running
+    flash_sim_update(sim);
+    if (sim->busy && opcode != READ_STATUS_REG_CMD && opcode != READ_FLAG_STATUS_REG_CMD &&
+        opcode != PROG_ERASE_SUSPEND_CMD)
+    {
+        sim->op_ignored = true;
+        sim->stats.ignored_cmds++;
+        sim->stats.violations++;
+        return;
+    }
+    // A suspended operation must be resumed before the next program/erase
+    if (sim->suspended && (sim->op == FLASH_SIM_OP_PROGRAM || sim->op == FLASH_SIM_OP_ERASE ||
+                           sim->op == FLASH_SIM_OP_CHIP_ERASE || sim->op == FLASH_SIM_OP_REG_IN))
+    {
+        sim->op_ignored = true;
+        sim->stats.ignored_cmds++;
+        sim->stats.violations++;
+        return;
+    }
+
+    if (sim->op == FLASH_SIM_OP_READ)
+    {
+        sim->stats.read_cmds++;
+    }
+}
+
+static uint8_t flash_sim_reg_out(flash_sim_t *sim, uint32_t index)
+{
+    switch (sim->opcode)
+    {
+    case READ_STATUS_REG_CMD:
+        return flash_sim_status(sim);
+    case READ_FLAG_STATUS_REG_CMD:
+        return flash_sim_flag_status(sim);
+    case READ_ID_CMD:
+    case READ_ID_CMD2:
+        return flash_sim_id_byte(sim, index);
+    case READ_VOL_CFG_REG_CMD:
+        return sim->vcr;
+    case READ_LOCK_REG_CMD:
+        return 0x00;
+    case MX25Series_Command_RDCR:
+        return sim->cr[index % 2];
+    case MX25Series_Command_RDSCUR:
+        flash_sim_update(sim);
+        return sim->scur | flash_sim_suspend_flags(sim, FLASH_SIM_MX25_SCUR_PSB, FLASH_SIM_MX25_SCUR_ESB);
+    case MX25Series_Command_RES:
+        return MX25R6435F_MEMORY_DENSITY;
+    case MX25Series_Command_REMS:
+        return (index % 2) ? MX25R6435F_MEMORY_DENSITY : MX25R6435F_MANUFACTURER_ID;
+    default:
+        return 0xFF;
+    }
+}
+
+uint8_t flash_sim_transfer(flash_sim_t *sim, uint8_t mosi)
+{
+    sim->stats.bytes++;
+    if (!sim->selected)
+    {
+        return 0xFF;
+    }
+
+    uint32_t pos = sim->pos++;
+    if (pos == 0)
+    {
+        flash_sim_decode(sim, mosi);
+        return 0xFF;
+    }
+    if (sim->op_ignored)
+    {
+        return 0xFF;
+    }
+
+    // Address phase
+    if (pos <= sim->addr_len)
+    {
+        sim->addr = (sim->addr << 8) | mosi;
+        return 0xFF;
+    }
+    // Dummy phase
+    if (pos <= sim->addr_len + sim->dummy_len)
+    {
+        return 0xFF;
+    }
+
+    uint32_t index = sim->data_pos++;
+    switch (sim->op)
+    {
+    case FLASH_SIM_OP_READ: {
+        // READ is not specified above its clock limit, FAST_READ must be used
+        if (index == 0 && sim->opcode == READ_CMD && flash_sim_is_n25q(sim) &&
+            sim->byte_ns * N25Q128A_READ_MAX_FREQ < 8ULL * 1000000000ULL)
+        {
+            sim->stats.violations++;
+        }
+        // The page or block of a suspended operation holds no valid data
+        if (!sim->frame_violation && flash_sim_in_suspended(sim, (sim->addr + index) % sim->size))
+        {
+            sim->frame_violation = true;
+            sim->stats.violations++;
+        }
+        uint8_t value = sim->mem[(sim->addr + index) % sim->size];
+        sim->stats.read_bytes++;
+        return value;
+    }
+    case FLASH_SIM_OP_PROGRAM: {
+        // Column address wraps inside the page, the last 256 bytes sent are programmed
+        uint32_t column = ((sim->addr % FLASH_SIM_PAGE_SIZE) + index) % FLASH_SIM_PAGE_SIZE;
+        sim->page_buf[column] = mosi;
+        sim->page_mask[column] = 1;
+        return 0xFF;
+    }
+    case FLASH_SIM_OP_REG_OUT:
+        return flash_sim_reg_out(sim, index);
+    case FLASH_SIM_OP_SFDP:
+        return (sim->addr + index < FLASH_SIM_SFDP_SIZE) ? sim->sfdp[sim->addr + index] : 0xFF;
+    case FLASH_SIM_OP_REG_IN:
+        if (index < sizeof(sim->reg_in))
+        {
+            sim->reg_in[index] = mosi;
+        }
+        return 0xFF;
+    default:
+        return 0xFF;
+    }
+}
+
+static void flash_sim_program(flash_sim_t *sim)
+{
+    uint32_t page_base = sim->addr & ~(FLASH_SIM_PAGE_SIZE - 1);
+    bool violation = false;
+    uint32_t count = 0;
+
+    if (sim->data_pos == 0)
+    {
+        return;
+    }
+    for (uint32_t col = 0; col < FLASH_SIM_PAGE_SIZE; col++)
+    {
+        if (!sim->page_mask[col])
+        {
+            continue;
+        }
+        uint8_t *cell = &sim->mem[(page_base + col) % sim->size];
+        uint8_t value = sim->page_buf[col];
+        // NOR cells only go from 1 to 0, programming a 0 bit back to 1 requires an erase
+        if ((*cell & value) != value)
+        {
+            violation = true;
+        }
+        *cell &= value;
+        count++;
+    }
+    if (violation)
+    {
+        sim->stats.violations++;
+        if (sim->strict)
+        {
+            if (flash_sim_is_n25q(sim))
+            {
+                sim->fsr_errors |= N25Q128A_FSR_PGERR;
+            }
+            else
+            {
+                sim->scur |= FLASH_SIM_MX25_SCUR_P_FAIL;
+            }
+        }
+    }
+    sim->stats.program_ops++;
+    sim->stats.program_bytes += count;
+    if (sim->fault_interval != 0 && (sim->stats.program_ops % sim->fault_interval) == 0)
+    {
+        // Weak cell: the first programmed 0 bit of the page stays at 1, without any error flag
+        for (uint32_t col = 0; col < FLASH_SIM_PAGE_SIZE; col++)
+        {
+            uint8_t *cell = &sim->mem[(page_base + col) % sim->size];
+            if (sim->page_mask[col] && *cell != 0xFF)
+            {
+                *cell |= (uint8_t) (~*cell & -(~*cell));
+                sim->stats.injected_faults++;
+                break;
+            }
+        }
+    }
+    flash_sim_start_busy(sim, flash_sim_timing(sim).page_program_us);
+    sim->busy_kind = FLASH_SIM_BUSY_PROGRAM;
+    sim->busy_addr = page_base;
+    sim->busy_size = FLASH_SIM_PAGE_SIZE;
+}
+
+static void flash_sim_erase(flash_sim_t *sim, uint32_t addr, uint32_t size, uint32_t duration_us)
+{
+    addr &= ~(size - 1);
+    memset(&sim->mem[addr % sim->size], 0xFF, size);
+    sim->stats.erase_ops++;
+    sim->stats.erase_bytes += size;
+    if (!flash_sim_is_n25q(sim))
+    {
+        sim->scur &= ~FLASH_SIM_MX25_SCUR_E_FAIL;
+    }
+    flash_sim_start_busy(sim, duration_us);
+    // The chip erase stays FLASH_SIM_BUSY_OTHER
+    if (size < sim->size)
+    {
+        sim->busy_kind = FLASH_SIM_BUSY_ERASE;
+        sim->busy_addr = addr % sim->size;
+        sim->busy_size = size;
+    }
+}
+
+static void flash_sim_write_register(flash_sim_t *sim)
+{
+    if (sim->data_pos == 0)
+    {
+        return;
+    }
+    if (sim->opcode == WRITE_VOL_CFG_REG_CMD)
+    {
+        sim->vcr = sim->reg_in[0];
+        sim->wel = false;
+        return;
+    }
+    // Write status register, MX25 also takes configuration registers 1 and 2
+    sim->sr = sim->reg_in[0] & ~(N25Q128A_SR_WIP | N25Q128A_SR_WREN);
+    if (!flash_sim_is_n25q(sim))
+    {
+        if (sim->data_pos > 1)
+        {
+            sim->cr[0] = sim->reg_in[1];
+        }
+        if (sim->data_pos > 2)
+        {
+            sim->cr[1] = sim->reg_in[2];
+        }
+    }
+    flash_sim_start_busy(sim, flash_sim_timing(sim).write_status_us);
+}
+
+/*
+ * @brief execute the command of a completed frame (chip select released)
+ */
+static void flash_sim_execute(flash_sim_t *sim)
+{
+    flash_sim_timing_t timing = flash_sim_timing(sim);
+    bool needs_wel = (sim->op == FLASH_SIM_OP_PROGRAM || sim->op == FLASH_SIM_OP_ERASE ||
+                      sim->op == FLASH_SIM_OP_CHIP_ERASE || sim->op == FLASH_SIM_OP_REG_IN ||
+                      (sim->op == FLASH_SIM_OP_SIMPLE && (sim->opcode == FLASH_SIM_CMD_ENTER_4B_ADDR ||
+                                                          sim->opcode == FLASH_SIM_CMD_EXIT_4B_ADDR)));
+
+    if (sim->pos == 0 || sim->op_ignored)
+    {
+        return;
+    }
+    if (needs_wel && !sim->wel)
+    {
+        sim->stats.ignored_cmds++;
+        return;
+    }
+    if ((sim->op == FLASH_SIM_OP_PROGRAM || sim->op == FLASH_SIM_OP_ERASE) && sim->pos <= sim->addr_len)
+    {
+        // Frame ended before the full address was sent
+        sim->stats.ignored_cmds++;
+        return;
+    }
+
+    switch (sim->op)
+    {
+    case FLASH_SIM_OP_PROGRAM:
+        flash_sim_program(sim);
+        break;
+    case FLASH_SIM_OP_ERASE:
+        flash_sim_erase(sim, sim->addr, sim->erase_size,
+                        (sim->erase_size == 0x1000)   ? timing.erase_4k_us
+                        : (sim->erase_size == 0x8000) ? timing.erase_32k_us
+                                                      : timing.erase_64k_us);
+        break;
+    case FLASH_SIM_OP_CHIP_ERASE:
+        flash_sim_erase(sim, 0, sim->size, timing.erase_chip_us);
+        break;
+    case FLASH_SIM_OP_REG_IN:
+        flash_sim_write_register(sim);
+        break;
+    case FLASH_SIM_OP_SIMPLE:
+        switch (sim->opcode)
+        {
+        case WRITE_ENABLE_CMD:
+            sim->wel = true;
+            break;
+        case WRITE_DISABLE_CMD:
+            sim->wel = false;
+            break;
+        case PROG_ERASE_SUSPEND_CMD:
+            flash_sim_suspend(sim);
+            break;
+        case PROG_ERASE_RESUME_CMD:
+            flash_sim_resume(sim);
+            break;
+        case CLEAR_FLAG_STATUS_REG_CMD:
+            sim->fsr_errors = 0;
+            break;
+        case FLASH_SIM_CMD_ENTER_4B_ADDR:
+            sim->addr_4byte = true;
+            sim->wel = false;
+            break;
+        case FLASH_SIM_CMD_EXIT_4B_ADDR:
+            sim->addr_4byte = false;
+            sim->wel = false;
+            break;
+        case MX25Series_Command_DP:
+            sim->deep_power_down = true;
+            break;
+        default:
+            break;
+        }
+        break;
+    case FLASH_SIM_OP_REG_OUT:
+        if (sim->opcode == MX25Series_Command_RES)
+        {
+            sim->deep_power_down = false;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void flash_sim_select(flash_sim_t *sim, bool selected)
+{
+    if (selected == sim->selected)
+    {
+        return;
+    }
+    sim->selected = selected;
+    if (selected)
+    {
+        sim->stats.frames++;
+        sim->pos = 0;
+        sim->data_pos = 0;
+        sim->addr = 0;
+        sim->op = FLASH_SIM_OP_NONE;
+        sim->op_ignored = false;
+        sim->frame_violation = false;
+    }
+    else
+    {
+        flash_sim_execute(sim);
+    }
+}
+
+bool flash_sim_is_busy(flash_sim_t *sim)
+{
+    flash_sim_update(sim);
+    return sim->busy;
+}
+
+void flash_sim_account_bus(flash_sim_t *sim, uint64_t ns)
+{
+    sim->stats.bus_ns += ns;
+    sim->byte_ns = ns;
+}
+
+flash_sim_t *flash_sim_create(flash_sim_part_t part, const char *image_path)
+{
+    flash_sim_t *sim = calloc(1, sizeof(flash_sim_t));
+    if (sim == NULL)
+    {
+        return NULL;
+    }
+    sim->part = part;
+    sim->fd = -1;
+    sim->timing_scale = 100;
+    switch (part)
+    {
+    case FLASH_SIM_N25Q128A:
+        sim->size = N25Q128A_FLASH_SIZE;
+        break;
+    case FLASH_SIM_N25Q256A:
+        sim->size = 2 * N25Q128A_FLASH_SIZE;
+        break;
+    case FLASH_SIM_MX25R6435F:
+    default:
+        sim->size = MX25R6435F_MEMORY_SIZE;
+        break;
+    }
+    flash_sim_build_sfdp(sim);
+
+    if (image_path == NULL)
+    {
+        sim->mem = mmap(NULL, sim->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (sim->mem == MAP_FAILED)
+        {
+            free(sim);
+            return NULL;
+        }
+        memset(sim->mem, 0xFF, sim->size);
+        return sim;
+    }
+
+    sim->fd = open(image_path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (sim->fd < 0 || fstat(sim->fd, &st) != 0)
+    {
+        perror(image_path);
+        free(sim);
+        return NULL;
+    }
+    uint32_t old_size = (st.st_size < sim->size) ? (uint32_t) st.st_size : sim->size;
+    if (st.st_size < sim->size && ftruncate(sim->fd, sim->size) != 0)
+    {
+        perror(image_path);
+        close(sim->fd);
+        free(sim);
+        return NULL;
+    }
+    sim->mem = mmap(NULL, sim->size, PROT_READ | PROT_WRITE, MAP_SHARED, sim->fd, 0);
+    if (sim->mem == MAP_FAILED)
+    {
+        perror(image_path);
+        close(sim->fd);
+        free(sim);
+        return NULL;
+    }
+    // Grown part of the image is erased flash
+    memset(sim->mem + old_size, 0xFF, sim->size - old_size);
+    return sim;
+}
+
+void flash_sim_destroy(flash_sim_t *sim)
+{
+    if (sim == NULL)
+    {
+        return;
+    }
+    munmap(sim->mem, sim->size);
+    if (sim->fd >= 0)
+    {
+        close(sim->fd);
+    }
+    free(sim);
+}
+
+uint8_t *flash_sim_memory(flash_sim_t *sim)
+{
+    return sim->mem;
+}
+
+uint32_t flash_sim_size(const flash_sim_t *sim)
+{
+    return sim->size;
+}
+
+const char *flash_sim_name(const flash_sim_t *sim)
+{
+    switch (sim->part)
+    {
+    case FLASH_SIM_N25Q128A:
+        return "N25Q128A";
+    case FLASH_SIM_N25Q256A:
+        return "N25Q256A";
+    default:
+        return "MX25R6435F";
+    }
+}
+
+const flash_sim_stats_t *flash_sim_stats(const flash_sim_t *sim)
+{
+    return &sim->stats;
+}
+
+void flash_sim_reset_stats(flash_sim_t *sim)
+{
+    memset(&sim->stats, 0, sizeof(sim->stats));
+}
+
+void flash_sim_set_timing_scale(flash_sim_t *sim, uint32_t percent)
+{
+    sim->timing_scale = percent;
+}
+
+void flash_sim_set_strict(flash_sim_t *sim, bool strict)
+{
+    sim->strict = strict;
+}
+
+void flash_sim_set_program_faults(flash_sim_t *sim, uint32_t interval)
+{
+    sim->fault_interval = interval;
+}
+
+void flash_sim_power_loss(flash_sim_t *sim)
+{
+    flash_sim_update(sim);
+    if (sim->busy || sim->suspended)
+    {
+        uint8_t *half = &sim->mem[sim->busy_addr + sim->busy_size / 2];
+        for (uint32_t i = 0; i < sim->busy_size / 2; i++)
+        {
+            if (sim->busy_kind == FLASH_SIM_BUSY_PROGRAM && sim->page_mask[FLASH_SIM_PAGE_SIZE / 2 + i])
+            {
+                half[i] |= (uint8_t) ~sim->page_buf[FLASH_SIM_PAGE_SIZE / 2 + i];
+            }
+            else if (sim->busy_kind == FLASH_SIM_BUSY_ERASE)
+            {
+                half[i] = (uint8_t) (0xA5 ^ i);
+            }
+        }
+    }
+    sim->busy = false;
+    sim->suspending = false;
+    sim->suspended = false;
+    sim->wel = false;
+    sim->addr_4byte = false;
+    sim->deep_power_down = false;
+}
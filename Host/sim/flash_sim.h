@@ -0,0 +1,107 @@
+/*******************************************************************************
+ * Title                 :   SPI NOR flash simulator
+ * Filename              :   flash_sim.h
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host build only
+ *******************************************************************************/
+
+/** \file flash_sim.h
+ *  \brief Software model of the N25Q128A/N25Q256A and MX25R6435F SPI NOR flash
+ *
+ *  The model decodes the SPI command stream of one chip select frame at a time
+ *  and keeps the array in an mmap'ed image file. It enforces write enable
+ *  latch, erase-before-program, page wrap and busy (WIP) semantics, and keeps
+ *  the array busy for the datasheet program/erase times against the simulated
+ *  clock of hal_sim.c. Program/erase suspend takes the suspend latency, the
+ *  suspended page or block cannot be read. RDSFDP returns a JESD216B table
+ *  matching the model.
+ */
+#ifndef FLASH_SIM_H_
+#define FLASH_SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    FLASH_SIM_N25Q128A = 0,  // 16MB, Micron command set
+    FLASH_SIM_N25Q256A,      // 32MB, Micron command set with 4-byte address mode
+    FLASH_SIM_MX25R6435F,    // 8MB, Macronix command set, Low Power / High Performance timing
+} flash_sim_part_t;
+
+typedef struct
+{
+    uint64_t frames;            // SPI transactions (chip select cycles)
+    uint64_t bytes;             // Bytes clocked while selected
+    uint64_t bus_ns;            // Time spent clocking bytes
+    uint64_t busy_ns;           // Time the array spent programming or erasing
+    uint64_t program_ops;       // Page program commands executed
+    uint64_t program_bytes;     // Bytes programmed
+    uint64_t erase_ops;         // Erase commands executed (any size)
+    uint64_t erase_bytes;       // Bytes erased
+    uint64_t read_cmds;         // Array read commands
+    uint64_t read_bytes;        // Bytes read from the array
+    uint64_t busy_polls;        // Status register bytes read while the array was busy
+    uint64_t ignored_cmds;      // Commands ignored (no WEL, busy, unsupported)
+    uint64_t violations;        // Erase-before-program violations, accesses while busy or to a suspended block,
+                                // READ above its clock limit
+    uint64_t injected_faults;   // Bits left unprogrammed by flash_sim_set_program_faults()
+} flash_sim_stats_t;
+
+typedef struct flash_sim flash_sim_t;
+
+/**
+ * @brief create a flash model
+ * @param part: simulated part
+ * @param image_path: backing image file, created (erased) if missing. NULL for an anonymous erased array
+ * @return model handle, NULL on error
+ */
+flash_sim_t *flash_sim_create(flash_sim_part_t part, const char *image_path);
+void flash_sim_destroy(flash_sim_t *sim);
+
+uint8_t *flash_sim_memory(flash_sim_t *sim);
+uint32_t flash_sim_size(const flash_sim_t *sim);
+const char *flash_sim_name(const flash_sim_t *sim);
+
+const flash_sim_stats_t *flash_sim_stats(const flash_sim_t *sim);
+void flash_sim_reset_stats(flash_sim_t *sim);
+
+/**
+ * @brief scale the datasheet maximum program/erase times, e.g. 20 to model typical parts
+ * @param percent: 100 uses the maximum times
+ */
+void flash_sim_set_timing_scale(flash_sim_t *sim, uint32_t percent);
+
+/**
+ * @brief strict mode reports erase-before-program violations through the error flags
+ *        (N25Q flag status PGERR, MX25 security register P_FAIL) on top of counting them
+ */
+void flash_sim_set_strict(flash_sim_t *sim, bool strict);
+
+/**
+ * @brief silent program faults: every interval-th page program leaves one bit at 1 without setting
+ *        any error flag, as a weak cell would. 0 disables the faults.
+ */
+void flash_sim_set_program_faults(flash_sim_t *sim, uint32_t interval);
+
+/**
+ * @brief power loss: the program or erase in flight stops halfway, the second half of its page or block is left
+ *        with its bits not yet programmed (still 1) or not yet erased (a mix of the old data and 0 bits)
+ */
+void flash_sim_power_loss(flash_sim_t *sim);
+
+/* Bus interface, driven by hal_sim.c */
+void flash_sim_select(flash_sim_t *sim, bool selected);
+uint8_t flash_sim_transfer(flash_sim_t *sim, uint8_t mosi);
+bool flash_sim_is_busy(flash_sim_t *sim);
+void flash_sim_account_bus(flash_sim_t *sim, uint64_t ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLASH_SIM_H_ */
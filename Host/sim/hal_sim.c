@@ -0,0 +1,407 @@
+/*******************************************************************************
+ * Title                 :   Host HAL simulation
+ * Filename              :   hal_sim.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host build only
+ *******************************************************************************/
+
+/** \file hal_sim.c
+ *  \brief GPIO/SPI/DMA/tick implementation of the host HAL shim
+ *
+ *  SPI DMA transfers run to completion inside the HAL_SPI_xxx_DMA() call: they
+ *  cost the DMA setup and the SCK time of the bytes but no per-byte CPU time,
+ *  and the CPU work that would overlap them on the target is not credited.
+ */
+/******************************************************************************
+ * Includes
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal_sim.h"
+#include "main.h"
+
+/******************************************************************************
+ * Module Preprocessor Constants
+ *******************************************************************************/
+#define HAL_SIM_MAX_DEVICES             (4)
+#define HAL_SIM_HCLK_HZ                 (32000000)
+#define HAL_SIM_SYSTICK_ACCESS_NS       (125)   // ~4 cycles @ 32MHz HCLK per SysTick register access
+
+/******************************************************************************
+ * Module Typedefs
+ *******************************************************************************/
+typedef struct
+{
+    SPI_HandleTypeDef *hspi;
+    GPIO_TypeDef *cs_port;
+    uint16_t cs_pin;
+    bool selected;
+    flash_sim_t *flash;
+} hal_sim_device_t;
+
+/******************************************************************************
+ * Module Variable Definitions
+ *******************************************************************************/
+GPIO_TypeDef hal_sim_gpio_ports[6] = {{0}, {1}, {2}, {3}, {4}, {5}};
+SPI_TypeDef hal_sim_spi_instances[2] = {{1}, {2}};
+DMA_Channel_TypeDef hal_sim_dma_channels[7] = {{1}, {2}, {3}, {4}, {5}, {6}, {7}};
+
+static const hal_sim_config_t hal_sim_default_config = {
+    .pclk_hz = 32000000,
+    .spi_call_overhead_ns = 4000,   // ~130 cycles @ 32MHz HCLK for HAL_SPI_Transmit/Receive entry/exit
+    .spi_cpu_byte_ns = 1000,        // ~32 cycles @ 32MHz HCLK per byte of the polled HAL loop
+    .gpio_overhead_ns = 500,
+    .crc_cpu_byte_ns = 250,         // ~8 cycles @ 32MHz HCLK per byte for the slice-by-4 kernel
+    .dma_overhead_ns = 6000,        // ~190 cycles @ 32MHz HCLK for HAL_DMA_Start_IT(), SPI enable and the TC interrupt
+};
+
+static hal_sim_config_t hal_sim_cfg;
+static uint64_t hal_sim_time_ns;
+static uint64_t hal_sim_sleep_time_ns;
+static hal_sim_device_t hal_sim_devices[HAL_SIM_MAX_DEVICES];
+static uint32_t hal_sim_device_count;
+static uint64_t hal_sim_power_cut_ns;
+static void (*hal_sim_power_cut_handler)(void);
+
+/******************************************************************************
+ * Function Definitions
+ *******************************************************************************/
+void hal_sim_init(const hal_sim_config_t *cfg)
+{
+    hal_sim_cfg = (cfg != NULL) ? *cfg : hal_sim_default_config;
+    hal_sim_time_ns = 0;
+    hal_sim_sleep_time_ns = 0;
+    hal_sim_device_count = 0;
+    hal_sim_power_cut_handler = NULL;
+    memset(hal_sim_devices, 0, sizeof(hal_sim_devices));
+}
+
+const hal_sim_config_t *hal_sim_config(void)
+{
+    if (hal_sim_cfg.pclk_hz == 0)
+    {
+        hal_sim_init(NULL);
+    }
+    return &hal_sim_cfg;
+}
+
+uint64_t hal_sim_now_ns(void)
+{
+    return hal_sim_time_ns;
+}
+
+void hal_sim_advance_ns(uint64_t ns)
+{
+    hal_sim_time_ns += ns;
+}
+
+uint64_t hal_sim_sleep_ns(void)
+{
+    return hal_sim_sleep_time_ns;
+}
+
+int hal_sim_attach_flash(SPI_HandleTypeDef *hspi, GPIO_TypeDef *cs_port, uint16_t cs_pin, flash_sim_t *flash)
+{
+    if (hal_sim_device_count >= HAL_SIM_MAX_DEVICES || hspi == NULL || flash == NULL)
+    {
+        return -1;
+    }
+    hal_sim_devices[hal_sim_device_count++] = (hal_sim_device_t){
+        .hspi = hspi, .cs_port = cs_port, .cs_pin = cs_pin, .selected = false, .flash = flash};
+    return 0;
+}
+
+uint32_t hal_sim_spi_clock_hz(const SPI_HandleTypeDef *hspi)
+{
+    uint32_t prescaler_shift = ((hspi->Init.BaudRatePrescaler >> SPI_CR1_BR_Pos) & 0x7) + 1;
+    return hal_sim_config()->pclk_hz >> prescaler_shift;
+}
+
+static hal_sim_device_t *hal_sim_selected_device(SPI_HandleTypeDef *hspi)
+{
+    for (uint32_t i = 0; i < hal_sim_device_count; i++)
+    {
+        if (hal_sim_devices[i].hspi == hspi && hal_sim_devices[i].selected)
+        {
+            return &hal_sim_devices[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * @brief clock one byte on the bus, the slower of the SCK and the CPU (0 for DMA) sets the pace
+ */
+static uint8_t hal_sim_spi_byte(SPI_HandleTypeDef *hspi, hal_sim_device_t *dev, uint8_t mosi, uint32_t cpu_byte_ns)
+{
+    uint64_t sck_ns = 8ULL * 1000000000ULL / hal_sim_spi_clock_hz(hspi);
+    uint64_t byte_ns = (sck_ns > cpu_byte_ns) ? sck_ns : cpu_byte_ns;
+    hal_sim_time_ns += byte_ns;
+    if (dev == NULL)
+    {
+        return 0xFF;
+    }
+    flash_sim_account_bus(dev->flash, sck_ns);
+    uint8_t miso = flash_sim_transfer(dev->flash, mosi);
+    if (hal_sim_cfg.spi_max_hz != 0 && hal_sim_spi_clock_hz(hspi) > hal_sim_cfg.spi_max_hz)
+    {
+        // Bits arrive one SCK edge late, the last bit of the previous byte is lost
+        miso = (uint8_t) ((miso >> 1) | 0x80);
+    }
+    return miso;
+}
+
+/* ====================== GPIO ====================== */
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+    (void) GPIOx;
+    (void) GPIO_Init;
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin)
+{
+    (void) GPIOx;
+    (void) GPIO_Pin;
+}
+
+void hal_sim_set_power_cut(uint64_t at_ns, void (*handler)(void))
+{
+    hal_sim_power_cut_ns = at_ns;
+    hal_sim_power_cut_handler = handler;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    hal_sim_time_ns += hal_sim_config()->gpio_overhead_ns;
+    if (hal_sim_power_cut_handler != NULL && hal_sim_time_ns >= hal_sim_power_cut_ns)
+    {
+        void (*handler)(void) = hal_sim_power_cut_handler;
+        hal_sim_power_cut_handler = NULL;
+        for (uint32_t i = 0; i < hal_sim_device_count; i++)
+        {
+            hal_sim_devices[i].selected = false;
+            flash_sim_power_loss(hal_sim_devices[i].flash);
+        }
+        handler();
+    }
+    for (uint32_t i = 0; i < hal_sim_device_count; i++)
+    {
+        hal_sim_device_t *dev = &hal_sim_devices[i];
+        if (dev->cs_port == GPIOx && (dev->cs_pin & GPIO_Pin))
+        {
+            bool select = (PinState == GPIO_PIN_RESET);
+            if (select != dev->selected)
+            {
+                dev->selected = select;
+                flash_sim_select(dev->flash, select);
+            }
+        }
+    }
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    for (uint32_t i = 0; i < hal_sim_device_count; i++)
+    {
+        if (hal_sim_devices[i].cs_port == GPIOx && (hal_sim_devices[i].cs_pin & GPIO_Pin))
+        {
+            return hal_sim_devices[i].selected ? GPIO_PIN_RESET : GPIO_PIN_SET;
+        }
+    }
+    return GPIO_PIN_RESET;
+}
+
+/* ====================== SPI ====================== */
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == NULL)
+    {
+        return HAL_ERROR;
+    }
+    HAL_SPI_MspInit(hspi);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == NULL)
+    {
+        return HAL_ERROR;
+    }
+    HAL_SPI_MspDeInit(hspi);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void) Timeout;
+    hal_sim_device_t *dev = hal_sim_selected_device(hspi);
+    hal_sim_time_ns += hal_sim_config()->spi_call_overhead_ns;
+    for (uint16_t i = 0; i < Size; i++)
+    {
+        hal_sim_spi_byte(hspi, dev, pData[i], hal_sim_config()->spi_cpu_byte_ns);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void) Timeout;
+    hal_sim_device_t *dev = hal_sim_selected_device(hspi);
+    hal_sim_time_ns += hal_sim_config()->spi_call_overhead_ns;
+    for (uint16_t i = 0; i < Size; i++)
+    {
+        pData[i] = hal_sim_spi_byte(hspi, dev, 0xFF, hal_sim_config()->spi_cpu_byte_ns);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size,
+                                          uint32_t Timeout)
+{
+    (void) Timeout;
+    hal_sim_device_t *dev = hal_sim_selected_device(hspi);
+    hal_sim_time_ns += hal_sim_config()->spi_call_overhead_ns;
+    for (uint16_t i = 0; i < Size; i++)
+    {
+        pRxData[i] = hal_sim_spi_byte(hspi, dev, pTxData[i], hal_sim_config()->spi_cpu_byte_ns);
+    }
+    return HAL_OK;
+}
+
+/* ====================== SPI DMA ====================== */
+__attribute__((weak)) void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    (void) hspi;
+}
+
+__attribute__((weak)) void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    (void) hspi;
+}
+
+__attribute__((weak)) void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    (void) hspi;
+}
+
+__attribute__((weak)) void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+    (void) hspi;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+    return (hdma == NULL) ? HAL_ERROR : HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma)
+{
+    return (hdma == NULL) ? HAL_ERROR : HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma)
+{
+    (void) hdma;
+}
+
+/*
+ * @brief run a DMA transfer to completion, pTxData NULL clocks out dummy bytes, pRxData NULL drops the MISO bytes
+ */
+static HAL_StatusTypeDef hal_sim_spi_dma(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+    if (hspi == NULL || Size == 0 || hspi->hdmatx == NULL || (pRxData != NULL && hspi->hdmarx == NULL))
+    {
+        return HAL_ERROR;
+    }
+    hal_sim_device_t *dev = hal_sim_selected_device(hspi);
+    hal_sim_time_ns += hal_sim_config()->dma_overhead_ns;
+    for (uint16_t i = 0; i < Size; i++)
+    {
+        uint8_t miso = hal_sim_spi_byte(hspi, dev, (pTxData != NULL) ? pTxData[i] : 0xFF, 0);
+        if (pRxData != NULL)
+        {
+            pRxData[i] = miso;
+        }
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+    if (hal_sim_spi_dma(hspi, pData, NULL, Size) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+    HAL_SPI_TxCpltCallback(hspi);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+    if (hal_sim_spi_dma(hspi, NULL, pData, Size) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+    HAL_SPI_RxCpltCallback(hspi);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData,
+                                              uint16_t Size)
+{
+    if (hal_sim_spi_dma(hspi, pTxData, pRxData, Size) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+    HAL_SPI_TxRxCpltCallback(hspi);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi)
+{
+    return (hspi == NULL) ? HAL_ERROR : HAL_OK;
+}
+
+/* ====================== RCC / Tick ====================== */
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+    return hal_sim_config()->pclk_hz;
+}
+
+uint32_t HAL_GetTick(void)
+{
+    return (uint32_t) (hal_sim_time_ns / 1000000ULL);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+    hal_sim_time_ns += (uint64_t) Delay * 1000000ULL;
+}
+
+SysTick_Type *hal_sim_systick(void)
+{
+    static SysTick_Type systick;
+    hal_sim_time_ns += HAL_SIM_SYSTICK_ACCESS_NS;
+    systick.LOAD = HAL_SIM_HCLK_HZ / 1000 - 1;
+    systick.VAL = systick.LOAD - (uint32_t) ((hal_sim_time_ns % 1000000ULL) * (systick.LOAD + 1) / 1000000ULL);
+    return &systick;
+}
+
+/* ====================== PWR ====================== */
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry)
+{
+    (void) Regulator;
+    (void) SLEEPEntry;
+    uint64_t sleep_ns = 1000000ULL - hal_sim_time_ns % 1000000ULL;
+    hal_sim_time_ns += sleep_ns;
+    hal_sim_sleep_time_ns += sleep_ns;
+}
+
+void Error_Handler(void)
+{
+    fprintf(stderr, "Error_Handler() called\n");
+    abort();
+}
@@ -0,0 +1,71 @@
+/*******************************************************************************
+ * Title                 :   Host HAL simulation
+ * Filename              :   hal_sim.h
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host build only
+ *******************************************************************************/
+
+/** \file hal_sim.h
+ *  \brief Simulated clock and SPI buses behind the host HAL shim
+ *
+ *  Every HAL call advances a simulated clock by a CPU cost, and every SPI byte
+ *  by its transfer time at the configured prescaler, so driver code can be
+ *  timed as it would run on the STM32G070.
+ */
+#ifndef HAL_SIM_H_
+#define HAL_SIM_H_
+
+#include <stdint.h>
+
+#include "flash_sim.h"
+#include "stm32g0xx_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint32_t pclk_hz;               // SPI kernel clock (PCLK1)
+    uint32_t spi_call_overhead_ns;  // CPU cost of one HAL_SPI_xxx() call
+    uint32_t spi_cpu_byte_ns;       // CPU cost per byte of the polled HAL transfer loop
+    uint32_t gpio_overhead_ns;      // CPU cost of one HAL_GPIO_WritePin()
+    uint32_t crc_cpu_byte_ns;       // CPU cost per byte of crc32()/crc32_update(), charged by dfu_profile.c
+    uint32_t dma_overhead_ns;       // CPU cost of one HAL_SPI_xxx_DMA() call and its completion interrupt
+    uint32_t spi_max_hz;            // Fastest SCK the board traces carry, MISO is sampled late above it (0: no limit)
+} hal_sim_config_t;
+
+/**
+ * @brief reset the simulated clock and detach all devices
+ * @param cfg: bus/CPU cost model, NULL for the STM32G070 @ 64MHz SYSCLK / 32MHz PCLK defaults
+ */
+void hal_sim_init(const hal_sim_config_t *cfg);
+const hal_sim_config_t *hal_sim_config(void);
+
+uint64_t hal_sim_now_ns(void);
+void hal_sim_advance_ns(uint64_t ns);
+/* Time spent in HAL_PWR_EnterSLEEPMode() since hal_sim_init() */
+uint64_t hal_sim_sleep_ns(void);
+
+/**
+ * @brief attach a flash model to a SPI bus, selected by a GPIO pin (active low)
+ * @return 0 on success, negative value otherwise
+ */
+int hal_sim_attach_flash(SPI_HandleTypeDef *hspi, GPIO_TypeDef *cs_port, uint16_t cs_pin, flash_sim_t *flash);
+
+/**
+ * @brief SCK frequency currently configured on a bus
+ */
+uint32_t hal_sim_spi_clock_hz(const SPI_HandleTypeDef *hspi);
+
+/**
+ * @brief cut the power of the attached flash models at the first chip select change at or after at_ns
+ *        (flash_sim_power_loss()), then call handler, which does not return (longjmp() out of the code under test)
+ */
+void hal_sim_set_power_cut(uint64_t at_ns, void (*handler)(void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_SIM_H_ */
@@ -0,0 +1,278 @@
+/*******************************************************************************
+ * Title                 :   Host HAL shim
+ * Filename              :   stm32g0xx_hal.h
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host build only, shadows the STM32G0 HAL header
+ *******************************************************************************/
+
+/** \file stm32g0xx_hal.h
+ *  \brief Minimal subset of the STM32G0 HAL used by the flash drivers
+ *
+ *  Included through Core/Inc/main.h when building on Linux. GPIO, SPI and SPI
+ *  DMA calls are routed to hal_sim.c, which drives the flash models of flash_sim.c and
+ *  keeps a simulated clock for HAL_GetTick()/HAL_Delay().
+ */
+#ifndef STM32G0XX_HAL_H
+#define STM32G0XX_HAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __IO volatile
+
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY                   (0xFFFFFFFFU)
+
+/* ====================== GPIO ====================== */
+typedef struct
+{
+    uint32_t port_index;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef hal_sim_gpio_ports[6];
+#define GPIOA                           (&hal_sim_gpio_ports[0])
+#define GPIOB                           (&hal_sim_gpio_ports[1])
+#define GPIOC                           (&hal_sim_gpio_ports[2])
+#define GPIOD                           (&hal_sim_gpio_ports[3])
+#define GPIOE                           (&hal_sim_gpio_ports[4])
+#define GPIOF                           (&hal_sim_gpio_ports[5])
+
+#define GPIO_PIN_0                      ((uint16_t) 0x0001)
+#define GPIO_PIN_1                      ((uint16_t) 0x0002)
+#define GPIO_PIN_2                      ((uint16_t) 0x0004)
+#define GPIO_PIN_3                      ((uint16_t) 0x0008)
+#define GPIO_PIN_4                      ((uint16_t) 0x0010)
+#define GPIO_PIN_5                      ((uint16_t) 0x0020)
+#define GPIO_PIN_6                      ((uint16_t) 0x0040)
+#define GPIO_PIN_7                      ((uint16_t) 0x0080)
+#define GPIO_PIN_8                      ((uint16_t) 0x0100)
+#define GPIO_PIN_9                      ((uint16_t) 0x0200)
+#define GPIO_PIN_10                     ((uint16_t) 0x0400)
+#define GPIO_PIN_11                     ((uint16_t) 0x0800)
+#define GPIO_PIN_12                     ((uint16_t) 0x1000)
+#define GPIO_PIN_13                     ((uint16_t) 0x2000)
+#define GPIO_PIN_14                     ((uint16_t) 0x4000)
+#define GPIO_PIN_15                     ((uint16_t) 0x8000)
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0U,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_MODE_INPUT                 (0x00000000U)
+#define GPIO_MODE_OUTPUT_PP             (0x00000001U)
+#define GPIO_MODE_AF_PP                 (0x00000002U)
+#define GPIO_MODE_ANALOG                (0x00000003U)
+#define GPIO_NOPULL                     (0x00000000U)
+#define GPIO_SPEED_FREQ_LOW             (0x00000000U)
+#define GPIO_SPEED_FREQ_VERY_HIGH       (0x00000003U)
+#define GPIO_AF0_SPI1                   ((uint8_t) 0x00)
+#define GPIO_AF0_SPI2                   ((uint8_t) 0x00)
+#define GPIO_AF1_SPI2                   ((uint8_t) 0x01)
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+/* ====================== DMA ====================== */
+typedef struct
+{
+    uint32_t channel_index;
+} DMA_Channel_TypeDef;
+
+extern DMA_Channel_TypeDef hal_sim_dma_channels[7];
+#define DMA1_Channel1                   (&hal_sim_dma_channels[0])
+#define DMA1_Channel2                   (&hal_sim_dma_channels[1])
+#define DMA1_Channel3                   (&hal_sim_dma_channels[2])
+#define DMA1_Channel4                   (&hal_sim_dma_channels[3])
+#define DMA1_Channel5                   (&hal_sim_dma_channels[4])
+#define DMA1_Channel6                   (&hal_sim_dma_channels[5])
+#define DMA1_Channel7                   (&hal_sim_dma_channels[6])
+
+#define DMA_REQUEST_SPI1_RX             (16U)
+#define DMA_REQUEST_SPI1_TX             (17U)
+#define DMA_REQUEST_SPI2_RX             (18U)
+#define DMA_REQUEST_SPI2_TX             (19U)
+#define DMA_PERIPH_TO_MEMORY            (0x00000000U)
+#define DMA_MEMORY_TO_PERIPH            (0x00000010U)
+#define DMA_PINC_DISABLE                (0x00000000U)
+#define DMA_MINC_ENABLE                 (0x00000080U)
+#define DMA_PDATAALIGN_BYTE             (0x00000000U)
+#define DMA_MDATAALIGN_BYTE             (0x00000000U)
+#define DMA_NORMAL                      (0x00000000U)
+#define DMA_PRIORITY_LOW                (0x00000000U)
+#define DMA_PRIORITY_MEDIUM             (0x00001000U)
+#define DMA_PRIORITY_HIGH               (0x00002000U)
+#define DMA_PRIORITY_VERY_HIGH          (0x00003000U)
+
+typedef struct
+{
+    uint32_t Request;
+    uint32_t Direction;
+    uint32_t PeriphInc;
+    uint32_t MemInc;
+    uint32_t PeriphDataAlignment;
+    uint32_t MemDataAlignment;
+    uint32_t Mode;
+    uint32_t Priority;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef
+{
+    DMA_Channel_TypeDef *Instance;
+    DMA_InitTypeDef Init;
+    void *Parent;
+} DMA_HandleTypeDef;
+
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__) \
+    do                                                             \
+    {                                                              \
+        (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__);       \
+        (__DMA_HANDLE__).Parent = (__HANDLE__);                    \
+    } while (0)
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+/* ====================== SPI ====================== */
+typedef struct
+{
+    uint32_t instance_index;
+} SPI_TypeDef;
+
+extern SPI_TypeDef hal_sim_spi_instances[2];
+#define SPI1                            (&hal_sim_spi_instances[0])
+#define SPI2                            (&hal_sim_spi_instances[1])
+
+#define SPI_CR1_BR_Pos                  (3U)
+#define SPI_BAUDRATEPRESCALER_2         (0x00000000U)
+#define SPI_BAUDRATEPRESCALER_4         (0x00000008U)
+#define SPI_BAUDRATEPRESCALER_8         (0x00000010U)
+#define SPI_BAUDRATEPRESCALER_16        (0x00000018U)
+#define SPI_BAUDRATEPRESCALER_32        (0x00000020U)
+#define SPI_BAUDRATEPRESCALER_64        (0x00000028U)
+#define SPI_BAUDRATEPRESCALER_128       (0x00000030U)
+#define SPI_BAUDRATEPRESCALER_256       (0x00000038U)
+
+#define SPI_MODE_MASTER                 (0x00000104U)
+#define SPI_DIRECTION_2LINES            (0x00000000U)
+#define SPI_DATASIZE_8BIT               (0x00000700U)
+#define SPI_POLARITY_LOW                (0x00000000U)
+#define SPI_PHASE_1EDGE                 (0x00000000U)
+#define SPI_NSS_SOFT                    (0x00000200U)
+#define SPI_FIRSTBIT_MSB                (0x00000000U)
+#define SPI_TIMODE_DISABLE              (0x00000000U)
+#define SPI_CRCCALCULATION_DISABLE      (0x00000000U)
+#define SPI_CRC_LENGTH_DATASIZE         (0x00000000U)
+#define SPI_NSS_PULSE_DISABLE           (0x00000000U)
+
+typedef struct
+{
+    uint32_t Mode;
+    uint32_t Direction;
+    uint32_t DataSize;
+    uint32_t CLKPolarity;
+    uint32_t CLKPhase;
+    uint32_t NSS;
+    uint32_t BaudRatePrescaler;
+    uint32_t FirstBit;
+    uint32_t TIMode;
+    uint32_t CRCCalculation;
+    uint32_t CRCPolynomial;
+    uint32_t CRCLength;
+    uint32_t NSSPMode;
+} SPI_InitTypeDef;
+
+typedef struct __SPI_HandleTypeDef
+{
+    SPI_TypeDef *Instance;
+    SPI_InitTypeDef Init;
+    DMA_HandleTypeDef *hdmatx;
+    DMA_HandleTypeDef *hdmarx;
+} SPI_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi);
+void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi);
+void HAL_SPI_MspDeInit(SPI_HandleTypeDef *hspi);
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size,
+                                          uint32_t Timeout);
+
+/* DMA transfers complete before returning, the completion callbacks are called from the call */
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData,
+                                              uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
+
+/* ====================== RCC / Tick ====================== */
+#define __HAL_RCC_GPIOA_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_SPI1_CLK_ENABLE()     do { } while (0)
+#define __HAL_RCC_SPI2_CLK_ENABLE()     do { } while (0)
+#define __HAL_RCC_SPI1_CLK_DISABLE()    do { } while (0)
+#define __HAL_RCC_SPI2_CLK_DISABLE()    do { } while (0)
+#define __HAL_RCC_DMA1_CLK_ENABLE()     do { } while (0)
+
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+/* SysTick reloaded every millisecond as set up by HAL_InitTick(), every access reads the simulated clock */
+typedef struct
+{
+    uint32_t CTRL;
+    uint32_t LOAD;
+    uint32_t VAL;
+    uint32_t CALIB;
+} SysTick_Type;
+
+SysTick_Type *hal_sim_systick(void);
+#define SysTick                         (hal_sim_systick())
+
+/* ====================== PWR ====================== */
+#define PWR_MAINREGULATOR_ON            (0x00000000U)
+#define PWR_LOWPOWERREGULATOR_ON        (0x00004000U)
+#define PWR_SLEEPENTRY_WFI              ((uint8_t) 0x01)
+#define PWR_SLEEPENTRY_WFE              ((uint8_t) 0x02)
+
+/* Sleeps until the next SysTick interrupt, the only wakeup source simulated */
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STM32G0XX_HAL_H */
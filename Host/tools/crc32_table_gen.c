@@ -0,0 +1,94 @@
+/*******************************************************************************
+ * Title                 :   CRC32 table generator
+ * Filename              :   crc32_table_gen.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host tool, generates Core/Src/crc32_table.h
+ *******************************************************************************/
+
+/** \file crc32_table_gen.c
+ *  \brief Generate the constant lookup tables used by the CRC32 kernels
+ *
+ *  Usage: crc32_table_gen <output header>
+ *  Writes the nibble table and 8 slicing tables for the reflected CRC-32
+ *  polynomial 0xEDB88320. crc32.c only compiles in the rows needed by the
+ *  selected CRC32_KERNEL.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#define CRC32_POLY          (0xEDB88320UL)
+#define CRC32_SLICE_ROWS    (8)
+
+static uint32_t crc32_gen_bits(uint32_t r, int bits)
+{
+    for (int j = 0; j < bits; ++j)
+    {
+        r = (r & 1) ? (r >> 1) ^ CRC32_POLY : (r >> 1);
+    }
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    static uint32_t table[CRC32_SLICE_ROWS][256];
+    FILE *out = stdout;
+
+    if (argc > 1)
+    {
+        out = fopen(argv[1], "wb");
+        if (out == NULL)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        table[0][i] = crc32_gen_bits(i, 8);
+    }
+    for (int row = 1; row < CRC32_SLICE_ROWS; row++)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            table[row][i] = (table[row - 1][i] >> 8) ^ table[0][table[row - 1][i] & 0xFF];
+        }
+    }
+
+    fprintf(out, "/* Generated by Host/tools/crc32_table_gen.c, do not edit */\n");
+    fprintf(out, "/* CRC-32 (IEEE 802.3), reflected polynomial 0x%08lX */\n\n", CRC32_POLY);
+    fprintf(out, "#if (CRC32_KERNEL == CRC32_KERNEL_NIBBLE)\n");
+    fprintf(out, "static const uint32_t crc32_table[1][16] = {\n    {");
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        fprintf(out, "%s0x%08XUL,", (i % 4) ? " " : "\n        ", crc32_gen_bits(i, 4));
+    }
+    fprintf(out, "\n    },\n};\n");
+    fprintf(out, "#else /* !(CRC32_KERNEL == CRC32_KERNEL_NIBBLE) */\n");
+    fprintf(out, "static const uint32_t crc32_table[CRC32_TABLE_ROWS][256] = {\n");
+    for (int row = 0; row < CRC32_SLICE_ROWS; row++)
+    {
+        if (row > 0)
+        {
+            fprintf(out, "#if (CRC32_TABLE_ROWS > %d)\n", row);
+        }
+        fprintf(out, "    {");
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            fprintf(out, "%s0x%08XUL,", (i % 6) ? " " : "\n        ", table[row][i]);
+        }
+        fprintf(out, "\n    },\n");
+        if (row > 0)
+        {
+            fprintf(out, "#endif\n");
+        }
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "#endif /* End of (CRC32_KERNEL == CRC32_KERNEL_NIBBLE) */\n");
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,419 @@
+/*******************************************************************************
+ * Title                 :   DFU on simulated flash
+ * Filename              :   dfu_sim.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host tool
+ *******************************************************************************/
+
+/** \file dfu_sim.c
+ *  \brief Run the firmware DFU code against a file-backed flash model
+ *
+ *  Usage: dfu_sim [-p n25q128a|n25q256a|mx25r6435f|ram] [-i flash.img] [-s prescaler] [-t max_hz] [-b budget_ms] [-r]
+ *                 [-e] [-c offset] [-k ms] fw.bin
+ *  dfu_init() selects the storage backend from the JEDEC ID of the simulated
+ *  part, then dfu_fw_image_update() writes fw.bin to the inactive image slot
+ *  of the image file. The ram part uses the RAM backend instead of a flash
+ *  model (no image file, no bus statistics). fw.bin may also be a compressed
+ *  payload made by lz_pack, it is then decoded into the slot.
+ *  With -b the non-blocking API is used instead (dfu_fw_image_update_begin(),
+ *  then dfu_update_feed()/dfu_update_poll() from a simulated main loop) and the
+ *  longest poll is reported. -r then rolls back to the previous slot.
+ *  -t trains the SPI link from the -s prescaler before the update, on traces
+ *  that carry at most max_hz (0 for no limit). The reference region is the
+ *  start of the SFDP space, the array may be blank.
+ *  -e pre-erases the inactive slot from an idle main loop before the update
+ *  (dfu_fw_image_preerase_begin()/dfu_preerase_poll()) and reports the time
+ *  the CPU slept. The slot is kept when it holds the image -r goes back to.
+ *  -c clears a byte of the active image at offset after the update, then
+ *  times the validation of the whole image and of its first 4 KB.
+ *  -k cuts the power ms into the update and exits with the image file as
+ *  the cut left it, the next run resumes the update from its journal.
+ *  Prints the simulated time and the bus/array statistics.
+ */
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dfu.h"
+#include "dfu_storage.h"
+#include "hal_sim.h"
+#include "main.h"
+#include "MX25Series.h"
+#include "spi.h"
+#include "spi_link.h"
+
+static uint8_t *dfu_sim_load(const char *path, uint32_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (data != NULL && fread(data, 1, size, f) != (size_t) size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = (uint32_t) size;
+    return data;
+}
+
+static uint32_t dfu_sim_prescaler(unsigned divider)
+{
+    uint32_t br = 0;
+    while ((2u << br) < divider && br < 7)
+    {
+        br++;
+    }
+    return br << SPI_CR1_BR_Pos;
+}
+
+#define DFU_SIM_LOOP_WORK_NS            (100000) // Other work of the simulated main loop per iteration
+#define DFU_SIM_RAM_SIZE                (0x1000000) // Size of the RAM backend storage
+
+static jmp_buf dfu_sim_power_cut_jmp;
+
+/*
+ * @brief hal_sim power cut handler, leaves the update where it was cut
+ */
+static void dfu_sim_power_cut(void)
+{
+    longjmp(dfu_sim_power_cut_jmp, 1);
+}
+
+/*
+ * @brief update through the non-blocking API, the main loop feeds all the data it can and polls once per iteration
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_sim_update_async(const uint8_t *fw, uint32_t fw_len, uint32_t budget_ms)
+{
+    static dfu_update_t update;
+    uint64_t start_ns = hal_sim_now_ns();
+    int result = dfu_fw_image_update_begin(&update, fw, fw_len);
+    if (result <= 0)
+    {
+        return result;
+    }
+    dfu_update_set_budget(&update, budget_ms);
+
+    uint32_t fed = 0;
+    uint64_t polls = 0;
+    uint64_t max_poll_ns = 0;
+    uint8_t progress = 0;
+    dfu_update_state_t state = DFU_UPDATE_ERASE;
+    while (state != DFU_UPDATE_DONE && state != DFU_UPDATE_ERROR)
+    {
+        int accepted = dfu_update_feed(&update, fw + fed, fw_len - fed);
+        fed += (accepted > 0) ? accepted : 0;
+
+        uint64_t poll_ns = hal_sim_now_ns();
+        state = dfu_update_poll(&update);
+        poll_ns = hal_sim_now_ns() - poll_ns;
+        max_poll_ns = (poll_ns > max_poll_ns) ? poll_ns : max_poll_ns;
+        polls++;
+        if (dfu_update_progress(&update) >= progress + 10)
+        {
+            progress = dfu_update_progress(&update);
+            printf("progress: %u%%, state: %d\n", progress, state);
+        }
+        hal_sim_advance_ns(DFU_SIM_LOOP_WORK_NS);
+    }
+    printf("async update: %s, budget: %u ms, polls: %llu, longest poll: %.3f ms, time: %.3f s\n",
+           (state == DFU_UPDATE_DONE) ? "done" : "failed", budget_ms, (unsigned long long) polls, max_poll_ns / 1e6,
+           (hal_sim_now_ns() - start_ns) / 1e9);
+    image_header_t header;
+    return (state == DFU_UPDATE_DONE && dfu_slot_active(&header) >= 0) ? 0 : -1;
+}
+
+/*
+ * @brief pre-erase the inactive slot from a main loop with nothing else to do
+ * @return int 0 on success, negative value otherwise
+ */
+static int dfu_sim_preerase(void)
+{
+    static dfu_preerase_t preerase;
+    uint64_t start_ns = hal_sim_now_ns();
+    uint64_t start_sleep_ns = hal_sim_sleep_ns();
+    int result = dfu_fw_image_preerase_begin(&preerase);
+    if (result == 1)
+    {
+        printf("pre-erase: skipped, the slot holds the rollback image\n");
+        return 0;
+    }
+    while (result == 0 && (result = dfu_preerase_poll(&preerase)) > 0)
+    {
+        result = 0;
+    }
+    uint64_t time_ns = hal_sim_now_ns() - start_ns;
+    uint64_t sleep_ns = hal_sim_sleep_ns() - start_sleep_ns;
+    printf("pre-erase: %s, erased: %u KB, already blank: %u KB, time: %.3f s, asleep: %.1f%%\n",
+           (result == 0) ? "done" : "failed", preerase.erased / 1024, preerase.blank / 1024, time_ns / 1e9,
+           (time_ns > 0) ? 100.0 * sleep_ns / time_ns : 0.0);
+    return result;
+}
+
+/*
+ * @brief clear one byte of the active image, then validate the whole image and its first 4 KB
+ * @return int 0 if the damage is found and the first 4 KB are still valid when outside them, negative value otherwise
+ */
+static int dfu_sim_corrupt(uint32_t offset)
+{
+    image_header_t header;
+    int slot = dfu_slot_active(&header);
+    if (slot < 0 || offset >= header.img_data_size)
+    {
+        return -1;
+    }
+    uint32_t hdr_addr = dfu_slot_addr(slot) + dfu_slot_size() - DFU_SLOT_HEADER_SIZE;
+    uint8_t zero = 0;
+    const dfu_storage_ops_t *ops = dfu_storage_backend();
+    ops->program_stage(header.img_data_start_addr + offset, &zero, sizeof(zero));
+    if (ops->program_start() != 0 || dfu_storage_wait(dfu_storage_geometry()->program_max_ms + 1) != DFU_STORAGE_READY)
+    {
+        return -1;
+    }
+
+    uint64_t start_ns = hal_sim_now_ns();
+    int whole = dfu_image_validate_data_content(hdr_addr);
+    uint64_t whole_ns = hal_sim_now_ns() - start_ns;
+    uint32_t head_len = (header.img_data_size < 4096) ? header.img_data_size : 4096;
+    start_ns = hal_sim_now_ns();
+    int head = dfu_image_validate_range(hdr_addr, 0, head_len);
+    uint64_t head_ns = hal_sim_now_ns() - start_ns;
+    printf("corrupted at %u: image %s in %.3f ms, first %u B %s in %.3f ms\n", offset,
+           (whole == 0) ? "valid" : "invalid", whole_ns / 1e6, head_len, (head == 0) ? "valid" : "invalid",
+           head_ns / 1e6);
+    return (whole != 0 && (head == 0) == (offset >= head_len)) ? 0 : -1;
+}
+
+static void dfu_sim_report(flash_sim_t *flash)
+{
+    const flash_sim_stats_t *st = flash_sim_stats(flash);
+    printf("part: %s, simulated time: %.3f s\n", flash_sim_name(flash), hal_sim_now_ns() / 1e9);
+    printf("frames: %llu, bytes: %llu, bus: %.3f s, busy: %.3f s, busy polls: %llu\n",
+           (unsigned long long) st->frames, (unsigned long long) st->bytes, st->bus_ns / 1e9, st->busy_ns / 1e9,
+           (unsigned long long) st->busy_polls);
+    printf("program: %llu ops / %llu B, erase: %llu ops / %llu B, read: %llu cmds / %llu B\n",
+           (unsigned long long) st->program_ops, (unsigned long long) st->program_bytes,
+           (unsigned long long) st->erase_ops, (unsigned long long) st->erase_bytes,
+           (unsigned long long) st->read_cmds, (unsigned long long) st->read_bytes);
+    printf("ignored commands: %llu, violations: %llu\n", (unsigned long long) st->ignored_cmds,
+           (unsigned long long) st->violations);
+}
+
+/*
+ * @brief print the command line syntax
+ * @return int exit status of a bad command line
+ */
+static int dfu_sim_usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-p n25q128a|n25q256a|mx25r6435f|ram] [-i flash.img] [-s prescaler] [-t max_hz] "
+                    "[-b budget_ms] [-r] [-e] [-c offset] [-k ms] fw.bin\n", prog);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    flash_sim_part_t part = FLASH_SIM_N25Q256A;
+    bool use_ram = false;
+    const char *image_path = NULL;
+    unsigned divider = 256;
+    int budget_ms = -1;
+    bool rollback = false;
+    bool preerase = false;
+    long corrupt_offset = -1;
+    long train_max_hz = -1;
+    long power_cut_ms = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:i:s:t:b:rec:k:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            use_ram = !strcmp(optarg, "ram");
+            if (!strcmp(optarg, "n25q128a"))
+            {
+                part = FLASH_SIM_N25Q128A;
+            }
+            else if (!strcmp(optarg, "n25q256a"))
+            {
+                part = FLASH_SIM_N25Q256A;
+            }
+            else if (!strcmp(optarg, "mx25r6435f"))
+            {
+                part = FLASH_SIM_MX25R6435F;
+            }
+            else if (!use_ram)
+            {
+                fprintf(stderr, "unknown part: %s\n", optarg);
+                return dfu_sim_usage(argv[0]);
+            }
+            break;
+        case 'i':
+            image_path = optarg;
+            break;
+        case 's':
+            divider = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            train_max_hz = strtol(optarg, NULL, 0);
+            break;
+        case 'b':
+            budget_ms = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            rollback = true;
+            break;
+        case 'e':
+            preerase = true;
+            break;
+        case 'c':
+            corrupt_offset = strtol(optarg, NULL, 0);
+            break;
+        case 'k':
+            power_cut_ms = strtol(optarg, NULL, 0);
+            break;
+        default:
+            return dfu_sim_usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+    {
+        return dfu_sim_usage(argv[0]);
+    }
+
+    uint32_t fw_len = 0;
+    uint8_t *fw = dfu_sim_load(argv[optind], &fw_len);
+    if (fw == NULL)
+    {
+        return 1;
+    }
+
+    hal_sim_config_t sim_cfg = *hal_sim_config();
+    sim_cfg.spi_max_hz = (train_max_hz > 0) ? (uint32_t) train_max_hz : 0;
+    hal_sim_init(&sim_cfg);
+    flash_sim_t *flash = NULL;
+    uint8_t *ram = NULL;
+    int retval = 0;
+    if (use_ram)
+    {
+        ram = malloc(DFU_SIM_RAM_SIZE);
+        if (ram == NULL)
+        {
+            return 1;
+        }
+        memset(ram, 0xFF, DFU_SIM_RAM_SIZE);
+        dfu_storage_ram_attach(ram, DFU_SIM_RAM_SIZE);
+        retval = (dfu_storage_select(&dfu_storage_ram) != 0);
+    }
+    else
+    {
+        flash = flash_sim_create(part, image_path);
+        if (flash == NULL)
+        {
+            return 1;
+        }
+        MX_SPI2_Init();
+        hspi2.Init.BaudRatePrescaler = dfu_sim_prescaler(divider);
+        hal_sim_attach_flash(&hspi2, SPI2_NSS_GPIO_Port, SPI2_NSS_Pin, flash);
+        printf("SPI2 clock: %u Hz\n", hal_sim_spi_clock_hz(&hspi2));
+
+        // Both parts sit on SPI2, as on the board
+        static MX25Series_t mx25_dev;
+        MX25Series_init(&mx25_dev, &MX25R6435F_Chip_Def_Low_Power, SPI2_NSS_PIN_NUMBER, FLASH_RESET_PIN_NUMBER,
+                        FLASH_WP_PIN_NUMBER, 0, &hspi2);
+        dfu_storage_mx25_attach(&mx25_dev, &MX25R6435F_Chip_Def_High_Performance);
+        retval = (dfu_init(NULL) != 0);
+    }
+    if (retval != 0)
+    {
+        fprintf(stderr, "dfu_init() failed\n");
+        return 1;
+    }
+    const dfu_storage_geometry_t *geo = dfu_storage_geometry();
+    printf("storage: %s, ID: %02X %02X %02X, %u KB, slot: %u KB\n", geo->name, geo->jedec_id[0], geo->jedec_id[1],
+           geo->jedec_id[2], geo->size / 1024, dfu_slot_size() / 1024);
+
+    if (train_max_hz >= 0 && flash != NULL)
+    {
+        spi_link_probe_t probe = {
+            .read_id = dfu_storage_read_id,
+            .read = dfu_storage_read_sfdp,
+            .ref_addr = 0,
+            .ref_len = SPI_LINK_SFDP_REF_LEN,
+        };
+        spi_link_result_t link;
+        if (spi_link_train(&hspi2, &probe, &link) != 0)
+        {
+            fprintf(stderr, "SPI link training failed\n");
+            return 1;
+        }
+        printf("SPI2 link: %u Hz, fastest passing: %u Hz, first failing: %u Hz\n", link.clock_hz, link.fastest_hz,
+               link.failed_hz);
+    }
+
+    if (preerase && dfu_sim_preerase() != 0)
+    {
+        fprintf(stderr, "pre-erase failed\n");
+        retval = 1;
+    }
+    uint64_t update_start_ns = hal_sim_now_ns();
+    if (power_cut_ms >= 0 && flash != NULL)
+    {
+        hal_sim_set_power_cut(update_start_ns + (uint64_t) power_cut_ms * 1000000ULL, dfu_sim_power_cut);
+        if (setjmp(dfu_sim_power_cut_jmp) != 0)
+        {
+            printf("power cut %.3f s into the update\n", (hal_sim_now_ns() - update_start_ns) / 1e9);
+            dfu_sim_report(flash);
+            flash_sim_destroy(flash);
+            free(fw);
+            return 0;
+        }
+    }
+    if (budget_ms >= 0)
+    {
+        if (dfu_sim_update_async(fw, fw_len, budget_ms) != 0)
+        {
+            fprintf(stderr, "non-blocking update failed\n");
+            retval = 1;
+        }
+    }
+    else if (dfu_fw_image_update(fw, fw_len) != 0)
+    {
+        fprintf(stderr, "dfu_fw_image_update() failed\n");
+        retval = 1;
+    }
+    hal_sim_set_power_cut(0, NULL);
+    printf("update%s: %.3f s\n", preerase ? " after the pre-erase" : "", (hal_sim_now_ns() - update_start_ns) / 1e9);
+    if (rollback && dfu_slot_rollback() < 0)
+    {
+        fprintf(stderr, "dfu_slot_rollback() failed\n");
+        retval = 1;
+    }
+    if (corrupt_offset >= 0 && dfu_sim_corrupt((uint32_t) corrupt_offset) != 0)
+    {
+        fprintf(stderr, "corrupted image check failed\n");
+        retval = 1;
+    }
+    image_header_t header;
+    int slot = dfu_slot_active(&header);
+    printf("active slot: %d, sequence: %u\n", slot, (slot >= 0) ? header.image_sequence : 0);
+
+    if (flash != NULL)
+    {
+        dfu_sim_report(flash);
+        flash_sim_destroy(flash);
+    }
+    free(ram);
+    free(fw);
+    return retval;
+}
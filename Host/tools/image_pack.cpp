@@ -0,0 +1,457 @@
+/*******************************************************************************
+ * Title                 :   Image packer
+ * Filename              :   image_pack.cpp
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host tool, generates packs read by Core/Src/image_pack.c
+ *******************************************************************************/
+
+/** \file image_pack.cpp
+ *  \brief Pack firmware images with the header built on the host
+ *
+ *  Usage: image_pack [-j threads] [-c] [-w window_bits] [-B block_size] -o out.ipk
+ *                    image.bin[:type[:major.minor.revision]]...
+ *  Each image gets its image_header_t (magic, type, version, size and CRC),
+ *  type and version default to the ones dfu.h builds into the firmware.
+ *  -c stores the images as compressed payloads (lz_stream.h), -B adds the
+ *  crc32() of every block_size bytes block of each image. The CRCs and the
+ *  match search of the compression run on all cores (-j): images are cut in
+ *  chunks searched independently, with the window before each chunk as
+ *  history, so the payload only loses the matches crossing a chunk end. The
+ *  CRC of a whole image is combined from the CRCs of its chunks. Compressed
+ *  payloads are decoded and checked before the pack is written.
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crc32.h"
+#include "image_pack.h"
+#include "lz_encode.h"
+#include "lz_stream.h"
+
+#define IMAGE_PACK_LZ_CHUNK_SIZE        (256 * 1024) // Compression chunk searched by one task
+#define IMAGE_PACK_CRC_CHUNK_SIZE       (1024 * 1024) // CRC unit without block table, and bytes hashed by one task
+#define IMAGE_PACK_MIN_BLOCK_SIZE       (256)
+#define IMAGE_PACK_CRC_POLY             (0xEDB88320UL)
+
+struct pack_image
+{
+    std::string path;
+    std::vector<uint8_t> raw;
+    image_header_t header;
+    uint32_t crc_unit;                  // Bytes per entry of unit_crcs
+    std::vector<uint32_t> unit_crcs;
+    std::vector<std::vector<lz_match_t>> chunk_matches;
+    std::vector<uint8_t> payload;
+    image_pack_entry_t entry;
+};
+
+static uint32_t image_pack_gf2_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    for (; vec != 0; vec >>= 1, mat++)
+    {
+        if ((vec & 1) != 0)
+        {
+            sum ^= *mat;
+        }
+    }
+    return sum;
+}
+
+static void image_pack_gf2_square(uint32_t *square, const uint32_t *mat)
+{
+    for (int n = 0; n < 32; n++)
+    {
+        square[n] = image_pack_gf2_times(mat, mat[n]);
+    }
+}
+
+/*
+ * @brief crc32() of A followed by B, from crc32() of A, crc32() of B and the length of B
+ */
+static uint32_t image_pack_crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b)
+{
+    uint32_t even[32];
+    uint32_t odd[32];
+    if (len_b == 0)
+    {
+        return crc_a;
+    }
+    // Operator of one zero bit, then squared to 2 and 4 zero bits
+    odd[0] = IMAGE_PACK_CRC_POLY;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = 1UL << (n - 1);
+    }
+    image_pack_gf2_square(even, odd);
+    image_pack_gf2_square(odd, even);
+    // Zero bytes of B applied to the CRC of A, one bit of len_b per squaring
+    while (len_b != 0)
+    {
+        image_pack_gf2_square(even, odd);
+        if ((len_b & 1) != 0)
+        {
+            crc_a = image_pack_gf2_times(even, crc_a);
+        }
+        len_b >>= 1;
+        if (len_b == 0)
+        {
+            break;
+        }
+        image_pack_gf2_square(odd, even);
+        if ((len_b & 1) != 0)
+        {
+            crc_a = image_pack_gf2_times(odd, crc_a);
+        }
+        len_b >>= 1;
+    }
+    return crc_a ^ crc_b;
+}
+
+/*
+ * @brief run the tasks on up to thread_count threads, the remaining ones are skipped after a failure
+ * @return int 0 if every task returned 0, negative value otherwise
+ */
+static int image_pack_run(const std::vector<std::function<int()>> &tasks, unsigned thread_count)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<int> result(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < tasks.size() && result == 0; i = next++)
+        {
+            if (tasks[i]() != 0)
+            {
+                result = -1;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < thread_count && t < tasks.size(); t++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    return result;
+}
+
+static int image_pack_match_add(void *arg, const lz_match_t *match)
+{
+    static_cast<std::vector<lz_match_t> *>(arg)->push_back(*match);
+    return 0;
+}
+
+static bool image_pack_load(pack_image &image)
+{
+    FILE *f = fopen(image.path.c_str(), "rb");
+    if (f == NULL)
+    {
+        perror(image.path.c_str());
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    image.raw.resize(size > 0 ? size : 0);
+    bool ok = (size >= 0 && fread(image.raw.data(), 1, image.raw.size(), f) == image.raw.size());
+    fclose(f);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: read failed\n", image.path.c_str());
+    }
+    return ok;
+}
+
+/*
+ * @brief image.bin[:type[:major.minor.revision]], the metadata defaults to the built-in firmware image
+ */
+static bool image_pack_parse(const char *arg, pack_image &image)
+{
+    std::string spec(arg);
+    size_t sep = spec.find(':');
+    image.path = spec.substr(0, sep);
+    memset(&image.header, 0, sizeof(image.header));
+    image.header.image_magic = IMAGE_MAGIC_NUMBER;
+    image.header.image_data_type = IMAGE_TYPE_RFIC_FIRMWARE;
+    image.header.image_data_version_major = IMAGE_FIRMWARE_MAJOR_VERSION;
+    image.header.image_data_version_minor = IMAGE_FIRMWARE_MINOR_VERSION;
+    image.header.image_data_version_revision = IMAGE_FIRMWARE_REVISION_VERSION;
+    if (sep == std::string::npos)
+    {
+        return !image.path.empty();
+    }
+    unsigned type = 0;
+    unsigned major = image.header.image_data_version_major;
+    unsigned minor = image.header.image_data_version_minor;
+    unsigned revision = image.header.image_data_version_revision;
+    std::string meta = spec.substr(sep + 1);
+    int fields = sscanf(meta.c_str(), "%u:%u.%u.%u", &type, &major, &minor, &revision);
+    if ((fields != 1 && fields != 4) || type > 0xFF || major > 0xFF || minor > 0xFF || revision > 0xFF)
+    {
+        return false;
+    }
+    image.header.image_data_type = (uint8_t) type;
+    image.header.image_data_version_major = (uint8_t) major;
+    image.header.image_data_version_minor = (uint8_t) minor;
+    image.header.image_data_version_revision = (uint8_t) revision;
+    return !image.path.empty();
+}
+
+/*
+ * @brief decode a compressed payload and compare it with the image
+ * @return int 0 if they match, negative value otherwise
+ */
+static int image_pack_check_payload(const pack_image &image)
+{
+    std::vector<uint8_t> check(image.raw.size() + 1);
+    lz_stream_t *stream = new lz_stream_t;
+    uint32_t consumed;
+    lz_stream_init(stream);
+    int decoded = lz_stream_decode(stream, image.payload.data(), image.payload.size(), &consumed, check.data(),
+                                   check.size());
+    bool ok = (decoded == (int) image.raw.size() && lz_stream_done(stream) &&
+               memcmp(check.data(), image.raw.data(), image.raw.size()) == 0);
+    delete stream;
+    if (!ok)
+    {
+        fprintf(stderr, "%s: decoded image does not match\n", image.path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static void image_pack_usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-j threads] [-c] [-w window_bits] [-B block_size] -o out.ipk "
+                    "image.bin[:type[:major.minor.revision]]...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned thread_count = std::max(1u, std::thread::hardware_concurrency());
+    bool compress = false;
+    uint8_t window_bits = LZ_STREAM_MAX_WINDOW_BITS;
+    uint32_t block_size = 0;
+    const char *out_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:cw:B:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            thread_count = std::max(1, atoi(optarg));
+            break;
+        case 'c':
+            compress = true;
+            break;
+        case 'w':
+            window_bits = (uint8_t) atoi(optarg);
+            break;
+        case 'B':
+            block_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            image_pack_usage(argv[0]);
+            return 1;
+        }
+    }
+    uint32_t image_count = argc - optind;
+    if (out_path == NULL || image_count == 0 || image_count > IMAGE_PACK_MAX_IMAGES ||
+        window_bits < LZ_STREAM_MIN_WINDOW_BITS || window_bits > LZ_STREAM_MAX_WINDOW_BITS ||
+        (block_size != 0 && (block_size < IMAGE_PACK_MIN_BLOCK_SIZE || (block_size & (block_size - 1)) != 0)))
+    {
+        image_pack_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<pack_image> images(image_count);
+    for (uint32_t i = 0; i < image_count; i++)
+    {
+        if (!image_pack_parse(argv[optind + i], images[i]))
+        {
+            image_pack_usage(argv[0]);
+            return 1;
+        }
+        for (uint32_t j = 0; j < i; j++)
+        {
+            if (images[j].header.image_data_type == images[i].header.image_data_type)
+            {
+                fprintf(stderr, "%s: image type %u already packed\n", images[i].path.c_str(),
+                        images[i].header.image_data_type);
+                return 1;
+            }
+        }
+        if (!image_pack_load(images[i]))
+        {
+            return 1;
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    // CRC units and compression chunks of every image, all in one task list
+    std::vector<std::function<int()>> tasks;
+    for (pack_image &image : images)
+    {
+        uint32_t len = image.raw.size();
+        image.crc_unit = (block_size != 0) ? block_size : IMAGE_PACK_CRC_CHUNK_SIZE;
+        image.unit_crcs.resize((len + image.crc_unit - 1) / image.crc_unit);
+        uint32_t units_per_task = std::max<uint32_t>(1, IMAGE_PACK_CRC_CHUNK_SIZE / image.crc_unit);
+        for (uint32_t first = 0; first < image.unit_crcs.size(); first += units_per_task)
+        {
+            tasks.push_back([&image, first, units_per_task, len]() {
+                uint32_t last = std::min<uint32_t>(first + units_per_task, image.unit_crcs.size());
+                for (uint32_t u = first; u < last; u++)
+                {
+                    uint32_t offset = u * image.crc_unit;
+                    image.unit_crcs[u] = crc32(&image.raw[offset], std::min(image.crc_unit, len - offset));
+                }
+                return 0;
+            });
+        }
+        if (compress)
+        {
+            image.chunk_matches.resize((len + IMAGE_PACK_LZ_CHUNK_SIZE - 1) / IMAGE_PACK_LZ_CHUNK_SIZE);
+            for (uint32_t c = 0; c < image.chunk_matches.size(); c++)
+            {
+                tasks.push_back([&image, c, len, window_bits]() {
+                    uint32_t chunk_start = c * IMAGE_PACK_LZ_CHUNK_SIZE;
+                    uint32_t chunk_end = std::min<uint32_t>(chunk_start + IMAGE_PACK_LZ_CHUNK_SIZE, len);
+                    return lz_encode_matches(image.raw.data(), chunk_start, chunk_end, window_bits,
+                                             image_pack_match_add, &image.chunk_matches[c]);
+                });
+            }
+        }
+    }
+    if (image_pack_run(tasks, thread_count) != 0)
+    {
+        fprintf(stderr, "match search failed\n");
+        return 1;
+    }
+
+    // Payloads from the concatenated matches, then checked by decoding them
+    tasks.clear();
+    for (pack_image &image : images)
+    {
+        uint32_t len = image.raw.size();
+        uint32_t crc = 0; // crc32() of no data
+        for (uint32_t u = 0; u < image.unit_crcs.size(); u++)
+        {
+            crc = image_pack_crc32_combine(crc, image.unit_crcs[u], std::min(image.crc_unit, len - u * image.crc_unit));
+        }
+        image.header.img_data_size = len;
+        image.header.image_data_crc = crc;
+        if (!compress)
+        {
+            continue;
+        }
+        tasks.push_back([&image, len, window_bits]() {
+            std::vector<lz_match_t> matches;
+            for (const std::vector<lz_match_t> &chunk : image.chunk_matches)
+            {
+                matches.insert(matches.end(), chunk.begin(), chunk.end());
+            }
+            image.payload.resize(LZ_ENCODE_BOUND(len));
+            int payload_len = lz_encode_payload(image.raw.data(), len, image.header.image_data_crc, window_bits,
+                                                matches.data(), matches.size(), image.payload.data(),
+                                                image.payload.size());
+            if (payload_len < 0)
+            {
+                fprintf(stderr, "%s: encoding failed\n", image.path.c_str());
+                return -1;
+            }
+            image.payload.resize(payload_len);
+            return image_pack_check_payload(image);
+        });
+    }
+    if (image_pack_run(tasks, thread_count) != 0)
+    {
+        return 1;
+    }
+
+    // Layout: header, entry table, then the payload and block CRC table of each image
+    std::vector<uint8_t> pack(sizeof(image_pack_header_t) + image_count * sizeof(image_pack_entry_t));
+    auto align = [&pack]() { pack.resize((pack.size() + IMAGE_PACK_ALIGN - 1) & ~(IMAGE_PACK_ALIGN - 1)); };
+    for (pack_image &image : images)
+    {
+        const std::vector<uint8_t> &payload = compress ? image.payload : image.raw;
+        memset(&image.entry, 0, sizeof(image.entry));
+        image.entry.header = image.header;
+        image.entry.payload_offset = pack.size();
+        image.entry.payload_len = payload.size();
+        image.entry.flags = compress ? IMAGE_PACK_FLAG_COMPRESSED : 0;
+        pack.insert(pack.end(), payload.begin(), payload.end());
+        align();
+        if (block_size != 0)
+        {
+            image.entry.flags |= IMAGE_PACK_FLAG_BLOCK_CRC;
+            image.entry.block_crc_offset = pack.size();
+            image.entry.block_size_log2 = (uint8_t) __builtin_ctz(block_size);
+            const uint8_t *crcs = (const uint8_t *) image.unit_crcs.data();
+            pack.insert(pack.end(), crcs, crcs + image.unit_crcs.size() * sizeof(uint32_t));
+        }
+    }
+    image_pack_entry_t *entries = (image_pack_entry_t *) &pack[sizeof(image_pack_header_t)];
+    for (uint32_t i = 0; i < image_count; i++)
+    {
+        memcpy(&entries[i], &images[i].entry, sizeof(image_pack_entry_t));
+    }
+    image_pack_header_t header = {};
+    header.magic = IMAGE_PACK_MAGIC;
+    header.image_count = (uint8_t) image_count;
+    header.total_len = pack.size();
+    header.entries_crc = crc32(entries, image_count * sizeof(image_pack_entry_t));
+    memcpy(pack.data(), &header, sizeof(header));
+    for (const pack_image &image : images)
+    {
+        const image_pack_entry_t *p_entry = image_pack_find(pack.data(), pack.size(), image.header.image_data_type);
+        if (p_entry == NULL || memcmp(&p_entry->header, &image.header, sizeof(image.header)) != 0)
+        {
+            fprintf(stderr, "%s: packed entry does not check\n", image.path.c_str());
+            return 1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE *out = fopen(out_path, "wb");
+    if (out == NULL || fwrite(pack.data(), 1, pack.size(), out) != pack.size())
+    {
+        perror(out_path);
+        return 1;
+    }
+    fclose(out);
+    uint64_t raw_total = 0;
+    for (const pack_image &image : images)
+    {
+        raw_total += image.raw.size();
+        printf("%s: type %u, version %u.%u.%u, CRC 0x%08X, %u -> %u bytes%s", image.path.c_str(),
+               image.header.image_data_type, image.header.image_data_version_major,
+               image.header.image_data_version_minor, image.header.image_data_version_revision,
+               image.header.image_data_crc, image.header.img_data_size, image.entry.payload_len,
+               (compress && (((const lz_stream_header_t *) image.payload.data())->flags &
+                             LZ_STREAM_FLAG_COMPRESSED) == 0) ? " (stored)" : "");
+        if (block_size != 0)
+        {
+            printf(", %zu blocks of %u bytes", image.unit_crcs.size(), block_size);
+        }
+        printf("\n");
+    }
+    printf("%s: %u images, %llu -> %zu bytes, %u threads, %.3f s\n", out_path, image_count,
+           (unsigned long long) raw_total, pack.size(), thread_count, seconds);
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*******************************************************************************
+ * Title                 :   LZ payload encoder
+ * Filename              :   lz_encode.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host only, used by lz_pack and lz_bench
+ *******************************************************************************/
+
+/** \file lz_encode.c
+ *  \brief Compress an image into a payload decodable by lz_stream_decode()
+ *
+ *  Greedy parser over hash chains of 4 bytes sequences, with a one byte lazy
+ *  step: a match is deferred when the next position has a longer one. Match
+ *  offsets are limited to the decoder window. When the sequences are not
+ *  smaller than the image, the payload is stored uncompressed.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "lz_encode.h"
+
+#define LZ_HASH_BITS            (15)
+#define LZ_CHAIN_DEPTH          (64)
+#define LZ_NO_POS               (0xFFFFFFFFUL)
+
+typedef struct
+{
+    const uint8_t *in;
+    uint32_t len;       // Matches end there
+    uint32_t base;      // First position of the history
+    uint32_t window;
+    uint32_t *head;     // Last position of each hash
+    uint32_t *prev;     // Previous position with the same hash, indexed by position - base
+} lz_matcher_t;
+
+typedef struct
+{
+    uint8_t *out;
+    uint32_t cap;
+    uint32_t pos;
+} lz_writer_t;
+
+static uint32_t lz_hash(const uint8_t *p)
+{
+    uint32_t v = (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+    return (uint32_t) (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void lz_insert(lz_matcher_t *m, uint32_t pos)
+{
+    if (pos + LZ_STREAM_MIN_MATCH > m->len)
+    {
+        return;
+    }
+    uint32_t h = lz_hash(&m->in[pos]);
+    m->prev[pos - m->base] = m->head[h];
+    m->head[h] = pos;
+}
+
+/* Longest match for pos among the previous positions inside the window, length 0 if none */
+static uint32_t lz_find(const lz_matcher_t *m, uint32_t pos, uint32_t *p_offset)
+{
+    uint32_t best = 0;
+    if (pos + LZ_STREAM_MIN_MATCH > m->len)
+    {
+        return 0;
+    }
+    uint32_t cand = m->head[lz_hash(&m->in[pos])];
+    for (int depth = 0; depth < LZ_CHAIN_DEPTH && cand != LZ_NO_POS && pos - cand <= m->window; depth++)
+    {
+        uint32_t n = 0;
+        while (pos + n < m->len && m->in[cand + n] == m->in[pos + n])
+        {
+            n++;
+        }
+        if (n > best)
+        {
+            best = n;
+            *p_offset = pos - cand;
+        }
+        cand = m->prev[cand - m->base];
+    }
+    return (best >= LZ_STREAM_MIN_MATCH) ? best : 0;
+}
+
+static int lz_put(lz_writer_t *w, uint8_t byte)
+{
+    if (w->pos == w->cap)
+    {
+        return -1;
+    }
+    w->out[w->pos++] = byte;
+    return 0;
+}
+
+static int lz_put_len(lz_writer_t *w, uint32_t len)
+{
+    // Extra bytes after a nibble of 15, terminated by a byte lower than 255
+    for (; len >= 0xFF; len -= 0xFF)
+    {
+        if (lz_put(w, 0xFF) != 0)
+        {
+            return -1;
+        }
+    }
+    return lz_put(w, (uint8_t) len);
+}
+
+static int lz_put_sequence(lz_writer_t *w, const uint8_t *literals, uint32_t literal_len, uint32_t match_len,
+                           uint32_t offset)
+{
+    uint32_t ml = (match_len != 0) ? match_len - LZ_STREAM_MIN_MATCH : 0;
+    uint8_t token = (uint8_t) (((literal_len < 15) ? literal_len : 15) << 4) | ((ml < 15) ? ml : 15);
+    if (lz_put(w, token) != 0 || (literal_len >= 15 && lz_put_len(w, literal_len - 15) != 0))
+    {
+        return -1;
+    }
+    if (w->cap - w->pos < literal_len)
+    {
+        return -1;
+    }
+    memcpy(&w->out[w->pos], literals, literal_len);
+    w->pos += literal_len;
+    if (match_len == 0)
+    {
+        return 0;
+    }
+    if (lz_put(w, offset & 0xFF) != 0 || lz_put(w, offset >> 8) != 0 || (ml >= 15 && lz_put_len(w, ml - 15) != 0))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct
+{
+    lz_match_t *matches;
+    uint32_t count;
+    uint32_t cap;
+} lz_match_list_t;
+
+static int lz_match_list_add(void *arg, const lz_match_t *match)
+{
+    lz_match_list_t *list = arg;
+    if (list->count == list->cap)
+    {
+        uint32_t cap = (list->cap != 0) ? 2 * list->cap : 1024;
+        lz_match_t *matches = realloc(list->matches, sizeof(lz_match_t) * cap);
+        if (matches == NULL)
+        {
+            return -1;
+        }
+        list->matches = matches;
+        list->cap = cap;
+    }
+    list->matches[list->count++] = *match;
+    return 0;
+}
+
+/*
+ * @brief find the matches of [start, end), against the data from start - window on. Matches do not cross end, so
+ *        ranges can be searched independently (e.g. by several threads) and their matches concatenated.
+ * @param sink: called for every match, by increasing position
+ * @return int 0 on success, negative value on error
+ */
+int lz_encode_matches(const uint8_t *in, uint32_t start, uint32_t end, uint8_t window_bits, lz_match_sink_t sink,
+                      void *arg)
+{
+    uint32_t window = 1UL << window_bits;
+    uint32_t base = (start > window) ? start - window : 0;
+    lz_matcher_t m = {
+        .in = in,
+        .len = end,
+        .base = base,
+        .window = window,
+        .head = malloc(sizeof(uint32_t) << LZ_HASH_BITS),
+        .prev = malloc(sizeof(uint32_t) * (end - base + 1)),
+    };
+    int ret = -1;
+    if (m.head == NULL || m.prev == NULL)
+    {
+        goto exit;
+    }
+    memset(m.head, 0xFF, sizeof(uint32_t) << LZ_HASH_BITS);
+    for (uint32_t pos = base; pos < start; pos++)
+    {
+        lz_insert(&m, pos);
+    }
+
+    uint32_t pos = start;
+    while (pos < end)
+    {
+        lz_match_t match = { .pos = pos };
+        match.len = lz_find(&m, pos, &match.offset);
+        if (match.len != 0)
+        {
+            // Lazy step, take a literal if the next position matches longer
+            uint32_t next_offset;
+            lz_insert(&m, pos);
+            uint32_t next_len = lz_find(&m, pos + 1, &next_offset);
+            if (next_len > match.len + 1)
+            {
+                pos++;
+                continue;
+            }
+            if (sink(arg, &match) != 0)
+            {
+                goto exit;
+            }
+            for (uint32_t i = 1; i < match.len; i++)
+            {
+                lz_insert(&m, pos + i);
+            }
+            pos += match.len;
+            continue;
+        }
+        lz_insert(&m, pos);
+        pos++;
+    }
+    ret = 0;
+
+exit:
+    free(m.head);
+    free(m.prev);
+    return ret;
+}
+
+static int lz_encode_sequences(const uint8_t *in, uint32_t raw_len, const lz_match_t *matches, uint32_t match_count,
+                               lz_writer_t *w)
+{
+    uint32_t anchor = 0;
+    for (uint32_t i = 0; i < match_count; i++)
+    {
+        const lz_match_t *match = &matches[i];
+        if (match->pos < anchor || match->len < LZ_STREAM_MIN_MATCH || match->pos + match->len > raw_len ||
+            lz_put_sequence(w, &in[anchor], match->pos - anchor, match->len, match->offset) != 0)
+        {
+            return -1;
+        }
+        anchor = match->pos + match->len;
+    }
+    // The last sequence only has literals
+    if (anchor < raw_len)
+    {
+        if (lz_put_sequence(w, &in[anchor], raw_len - anchor, 0, 0) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief build the payload of raw_len bytes from its matches, stored uncompressed if that is not smaller
+ * @param raw_crc: crc32() of the raw_len bytes
+ * @param matches: matches of the whole image by increasing position, e.g. from lz_encode_matches()
+ * @param out_cap should be at least LZ_ENCODE_BOUND(raw_len)
+ * @return int payload length, negative value on error
+ */
+int lz_encode_payload(const uint8_t *in, uint32_t raw_len, uint32_t raw_crc, uint8_t window_bits,
+                      const lz_match_t *matches, uint32_t match_count, uint8_t *out, uint32_t out_cap)
+{
+    lz_stream_header_t header = {
+        .magic = LZ_STREAM_MAGIC,
+        .raw_size = raw_len,
+        .raw_crc = raw_crc,
+        .window_bits = window_bits,
+        .flags = LZ_STREAM_FLAG_COMPRESSED,
+    };
+    if (window_bits < LZ_STREAM_MIN_WINDOW_BITS || window_bits > LZ_STREAM_MAX_WINDOW_BITS ||
+        out_cap < sizeof(header))
+    {
+        return -1;
+    }
+
+    lz_writer_t w = { .out = out, .cap = out_cap, .pos = sizeof(header) };
+    if (lz_encode_sequences(in, raw_len, matches, match_count, &w) != 0 || w.pos >= sizeof(header) + raw_len)
+    {
+        // Incompressible, store it
+        if (out_cap < LZ_ENCODE_BOUND(raw_len))
+        {
+            return -1;
+        }
+        header.flags = 0;
+        memcpy(&out[sizeof(header)], in, raw_len);
+        w.pos = sizeof(header) + raw_len;
+    }
+    memcpy(out, &header, sizeof(header));
+    return (int) w.pos;
+}
+
+/*
+ * @brief compress raw_len bytes into out
+ * @param window_bits decoder window, LZ_STREAM_MIN_WINDOW_BITS to LZ_STREAM_MAX_WINDOW_BITS
+ * @param out_cap should be at least LZ_ENCODE_BOUND(raw_len)
+ * @return int payload length, negative value on error
+ */
+int lz_encode(const uint8_t *in, uint32_t raw_len, uint8_t window_bits, uint8_t *out, uint32_t out_cap)
+{
+    lz_match_list_t list = {0};
+    int ret = -1;
+    if (window_bits >= LZ_STREAM_MIN_WINDOW_BITS && window_bits <= LZ_STREAM_MAX_WINDOW_BITS &&
+        lz_encode_matches(in, 0, raw_len, window_bits, lz_match_list_add, &list) == 0)
+    {
+        ret = lz_encode_payload(in, raw_len, crc32(in, raw_len), window_bits, list.matches, list.count, out,
+                                out_cap);
+    }
+    free(list.matches);
+    return ret;
+}
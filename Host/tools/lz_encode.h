@@ -0,0 +1,46 @@
+/****************************************************************************
+* Title                 :   LZ payload encoder header file
+* Filename              :   lz_encode.h
+* Origin Date           :   2026/10/17
+* Notes                 :   Host only, the firmware only decodes (Core/Src/lz_stream.c)
+*****************************************************************************/
+
+/** \file lz_encode.h
+ *  \brief Compress an image into a payload decodable by lz_stream_decode()
+ */
+#ifndef LZ_ENCODE_H_
+#define LZ_ENCODE_H_
+
+#include <stdint.h>
+
+#include "lz_stream.h"
+
+/* Largest payload produced for raw_len bytes of input (stored fallback) */
+#define LZ_ENCODE_BOUND(raw_len)    ((uint32_t) sizeof(lz_stream_header_t) + (raw_len))
+
+/* len bytes at pos repeat the ones offset bytes before */
+typedef struct
+{
+    uint32_t pos;
+    uint32_t len;
+    uint32_t offset;
+} lz_match_t;
+
+/* Receives the matches by increasing position, returns 0 to continue */
+typedef int (*lz_match_sink_t)(void *arg, const lz_match_t *match);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int lz_encode(const uint8_t *in, uint32_t raw_len, uint8_t window_bits, uint8_t *out, uint32_t out_cap);
+int lz_encode_matches(const uint8_t *in, uint32_t start, uint32_t end, uint8_t window_bits, lz_match_sink_t sink,
+                      void *arg);
+int lz_encode_payload(const uint8_t *in, uint32_t raw_len, uint32_t raw_crc, uint8_t window_bits,
+                      const lz_match_t *matches, uint32_t match_count, uint8_t *out, uint32_t out_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LZ_ENCODE_H_
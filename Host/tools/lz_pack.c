@@ -0,0 +1,106 @@
+/*******************************************************************************
+ * Title                 :   Image packer
+ * Filename              :   lz_pack.c
+ * Origin Date           :   2026/10/17
+ * Notes                 :   Host tool, generates fw.lz
+ *******************************************************************************/
+
+/** \file lz_pack.c
+ *  \brief Compress a firmware image into the payload linked into the MCU flash
+ *
+ *  Usage: lz_pack [-w window_bits] in.bin out.lz
+ *  window_bits defaults to LZ_STREAM_MAX_WINDOW_BITS, the decoder RAM the
+ *  firmware is built with. The decoded image is checked before writing.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lz_encode.h"
+#include "lz_stream.h"
+
+static uint8_t *lz_pack_load(const char *path, uint32_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (data != NULL && fread(data, 1, size, f) != (size_t) size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = (uint32_t) size;
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t window_bits = LZ_STREAM_MAX_WINDOW_BITS;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:")) != -1)
+    {
+        if (opt == 'w')
+        {
+            window_bits = (uint8_t) atoi(optarg);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-w window_bits] in.bin out.lz\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        fprintf(stderr, "Usage: %s [-w window_bits] in.bin out.lz\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t raw_len;
+    uint8_t *raw = lz_pack_load(argv[optind], &raw_len);
+    if (raw == NULL)
+    {
+        return 1;
+    }
+    uint8_t *payload = malloc(LZ_ENCODE_BOUND(raw_len));
+    uint8_t *check = malloc(raw_len + 1);
+    static lz_stream_t stream;
+    int payload_len = (payload != NULL) ? lz_encode(raw, raw_len, window_bits, payload, LZ_ENCODE_BOUND(raw_len)) : -1;
+    if (payload_len < 0 || check == NULL)
+    {
+        fprintf(stderr, "%s: encoding failed\n", argv[optind]);
+        return 1;
+    }
+
+    uint32_t consumed;
+    lz_stream_init(&stream);
+    int decoded = lz_stream_decode(&stream, payload, payload_len, &consumed, check, raw_len + 1);
+    if (decoded != (int) raw_len || !lz_stream_done(&stream) || memcmp(check, raw, raw_len) != 0)
+    {
+        fprintf(stderr, "%s: decoded image does not match\n", argv[optind]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[optind + 1], "wb");
+    if (out == NULL || fwrite(payload, 1, payload_len, out) != (size_t) payload_len)
+    {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    fclose(out);
+    printf("%s: %u -> %d bytes (%.1f%%), window %u bytes%s\n", argv[optind + 1], raw_len, payload_len,
+           raw_len ? 100.0 * payload_len / raw_len : 0.0, 1u << window_bits,
+           (((const lz_stream_header_t *) payload)->flags & LZ_STREAM_FLAG_COMPRESSED) ? "" : ", stored");
+    free(raw);
+    free(payload);
+    free(check);
+    return 0;
+}